@@ -0,0 +1,123 @@
+/*** shm_quotes.c -- print quotes published by twsdo --shm
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+/*
+ * Usage: shm_quotes [-f] NAME [CONID...]
+ *
+ * Print bid, ask and last of the given contracts, or of all published ones,
+ * once or with -f every second until twsdo exits. Reading never blocks
+ * twsdo, a consumer which needs lower latency would just spin on the slot's
+ * sequence number instead of sleeping.
+ */
+
+#include "tws_shm.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* IB's TickType */
+#define BID 1
+#define ASK 2
+#define LAST 4
+
+
+static const struct tws_shm_header* shm_map( const char *name, size_t *size )
+{
+	struct stat st;
+	void *p;
+	int fd = shm_open( name, O_RDONLY, 0 );
+	if( fd < 0 ) {
+		perror( name );
+		return NULL;
+	}
+	if( fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct tws_shm_header) ) {
+		fprintf( stderr, "error, bad shared memory object '%s'\n", name );
+		close( fd );
+		return NULL;
+	}
+	p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( p == MAP_FAILED ) {
+		perror( name );
+		return NULL;
+	}
+	*size = st.st_size;
+	return (const struct tws_shm_header*)p;
+}
+
+static void print_slot( const struct tws_shm_header *h, int slot,
+	double *v, int64_t *st )
+{
+	const int cols[3] = { BID, ASK, LAST };
+	const struct tws_shm_slot *s = tws_shm_slot_ptr( h, slot );
+	int i;
+
+	tws_shm_read( h, slot, v, st );
+	printf( "%d\t%d", s->conId, s->tickerId );
+	for( i = 0; i < 3; i++ ) {
+		int c = tws_shm_col( h, cols[i] );
+		if( c >= 0 && st[c] != 0 ) {
+			printf( "\t%g", v[c] );
+		} else {
+			printf( "\t-" );
+		}
+	}
+	printf( "\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	const struct tws_shm_header *h;
+	double v[TWS_SHM_MAX_COLS];
+	int64_t st[TWS_SHM_MAX_COLS];
+	size_t size;
+	int follow = 0;
+	int i, slot;
+
+	if( argc > 1 && argv[1][0] == '-' && argv[1][1] == 'f' ) {
+		follow = 1;
+		argc--;
+		argv++;
+	}
+	if( argc < 2 ) {
+		fprintf( stderr, "usage: shm_quotes [-f] NAME [CONID...]\n" );
+		return 2;
+	}
+	if( (h = shm_map(argv[1], &size)) == NULL ) {
+		return 1;
+	}
+	if( !tws_shm_ready(h) ) {
+		fprintf( stderr, "error, '%s' is not ready\n", argv[1] );
+		return 1;
+	}
+
+	do {
+		printf( "#conId\ttickerId\tbid\task\tlast\n" );
+		if( argc == 2 ) {
+			for( slot = 0; slot < (int)h->nSlots; slot++ ) {
+				print_slot( h, slot, v, st );
+			}
+		}
+		for( i = 2; i < argc; i++ ) {
+			if( (slot = tws_shm_find(h, atoi(argv[i]))) < 0 ) {
+				fprintf( stderr, "Warning, conId %s not published\n",
+					argv[i] );
+				continue;
+			}
+			print_slot( h, slot, v, st );
+		}
+		fflush( stdout );
+	} while( follow && tws_shm_ready(h) && sleep(1) == 0 );
+
+	munmap( (void*)h, size );
+	return 0;
+}
@@ -2,15 +2,24 @@
 #define GA_DEBUG_H
 
 #include "tws_util.h"
+#include "tws_log.h"
 #include <assert.h>
 #include <stdio.h>
 
 
 
 
+#define ERROR_PRINTF(_format_, _args_...)  \
+	TWS_LOG( TWS_LOG_ERROR, _format_, ## _args_ )
+
+#define WARN_PRINTF(_format_, _args_...)  \
+	TWS_LOG( TWS_LOG_WARN, _format_, ## _args_ )
+
+#define INFO_PRINTF(_format_, _args_...)  \
+	TWS_LOG( TWS_LOG_INFO, _format_, ## _args_ )
+
 #define DEBUG_PRINTF(_format_, _args_...)  \
-	fprintf (stderr, "%s " _format_ "\n" , \
-		msecs_to_string(nowInMsecs()).c_str(), ## _args_)
+	TWS_LOG( TWS_LOG_DEBUG, _format_, ## _args_ )
 
 
 
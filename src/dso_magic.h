@@ -13,14 +13,20 @@
 #endif	/* HAVE_CONFIG_H */
 # include <ltdl.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#include "tws_strat.h"
+
 #if !defined UNUSED
 # define UNUSED(x)	__attribute__((unused)) x
 #endif	/* UNUSED */
 
+struct TwsQuoteUpdate;
+
 typedef void(*lt_f)(void*);
+typedef void(*lt_quotes_f)(void*, const struct TwsQuoteUpdate*, size_t);
 typedef struct tws_dso_s *tws_dso_t;
 
 struct tws_dso_s {
@@ -28,6 +34,10 @@ struct tws_dso_s {
 	lt_f initf;
 	lt_f finif;
 	lt_f workf;
+	lt_quotes_f quotesf;
+	/* modules with TWS_STRAT_ENTRY use these instead */
+	int typed;
+	struct tws_strat_callbacks cb;
 };
 
 
@@ -64,23 +74,52 @@ static lt_dlhandle my_dlopen(const char *filename)
 }
 
 
-static tws_dso_t open_dso(const char *name, void *clo)
+static tws_dso_t open_dso(const char *name, void *clo,
+	const struct tws_strat_services *srv)
 {
 	const char minit[] = "init";
 	const char mfini[] = "fini";
 	const char mwork[] = "work";
-	static struct tws_dso_s dso[1];
+	const char mquotes[] = "quotes";
+	struct tws_dso_s *dso;
+	tws_strat_open_f openf;
 
 	/* initialise the dl system */
 	lt_dlinit();
 
+	/* one per module, several may be loaded */
+	dso = (struct tws_dso_s*)calloc( 1, sizeof(*dso) );
 	if( (dso->handle = my_dlopen( name )) == NULL ) {
 		error( "cannot open module `%s': %s", name, lt_dlerror() );
+		free( dso );
 		return NULL;
 	}
 
+	/* typed modules need nothing else */
+	memset( &dso->cb, 0, sizeof(dso->cb) );
+	if( (openf = (tws_strat_open_f)lt_dlsym( dso->handle,
+	    TWS_STRAT_ENTRY )) != NULL ) {
+		dso->cb.abi = TWS_STRAT_ABI;
+		dso->cb.size = sizeof(dso->cb);
+		if( openf( TWS_STRAT_ABI, srv, &dso->cb ) < 0 ) {
+			lt_dlclose( dso->handle );
+			free( dso );
+			error( "cannot open module `%s': %s() failed", name,
+				TWS_STRAT_ENTRY );
+			return NULL;
+		}
+		dso->typed = 1;
+		dso->initf = NULL;
+		dso->finif = NULL;
+		dso->workf = NULL;
+		dso->quotesf = (lt_quotes_f)lt_dlsym( dso->handle, mquotes );
+		return dso;
+	}
+	dso->typed = 0;
+
 	if( (dso->initf = (lt_f)lt_dlsym( dso->handle, minit )) == NULL ) {
 		lt_dlclose( dso->handle );
+		free( dso );
 		error( "cannot open module `%s': init() not found", name );
 		return NULL;
 	}
@@ -95,6 +134,9 @@ static tws_dso_t open_dso(const char *name, void *clo)
 		;
 	}
 
+	/* optional consumer of conflated quotes, see tws_conflate.h */
+	dso->quotesf = (lt_quotes_f)lt_dlsym( dso->handle, mquotes );
+
 	/* call the init() function */
 	dso->initf( clo );
 	return dso;
@@ -102,15 +144,14 @@ static tws_dso_t open_dso(const char *name, void *clo)
 
 static void close_dso(tws_dso_t mod, void *clo)
 {
+	if( mod->typed && mod->cb.fini != NULL ) {
+		mod->cb.fini( mod->cb.ctx );
+	}
 	if( mod->finif != NULL ) {
 		mod->finif( clo );
 	}
 	lt_dlclose( mod->handle );
-
-	mod->handle = NULL;
-	mod->initf = NULL;
-	mod->finif = NULL;
-	mod->workf = NULL;
+	free( mod );
 	return;
 }
 
@@ -122,4 +163,71 @@ static void work_dso(tws_dso_t mod, void *clo)
 	return;
 }
 
+static void quotes_dso(tws_dso_t mod, void *clo,
+	const struct TwsQuoteUpdate *upd, size_t n)
+{
+	if( mod->quotesf != NULL ) {
+		mod->quotesf( clo, upd, n );
+	}
+	return;
+}
+
+/* event callbacks of typed modules, see tws_strat.h */
+static void tick_dso(tws_dso_t mod, const struct tws_strat_tick *t)
+{
+	if( mod->cb.on_tick != NULL ) {
+		mod->cb.on_tick( mod->cb.ctx, t );
+	}
+	return;
+}
+
+static void bar_dso(tws_dso_t mod, const struct tws_strat_bar *b)
+{
+	if( mod->cb.on_bar != NULL ) {
+		mod->cb.on_bar( mod->cb.ctx, b );
+	}
+	return;
+}
+
+static void order_status_dso(tws_dso_t mod,
+	const struct tws_strat_order_status *os)
+{
+	if( mod->cb.on_order_status != NULL ) {
+		mod->cb.on_order_status( mod->cb.ctx, os );
+	}
+	return;
+}
+
+static void execution_dso(tws_dso_t mod, const struct tws_strat_execution *e)
+{
+	if( mod->cb.on_execution != NULL ) {
+		mod->cb.on_execution( mod->cb.ctx, e );
+	}
+	return;
+}
+
+static void timer_dso(tws_dso_t mod, int64_t now, void *cookie)
+{
+	if( mod->cb.on_timer != NULL ) {
+		mod->cb.on_timer( mod->cb.ctx, now, cookie );
+	}
+	return;
+}
+
+static void connection_dso(tws_dso_t mod, int state)
+{
+	if( mod->cb.on_connection != NULL ) {
+		mod->cb.on_connection( mod->cb.ctx, state );
+	}
+	return;
+}
+
+static void position_dso(tws_dso_t mod, const struct tws_strat_position *p)
+{
+	if( mod->cb.on_position != NULL ) {
+		mod->cb.on_position( mod->cb.ctx, p );
+	}
+	return;
+}
+
 #endif	/* INCLUDED_dso_magic_h_ */
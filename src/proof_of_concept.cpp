@@ -5,33 +5,114 @@
  * License: BSD 3-Clause, see LICENSE file
  *
  ***/
+#include "tws_strat.h"
+#include "tws_conflate.h"
+
 #include <stdio.h>
+#include <inttypes.h>
 
 extern "C" {
 /* libtool needs C symbols */
-extern void init(void*);
-extern void fini(void*);
-extern void work(void*);
+extern int tws_strat_open(uint32_t, const tws_strat_services*,
+	tws_strat_callbacks*);
+extern void quotes(void*, const TwsQuoteUpdate*, size_t);
+}
+
+
+struct poc
+{
+	const tws_strat_services *srv;
+	long ticks;
+	long bars;
+};
+
+static poc the_poc;
+
+
+static void poc_fini(void *ctx)
+{
+	poc *p = (poc*)ctx;
+	fprintf( stderr, "fini() called, got %ld ticks and %ld bars\n",
+		p->ticks, p->bars );
+	return;
+}
+
+static void poc_on_tick(void *ctx, const tws_strat_tick *t)
+{
+	poc *p = (poc*)ctx;
+	if( p->ticks++ == 0 ) {
+		tws_strat_instrument in;
+		p->srv->instrument( p->srv->host, t->tickerId, &in );
+		fprintf( stderr, "first tick %s %d %d %g\n", in.symbol,
+			t->tickerId, t->tickType, t->value );
+	}
+	return;
+}
+
+static void poc_on_bar(void *ctx, const tws_strat_bar *b)
+{
+	poc *p = (poc*)ctx;
+	p->bars++;
+	fprintf( stderr, "bar %d %s %" PRId64 " %g %g %g %g\n", b->tickerId,
+		b->barSize, b->start, b->open, b->high, b->low, b->close );
+	return;
+}
+
+static void poc_on_order_status(void *ctx, const tws_strat_order_status *os)
+{
+	fprintf( stderr, "order %" PRId64 " %s filled %g\n", os->orderId,
+		os->status, os->filled );
+	return;
 }
 
-
-void init(void *clo)
+static void poc_on_execution(void *ctx, const tws_strat_execution *e)
 {
-	// we *know* that CLO is indeed a TwsDL instance but there's no
-	// way to get it it seems
-	fprintf( stderr, "init() called on class %p\n", clo );
+	fprintf( stderr, "execution %" PRId64 " %s %s %g @ %g\n", e->orderId,
+		e->symbol, e->side, e->shares, e->price );
 	return;
 }
 
-void fini(void *clo)
+static void poc_on_timer(void *ctx, int64_t now, void *cookie)
 {
-	fprintf( stderr, "fini() called on class %p\n", clo );
+	poc *p = (poc*)ctx;
+	fprintf( stderr, "timer, %ld ticks so far\n", p->ticks );
+	p->srv->timer( p->srv->host, now / 1000 + 10000, NULL );
 	return;
 }
 
-void work(void *clo)
+static void poc_on_connection(void *ctx, int state)
+{
+	fprintf( stderr, "connection state %d\n", state );
+	return;
+}
+
+int tws_strat_open(uint32_t abi, const tws_strat_services *srv,
+	tws_strat_callbacks *cb)
+{
+	if( abi != TWS_STRAT_ABI ) {
+		return -1;
+	}
+	the_poc.srv = srv;
+	cb->ctx = &the_poc;
+	cb->fini = poc_fini;
+	cb->on_tick = poc_on_tick;
+	cb->on_bar = poc_on_bar;
+	cb->on_order_status = poc_on_order_status;
+	cb->on_execution = poc_on_execution;
+	cb->on_timer = poc_on_timer;
+	cb->on_connection = poc_on_connection;
+
+	srv->subscribe( srv->host, 0 );
+	srv->timer( srv->host, srv->now(srv->host) / 1000 + 10000, NULL );
+	return 0;
+}
+
+/* typed modules may still consume conflated quotes */
+void quotes(void *clo, const TwsQuoteUpdate *upd, size_t n)
 {
-	fprintf( stderr, "work() called on class %p\n", clo );
+	fprintf( stderr, "quotes() called on class %p with %zu updates, "
+		"first %d %d %g\n", clo, n, upd[0].conId, upd[0].tickType,
+		upd[0].value );
 	return;
 }
 
@@ -7,10 +7,27 @@
  ***/
 
 #include "tws_account.h"
+#include "debug.h"
+
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+/* positions differing less are the same */
+#define POSITION_EPS 1e-9
 
+/* execIds remembered to skip duplicates, more than a day of fills */
+#define EXEC_ID_WINDOW 65536
 
-Account::Account()
+
+Account::Account() :
+	cntFills(0),
+	cntDuplicates(0),
+	cntMarks(0),
+	cntSnapshots(0),
+	cntBreaks(0)
 {
 }
 
@@ -18,27 +35,338 @@ Account::~Account()
 {
 }
 
-void Account::updatePortfolio( const RowPrtfl& row )
+Account::Instrument& Account::instrument( const Contract &c )
+{
+	std::unordered_map<long, Instrument>::iterator it =
+		instruments.find( c.conId );
+	if( it != instruments.end() ) {
+		return it->second;
+	}
+	Instrument &in = instruments[c.conId];
+	in.symbol = c.symbol;
+	in.multiplier = atof( c.multiplier.c_str() );
+	if( in.multiplier <= 0.0 ) {
+		in.multiplier = 1.0;
+	}
+	in.first = -1;
+	return in;
+}
+
+int Account::accountIdx( const std::string &name )
+{
+	for( size_t i = 0; i < accts.size(); i++ ) {
+		if( accts[i].name == name ) {
+			return i;
+		}
+	}
+	AccountPnl a = { name, 0.0, 0.0 };
+	accts.push_back( a );
+	return accts.size() - 1;
+}
+
+PositionPnl& Account::positionOf( const Contract &c,
+	const std::string &acct )
+{
+	Instrument &in = instrument( c );
+	const int a = accountIdx( acct );
+	int i = in.first;
+	while( i >= 0 && pos[i].acct != a ) {
+		i = pos[i].next;
+	}
+	if( i >= 0 ) {
+		return pos[i];
+	}
+	PositionPnl p = { c.conId, a, in.multiplier, 0.0, 0.0, 0.0, 0.0, 0.0,
+		0, false, in.first };
+	pos.push_back( p );
+	in.first = pos.size() - 1;
+	return pos.back();
+}
+
+void Account::setUnrealized( PositionPnl &p )
+{
+	double u = 0.0;
+	if( p.position != 0.0 && p.mark != 0.0 ) {
+		u = p.position * (p.mark - p.avgPrice) * p.multiplier;
+	}
+	accts[p.acct].unrealizedPNL += u - p.unrealizedPNL;
+	p.unrealizedPNL = u;
+}
+
+const PositionPnl* Account::updatePortfolio( const RowPrtfl& row,
+	int64_t stamp )
 {
 	long conid = row.contract.conId;
 	assert( conid > 0);
 
 	portfolio[conid] = row;
+
+	PositionPnl &p = positionOf( row.contract, row.accountName );
+	cntSnapshots++;
+	if( p.stamp != 0 && fabs(p.position - row.position) > POSITION_EPS ) {
+		INFO_PRINTF( "position break, %s %s %ld, ours %g, tws %g",
+			row.accountName.c_str(), row.contract.symbol.c_str(), conid,
+			p.position, row.position );
+		cntBreaks++;
+	}
+	accts[p.acct].realizedPNL += row.realizedPNL - p.realizedPNL;
+	p.position = row.position;
+	p.avgPrice = row.averageCost / p.multiplier;
+	p.realizedPNL = row.realizedPNL;
+	p.mark = row.marketPrice;
+	p.stamp = stamp;
+	p.dirty = true;
+	setUnrealized( p );
+	return &p;
 }
 
-void Account::update_oo( const RowOpenOrder& row )
+const PositionPnl* Account::execution( const RowExecution& row,
+	int64_t stamp )
 {
-	long permid = row.order.permId;
-	assert( permid > 0);
+	const Execution &e = row.execution;
+	/* a correction is the same execId with a new suffix */
+	const size_t dot = e.execId.rfind( '.' );
+	const std::string id = e.execId.substr( 0, dot );
+	if( !execIds.insert(id).second ) {
+		cntDuplicates++;
+		return NULL;
+	}
+	execOrder.push_back( id );
+	if( execOrder.size() > EXEC_ID_WINDOW ) {
+		execIds.erase( execOrder.front() );
+		execOrder.pop_front();
+	}
+	PositionPnl &p = positionOf( row.contract, e.acctNumber );
+	const double qty = e.shares;
+	const bool buy = e.side == "BOT";
 
-	openOrders[permid] = row;
+	/* average cost of the position, realize what's closed */
+	if( p.position == 0.0 || (p.position > 0.0) == buy ) {
+		p.avgPrice = (fabs(p.position) * p.avgPrice + qty * e.price)
+			/ (fabs(p.position) + qty);
+	} else {
+		const double closed = std::min( fabs(p.position), qty );
+		const double r = closed * (e.price - p.avgPrice)
+			* (p.position > 0.0 ? 1.0 : -1.0) * p.multiplier;
+		p.realizedPNL += r;
+		accts[p.acct].realizedPNL += r;
+		if( qty > closed ) {
+			p.avgPrice = e.price;
+		}
+	}
+	p.position += buy ? qty : -qty;
+	if( fabs(p.position) <= POSITION_EPS ) {
+		p.position = 0.0;
+		p.avgPrice = 0.0;
+	}
+	if( p.mark == 0.0 ) {
+		p.mark = e.price;
+	}
+	p.stamp = stamp;
+	p.dirty = true;
+	setUnrealized( p );
+	cntFills++;
+	return &p;
 }
 
-void Account::update_os( const RowOrderStatus& row )
+void Account::mark( long conId, double price )
 {
-	long permid = row.permId;
-	assert( permid > 0);
+	std::unordered_map<long, Instrument>::const_iterator it =
+		instruments.find( conId );
+	if( it == instruments.end() || price <= 0.0 ) {
+		return;
+	}
+	for( int i = it->second.first; i >= 0; i = pos[i].next ) {
+		PositionPnl &p = pos[i];
+		if( p.mark != price ) {
+			p.mark = price;
+			if( p.position != 0.0 ) {
+				setUnrealized( p );
+				p.dirty = true;
+			}
+		}
+	}
+	cntMarks++;
+}
+
+const PositionPnl* Account::position( long conId,
+	const std::string &acct ) const
+{
+	std::unordered_map<long, Instrument>::const_iterator it =
+		instruments.find( conId );
+	if( it == instruments.end() ) {
+		return NULL;
+	}
+	for( int i = it->second.first; i >= 0; i = pos[i].next ) {
+		if( acct.empty() || accts[pos[i].acct].name == acct ) {
+			return &pos[i];
+		}
+	}
+	return NULL;
+}
+
+const std::vector<PositionPnl>& Account::positions() const
+{
+	return pos;
+}
+
+const std::vector<AccountPnl>& Account::accounts() const
+{
+	return accts;
+}
+
+const std::string& Account::symbol( long conId ) const
+{
+	static const std::string none;
+	std::unordered_map<long, Instrument>::const_iterator it =
+		instruments.find( conId );
+	return it != instruments.end() ? it->second.symbol : none;
+}
 
-	orderStatus[permid] = row;
+void Account::dumpPnl()
+{
+	std::vector<bool> changed( accts.size(), false );
+	for( size_t i = 0; i < pos.size(); i++ ) {
+		PositionPnl &p = pos[i];
+		if( !p.dirty ) {
+			continue;
+		}
+		INFO_PRINTF( "pnl, %s %s %ld: pos %g, avg %.4f, mark %.4f, "
+			"real %.2f, unreal %.2f", accts[p.acct].name.c_str(),
+			symbol(p.conId).c_str(), p.conId, p.position, p.avgPrice,
+			p.mark, p.realizedPNL, p.unrealizedPNL );
+		p.dirty = false;
+		changed[p.acct] = true;
+	}
+	for( size_t i = 0; i < accts.size(); i++ ) {
+		if( changed[i] ) {
+			INFO_PRINTF( "pnl, %s: real %.2f, unreal %.2f",
+				accts[i].name.c_str(), accts[i].realizedPNL,
+				accts[i].unrealizedPNL );
+		}
+	}
 }
 
+void Account::dumpStats() const
+{
+	INFO_PRINTF( "account: %zu positions, %ld fills, %ld duplicates, "
+		"%ld marks, %ld snapshots, %ld breaks", pos.size(), cntFills,
+		cntDuplicates, cntMarks, cntSnapshots, cntBreaks );
+}
+
+
+
+
+AccountDelta::AccountDelta() :
+	vals(*(new std::unordered_map<std::string, Val>())),
+	prtfl(*(new std::unordered_map<std::string, Pos>())),
+	changedVals(*(new std::vector<Val*>())),
+	changedPrtfl(*(new std::vector<Pos*>())),
+	timeDirty(false),
+	cntUpdates(0),
+	cntUnchanged(0),
+	cntDeltas(0),
+	cntRows(0)
+{
+}
+
+AccountDelta::~AccountDelta()
+{
+	delete &changedPrtfl;
+	delete &changedVals;
+	delete &prtfl;
+	delete &vals;
+}
+
+bool AccountDelta::update( const RowAccVal& row )
+{
+	cntUpdates++;
+	Val &v = vals[row.accountName + '|' + row.key + '|' + row.currency];
+	if( !v.row.key.empty() && v.row.val == row.val ) {
+		cntUnchanged++;
+		return false;
+	}
+	v.row = row;
+	if( !v.dirty ) {
+		v.dirty = true;
+		changedVals.push_back( &v );
+	}
+	return true;
+}
+
+bool AccountDelta::update( const RowPrtfl& row )
+{
+	char conid[24];
+	snprintf( conid, sizeof(conid), "%ld", row.contract.conId );
+
+	cntUpdates++;
+	Pos &p = prtfl[row.accountName + '|' + conid];
+	const RowPrtfl &o = p.row;
+	if( o.contract.conId == row.contract.conId
+	    && o.position == row.position
+	    && o.marketPrice == row.marketPrice
+	    && o.marketValue == row.marketValue
+	    && o.averageCost == row.averageCost
+	    && o.unrealizedPNL == row.unrealizedPNL
+	    && o.realizedPNL == row.realizedPNL ) {
+		cntUnchanged++;
+		return false;
+	}
+	p.row = row;
+	if( !p.dirty ) {
+		p.dirty = true;
+		changedPrtfl.push_back( &p );
+	}
+	return true;
+}
+
+bool AccountDelta::updateTime( const std::string &timeStamp )
+{
+	if( time == timeStamp ) {
+		return false;
+	}
+	time = timeStamp;
+	timeDirty = true;
+	return true;
+}
+
+void AccountDelta::clean()
+{
+	for( size_t i = 0; i < changedVals.size(); i++ ) {
+		changedVals[i]->dirty = false;
+	}
+	for( size_t i = 0; i < changedPrtfl.size(); i++ ) {
+		changedPrtfl[i]->dirty = false;
+	}
+	changedVals.clear();
+	changedPrtfl.clear();
+	timeDirty = false;
+}
+
+bool AccountDelta::pending() const
+{
+	return !changedVals.empty() || !changedPrtfl.empty();
+}
+
+void AccountDelta::flush( PacketAccStatus *p )
+{
+	for( size_t i = 0; i < changedVals.size(); i++ ) {
+		p->append( changedVals[i]->row );
+	}
+	for( size_t i = 0; i < changedPrtfl.size(); i++ ) {
+		p->append( changedPrtfl[i]->row );
+	}
+	if( timeDirty ) {
+		p->appendUpdateAccountTime( time );
+	}
+	cntDeltas++;
+	cntRows += changedVals.size() + changedPrtfl.size();
+	clean();
+}
+
+void AccountDelta::dumpStats() const
+{
+	INFO_PRINTF( "account stream: %ld updates, %ld unchanged, %ld deltas, "
+		"%ld rows, %zu keys", cntUpdates, cntUnchanged, cntDeltas, cntRows,
+		vals.size() + prtfl.size() );
+}
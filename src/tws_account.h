@@ -10,28 +10,165 @@
 #define TWS_ACCOUNT_H
 
 #include "tws_meta.h"
+#include <stdint.h>
+#include <deque>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 
 typedef std::map<long, RowPrtfl> Prtfl;
-typedef std::map<long, RowOpenOrder> OpenOrders;
-typedef std::map<long, RowOrderStatus> OrderStatus;
 
 
+/* live position of one contract in one account, prices per unit without
+   multiplier, P&L in the contract's currency */
+struct PositionPnl
+{
+	long conId;
+	/* index of accounts() */
+	int acct;
+	double multiplier;
+	double position;
+	double avgPrice;
+	double realizedPNL;
+	double unrealizedPNL;
+	double mark;
+	/* usecs of the last change, not counting marks */
+	int64_t stamp;
+	/* changed since the last dumpPnl() */
+	bool dirty;
+	/* next position of the same conId in another account or -1 */
+	int next;
+};
+
+/* sums of all positions of an account */
+struct AccountPnl
+{
+	std::string name;
+	double realizedPNL;
+	double unrealizedPNL;
+};
+
+
+/**
+ * Positions and P&L, updated incrementally by our fills and by marks from
+ * the quote board. The updatePortfolio() snapshots of TWS win, the
+ * position, average cost and realized P&L are taken from there. Commissions
+ * are only contained in those snapshots.
+ */
 class Account
 {
 	public:
 		Account();
 		~Account();
 
-	void updatePortfolio( const RowPrtfl& row );
-	void update_oo( const RowOpenOrder& row );
-	void update_os( const RowOrderStatus& row );
+	/* return the reconciled position */
+	const PositionPnl* updatePortfolio( const RowPrtfl& row, int64_t stamp );
+	/* return the changed position, NULL if the execId is among the last
+	   EXEC_ID_WINDOW ones already, corrections are ignored */
+	const PositionPnl* execution( const RowExecution& row, int64_t stamp );
+	/* new market price of all positions in conId */
+	void mark( long conId, double price );
+
+	/* the position of conId in acct, the first one if acct is empty,
+	   NULL if there is none */
+	const PositionPnl* position( long conId, const std::string &acct ) const;
+	const std::vector<PositionPnl>& positions() const;
+	const std::vector<AccountPnl>& accounts() const;
+	const std::string& symbol( long conId ) const;
+
+	/* one line per changed position and per account, changes only */
+	void dumpPnl();
+	void dumpStats() const;
 
 // 	private:
 		Prtfl portfolio;
-		OpenOrders openOrders;
-		OrderStatus orderStatus;
+
+	private:
+		struct Instrument
+		{
+			std::string symbol;
+			double multiplier;
+			/* first position in any account or -1 */
+			int first;
+		};
+
+		Instrument& instrument( const Contract& );
+		int accountIdx( const std::string &name );
+		PositionPnl& positionOf( const Contract&, const std::string &acct );
+		void setUnrealized( PositionPnl& );
+
+		std::unordered_map<long, Instrument> instruments;
+		std::vector<PositionPnl> pos;
+		std::vector<AccountPnl> accts;
+		std::unordered_set<std::string> execIds;
+		/* execIds oldest first, to forget them */
+		std::deque<std::string> execOrder;
+
+		/* statistics */
+		long cntFills;
+		long cntDuplicates;
+		long cntMarks;
+		long cntSnapshots;
+		long cntBreaks;
+};
+
+
+/**
+ * The last state of a streamed account subscription. Updates equal to the
+ * last value of their key are dropped, the others are kept until flush()
+ * appends them to a delta packet. Values are keyed by account, key and
+ * currency, portfolio rows by account and conId.
+ */
+class AccountDelta
+{
+	public:
+		AccountDelta();
+		~AccountDelta();
+
+		/* false if the row didn't change */
+		bool update( const RowAccVal& row );
+		bool update( const RowPrtfl& row );
+		bool updateTime( const std::string &timeStamp );
+		/* forget the changes, the last state has been dumped already */
+		void clean();
+
+		bool pending() const;
+		/* append the changed rows in order of their first change */
+		void flush( PacketAccStatus *p );
+
+		void dumpStats() const;
+
+	private:
+		AccountDelta( const AccountDelta& );
+		AccountDelta& operator=( const AccountDelta& );
+
+		struct Val
+		{
+			RowAccVal row;
+			bool dirty;
+		};
+		struct Pos
+		{
+			RowPrtfl row;
+			bool dirty;
+		};
+
+		/* element pointers are stable within unordered_map */
+		std::unordered_map<std::string, Val> &vals;
+		std::unordered_map<std::string, Pos> &prtfl;
+		std::vector<Val*> &changedVals;
+		std::vector<Pos*> &changedPrtfl;
+		std::string time;
+		bool timeDirty;
+
+		/* statistics */
+		long cntUpdates;
+		long cntUnchanged;
+		long cntDeltas;
+		long cntRows;
 };
 
 
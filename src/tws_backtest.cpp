@@ -0,0 +1,1239 @@
+/*** tws_backtest.cpp -- replay market data through strategy modules
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_backtest.h"
+#include "tws_meta.h"
+#include "tws_query.h"
+#include "tws_quote.h"
+#include "tws_tick.h"
+#include "tws_xml.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <twsapi/twsapi_config.h>
+#include <twsapi/Contract.h>
+#include <twsapi/Execution.h>
+#include <twsapi/EWrapper.h>
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+#include "dso_magic.h"
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if TWSAPI_IB_VERSION_NUMBER < 97200
+# define lastTradeDateOrContractMonth expiry
+#endif
+
+/* Event.kind of bars, others are the tick recorder's kinds */
+#define EV_BAR 0xff
+
+enum bt_post {
+	BT_TICK,
+	BT_BAR,
+	BT_ORDER_STATUS,
+	BT_EXECUTION,
+	BT_POSITION,
+	BT_CONNECTION
+};
+
+enum bt_order_type {
+	ORD_MKT,
+	ORD_LMT,
+	ORD_STP,
+	ORD_STP_LMT
+};
+
+
+struct Backtest::Event
+{
+	int64_t stamp;
+	int32_t tickerId;
+	int16_t tickType;
+	uint8_t kind;
+	uint8_t reserved;
+	/* index of the bar or option computation */
+	int32_t idx;
+	double value;
+
+	bool operator<( const Event &e ) const
+	{
+		return stamp < e.stamp;
+	}
+};
+
+struct Backtest::Bar
+{
+	/* secs since epoch */
+	int64_t start;
+	int64_t end;
+	double open;
+	double high;
+	double low;
+	double close;
+	double wap;
+	int64_t volume;
+	int32_t count;
+	int32_t hasGaps;
+	int32_t barSize;
+};
+
+struct Backtest::Order
+{
+	int64_t id;
+	int tickerId;
+	bool buy;
+	int type;
+	double quantity;
+	double lmtPrice;
+	double auxPrice;
+	bool transmit;
+	bool triggered;
+	/* usecs, bars starting before can't fill it */
+	int64_t placed;
+	bool working;
+	double filled;
+	double avgFillPrice;
+	std::string account;
+	std::string orderRef;
+};
+
+struct Backtest::Ticker
+{
+	/* NAN until known */
+	double bid;
+	double ask;
+	double last;
+	/* bid, ask or last are from ticks, not from a bar */
+	bool quoted;
+	double multiplier;
+	/* orderIds */
+	std::vector<int64_t> working;
+
+	double position;
+	/* per unit, without multiplier */
+	double avgPrice;
+	double realizedPNL;
+	bool traded;
+};
+
+struct Backtest::Notice
+{
+	int type;
+	int64_t stamp;
+	union {
+		tws_strat_order_status os;
+		tws_strat_position pos;
+		size_t fill;
+	} u;
+};
+
+struct Backtest::Module
+{
+	Backtest *bt;
+	std::string file;
+	tws_dso_t dso;
+	tws_strat_services srv;
+	std::vector<char> subs;
+	bool subAll;
+};
+
+
+static int64_t bt_now( void *host )
+{
+	return ((Backtest::Module*)host)->bt->now();
+}
+
+static int bt_timer( void *host, int64_t msecs, void *cookie )
+{
+	Backtest::Module *m = (Backtest::Module*)host;
+	return m->bt->timer( m, msecs, cookie );
+}
+
+static int64_t bt_place_order( void *host, const tws_strat_order *o )
+{
+	return ((Backtest::Module*)host)->bt->placeOrder( *o );
+}
+
+static int bt_cancel_order( void *host, int64_t orderId )
+{
+	return ((Backtest::Module*)host)->bt->cancelOrder( orderId );
+}
+
+static int bt_subscribe( void *host, int tickerId )
+{
+	Backtest::Module *m = (Backtest::Module*)host;
+	return m->bt->subscribe( m, tickerId, true );
+}
+
+static int bt_unsubscribe( void *host, int tickerId )
+{
+	Backtest::Module *m = (Backtest::Module*)host;
+	return m->bt->subscribe( m, tickerId, false );
+}
+
+static int bt_instrument( void *host, int tickerId,
+	tws_strat_instrument *out )
+{
+	return ((Backtest::Module*)host)->bt->instrument( tickerId, out );
+}
+
+static int bt_position( void *host, int32_t conId, const char *account,
+	tws_strat_position *out )
+{
+	return ((Backtest::Module*)host)->bt->position( conId, account, out );
+}
+
+static int bt_quote_cols( void *host )
+{
+	return ((Backtest::Module*)host)->bt->quotes().cols();
+}
+
+static int bt_quote_col_type( void *host, int col )
+{
+	const QuoteBoard &q = ((Backtest::Module*)host)->bt->quotes();
+	if( col < 0 || col >= q.cols() ) {
+		return -1;
+	}
+	return q.tickType( col );
+}
+
+static double bt_quote( void *host, int tickerId, int tickType,
+	int64_t *stamp )
+{
+	const QuoteBoard &q = ((Backtest::Module*)host)->bt->quotes();
+	return q.get( tickerId, tickType, stamp );
+}
+
+static int bt_quote_row( void *host, int tickerId, double *vals,
+	int64_t *stamps )
+{
+	const QuoteBoard &q = ((Backtest::Module*)host)->bt->quotes();
+	return q.snapshot( tickerId, vals, stamps ) ? 0 : -1;
+}
+
+
+/* length of a bar in secs, also for bar sizes TWS has no fixed length for */
+static int bar_secs( const std::string &barSizeSetting )
+{
+	int secs = ib_bar_size2secs( barSizeSetting );
+	if( secs > 0 ) {
+		return secs;
+	}
+	const char *s = barSizeSetting.c_str();
+	char *unit;
+	long val = strtol( s, &unit, 10 );
+	if( unit == s || *unit != ' ' || val <= 0 ) {
+		return -1;
+	}
+	unit++;
+	if( strncasecmp(unit, "day", 3) == 0 ) {
+		return val * 86400;
+	} else if( strncasecmp(unit, "week", 4) == 0 ) {
+		return val * 7 * 86400;
+	} else if( strncasecmp(unit, "month", 5) == 0 ) {
+		return val * 30 * 86400;
+	}
+	return -1;
+}
+
+static int order_type( const char *s )
+{
+	if( strcmp(s, "MKT") == 0 ) {
+		return ORD_MKT;
+	} else if( strcmp(s, "LMT") == 0 ) {
+		return ORD_LMT;
+	} else if( strcmp(s, "STP") == 0 ) {
+		return ORD_STP;
+	} else if( strcmp(s, "STP LMT") == 0 ) {
+		return ORD_STP_LMT;
+	}
+	return -1;
+}
+
+
+Backtest::Backtest() :
+	account("BT"),
+	commission(0.0),
+	events(*(new std::vector<Event>())),
+	bars(*(new std::vector<Bar>())),
+	barSizes(*(new std::vector<std::string>())),
+	opts(*(new std::vector<double>())),
+	barContracts(*(new std::vector<Contract*>())),
+	barContractIds(*(new std::map<std::string, int>())),
+	contracts(*(new std::vector<Contract*>())),
+	tickers(*(new std::vector<Ticker>())),
+	board(*(new QuoteBoard())),
+	modules(*(new std::vector<Module*>())),
+	timers(*(new std::multimap<int64_t, std::pair<Module*, void*> >())),
+	orders(*(new std::vector<Order>())),
+	fills(*(new std::deque<RowExecution>())),
+	notices(*(new std::vector<Notice>())),
+	clock(0),
+	cntTicks(0),
+	cntBars(0),
+	cntSkipped(0),
+	cntDispatched(0),
+	cntTimers(0),
+	cntRejected(0),
+	loadUsecs(0),
+	runUsecs(0)
+{
+}
+
+Backtest::~Backtest()
+{
+	for( size_t i = 0; i < modules.size(); i++ ) {
+		close_dso( modules[i]->dso, NULL );
+		delete modules[i];
+	}
+	for( size_t i = 0; i < contracts.size(); i++ ) {
+		delete contracts[i];
+	}
+	for( size_t i = 0; i < barContracts.size(); i++ ) {
+		delete barContracts[i];
+	}
+	delete &notices;
+	delete &fills;
+	delete &orders;
+	delete &timers;
+	delete &modules;
+	delete &board;
+	delete &tickers;
+	delete &contracts;
+	delete &barContractIds;
+	delete &barContracts;
+	delete &opts;
+	delete &barSizes;
+	delete &bars;
+	delete &events;
+}
+
+void Backtest::setAccount( const std::string &a )
+{
+	account = a;
+}
+
+void Backtest::setCommission( double perUnit )
+{
+	commission = perUnit;
+}
+
+/* guess whether it's twsxml or a tick file */
+bool Backtest::loadFile( const char *filename )
+{
+	int c;
+	FILE *f = stdin;
+	if( filename != NULL && (f = fopen(filename, "rb")) == NULL ) {
+		fprintf( stderr, "error, cannot open file '%s': %s\n", filename,
+			strerror(errno) );
+		return false;
+	}
+	while( (c = getc(f)) == ' ' || c == '\t' || c == '\n' || c == '\r' ) {
+	}
+	if( f == stdin ) {
+		ungetc( c, f );
+	} else {
+		fclose( f );
+	}
+	if( c == '<' ) {
+		return loadBars( filename );
+	}
+	return loadTicks( filename );
+}
+
+bool Backtest::loadTicks( const char *filename )
+{
+	const int64_t t0 = nowInUsecs();
+	TickReader reader;
+	if( !reader.openFile(filename) ) {
+		return false;
+	}
+
+	TickRecord r;
+	while( reader.next(&r) ) {
+		cntTicks++;
+		if( r.tickerId <= 0 || r.kind >= TICK_DEPTH_ASK_INSERT ) {
+			cntSkipped++;
+			continue;
+		}
+		if( (int)contracts.size() <= r.tickerId ) {
+			contracts.resize( r.tickerId + 1, NULL );
+		}
+		if( contracts[r.tickerId] == NULL ) {
+			contracts[r.tickerId] = new Contract();
+			contracts[r.tickerId]->conId = r.conId;
+		}
+
+		if( r.kind >= TICK_OPT_IV && r.kind <= TICK_OPT_UND_PRICE ) {
+			/* collect the values of one computation in one event */
+			const int slot = r.kind - TICK_OPT_IV;
+			if( !events.empty() ) {
+				const Event &e = events.back();
+				if( e.kind == TICK_OPT_IV && e.stamp == r.stamp
+				    && e.tickerId == r.tickerId && e.tickType == r.tickType
+				    && opts[e.idx * 8 + slot] == DBL_MAX ) {
+					opts[e.idx * 8 + slot] = r.value;
+					continue;
+				}
+			}
+			Event e = { r.stamp, r.tickerId, r.tickType, TICK_OPT_IV, 0,
+				(int32_t)(opts.size() / 8), DBL_MAX };
+			opts.resize( opts.size() + 8, DBL_MAX );
+			opts[e.idx * 8 + slot] = r.value;
+			events.push_back( e );
+			continue;
+		}
+
+		Event e = { r.stamp, r.tickerId, r.tickType, r.kind, 0, 0, r.value };
+		events.push_back( e );
+	}
+	loadUsecs += nowInUsecs() - t0;
+	return true;
+}
+
+bool Backtest::loadBars( const char *filename )
+{
+	const int64_t t0 = nowInUsecs();
+	TwsXml file;
+	if( !file.openFile(filename) ) {
+		return false;
+	}
+
+	xmlNodePtr xn;
+	while( (xn = file.nextXmlNode()) != NULL ) {
+		PacketHistData *phd = PacketHistData::fromXml( xn );
+		const HistRequest &hR = phd->getRequest();
+		const std::vector<RowHist> &rows = phd->getRows();
+		const int secs = bar_secs( hR.barSizeSetting );
+		if( secs <= 0 ) {
+			if( !rows.empty() ) {
+				WARN_PRINTF( "Warning, skipping %d bars of unknown size '%s'.",
+					(int)rows.size(), hR.barSizeSetting.c_str() );
+			}
+			cntSkipped += rows.size();
+			delete phd;
+			continue;
+		}
+
+		int bss = std::find( barSizes.begin(), barSizes.end(),
+			hR.barSizeSetting ) - barSizes.begin();
+		if( bss == (int)barSizes.size() ) {
+			barSizes.push_back( hR.barSizeSetting );
+		}
+
+		/* same contract, same tickerId */
+		const Contract &c = hR.ibContract;
+		char key[32];
+		snprintf( key, sizeof(key), "%ld", (long)c.conId );
+		const std::string k = c.conId != 0 ? key : ibToString( c, true );
+		std::map<std::string, int>::const_iterator it =
+			barContractIds.find( k );
+		int cidx;
+		if( it != barContractIds.end() ) {
+			cidx = it->second;
+		} else {
+			cidx = barContracts.size();
+			barContracts.push_back( new Contract(c) );
+			barContractIds[k] = cidx;
+		}
+
+		for( size_t i = 0; i < rows.size(); i++ ) {
+			const RowHist &row = rows[i];
+			time_t start;
+			if( hR.formatDate == 2 ) {
+				char *end;
+				start = strtoll( row.date.c_str(), &end, 10 );
+				if( end == row.date.c_str() || *end != '\0' ) {
+					start = -1;
+				}
+			} else {
+				start = ib_datetime2time_t( row.date );
+			}
+			if( start == -1 ) {
+				cntSkipped++;
+				continue;
+			}
+
+			Bar b;
+			b.start = start;
+			b.end = start + secs;
+			b.open = row.open;
+			b.high = row.high;
+			b.low = row.low;
+			b.close = row.close;
+			b.wap = row.WAP;
+			b.volume = row.volume;
+			b.count = row.count;
+			b.hasGaps = row.hasGaps;
+			b.barSize = bss;
+
+			/* finished when it ends */
+			Event e = { b.end * 1000000, cidx, 0, EV_BAR, 0,
+				(int32_t)bars.size(), row.close };
+			events.push_back( e );
+			bars.push_back( b );
+			cntBars++;
+		}
+		delete phd;
+	}
+	loadUsecs += nowInUsecs() - t0;
+	return true;
+}
+
+bool Backtest::addModule( const char *file )
+{
+	/* the old interface needs a running twsdo */
+	lt_dlinit();
+	lt_dlhandle h = my_dlopen( file );
+	if( h == NULL ) {
+		fprintf( stderr, "error, cannot open module '%s': %s\n", file,
+			lt_dlerror() );
+		return false;
+	}
+	const bool typed = lt_dlsym( h, TWS_STRAT_ENTRY ) != NULL;
+	lt_dlclose( h );
+	if( !typed ) {
+		fprintf( stderr, "error, module '%s' does not export %s()\n", file,
+			TWS_STRAT_ENTRY );
+		return false;
+	}
+
+	Module *m = new Module();
+	m->bt = this;
+	m->file = file;
+	m->subAll = false;
+
+	tws_strat_services &srv = m->srv;
+	memset( &srv, 0, sizeof(srv) );
+	srv.abi = TWS_STRAT_ABI;
+	srv.size = sizeof(srv);
+	srv.host = m;
+	srv.now = bt_now;
+	srv.timer = bt_timer;
+	srv.place_order = bt_place_order;
+	srv.cancel_order = bt_cancel_order;
+	srv.subscribe = bt_subscribe;
+	srv.unsubscribe = bt_unsubscribe;
+	srv.instrument = bt_instrument;
+	srv.quote_cols = bt_quote_cols;
+	srv.quote_col_type = bt_quote_col_type;
+	srv.quote = bt_quote;
+	srv.quote_row = bt_quote_row;
+	srv.position = bt_position;
+
+	if( (m->dso = open_dso(file, NULL, &srv)) == NULL ) {
+		delete m;
+		return false;
+	}
+	modules.push_back( m );
+	return true;
+}
+
+/* tickerIds of the bars' contracts, after those of the ticks */
+int Backtest::barTickerId( const Contract &c )
+{
+	if( c.conId != 0 ) {
+		for( size_t i = 0; i < contracts.size(); i++ ) {
+			if( contracts[i] != NULL && contracts[i]->conId == c.conId ) {
+				*contracts[i] = c;
+				return i;
+			}
+		}
+	}
+	if( contracts.empty() ) {
+		contracts.push_back( NULL );
+	}
+	contracts.push_back( new Contract(c) );
+	return contracts.size() - 1;
+}
+
+void Backtest::prepare()
+{
+	const int64_t t0 = nowInUsecs();
+	std::vector<int> ids( barContracts.size() );
+	for( size_t i = 0; i < barContracts.size(); i++ ) {
+		ids[i] = barTickerId( *barContracts[i] );
+	}
+	for( size_t i = 0; i < events.size(); i++ ) {
+		if( events[i].kind == EV_BAR ) {
+			events[i].tickerId = ids[events[i].tickerId];
+		}
+	}
+
+	tickers.resize( contracts.size() );
+	for( size_t i = 0; i < tickers.size(); i++ ) {
+		Ticker &t = tickers[i];
+		t.bid = t.ask = t.last = NAN;
+		t.quoted = false;
+		t.multiplier = 1.0;
+		if( contracts[i] != NULL ) {
+			double m = atof( contracts[i]->multiplier.c_str() );
+			if( m > 0.0 ) {
+				t.multiplier = m;
+			}
+		}
+		t.position = 0.0;
+		t.avgPrice = 0.0;
+		t.realizedPNL = 0.0;
+		t.traded = false;
+	}
+	board.init( contracts.size(), QuoteBoard::tickTypes("", true) );
+
+	/* several files are merged, ties keep their order */
+	std::stable_sort( events.begin(), events.end() );
+	loadUsecs += nowInUsecs() - t0;
+}
+
+void Backtest::run()
+{
+	const int64_t t0 = nowInUsecs();
+	clock = events.empty() ? 0 : events.front().stamp;
+	int state = TWS_STRAT_CONNECTED;
+	post( BT_CONNECTION, &state, -1 );
+	notify();
+
+	for( size_t i = 0; i < events.size(); i++ ) {
+		step( events[i] );
+	}
+	fireTimers( clock );
+	runUsecs = nowInUsecs() - t0;
+}
+
+void Backtest::step( const Event &e )
+{
+	fireTimers( e.stamp );
+	clock = e.stamp;
+	if( e.kind == EV_BAR ) {
+		barEvent( e );
+	} else {
+		tickEvent( e );
+	}
+	notify();
+}
+
+/* timers due until the event at until, in between the clock is theirs */
+void Backtest::fireTimers( int64_t until )
+{
+	while( !timers.empty() && timers.begin()->first <= until ) {
+		const std::pair<Module*, void*> t = timers.begin()->second;
+		clock = std::max( clock, timers.begin()->first );
+		timers.erase( timers.begin() );
+		cntTimers++;
+		timer_dso( t.first->dso, clock, t.second );
+		notify();
+	}
+}
+
+void Backtest::tickEvent( const Event &e )
+{
+	Ticker &t = tickers[e.tickerId];
+	bool touch = e.kind == TICK_PRICE;
+	if( touch ) {
+		switch( e.tickType ) {
+		case BID:
+		case DELAYED_BID:
+			t.bid = e.value;
+			break;
+		case ASK:
+		case DELAYED_ASK:
+			t.ask = e.value;
+			break;
+		case LAST:
+		case DELAYED_LAST:
+			t.last = e.value;
+			break;
+		default:
+			touch = false;
+			break;
+		}
+	}
+	if( touch ) {
+		t.quoted = true;
+		if( !t.working.empty() ) {
+			matchTick( e.tickerId );
+			notify();
+		}
+	}
+	if( e.kind <= TICK_STRING ) {
+		board.set( e.tickerId, e.tickType, e.value, e.stamp / 1000 );
+	}
+
+	tws_strat_tick x;
+	char buf[32];
+	x.stamp = e.stamp;
+	x.tickerId = e.tickerId;
+	x.conId = contracts[e.tickerId]->conId;
+	x.tickType = e.tickType;
+	x.value = e.value;
+	x.opt = NULL;
+	x.str = NULL;
+	switch( e.kind ) {
+	case TICK_PRICE:
+		x.kind = TWS_STRAT_TICK_PRICE;
+		break;
+	case TICK_SIZE:
+		x.kind = TWS_STRAT_TICK_SIZE;
+		break;
+	case TICK_GENERIC:
+		x.kind = TWS_STRAT_TICK_GENERIC;
+		break;
+	case TICK_STRING:
+		/* the recorder kept the numeric prefix only */
+		x.kind = TWS_STRAT_TICK_STRING;
+		snprintf( buf, sizeof(buf), "%.15g", e.value );
+		x.str = buf;
+		break;
+	default:
+		x.kind = TWS_STRAT_TICK_OPTION;
+		x.opt = &opts[e.idx * 8];
+		x.value = x.opt[0];
+		break;
+	}
+	post( BT_TICK, &x, e.tickerId );
+}
+
+void Backtest::barEvent( const Event &e )
+{
+	const Bar &b = bars[e.idx];
+	Ticker &t = tickers[e.tickerId];
+	if( !t.working.empty() ) {
+		matchBar( e.tickerId, b );
+		notify();
+	}
+	/* quotes of earlier ticks are stale now */
+	t.bid = t.ask = NAN;
+	t.last = b.close;
+	t.quoted = false;
+	board.set( e.tickerId, LAST, b.close, e.stamp / 1000 );
+
+	tws_strat_bar x;
+	x.stamp = e.stamp;
+	x.tickerId = e.tickerId;
+	x.conId = contracts[e.tickerId]->conId;
+	x.start = b.start;
+	x.end = b.end;
+	x.open = b.open;
+	x.high = b.high;
+	x.low = b.low;
+	x.close = b.close;
+	x.wap = b.wap;
+	x.volume = b.volume;
+	x.count = b.count;
+	x.hasGaps = b.hasGaps;
+	x.barSize = barSizes[b.barSize].c_str();
+	post( BT_BAR, &x, e.tickerId );
+}
+
+/* fill the working orders of tickerId which the latest tick made marketable */
+void Backtest::matchTick( int tickerId )
+{
+	Ticker &t = tickers[tickerId];
+	size_t n = 0;
+	for( size_t i = 0; i < t.working.size(); i++ ) {
+		Order &o = orders[t.working[i] - 1];
+		if( !o.transmit || !tryFill(o, t) ) {
+			t.working[n++] = t.working[i];
+		}
+	}
+	t.working.resize( n );
+}
+
+/* try to fill at the touch, return true if filled */
+bool Backtest::tryFill( Order &o, const Ticker &t )
+{
+	double ref = o.buy ? t.ask : t.bid;
+	if( isnan(ref) ) {
+		ref = t.last;
+	}
+	if( isnan(ref) ) {
+		return false;
+	}
+	if( (o.type == ORD_STP || o.type == ORD_STP_LMT) && !o.triggered ) {
+		const double trig = isnan(t.last) ? ref : t.last;
+		if( o.buy ? trig < o.auxPrice : trig > o.auxPrice ) {
+			return false;
+		}
+		o.triggered = true;
+	}
+	if( o.type == ORD_LMT || o.type == ORD_STP_LMT ) {
+		if( o.buy ? ref > o.lmtPrice : ref < o.lmtPrice ) {
+			return false;
+		}
+	}
+	fill( o, ref );
+	return true;
+}
+
+/* fill orders placed before the bar started, at the open if it gapped */
+void Backtest::matchBar( int tickerId, const Bar &b )
+{
+	Ticker &t = tickers[tickerId];
+	const int64_t start = b.start * 1000000;
+	size_t n = 0;
+	for( size_t i = 0; i < t.working.size(); i++ ) {
+		Order &o = orders[t.working[i] - 1];
+		double px = NAN;
+		if( !o.transmit || o.placed > start ) {
+			t.working[n++] = t.working[i];
+			continue;
+		}
+
+		double open = b.open;
+		if( (o.type == ORD_STP || o.type == ORD_STP_LMT) && !o.triggered ) {
+			if( o.buy ? b.open >= o.auxPrice : b.open <= o.auxPrice ) {
+				o.triggered = true;
+			} else if( o.buy ? b.high >= o.auxPrice : b.low <= o.auxPrice ) {
+				/* the rest of the bar is unknown, start at the stop */
+				o.triggered = true;
+				open = o.auxPrice;
+			}
+		}
+
+		switch( o.type ) {
+		case ORD_MKT:
+			px = b.open;
+			break;
+		case ORD_STP:
+			if( o.triggered ) {
+				px = open;
+			}
+			break;
+		case ORD_STP_LMT:
+			if( !o.triggered ) {
+				break;
+			} else if( open != b.open ) {
+				if( o.buy ? open <= o.lmtPrice : open >= o.lmtPrice ) {
+					px = open;
+				}
+				break;
+			}
+			/* fall through */
+		case ORD_LMT:
+			if( o.buy ? b.open <= o.lmtPrice : b.open >= o.lmtPrice ) {
+				px = b.open;
+			} else if( o.buy ? b.low <= o.lmtPrice
+			    : b.high >= o.lmtPrice ) {
+				px = o.lmtPrice;
+			}
+			break;
+		}
+
+		if( isnan(px) ) {
+			t.working[n++] = t.working[i];
+		} else {
+			fill( o, px );
+		}
+	}
+	t.working.resize( n );
+}
+
+/* execute the rest of the order, the caller removes it from working */
+void Backtest::fill( Order &o, double price )
+{
+	Ticker &t = tickers[o.tickerId];
+	const Contract &c = *contracts[o.tickerId];
+	const double qty = o.quantity - o.filled;
+	const double sq = o.buy ? qty : -qty;
+
+	/* average cost of the position, realize what's closed */
+	if( t.position == 0.0 || (t.position > 0.0) == o.buy ) {
+		t.avgPrice = (fabs(t.position) * t.avgPrice + qty * price)
+			/ (fabs(t.position) + qty);
+	} else {
+		const double closed = std::min( fabs(t.position), qty );
+		t.realizedPNL += closed * (price - t.avgPrice)
+			* (t.position > 0.0 ? 1.0 : -1.0) * t.multiplier;
+		if( qty > closed ) {
+			t.avgPrice = price;
+		}
+	}
+	t.position += sq;
+	if( t.position == 0.0 ) {
+		t.avgPrice = 0.0;
+	}
+	t.realizedPNL -= qty * commission;
+	t.traded = true;
+
+	o.avgFillPrice = (o.filled * o.avgFillPrice + qty * price)
+		/ (o.filled + qty);
+	o.filled += qty;
+	o.working = false;
+
+	RowExecution row;
+	row.contract = c;
+	Execution &e = row.execution;
+	char id[32];
+	snprintf( id, sizeof(id), "%08lx.01.01", (unsigned long)fills.size() + 1 );
+	e.execId = id;
+	e.time = time_t_ib( clock / 1000000 );
+	e.acctNumber = o.account;
+	e.exchange = c.exchange.empty() ? "BT" : c.exchange;
+	e.side = o.buy ? "BOT" : "SLD";
+	e.shares = qty;
+	e.price = price;
+	e.permId = o.id;
+	e.clientId = 0;
+	e.orderId = o.id;
+	e.cumQty = o.filled;
+	e.avgPrice = o.avgFillPrice;
+	e.orderRef = o.orderRef;
+	fills.push_back( row );
+
+	Notice n;
+	n.type = BT_EXECUTION;
+	n.stamp = clock;
+	n.u.fill = fills.size() - 1;
+	notices.push_back( n );
+
+	orderStatus( o, "Filled" );
+
+	n.type = BT_POSITION;
+	positionOf( o.tickerId, price, &n.u.pos );
+	notices.push_back( n );
+}
+
+void Backtest::positionOf( int tickerId, double mark,
+	tws_strat_position *p ) const
+{
+	const Ticker &t = tickers[tickerId];
+	p->stamp = clock;
+	p->conId = contracts[tickerId]->conId;
+	p->reserved = 0;
+	p->position = t.position;
+	p->marketPrice = mark;
+	p->averageCost = t.avgPrice * t.multiplier;
+	p->unrealizedPNL = t.position * (mark - t.avgPrice) * t.multiplier;
+	p->realizedPNL = t.realizedPNL;
+	p->account = account.c_str();
+	p->symbol = contracts[tickerId]->symbol.c_str();
+}
+
+void Backtest::orderStatus( const Order &o, const char *status )
+{
+	Notice n;
+	n.type = BT_ORDER_STATUS;
+	n.stamp = clock;
+	tws_strat_order_status &os = n.u.os;
+	os.stamp = clock;
+	os.orderId = o.id;
+	os.permId = o.id;
+	os.parentId = 0;
+	os.clientId = 0;
+	os.reserved = 0;
+	os.filled = o.filled;
+	os.remaining = o.working ? o.quantity - o.filled : 0.0;
+	os.avgFillPrice = o.avgFillPrice;
+	os.lastFillPrice = fills.empty() || !o.filled ? 0.0
+		: fills.back().execution.price;
+	os.status = status;
+	os.whyHeld = "";
+	notices.push_back( n );
+}
+
+/* deliver what the last event or callback caused */
+void Backtest::notify()
+{
+	for( size_t i = 0; i < notices.size(); i++ ) {
+		const Notice n = notices[i];
+		switch( n.type ) {
+		case BT_ORDER_STATUS:
+			post( BT_ORDER_STATUS, &n.u.os, -1 );
+			break;
+		case BT_POSITION:
+			post( BT_POSITION, &n.u.pos, -1 );
+			break;
+		case BT_EXECUTION:
+			{
+				const RowExecution &row = fills[n.u.fill];
+				const Execution &e = row.execution;
+				tws_strat_execution x;
+				x.stamp = n.stamp;
+				x.orderId = e.orderId;
+				x.conId = row.contract.conId;
+				x.clientId = e.clientId;
+				x.permId = e.permId;
+				x.reserved = 0;
+				x.shares = e.shares;
+				x.price = e.price;
+				x.cumQty = e.cumQty;
+				x.avgPrice = e.avgPrice;
+				x.execId = e.execId.c_str();
+				x.time = e.time.c_str();
+				x.account = e.acctNumber.c_str();
+				x.exchange = e.exchange.c_str();
+				x.side = e.side.c_str();
+				x.symbol = row.contract.symbol.c_str();
+				post( BT_EXECUTION, &x, -1 );
+			}
+			break;
+		}
+	}
+	notices.clear();
+}
+
+void Backtest::post( int type, const void *view, int tickerId )
+{
+	for( size_t i = 0; i < modules.size(); i++ ) {
+		Module *m = modules[i];
+		if( tickerId > 0 && !m->subAll && ((int)m->subs.size() <= tickerId
+		    || !m->subs[tickerId]) ) {
+			continue;
+		}
+		cntDispatched++;
+		switch( type ) {
+		case BT_TICK:
+			tick_dso( m->dso, (const tws_strat_tick*)view );
+			break;
+		case BT_BAR:
+			bar_dso( m->dso, (const tws_strat_bar*)view );
+			break;
+		case BT_ORDER_STATUS:
+			order_status_dso( m->dso,
+				(const tws_strat_order_status*)view );
+			break;
+		case BT_EXECUTION:
+			execution_dso( m->dso, (const tws_strat_execution*)view );
+			break;
+		case BT_POSITION:
+			position_dso( m->dso, (const tws_strat_position*)view );
+			break;
+		case BT_CONNECTION:
+			connection_dso( m->dso, *(const int*)view );
+			break;
+		}
+	}
+}
+
+int64_t Backtest::now() const
+{
+	return clock;
+}
+
+int Backtest::timer( Module *m, int64_t msecs, void *cookie )
+{
+	timers.insert( std::make_pair(msecs * 1000, std::make_pair(m, cookie)) );
+	return 0;
+}
+
+int64_t Backtest::placeOrder( const tws_strat_order &so )
+{
+	int type;
+	if( so.size < sizeof(so) || so.tickerId <= 0
+	    || so.tickerId >= (int)contracts.size()
+	    || contracts[so.tickerId] == NULL || so.action == NULL
+	    || so.orderType == NULL || !(so.quantity > 0.0)
+	    || (strcmp(so.action, "BUY") != 0 && strcmp(so.action, "SELL") != 0)
+	    || (type = order_type(so.orderType)) < 0 ) {
+		cntRejected++;
+		return -1;
+	}
+
+	Order *o;
+	if( so.orderId != 0 ) {
+		if( so.orderId < 0 || so.orderId > (int64_t)orders.size()
+		    || !orders[so.orderId - 1].working
+		    || orders[so.orderId - 1].tickerId != so.tickerId ) {
+			cntRejected++;
+			return -1;
+		}
+		o = &orders[so.orderId - 1];
+		if( o->type != type ) {
+			o->triggered = false;
+		}
+	} else {
+		orders.push_back( Order() );
+		o = &orders.back();
+		o->id = orders.size();
+		o->tickerId = so.tickerId;
+		o->triggered = false;
+		o->working = true;
+		o->filled = 0.0;
+		o->avgFillPrice = 0.0;
+		tickers[so.tickerId].working.push_back( o->id );
+	}
+	o->buy = strcmp( so.action, "BUY" ) == 0;
+	o->type = type;
+	o->quantity = so.quantity;
+	o->lmtPrice = so.lmtPrice;
+	o->auxPrice = so.auxPrice;
+	o->transmit = !(so.flags & TWS_STRAT_NO_TRANSMIT);
+	o->placed = clock;
+	o->account = so.account != NULL ? so.account : account;
+	o->orderRef = so.orderRef != NULL ? so.orderRef : "";
+	orderStatus( *o, o->transmit ? "Submitted" : "PreSubmitted" );
+
+	/* marketable right away while we have quotes */
+	Ticker &t = tickers[so.tickerId];
+	if( o->transmit && t.quoted && tryFill(*o, t) ) {
+		t.working.erase( std::find(t.working.begin(), t.working.end(),
+			o->id) );
+	}
+	return o->id;
+}
+
+int Backtest::cancelOrder( int64_t orderId )
+{
+	if( orderId <= 0 || orderId > (int64_t)orders.size()
+	    || !orders[orderId - 1].working ) {
+		return -1;
+	}
+	Order &o = orders[orderId - 1];
+	Ticker &t = tickers[o.tickerId];
+	o.working = false;
+	t.working.erase( std::find(t.working.begin(), t.working.end(), o.id) );
+	orderStatus( o, "Cancelled" );
+	return 0;
+}
+
+int Backtest::subscribe( Module *m, int tickerId, bool on )
+{
+	if( tickerId < 0 ) {
+		return -1;
+	} else if( tickerId == 0 ) {
+		m->subAll = on;
+		m->subs.clear();
+		return 0;
+	}
+	if( (int)m->subs.size() <= tickerId ) {
+		m->subs.resize( tickerId + 1, 0 );
+	}
+	m->subs[tickerId] = on;
+	return 0;
+}
+
+int Backtest::instrument( int tickerId, tws_strat_instrument *out ) const
+{
+	if( tickerId <= 0 || tickerId >= (int)contracts.size()
+	    || contracts[tickerId] == NULL ) {
+		return -1;
+	}
+	const Contract &c = *contracts[tickerId];
+	out->tickerId = tickerId;
+	out->conId = c.conId;
+	out->symbol = c.symbol.c_str();
+	out->secType = c.secType.c_str();
+	out->expiry = c.lastTradeDateOrContractMonth.c_str();
+	out->strike = c.strike;
+	out->right = c.right.c_str();
+	out->exchange = c.exchange.c_str();
+	out->currency = c.currency.c_str();
+	return 0;
+}
+
+const QuoteBoard& Backtest::quotes() const
+{
+	return board;
+}
+
+int Backtest::position( long conId, const char *acct,
+	tws_strat_position *out ) const
+{
+	if( acct != NULL && account != acct ) {
+		return -1;
+	}
+	for( size_t i = 0; i < tickers.size(); i++ ) {
+		if( tickers[i].traded && contracts[i]->conId == conId ) {
+			positionOf( i, markOf(i), out );
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* the last price, or mid */
+double Backtest::markOf( int tickerId ) const
+{
+	const Ticker &t = tickers[tickerId];
+	double mark = t.last;
+	if( isnan(mark) ) {
+		mark = (t.bid + t.ask) / 2.0;
+	}
+	if( isnan(mark) ) {
+		mark = t.avgPrice;
+	}
+	return mark;
+}
+
+void Backtest::dumpXml() const
+{
+	PacketExecutions pe;
+	pe.record( 0, ExecutionsRequest() );
+	for( size_t i = 0; i < fills.size(); i++ ) {
+		pe.append( 0, fills[i] );
+	}
+	pe.appendExecutionsEnd( 0 );
+	pe.dumpXml();
+
+	/* positions marked at the last price, or mid */
+	PacketAccStatus pa;
+	AccStatusRequest aR;
+	aR.subscribe = false;
+	aR.acctCode = account;
+	pa.record( aR );
+
+	std::vector<RowPrtfl> rows;
+	double realized = 0.0;
+	double unrealized = 0.0;
+	for( size_t i = 0; i < tickers.size(); i++ ) {
+		const Ticker &t = tickers[i];
+		if( !t.traded ) {
+			continue;
+		}
+		const double mark = markOf( i );
+		RowPrtfl p;
+		p.contract = *contracts[i];
+		p.position = t.position;
+		p.marketPrice = mark;
+		p.marketValue = t.position * mark * t.multiplier;
+		p.averageCost = t.avgPrice * t.multiplier;
+		p.unrealizedPNL = t.position * (mark - t.avgPrice) * t.multiplier;
+		p.realizedPNL = t.realizedPNL;
+		p.accountName = account;
+		rows.push_back( p );
+		realized += p.realizedPNL;
+		unrealized += p.unrealizedPNL;
+	}
+
+	char buf[32];
+	RowAccVal v;
+	v.currency = "BASE";
+	v.accountName = account;
+	v.key = "RealizedPnL";
+	snprintf( buf, sizeof(buf), "%.2f", realized );
+	v.val = buf;
+	pa.append( v );
+	v.key = "UnrealizedPnL";
+	snprintf( buf, sizeof(buf), "%.2f", unrealized );
+	v.val = buf;
+	pa.append( v );
+	for( size_t i = 0; i < rows.size(); i++ ) {
+		pa.append( rows[i] );
+	}
+	pa.appendAccountDownloadEnd( account );
+	pa.dumpXml();
+}
+
+void Backtest::dumpStats() const
+{
+	const double secs = runUsecs / 1000000.0;
+	fprintf( stderr, "notice, loaded %ld ticks and %ld bars in %.3f secs, "
+		"skipped %ld\n", cntTicks, cntBars, loadUsecs / 1000000.0,
+		cntSkipped );
+	fprintf( stderr, "notice, replayed %ld events in %.3f secs (%.0f/s), "
+		"%ld callbacks, %ld timers\n", (long)events.size(), secs,
+		secs > 0.0 ? events.size() / secs : 0.0, cntDispatched, cntTimers );
+	fprintf( stderr, "notice, %ld orders, %ld fills, %ld rejected\n",
+		(long)orders.size(), (long)fills.size(), cntRejected );
+}
@@ -0,0 +1,147 @@
+/*** tws_backtest.h -- replay market data through strategy modules
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_BACKTEST_H
+#define TWS_BACKTEST_H
+
+#include "tws_strat.h"
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <twsapi/twsapi_config.h>
+
+#ifndef TWSAPI_NO_NAMESPACE
+namespace IB {
+#endif
+	class Contract;
+#ifndef TWSAPI_NO_NAMESPACE
+}
+using namespace IB;
+#endif
+
+class QuoteBoard;
+struct RowExecution;
+
+
+/**
+ * Feed recorded ticks and historical bars through typed strategy modules
+ * under a virtual clock. All data is loaded and sorted by stamp first, then
+ * run() dispatches it as fast as the modules take it. now() is the stamp of
+ * the event being handled, timers fire in between.
+ *
+ * Orders are filled by a simple deterministic model, always completely:
+ * A tick updates bid, ask or last of its instrument and fills all working
+ * orders it makes marketable, before the modules see it. Buy orders are
+ * matched against the ask, sell orders against the bid, or both against
+ * last while there was no quote yet. Stop orders trigger on last. A bar
+ * fills orders placed before it started, at the open if that's through the
+ * order's price, otherwise at the limit or stop price if the bar's range
+ * touched it. Orders placed while the instrument is quoted by ticks may fill
+ * right away. Order status, executions and positions are delivered after
+ * the callback which caused them.
+ */
+class Backtest
+{
+	public:
+		Backtest();
+		~Backtest();
+
+		void setAccount( const std::string& );
+		void setCommission( double perUnit );
+
+		/* input files, NULL for stdin, before run() */
+		bool loadFile( const char *filename );
+		bool loadTicks( const char *filename );
+		bool loadBars( const char *filename );
+		/* merge the input, modules opened afterwards know all tickerIds */
+		void prepare();
+		bool addModule( const char *file );
+
+		void run();
+		/* PacketExecutions and PacketAccStatus of all fills */
+		void dumpXml() const;
+		void dumpStats() const;
+
+		/* services, see tws_strat.h */
+		struct Module;
+		int64_t now() const;
+		int timer( Module*, int64_t msecs, void *cookie );
+		int64_t placeOrder( const tws_strat_order& );
+		int cancelOrder( int64_t orderId );
+		int subscribe( Module*, int tickerId, bool on );
+		int instrument( int tickerId, tws_strat_instrument* ) const;
+		const QuoteBoard& quotes() const;
+		int position( long conId, const char *account,
+			tws_strat_position* ) const;
+
+	private:
+		Backtest( const Backtest& );
+		Backtest& operator=( const Backtest& );
+
+		struct Event;
+		struct Bar;
+		struct Order;
+		struct Ticker;
+		struct Notice;
+
+		int barTickerId( const Contract& );
+		void step( const Event& );
+		void fireTimers( int64_t until );
+		void tickEvent( const Event& );
+		void barEvent( const Event& );
+		void matchTick( int tickerId );
+		void matchBar( int tickerId, const Bar& );
+		bool tryFill( Order&, const Ticker& );
+		void fill( Order&, double price );
+		double markOf( int tickerId ) const;
+		void positionOf( int tickerId, double mark,
+			tws_strat_position* ) const;
+		void orderStatus( const Order&, const char *status );
+		void notify();
+		void post( int type, const void *view, int tickerId );
+
+		std::string account;
+		double commission;
+
+		std::vector<Event> &events;
+		std::vector<Bar> &bars;
+		std::vector<std::string> &barSizes;
+		/* 8 values of each option computation tick */
+		std::vector<double> &opts;
+		/* contracts of the bars, before prepare() assigns tickerIds */
+		std::vector<Contract*> &barContracts;
+		std::map<std::string, int> &barContractIds;
+
+		/* indexed by tickerId */
+		std::vector<Contract*> &contracts;
+		std::vector<Ticker> &tickers;
+		QuoteBoard &board;
+
+		std::vector<Module*> &modules;
+		std::multimap<int64_t, std::pair<Module*, void*> > &timers;
+		std::vector<Order> &orders;
+		std::deque<RowExecution> &fills;
+		std::vector<Notice> &notices;
+		int64_t clock;
+
+		/* statistics */
+		long cntTicks;
+		long cntBars;
+		long cntSkipped;
+		long cntDispatched;
+		long cntTimers;
+		long cntRejected;
+		int64_t loadUsecs;
+		int64_t runUsecs;
+};
+
+#endif
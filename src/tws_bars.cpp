@@ -0,0 +1,234 @@
+/*** tws_bars.cpp -- aggregate real-time bars
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_bars.h"
+#include "tws_meta.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+
+BarAggregator::BarAggregator() :
+	aggs(*(new std::vector<Agg>())),
+	barSizes(*(new std::vector<std::string>())),
+	first(*(new std::vector<int>())),
+	doneAggs(*(new std::vector<int>())),
+	doneEnds(*(new std::vector<time_t>())),
+	done(*(new std::vector<RowHist>())),
+	nDone(0),
+	cntBars(0),
+	cntStale(0),
+	cntFinished(0),
+	cntGaps(0)
+{
+}
+
+BarAggregator::~BarAggregator()
+{
+	delete &done;
+	delete &doneEnds;
+	delete &doneAggs;
+	delete &first;
+	delete &barSizes;
+	delete &aggs;
+}
+
+int BarAggregator::add( int request, const std::string &barSizeSetting,
+	int formatDate )
+{
+	assert( request >= 0 );
+	assert( aggs.empty() || aggs.back().request <= request );
+	const int secs = ib_bar_size2secs( barSizeSetting );
+	if( secs <= 0 || secs % RT_BAR_SECS != 0 ) {
+		return -1;
+	}
+
+	while( (int)first.size() <= request ) {
+		first.push_back( aggs.size() );
+	}
+	Agg a;
+	memset( &a, 0, sizeof(a) );
+	a.request = request;
+	a.secs = secs;
+	a.formatDate = formatDate;
+	aggs.push_back( a );
+	barSizes.push_back( barSizeSetting );
+	if( (int)first.size() == request + 1 ) {
+		first.push_back( aggs.size() );
+	} else {
+		first[request + 1] = aggs.size();
+	}
+	return aggs.size() - 1;
+}
+
+int BarAggregator::size() const
+{
+	return aggs.size();
+}
+
+int BarAggregator::request( int agg ) const
+{
+	return aggs[agg].request;
+}
+
+const std::string& BarAggregator::barSizeSetting( int agg ) const
+{
+	return barSizes[agg];
+}
+
+/* local midnight before t */
+static time_t day_start( time_t t )
+{
+	struct tm tm;
+#ifdef HAVE_LOCALTIME_R
+	localtime_r( &t, &tm );
+#else
+	tm = *localtime( &t );
+#endif
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+	return mktime( &tm );
+}
+
+int BarAggregator::update( int request, const RtBar &bar )
+{
+	nDone = 0;
+	cntBars++;
+	if( request < 0 || request + 1 >= (int)first.size() ) {
+		return 0;
+	}
+
+	const time_t day = day_start( bar.time );
+	bool stale = false;
+	for( int i = first[request]; i < first[request + 1]; i++ ) {
+		Agg &a = aggs[i];
+		if( bar.time < a.next ) {
+			/* repeated or out of order */
+			stale = true;
+			continue;
+		}
+		const time_t start = day + (bar.time - day) / a.secs * a.secs;
+		if( a.active && start != a.start ) {
+			/* the last 5 secs bars of the current one are missing */
+			a.gaps = true;
+			finish( i );
+		}
+
+		if( !a.active ) {
+			a.active = true;
+			a.gaps = bar.time != start;
+			a.start = start;
+			a.open = bar.open;
+			a.high = bar.high;
+			a.low = bar.low;
+			a.volume = 0;
+			a.wapSum = 0.0;
+			a.count = 0;
+		} else {
+			if( bar.time != a.next ) {
+				a.gaps = true;
+			}
+			a.high = std::max( a.high, bar.high );
+			a.low = std::min( a.low, bar.low );
+		}
+		a.close = bar.close;
+		a.wap = bar.wap;
+		/* no volume, count and wap for MIDPOINT, BID, ... */
+		if( bar.volume < 0 || a.volume < 0 ) {
+			a.volume = -1;
+		} else {
+			a.volume += bar.volume;
+			a.wapSum += bar.wap * bar.volume;
+		}
+		if( bar.count < 0 || a.count < 0 ) {
+			a.count = -1;
+		} else {
+			a.count += bar.count;
+		}
+		a.next = bar.time + RT_BAR_SECS;
+
+		if( a.next >= a.start + a.secs ) {
+			finish( i );
+		}
+	}
+	if( stale ) {
+		cntStale++;
+	}
+	return nDone;
+}
+
+void BarAggregator::finish( int i )
+{
+	Agg &a = aggs[i];
+	assert( a.active );
+	if( nDone >= (int)done.size() ) {
+		done.push_back( dflt_RowHist );
+		doneAggs.push_back( -1 );
+		doneEnds.push_back( 0 );
+	}
+	RowHist &row = done[nDone];
+	doneAggs[nDone] = i;
+	doneEnds[nDone] = a.start + a.secs;
+	nDone++;
+
+	if( a.formatDate == 2 ) {
+		char tmp[24];
+		snprintf( tmp, sizeof(tmp), "%ld", (long)a.start );
+		row.date = tmp;
+	} else {
+		row.date = time_t_ib( a.start );
+	}
+	row.open = a.open;
+	row.high = a.high;
+	row.low = a.low;
+	row.close = a.close;
+	row.volume = a.volume;
+	row.count = a.count;
+	row.WAP = a.volume > 0 ? a.wapSum / a.volume : a.wap;
+	row.hasGaps = a.gaps;
+
+	cntFinished++;
+	if( a.gaps ) {
+		cntGaps++;
+	}
+	a.active = false;
+}
+
+int BarAggregator::finishedAgg( int i ) const
+{
+	assert( i >= 0 && i < nDone );
+	return doneAggs[i];
+}
+
+const RowHist& BarAggregator::finished( int i ) const
+{
+	assert( i >= 0 && i < nDone );
+	return done[i];
+}
+
+time_t BarAggregator::finishedEnd( int i ) const
+{
+	assert( i >= 0 && i < nDone );
+	return doneEnds[i];
+}
+
+void BarAggregator::dumpStats() const
+{
+	INFO_PRINTF( "real-time bars: %zu bar sizes, %ld 5 secs bars received, "
+		"%ld stale, %ld bars finished, %ld with gaps", aggs.size(), cntBars,
+		cntStale, cntFinished, cntGaps );
+}
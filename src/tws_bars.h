@@ -0,0 +1,108 @@
+/*** tws_bars.h -- aggregate real-time bars
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_BARS_H
+#define TWS_BARS_H
+
+#include <time.h>
+#include <string>
+#include <vector>
+
+struct RowHist;
+
+
+/* one bar of reqRealTimeBars, TWS sends only 5 secs bars */
+struct RtBar
+{
+	time_t time;
+	double open;
+	double high;
+	double low;
+	double close;
+	long long volume;
+	double wap;
+	int count;
+};
+
+#define RT_BAR_SECS 5
+
+
+/**
+ * Aggregate the 5 secs bars of real-time bar requests into any intraday bar
+ * size which is a multiple of 5 secs. Bars are aligned to local midnight
+ * like TWS's historical bars. A bar is finished as soon as its last 5 secs
+ * bar arrives. Bars missing some 5 secs bars, e.g. the first one after
+ * subscribing or reconnecting, are finished with hasGaps set.
+ */
+class BarAggregator
+{
+	public:
+		BarAggregator();
+		~BarAggregator();
+
+		/* requests must be added in ascending order, return the index or
+		   -1 if barSizeSetting is not supported */
+		int add( int request, const std::string &barSizeSetting,
+			int formatDate );
+		int size() const;
+		int request( int agg ) const;
+		const std::string& barSizeSetting( int agg ) const;
+
+		/* feed one 5 secs bar of request, return the number of finished
+		   bars, see finished() */
+		int update( int request, const RtBar& );
+		int finishedAgg( int i ) const;
+		const RowHist& finished( int i ) const;
+		/* end of the finished bar, the begin is its date */
+		time_t finishedEnd( int i ) const;
+
+		void dumpStats() const;
+
+	private:
+		BarAggregator( const BarAggregator& );
+		BarAggregator& operator=( const BarAggregator& );
+
+		struct Agg
+		{
+			int request;
+			int secs;
+			int formatDate;
+			bool active;
+			bool gaps;
+			/* begin of the current bar and expected next 5 secs bar */
+			time_t start;
+			time_t next;
+			double open;
+			double high;
+			double low;
+			double close;
+			long long volume;
+			double wapSum;
+			double wap;
+			int count;
+		};
+
+		void finish( int agg );
+
+		std::vector<Agg> &aggs;
+		std::vector<std::string> &barSizes;
+		/* first agg of each request, the next entry is its end */
+		std::vector<int> &first;
+		std::vector<int> &doneAggs;
+		std::vector<time_t> &doneEnds;
+		std::vector<RowHist> &done;
+		int nDone;
+
+		/* statistics */
+		long cntBars;
+		long cntStale;
+		long cntFinished;
+		long cntGaps;
+};
+
+#endif
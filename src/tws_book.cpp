@@ -0,0 +1,156 @@
+/*** tws_book.cpp -- market depth books
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_book.h"
+#include "debug.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+DepthBooks::DepthBooks() :
+	nBooks(0),
+	cap(0),
+	levels(*(new std::vector<DepthLevel>())),
+	counts(*(new std::vector<int>())),
+	cntInsert(0),
+	cntUpdate(0),
+	cntDelete(0),
+	cntInvalid(0),
+	maxDepth(0)
+{
+}
+
+DepthBooks::~DepthBooks()
+{
+	delete &counts;
+	delete &levels;
+}
+
+void DepthBooks::init( int books, int capacity )
+{
+	assert( books >= 0 && capacity > 0 );
+	nBooks = books;
+	cap = capacity;
+	DepthLevel empty;
+	memset( &empty, 0, sizeof(empty) );
+	levels.assign( (size_t)nBooks * 2 * cap, empty );
+	counts.assign( nBooks * 2, 0 );
+}
+
+int DepthBooks::size() const
+{
+	return nBooks;
+}
+
+int DepthBooks::capacity() const
+{
+	return cap;
+}
+
+DepthLevel* DepthBooks::side( int book, int s )
+{
+	return &levels[((size_t)book * 2 + s) * cap];
+}
+
+/**
+ * Apply one updateMktDepth operation, return false and change nothing if it
+ * does not fit the book. Inserts push the worst level out of a full book.
+ */
+bool DepthBooks::apply( int book, int position, int operation, int s,
+	double price, int size, const char *mktMaker )
+{
+	if( book < 0 || book >= nBooks || (s != DEPTH_ASK && s != DEPTH_BID)
+	    || position < 0 || position >= cap ) {
+		cntInvalid++;
+		return false;
+	}
+	DepthLevel *l = side( book, s );
+	int &n = counts[book * 2 + s];
+
+	switch( operation ) {
+	case DEPTH_INSERT:
+		if( position > n ) {
+			cntInvalid++;
+			return false;
+		}
+		memmove( l + position + 1, l + position,
+			(std::min(n, cap - 1) - position) * sizeof(*l) );
+		n = std::min( n + 1, cap );
+		cntInsert++;
+		break;
+	case DEPTH_UPDATE:
+		/* TWS sometimes updates the first empty level */
+		if( position > n ) {
+			cntInvalid++;
+			return false;
+		} else if( position == n ) {
+			n++;
+		}
+		cntUpdate++;
+		break;
+	case DEPTH_DELETE:
+		if( position >= n ) {
+			cntInvalid++;
+			return false;
+		}
+		memmove( l + position, l + position + 1,
+			(n - position - 1) * sizeof(*l) );
+		n--;
+		cntDelete++;
+		return true;
+	default:
+		cntInvalid++;
+		return false;
+	}
+
+	DepthLevel &x = l[position];
+	x.price = price;
+	x.size = size;
+	strncpy( x.mktMaker, mktMaker, sizeof(x.mktMaker) - 1 );
+	x.mktMaker[sizeof(x.mktMaker) - 1] = '\0';
+	maxDepth = std::max( maxDepth, n );
+	return true;
+}
+
+/* forget all levels, e.g. after TWS reset the book */
+void DepthBooks::clear( int book )
+{
+	assert( book >= 0 && book < nBooks );
+	counts[book * 2 + DEPTH_ASK] = 0;
+	counts[book * 2 + DEPTH_BID] = 0;
+}
+
+int DepthBooks::depth( int book, int s ) const
+{
+	assert( book >= 0 && book < nBooks && (s == DEPTH_ASK || s == DEPTH_BID) );
+	return counts[book * 2 + s];
+}
+
+const DepthLevel& DepthBooks::level( int book, int s, int position ) const
+{
+	assert( position >= 0 && position < depth(book, s) );
+	return levels[((size_t)book * 2 + s) * cap + position];
+}
+
+int DepthBooks::top( int book, int s, int n, DepthLevel *out ) const
+{
+	n = std::min( n, depth(book, s) );
+	if( n > 0 ) {
+		memcpy( out, &levels[((size_t)book * 2 + s) * cap],
+			n * sizeof(*out) );
+	}
+	return n;
+}
+
+void DepthBooks::dumpStats() const
+{
+	INFO_PRINTF( "depth books: %d books, %d levels per side, %ld inserts, "
+		"%ld updates, %ld deletes, %ld invalid, max depth %d", nBooks, cap,
+		cntInsert, cntUpdate, cntDelete, cntInvalid, maxDepth );
+}
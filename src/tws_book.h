@@ -0,0 +1,76 @@
+/*** tws_book.h -- market depth books
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_BOOK_H
+#define TWS_BOOK_H
+
+#include <stdint.h>
+#include <vector>
+
+
+struct DepthLevel
+{
+	double price;
+	int size;
+	/* only for updateMktDepthL2, NUL terminated, maybe truncated */
+	char mktMaker[12];
+};
+
+/* IB's side and operation of updateMktDepth */
+enum depth_side { DEPTH_ASK = 0, DEPTH_BID = 1 };
+enum depth_op { DEPTH_INSERT = 0, DEPTH_UPDATE = 1, DEPTH_DELETE = 2 };
+
+
+/**
+ * Order books of all market depth requests, book i is the i-th request of
+ * the job. Levels are stored in one flat array, each side of each book has
+ * room for capacity levels, nothing is allocated after init(). Position 0
+ * is the best level.
+ */
+class DepthBooks
+{
+	public:
+		DepthBooks();
+		~DepthBooks();
+
+		void init( int books, int capacity );
+		int size() const;
+		int capacity() const;
+
+		bool apply( int book, int position, int operation, int side,
+			double price, int size, const char *mktMaker = "" );
+		void clear( int book );
+
+		/* number of valid levels of one side */
+		int depth( int book, int side ) const;
+		const DepthLevel& level( int book, int side, int position ) const;
+		/* copy up to n best levels, return how many */
+		int top( int book, int side, int n, DepthLevel *out ) const;
+
+		void dumpStats() const;
+
+	private:
+		DepthBooks( const DepthBooks& );
+		DepthBooks& operator=( const DepthBooks& );
+
+		DepthLevel* side( int book, int side );
+
+		int nBooks;
+		int cap;
+		std::vector<DepthLevel> &levels;
+		std::vector<int> &counts;
+
+		/* statistics */
+		long cntInsert;
+		long cntUpdate;
+		long cntDelete;
+		long cntInvalid;
+		int maxDepth;
+};
+
+#endif
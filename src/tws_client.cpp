@@ -46,11 +46,15 @@
 		DEBUG_PRINTF("tws debug: " _fmt, ## _msg); \
 	}
 
+#define CLIENT_LOCK \
+	std::lock_guard<std::recursive_mutex> client_lock(mutex)
+
 #if TWSAPI_IB_VERSION_NUMBER < 97200
 # define lastTradeDateOrContractMonth expiry
 #endif
 
 TWSClient::TWSClient( EWrapper *ew ) :
+	mutex(*(new std::recursive_mutex())),
 	myEWrapper(ew)
 {
 #if ! defined TWS_ORIG_CLIENT
@@ -69,11 +73,13 @@ TWSClient::TWSClient( EWrapper *ew ) :
 TWSClient::~TWSClient()
 {
 	delete ePosixClient;
+	delete &mutex;
 }
 
 
 bool TWSClient::isConnected() const
 {
+	CLIENT_LOCK;
 	return ePosixClient->isConnected();
 }
 
@@ -81,7 +87,8 @@ bool TWSClient::isConnected() const
 bool TWSClient::connectTWS( const std::string &host, int port, int clientId,
 	int ai_family )
 {
-	DEBUG_PRINTF("connect: %s:%d, clientId: %d", host.c_str(), port, clientId);
+	CLIENT_LOCK;
+	INFO_PRINTF("connect: %s:%d, clientId: %d", host.c_str(), port, clientId);
 
 #if ! defined TWS_ORIG_CLIENT
 	return ePosixClient->eConnect2( host.c_str(), port, clientId, ai_family );
@@ -98,7 +105,8 @@ bool TWSClient::connectTWS( const std::string &host, int port, int clientId,
 
 void TWSClient::disconnectTWS()
 {
-	DEBUG_PRINTF("disconnect TWS");
+	CLIENT_LOCK;
+	INFO_PRINTF("disconnect TWS");
 
 	if ( !isConnected()) {
 		return;
@@ -106,12 +114,13 @@ void TWSClient::disconnectTWS()
 
 	ePosixClient->eDisconnect();
 	myEWrapper->connectionClosed();
-	DEBUG_PRINTF("We are disconnected");
+	INFO_PRINTF("We are disconnected");
 }
 
 
 void TWSClient::selectStuff( int msec )
 {
+	CLIENT_LOCK;
 	assert( msec >= 0 );
 	//DEBUG_PRINTF("usleep ....." );
 	//usleep(2000 * 1000);
@@ -177,8 +186,43 @@ void TWSClient::selectStuff( int msec )
 }
 
 
+/**
+ * Wait until the socket is readable without holding the lock, so that
+ * requests can be sent meanwhile. Used by the reader thread which then
+ * decodes using selectStuff(0).
+ */
+bool TWSClient::waitReadable( int msec )
+{
+#if ! defined TWS_ORIG_CLIENT
+	int fd;
+	{
+		CLIENT_LOCK;
+		if( !ePosixClient->isConnected() ) {
+			return false;
+		}
+		fd = ePosixClient->fd();
+	}
+
+	struct timeval tval;
+	tval.tv_sec = msec / 1000 ;
+	tval.tv_usec = (msec % 1000) * 1000;
+
+	fd_set readSet;
+	FD_ZERO( &readSet);
+	FD_SET( fd, &readSet);
+	/* on errors let selectStuff() find out what's wrong */
+	return select( fd + 1, &readSet, NULL, NULL, &tval ) != 0;
+#else
+	/* the original client has its own reader thread */
+	assert( false );
+	return false;
+#endif
+}
+
+
 int TWSClient::serverVersion()
 {
+	CLIENT_LOCK;
 #if TWSAPI_IB_VERSION_NUMBER >= 97200
 	return ePosixClient->EClient::serverVersion();
 #else
@@ -186,8 +230,23 @@ int TWSClient::serverVersion()
 #endif
 }
 
+#if TWSAPI_IB_VERSION_NUMBER >= 97200
+bool TWSClient::asyncEConnect() const
+{
+	CLIENT_LOCK;
+	return ePosixClient->asyncEConnect();
+}
+
+void TWSClient::startApi()
+{
+	CLIENT_LOCK;
+	ePosixClient->startApi();
+}
+#endif
+
 std::string TWSClient::TwsConnectionTime()
 {
+	CLIENT_LOCK;
 	return ePosixClient->TwsConnectionTime();
 }
 
@@ -198,6 +257,7 @@ std::string TWSClient::TwsConnectionTime()
 void TWSClient::reqMktData(int tickerId, const Contract &contract,
 	const  std::string &genericTickList, bool snapshot)
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF( "REQ_MKT_DATA %d "
 		"'%s' '%ld' '%s' '%s' '%s' '%s' '%g' '%s' '%s' '%s' %d",
 		tickerId, contract.symbol.c_str(), contract.conId, contract.exchange.c_str(),
@@ -218,15 +278,65 @@ void TWSClient::reqMktData(int tickerId, const Contract &contract,
 
 void TWSClient::cancelMktData ( int tickerId )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("CANCEL_MKT_DATA %d", tickerId);
 
 	ePosixClient->cancelMktData( tickerId );
 }
 
+void TWSClient::reqMktDepth( int tickerId, const Contract &contract,
+	int numRows )
+{
+	CLIENT_LOCK;
+	DEBUG_PRINTF( "REQ_MKT_DEPTH %d '%s' '%ld' '%s' '%s' %d",
+		tickerId, contract.symbol.c_str(), contract.conId,
+		contract.exchange.c_str(), contract.secType.c_str(), numRows );
+
+	ePosixClient->reqMktDepth( tickerId, contract, numRows
+#if TWSAPI_IB_VERSION_NUMBER >= 971
+	, TagValueListSPtr()
+#endif
+	);
+}
+
+void TWSClient::cancelMktDepth( int tickerId )
+{
+	CLIENT_LOCK;
+	DEBUG_PRINTF("CANCEL_MKT_DEPTH %d", tickerId);
+
+	ePosixClient->cancelMktDepth( tickerId );
+}
+
+void TWSClient::reqRealTimeBars( int tickerId, const Contract &contract,
+	const std::string &whatToShow, bool useRTH )
+{
+	CLIENT_LOCK;
+	DEBUG_PRINTF( "REQ_REAL_TIME_BARS %d '%s' '%ld' '%s' '%s' '%s' %d",
+		tickerId, contract.symbol.c_str(), contract.conId,
+		contract.exchange.c_str(), contract.secType.c_str(),
+		whatToShow.c_str(), useRTH );
+
+	/* TWS supports 5 secs bars only */
+	ePosixClient->reqRealTimeBars( tickerId, contract, 5, whatToShow, useRTH
+#if TWSAPI_IB_VERSION_NUMBER >= 971
+	, TagValueListSPtr()
+#endif
+	);
+}
+
+void TWSClient::cancelRealTimeBars( int tickerId )
+{
+	CLIENT_LOCK;
+	DEBUG_PRINTF("CANCEL_REAL_TIME_BARS %d", tickerId);
+
+	ePosixClient->cancelRealTimeBars( tickerId );
+}
+
 
 void TWSClient::placeOrder ( int id, const Contract &contract,
 	const Order &order )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("PLACE_ORDER %d '%s' %g '%s' %g '%s' %ld",
 		id, order.orderType.c_str(), (double)order.totalQuantity, order.action.c_str(),
 		order.lmtPrice, contract.symbol.c_str(), contract.conId );
@@ -237,6 +347,7 @@ void TWSClient::placeOrder ( int id, const Contract &contract,
 
 void TWSClient::cancelOrder ( int id )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("CANCEL_ORDER %d", id);
 
 	ePosixClient->cancelOrder( id );
@@ -245,6 +356,7 @@ void TWSClient::cancelOrder ( int id )
 
 void TWSClient::reqOpenOrders()
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_OPEN_ORDERS");
 
 	ePosixClient->reqOpenOrders();
@@ -253,6 +365,7 @@ void TWSClient::reqOpenOrders()
 
 void TWSClient::reqAllOpenOrders()
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_ALL_OPEN_ORDERS");
 	ePosixClient->reqAllOpenOrders();
 }
@@ -260,6 +373,7 @@ void TWSClient::reqAllOpenOrders()
 
 void TWSClient::reqAutoOpenOrders( bool bAutoBind )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_AUTO_OPEN_ORDERS %d", bAutoBind);
 	ePosixClient->reqAutoOpenOrders( bAutoBind );
 }
@@ -267,6 +381,7 @@ void TWSClient::reqAutoOpenOrders( bool bAutoBind )
 
 void TWSClient::reqAccountUpdates( bool subscribe, const std::string &acctCode )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_ACCOUNT_DATA %d '%s'", subscribe, acctCode.c_str() );
 
 	ePosixClient->reqAccountUpdates( subscribe, acctCode );
@@ -275,6 +390,7 @@ void TWSClient::reqAccountUpdates( bool subscribe, const std::string &acctCode )
 
 void TWSClient::reqExecutions(int reqId, const ExecutionFilter& filter)
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_EXECUTIONS %d", reqId);
 
 	ePosixClient->reqExecutions(reqId, filter);
@@ -283,6 +399,7 @@ void TWSClient::reqExecutions(int reqId, const ExecutionFilter& filter)
 
 void TWSClient::reqIds( int numIds)
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_IDS %d", numIds);
 
 	ePosixClient->reqIds( numIds );
@@ -291,6 +408,7 @@ void TWSClient::reqIds( int numIds)
 
 void TWSClient::reqContractDetails( int reqId, const Contract &contract )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_CONTRACT_DATA %d '%s' '%s' '%s'",
 		reqId, contract.symbol.c_str(), contract.secType.c_str(),
 		contract.exchange.c_str() );
@@ -301,6 +419,7 @@ void TWSClient::reqContractDetails( int reqId, const Contract &contract )
 
 void TWSClient::setServerLogLevel( int logLevel )
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("SET_SERVER_LOGLEVEL %d", logLevel);
 
 	ePosixClient->setServerLogLevel( logLevel );
@@ -312,6 +431,7 @@ void TWSClient::reqHistoricalData ( int tickerId, const Contract &contract,
 	const std::string &barSizeSetting, const std::string &whatToShow,
 	int useRTH, int formatDate )
 {
+	CLIENT_LOCK;
 #if 0
 	DEBUG_PRINTF("REQ_HISTORICAL_DATA %d "
 		"'%s' '%s' '%s' '%s' '%s' '%s' '%s' %d %d",
@@ -334,6 +454,7 @@ void TWSClient::reqHistoricalData ( int tickerId, const Contract &contract,
 
 void TWSClient::reqCurrentTime()
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_CURRENT_TIME");
 
 	ePosixClient->reqCurrentTime();
@@ -341,6 +462,7 @@ void TWSClient::reqCurrentTime()
 
 void TWSClient::reqMarketDataType(int marketDataType)
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_MARKET_DATA_TYPE %d", marketDataType);
 
 	ePosixClient->reqMarketDataType(marketDataType);
@@ -348,6 +470,7 @@ void TWSClient::reqMarketDataType(int marketDataType)
 
 void TWSClient::reqSecDefOptParams(int reqId, const Contract &c)
 {
+	CLIENT_LOCK;
 	DEBUG_PRINTF("REQ_OPT_PARAMS %d '%s' '%s' '%s' '%ld'", reqId,
 		c.symbol.c_str(), c.exchange.c_str(), c.secType.c_str(), c.conId);
 
@@ -9,6 +9,7 @@
 #ifndef TWS_CLIENT_H
 #define TWS_CLIENT_H
 
+#include <mutex>
 #include <string>
 
 #include <twsapi/twsapi_config.h>
@@ -46,6 +47,7 @@ class TWSClient
 		bool isConnected() const;
 
 		void selectStuff( int msec );
+		bool waitReadable( int msec );
 
 		/////////////////////////////////////////////////////
 		bool connectTWS( const std::string &host, int port, int clientId,
@@ -57,6 +59,11 @@ class TWSClient
 
 		void reqMktData( int tickerId, const Contract &contract, const std::string &genericTickList, bool snapshot );
 		void cancelMktData( int tickerId );
+		void reqMktDepth( int tickerId, const Contract &contract, int numRows );
+		void cancelMktDepth( int tickerId );
+		void reqRealTimeBars( int tickerId, const Contract &contract,
+			const std::string &whatToShow, bool useRTH );
+		void cancelRealTimeBars( int tickerId );
 		void placeOrder( int id, const Contract &contract, const Order &order );
 		void cancelOrder( int id );
 		void reqOpenOrders();
@@ -74,8 +81,15 @@ class TWSClient
 		void reqCurrentTime();
 		void reqMarketDataType(int marketDataType);
 		void reqSecDefOptParams(int reqId, const Contract &c);
+#if TWSAPI_IB_VERSION_NUMBER >= 97200
+		bool asyncEConnect() const;
+		void startApi();
+#endif
 
 // 	private:
+		/* serializes socket access with the reader thread */
+		std::recursive_mutex &mutex;
+
 		EWrapper* myEWrapper;
 #if ! defined TWS_ORIG_CLIENT
 		EPosixClientSocket* ePosixClient;
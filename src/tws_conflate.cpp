@@ -0,0 +1,321 @@
+/*** tws_conflate.cpp -- conflated quote stream
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_conflate.h"
+#include "tws_quote.h"
+#include "debug.h"
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined HAVE_SYS_UN_H
+# include <unistd.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+#if ! defined MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+/* unsent bytes for a slow socket reader before we drop batches */
+#define MAX_BACKLOG (4 << 20)
+
+
+Conflator::Conflator( int i, int l ) :
+	interval(i),
+	latency(l),
+	board(NULL),
+	conIds(*(new std::vector<long>())),
+	nCols(0),
+	cells(*(new std::vector<Cell>())),
+	dirtyRows(*(new std::vector<int>())),
+	rowDirty(*(new std::vector<char>())),
+	batch(*(new std::vector<TwsQuoteUpdate>())),
+	lastFlush(0),
+	due(0),
+	file(NULL),
+	fd(-1),
+	out(*(new std::string())),
+	outPos(0),
+	cb(NULL),
+	cbClo(NULL),
+	cntTicks(0),
+	cntEmitted(0),
+	cntSuppressed(0),
+	cntBatches(0),
+	cntEarly(0),
+	cntDropped(0),
+	maxBatch(0)
+{
+	assert( interval > 0 );
+}
+
+Conflator::~Conflator()
+{
+	if( file != NULL && file != stdout ) {
+		fclose( file );
+	}
+#if defined HAVE_SYS_UN_H
+	if( fd >= 0 ) {
+		close( fd );
+	}
+#endif
+	delete &out;
+	delete &batch;
+	delete &rowDirty;
+	delete &dirtyRows;
+	delete &cells;
+	delete &conIds;
+}
+
+/* append to a file, "-" means stdout */
+bool Conflator::openFile( const char *path )
+{
+	if( strcmp(path, "-") == 0 ) {
+		file = stdout;
+		return true;
+	}
+	file = fopen( path, "a" );
+	if( file == NULL ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), path );
+		return false;
+	}
+	return true;
+}
+
+#if defined HAVE_SYS_UN_H
+
+/* connect to a listening consumer */
+bool Conflator::openUnix( const char *path )
+{
+	struct sockaddr_un addr;
+	if( strlen(path) >= sizeof(addr.sun_path) ) {
+		fprintf( stderr, "error, socket path too long: '%s'\n", path );
+		return false;
+	}
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+
+	fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), path );
+		if( fd >= 0 ) {
+			close( fd );
+			fd = -1;
+		}
+		return false;
+	}
+	return true;
+}
+
+/* write as much of the backlog as the socket takes without blocking */
+bool Conflator::send()
+{
+	while( fd >= 0 && outPos < out.size() ) {
+		ssize_t n = ::send( fd, out.data() + outPos, out.size() - outPos,
+			MSG_DONTWAIT | MSG_NOSIGNAL );
+		if( n < 0 ) {
+			if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+				break;
+			} else if( errno == EINTR ) {
+				continue;
+			}
+			ERROR_PRINTF( "conflated quotes consumer lost: %s",
+				strerror(errno) );
+			close( fd );
+			fd = -1;
+			out.clear();
+			outPos = 0;
+			return false;
+		}
+		outPos += n;
+	}
+	if( outPos == out.size() ) {
+		out.clear();
+		outPos = 0;
+	} else if( outPos > out.size() / 2 ) {
+		out.erase( 0, outPos );
+		outPos = 0;
+	}
+	return true;
+}
+
+#else
+
+bool Conflator::openUnix( const char *path )
+{
+	fprintf( stderr, "error, no unix domain sockets for '%s'\n", path );
+	return false;
+}
+
+bool Conflator::send()
+{
+	return false;
+}
+
+#endif /* HAVE_SYS_UN_H */
+
+void Conflator::setCallback( conflate_cb f, void *clo )
+{
+	cb = f;
+	cbClo = clo;
+}
+
+void Conflator::init( const QuoteBoard &b, const std::vector<long> &c )
+{
+	board = &b;
+	conIds = c;
+	nCols = b.cols();
+	/* row 0 is unused like in QuoteBoard */
+	const size_t rows = conIds.size() + 1;
+	Cell empty = { 0.0, 0, false };
+	cells.assign( rows * nCols, empty );
+	rowDirty.assign( rows, 0 );
+	dirtyRows.clear();
+	dirtyRows.reserve( rows );
+	batch.reserve( rows * nCols );
+}
+
+bool Conflator::update( int tickerId, int tickType, double val,
+	int64_t stamp )
+{
+	cntTicks++;
+	int c = board->col( tickType );
+	if( tickerId < 1 || tickerId > (int)conIds.size() || c < 0 ) {
+		return false;
+	}
+
+	Cell &x = cells[(size_t)tickerId * nCols + c];
+	if( x.dirty ) {
+		cntSuppressed++;
+	}
+	x.val = val;
+	x.stamp = stamp;
+	x.dirty = true;
+	if( rowDirty[tickerId] ) {
+		return false;
+	}
+	rowDirty[tickerId] = 1;
+	dirtyRows.push_back( tickerId );
+	if( dirtyRows.size() > 1 ) {
+		return false;
+	}
+
+	/* first change since the last batch */
+	due = lastFlush + interval;
+	if( latency > 0 ) {
+		due = std::min( due, stamp / 1000 + latency );
+	}
+	return true;
+}
+
+/* true if there is anything to send */
+bool Conflator::pending() const
+{
+	return !dirtyRows.empty() || outPos < out.size();
+}
+
+/* time in msecs when flush() should be called if pending() */
+int64_t Conflator::deadline() const
+{
+	return due;
+}
+
+void Conflator::flush( int64_t now )
+{
+	batch.clear();
+	for( size_t i = 0; i < dirtyRows.size(); i++ ) {
+		const int row = dirtyRows[i];
+		Cell *x = &cells[(size_t)row * nCols];
+		for( int c = 0; c < nCols; c++ ) {
+			if( !x[c].dirty ) {
+				continue;
+			}
+			TwsQuoteUpdate u;
+			u.stamp = x[c].stamp;
+			u.tickerId = row;
+			u.conId = conIds[row - 1];
+			u.tickType = board->tickType( c );
+			u.reserved = 0;
+			u.value = x[c].val;
+			batch.push_back( u );
+			x[c].dirty = false;
+		}
+		rowDirty[row] = 0;
+	}
+	dirtyRows.clear();
+
+	if( !batch.empty() ) {
+		cntBatches++;
+		cntEmitted += batch.size();
+		maxBatch = std::max( maxBatch, batch.size() );
+		if( now < lastFlush + interval ) {
+			cntEarly++;
+		}
+		lastFlush = now;
+		write();
+	} else {
+		send();
+	}
+	/* retry a socket backlog */
+	due = now + interval;
+}
+
+void Conflator::write()
+{
+	if( cb != NULL ) {
+		cb( cbClo, batch.data(), batch.size() );
+		return;
+	}
+	if( fd >= 0 ) {
+		send();
+	}
+	if( (fd < 0 && file == NULL) || out.size() - outPos > MAX_BACKLOG ) {
+		/* lost or too slow socket reader */
+		cntDropped++;
+		return;
+	}
+
+	char line[128];
+	for( size_t i = 0; i < batch.size(); i++ ) {
+		const TwsQuoteUpdate &u = batch[i];
+		int n = snprintf( line, sizeof(line), "%ld.%06ld\t%d\t%d\t%d\t%.10g\n",
+			(long)(u.stamp / 1000000), (long)(u.stamp % 1000000), u.tickerId,
+			u.conId, u.tickType, u.value );
+		out.append( line, n );
+	}
+	out += '\n';
+
+	if( fd >= 0 ) {
+		send();
+	} else if( file != NULL ) {
+		if( fwrite(out.data(), 1, out.size(), file) != out.size()
+		    || fflush(file) != 0 ) {
+			ERROR_PRINTF( "writing conflated quotes failed: %s",
+				strerror(errno) );
+		}
+		out.clear();
+	}
+}
+
+void Conflator::dumpStats() const
+{
+	const double n = cntTicks > 0 ? cntTicks / 100.0 : 1.0;
+	INFO_PRINTF( "conflator: %dms interval, %dms latency, %ld ticks, "
+		"%ld emitted (%.1f%%) in %ld batches (%ld early, max %zu), "
+		"%ld suppressed (%.1f%%), %ld batches dropped", interval, latency,
+		cntTicks, cntEmitted, cntEmitted / n, cntBatches, cntEarly, maxBatch,
+		cntSuppressed, cntSuppressed / n, cntDropped );
+}
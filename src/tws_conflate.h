@@ -0,0 +1,109 @@
+/*** tws_conflate.h -- conflated quote stream
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_CONFLATE_H
+#define TWS_CONFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class QuoteBoard;
+
+
+/* one changed field of a conflated batch, see dso_magic.h */
+struct TwsQuoteUpdate
+{
+	/* receive time of the last tick in usecs since epoch */
+	int64_t stamp;
+	int32_t tickerId;
+	int32_t conId;
+	int32_t tickType;
+	int32_t reserved;
+	double value;
+};
+
+typedef void (*conflate_cb)( void *clo, const TwsQuoteUpdate*, size_t n );
+
+
+/**
+ * Keep only the last value per tickerId and tick type and pass the changed
+ * ones on in batches, at most one per interval. A batch is sent earlier if
+ * the oldest change waits longer than the latency budget. The sink is a
+ * file, a unix domain socket or a callback. Batches for slow sockets are
+ * buffered up to a limit, then dropped as a whole.
+ */
+class Conflator
+{
+	public:
+		Conflator( int intervalMsecs, int latencyMsecs );
+		~Conflator();
+
+		/* sinks, text lines "sec.usec tickerId conId tickType value" and
+		   an empty line after each batch */
+		bool openFile( const char *path );
+		bool openUnix( const char *path );
+		void setCallback( conflate_cb, void *clo );
+
+		/* conIds of all tickerIds, starting with tickerId 1 */
+		void init( const QuoteBoard&, const std::vector<long> &conIds );
+		/* return true if deadline() changed */
+		bool update( int tickerId, int tickType, double val, int64_t stamp );
+		bool pending() const;
+		int64_t deadline() const;
+		void flush( int64_t now );
+
+		void dumpStats() const;
+
+	private:
+		Conflator( const Conflator& );
+		Conflator& operator=( const Conflator& );
+
+		struct Cell
+		{
+			double val;
+			int64_t stamp;
+			bool dirty;
+		};
+
+		void write();
+		bool send();
+
+		const int interval;
+		const int latency;
+		const QuoteBoard *board;
+		std::vector<long> &conIds;
+		int nCols;
+		std::vector<Cell> &cells;
+		/* dirty tickerIds by time of their first change */
+		std::vector<int> &dirtyRows;
+		std::vector<char> &rowDirty;
+		std::vector<TwsQuoteUpdate> &batch;
+		int64_t lastFlush;
+		int64_t due;
+
+		FILE *file;
+		int fd;
+		std::string &out;
+		size_t outPos;
+		conflate_cb cb;
+		void *cbClo;
+
+		/* statistics */
+		long cntTicks;
+		long cntEmitted;
+		long cntSuppressed;
+		long cntBatches;
+		long cntEarly;
+		long cntDropped;
+		size_t maxBatch;
+};
+
+#endif
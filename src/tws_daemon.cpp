@@ -0,0 +1,460 @@
+/*** tws_daemon.cpp -- accept twsxml jobs on a unix domain socket
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_daemon.h"
+#include "tws_xml.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined HAVE_SYS_UN_H
+# include <fcntl.h>
+# include <poll.h>
+# include <unistd.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
+#endif
+
+#if ! defined MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#define READ_CHUNK 4096
+
+
+struct TwsDaemonClient
+{
+	int id;
+	int fd;
+	std::string in;
+	/* job received completely, we don't read anymore */
+	bool eof;
+	/* results pushed by the job thread, protected by TwsDaemon::mutex */
+	std::deque<xmlDocPtr> docs;
+	/* formatted results not written yet */
+	std::string out;
+	size_t outPos;
+	/* close after everything is written, protected by TwsDaemon::mutex */
+	bool finished;
+};
+
+
+TwsDaemon::TwsDaemon( void (*f)(void*), void *clo ) :
+	listenFd(-1),
+	thread(NULL),
+	running(false),
+	notify(f),
+	notify_clo(clo),
+	clients(*(new std::map<int, TwsDaemonClient*>())),
+	jobs(*(new std::deque<TwsJob>())),
+	controls(*(new std::deque<std::string>())),
+	nControls(0),
+	nextId(1),
+	active(-1),
+	activeSince(0),
+	cntClients(0),
+	cntJobs(0),
+	cntControls(0),
+	cntDocs(0),
+	cntDropped(0),
+	maxJobs(0),
+	sumQueuedMsecs(0),
+	sumJobMsecs(0)
+{
+	pipeFd[0] = pipeFd[1] = -1;
+}
+
+TwsDaemon::~TwsDaemon()
+{
+	stop();
+	delete &controls;
+	delete &jobs;
+	delete &clients;
+}
+
+
+#if defined HAVE_SYS_UN_H
+
+static bool set_nonblock( int fd )
+{
+	int flags = fcntl( fd, F_GETFL, 0 );
+	return flags >= 0 && fcntl( fd, F_SETFL, flags | O_NONBLOCK ) == 0;
+}
+
+/* create the socket, only the owner may connect */
+bool TwsDaemon::listen( const char *p )
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if( strlen(p) >= sizeof(addr.sun_path) ) {
+		fprintf( stderr, "error, socket path too long: '%s'\n", p );
+		return false;
+	}
+	/* remove a stale socket left by a killed daemon */
+	if( lstat(p, &st) == 0 && S_ISSOCK(st.st_mode) ) {
+		unlink( p );
+	}
+
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, p );
+
+	listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( listenFd < 0
+	    || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+	    || chmod(p, S_IRUSR | S_IWUSR) != 0
+	    || ::listen(listenFd, 16) != 0
+	    || !set_nonblock(listenFd)
+	    || pipe(pipeFd) != 0
+	    || !set_nonblock(pipeFd[0]) || !set_nonblock(pipeFd[1]) ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), p );
+		return false;
+	}
+	path = p;
+	INFO_PRINTF( "daemon listening on '%s'", p );
+	return true;
+}
+
+void TwsDaemon::start()
+{
+	assert( thread == NULL && listenFd >= 0 );
+	running = true;
+	thread = new std::thread( &TwsDaemon::run, this );
+}
+
+void TwsDaemon::stop()
+{
+	if( thread != NULL ) {
+		running = false;
+		wakeup();
+		thread->join();
+		delete thread;
+		thread = NULL;
+	}
+	while( !clients.empty() ) {
+		closeClient( clients.begin()->first );
+	}
+	if( listenFd >= 0 ) {
+		close( listenFd );
+		unlink( path.c_str() );
+		listenFd = -1;
+	}
+	for( int i = 0; i < 2; i++ ) {
+		if( pipeFd[i] >= 0 ) {
+			close( pipeFd[i] );
+			pipeFd[i] = -1;
+		}
+	}
+}
+
+/* interrupt poll() in the daemon thread */
+void TwsDaemon::wakeup()
+{
+	if( pipeFd[1] >= 0 && write(pipeFd[1], "", 1) < 0 ) {
+		/* pipe full, the daemon thread wakes up anyway */
+	}
+}
+
+void TwsDaemon::acceptClient()
+{
+	int fd;
+	while( (fd = accept(listenFd, NULL, NULL)) >= 0 ) {
+		if( !set_nonblock(fd) ) {
+			close( fd );
+			continue;
+		}
+		TwsDaemonClient *c = new TwsDaemonClient();
+		c->fd = fd;
+		c->eof = false;
+		c->outPos = 0;
+		c->finished = false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		c->id = nextId++;
+		clients[c->id] = c;
+		cntClients++;
+	}
+}
+
+/* the daemon thread is the only one changing the clients map */
+void TwsDaemon::closeClient( int id )
+{
+	TwsDaemonClient *c;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<int, TwsDaemonClient*>::iterator it = clients.find(id);
+		assert( it != clients.end() );
+		c = it->second;
+		clients.erase( it );
+		for( size_t i = 0; i < c->docs.size(); i++ ) {
+			xmlFreeDoc( c->docs[i] );
+			cntDropped++;
+		}
+	}
+	close( c->fd );
+	delete c;
+}
+
+/* read the job until eof, return false on errors */
+bool TwsDaemon::readClient( TwsDaemonClient *c )
+{
+	char buf[READ_CHUNK];
+	ssize_t n;
+	while( (n = read(c->fd, buf, sizeof(buf))) > 0 ) {
+		c->in.append( buf, n );
+	}
+	if( n < 0 ) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+
+	c->eof = true;
+	/* anything but a twsxml document is a control command */
+	size_t i = c->in.find_first_not_of( " \t\r\n" );
+	if( i != std::string::npos && c->in[i] != '<' ) {
+		std::lock_guard<std::mutex> lock(mutex);
+		controls.push_back( c->in.substr(i) );
+		nControls++;
+		cntControls++;
+		c->in.clear();
+		c->finished = true;
+		notify( notify_clo );
+		return true;
+	}
+	TwsJob job;
+	job.client = c->id;
+	job.received = nowInMsecs();
+	job.xml.swap( c->in );
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back( job );
+		maxJobs = std::max( maxJobs, jobs.size() );
+	}
+	notify( notify_clo );
+	return true;
+}
+
+/* format the pushed results and write as much as possible */
+bool TwsDaemon::writeClient( TwsDaemonClient *c )
+{
+	std::deque<xmlDocPtr> docs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		docs.swap( c->docs );
+	}
+	for( size_t i = 0; i < docs.size(); i++ ) {
+		xmlChar *mem;
+		int size;
+		xmlDocDumpFormatMemory( docs[i], &mem, &size, 1 );
+		c->out.append( (const char*)mem, size );
+		//HACK print form feed as xml file separator
+		c->out.append( 1, '\f' );
+		xmlFree( mem );
+		xmlFreeDoc( docs[i] );
+	}
+
+	while( c->outPos < c->out.size() ) {
+		ssize_t n = send( c->fd, c->out.data() + c->outPos,
+			c->out.size() - c->outPos, MSG_NOSIGNAL );
+		if( n < 0 ) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		c->outPos += n;
+	}
+	c->out.clear();
+	c->outPos = 0;
+	return true;
+}
+
+void TwsDaemon::run()
+{
+	std::vector<struct pollfd> pfds;
+	std::vector<int> ids;
+	while( running ) {
+		pfds.clear();
+		ids.clear();
+		struct pollfd p = { pipeFd[0], POLLIN, 0 };
+		pfds.push_back( p );
+		p.fd = listenFd;
+		pfds.push_back( p );
+
+		std::vector<int> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for( std::map<int, TwsDaemonClient*>::const_iterator it
+				    = clients.begin(); it != clients.end(); it++ ) {
+				const TwsDaemonClient *c = it->second;
+				bool pending = !c->docs.empty() || c->outPos < c->out.size();
+				if( c->finished && !pending ) {
+					done.push_back( it->first );
+					continue;
+				}
+				p.fd = c->fd;
+				p.events = (c->eof ? 0 : POLLIN) | (pending ? POLLOUT : 0);
+				pfds.push_back( p );
+				ids.push_back( it->first );
+			}
+		}
+		for( size_t i = 0; i < done.size(); i++ ) {
+			closeClient( done[i] );
+		}
+
+		if( poll(&pfds[0], pfds.size(), -1) < 0 ) {
+			if( errno != EINTR ) {
+				ERROR_PRINTF( "daemon poll failed: %s", strerror(errno) );
+			}
+			continue;
+		}
+
+		char buf[64];
+		while( read(pipeFd[0], buf, sizeof(buf)) > 0 ) {
+		}
+		if( pfds[1].revents & POLLIN ) {
+			acceptClient();
+		}
+
+		for( size_t i = 0; i < ids.size(); i++ ) {
+			const short ev = pfds[i + 2].revents;
+			TwsDaemonClient *c = clients.find(ids[i])->second;
+			bool ok = true;
+			if( ev & POLLIN ) {
+				ok = readClient( c );
+			}
+			if( ok && (ev & POLLOUT) ) {
+				ok = writeClient( c );
+			}
+			/* hangup after eof means nobody is reading the results */
+			if( !ok || (ev & (POLLERR | POLLNVAL))
+			    || ((ev & POLLHUP) && c->eof) ) {
+				closeClient( ids[i] );
+			}
+		}
+	}
+}
+
+#else
+
+bool TwsDaemon::listen( const char *p )
+{
+	fprintf( stderr, "error, no unix domain sockets for '%s'\n", p );
+	return false;
+}
+
+void TwsDaemon::start()
+{
+	assert( false );
+}
+
+void TwsDaemon::stop()
+{
+}
+
+void TwsDaemon::wakeup()
+{
+}
+
+#endif /* HAVE_SYS_UN_H */
+
+
+bool TwsDaemon::popJob( TwsJob *job )
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if( jobs.empty() ) {
+		return false;
+	}
+	*job = jobs.front();
+	jobs.pop_front();
+	sumQueuedMsecs += nowInMsecs() - job->received;
+	return true;
+}
+
+/* the next control command like "reload", the client is gone already */
+bool TwsDaemon::popControl( std::string *cmd )
+{
+	if( nControls.load(std::memory_order_relaxed) == 0 ) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	cmd->swap( controls.front() );
+	controls.pop_front();
+	nControls--;
+	return true;
+}
+
+/* route all results to the client of this job until finish() */
+void TwsDaemon::activate( const TwsJob &job )
+{
+	assert( active < 0 );
+	active = job.client;
+	activeSince = nowInMsecs();
+	INFO_PRINTF( "daemon job of client %d started, %zu bytes, queued %ldms",
+		active, job.xml.size(), (long)(activeSince - job.received) );
+}
+
+void TwsDaemon::finish()
+{
+	if( active < 0 ) {
+		return;
+	}
+	int64_t msecs = nowInMsecs() - activeSince;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<int, TwsDaemonClient*>::iterator it = clients.find(active);
+		if( it != clients.end() ) {
+			it->second->finished = true;
+		}
+		cntJobs++;
+		sumJobMsecs += msecs;
+	}
+	INFO_PRINTF( "daemon job of client %d done in %ldms", active,
+		(long)msecs );
+	active = -1;
+	wakeup();
+}
+
+/* take over a result document, results without active job go to stdout */
+void TwsDaemon::push( xmlDocPtr doc )
+{
+	if( active < 0 ) {
+		TwsXml::dumpDoc( doc );
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<int, TwsDaemonClient*>::iterator it = clients.find(active);
+		if( it == clients.end() ) {
+			/* client went away, finish the job anyway */
+			xmlFreeDoc( doc );
+			cntDropped++;
+			return;
+		}
+		it->second->docs.push_back( doc );
+		cntDocs++;
+	}
+	wakeup();
+}
+
+void TwsDaemon::dumpStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	INFO_PRINTF( "daemon: %ld clients, %ld jobs, %ld controls, "
+		"max queued %zu, avg queued %.3fms, avg job %.3fms, %ld docs, "
+		"dropped %ld", cntClients, cntJobs, cntControls, maxJobs,
+		cntJobs > 0 ? (double)sumQueuedMsecs / cntJobs : 0.0,
+		cntJobs > 0 ? (double)sumJobMsecs / cntJobs : 0.0,
+		cntDocs, cntDropped );
+}
@@ -0,0 +1,100 @@
+/*** tws_daemon.h -- accept twsxml jobs on a unix domain socket
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_DAEMON_H
+#define TWS_DAEMON_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <libxml/tree.h>
+
+struct TwsDaemonClient;
+
+
+/* a complete job document received from one client */
+struct TwsJob
+{
+	int client;
+	std::string xml;
+	int64_t received;
+};
+
+
+/**
+ * Thread serving a unix domain socket. Each client writes one twsxml job
+ * like a JOB_FILE and shuts down its writing side. The job thread pops
+ * jobs one after another, the results are streamed back to the client
+ * which sent the job and its connection is closed when the job is done.
+ * A client writing plain text instead sends a control command, it's
+ * handled right away and the connection is closed.
+ */
+class TwsDaemon
+{
+	public:
+		TwsDaemon( void (*notify)(void*), void *clo );
+		~TwsDaemon();
+
+		bool listen( const char *path );
+		void start();
+		void stop();
+
+		/* job thread */
+		bool popJob( TwsJob* );
+		bool popControl( std::string* );
+		void activate( const TwsJob& );
+		void finish();
+		void push( xmlDocPtr );
+		void dumpStats() const;
+
+	private:
+		void run();
+		void acceptClient();
+		bool readClient( TwsDaemonClient* );
+		bool writeClient( TwsDaemonClient* );
+		void closeClient( int id );
+		void wakeup();
+
+		std::string path;
+		int listenFd;
+		int pipeFd[2];
+		std::thread *thread;
+		std::atomic<bool> running;
+
+		/* called from the daemon thread when a job was queued */
+		void (*notify)(void*);
+		void *notify_clo;
+
+		mutable std::mutex mutex;
+		std::map<int, TwsDaemonClient*> &clients;
+		std::deque<TwsJob> &jobs;
+		std::deque<std::string> &controls;
+		std::atomic<int> nControls;
+		int nextId;
+
+		/* job thread only */
+		int active;
+		int64_t activeSince;
+
+		/* statistics, protected by mutex */
+		long cntClients;
+		long cntJobs;
+		long cntControls;
+		long cntDocs;
+		long cntDropped;
+		size_t maxJobs;
+		int64_t sumQueuedMsecs;
+		int64_t sumJobMsecs;
+};
+
+#endif
@@ -0,0 +1,289 @@
+/*** tws_gateway.cpp -- priority order gateway
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_gateway.h"
+#include "tws_meta.h"
+#include "tws_query.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <algorithm>
+
+
+OrderGateway::OrderGateway( int slots ) :
+	nSlots(slots),
+	nActive(0),
+	table(*(new std::vector<Slot>())),
+	queue(*(new std::vector<int>(slots, -1))),
+	qHead(0),
+	qSize(0),
+	cancels(*(new std::vector<int>(slots, -1))),
+	cHead(0),
+	cSize(0),
+	cntOrders(0),
+	cntModified(0),
+	cntCancels(0),
+	cntCoalesced(0),
+	cntDropped(0),
+	maxQueued(0),
+	cntDeferred(0),
+	cntFinished(0),
+	cntLatency(0),
+	sumLatency(0),
+	maxLatency(0)
+{
+	assert( slots > 0 );
+	Slot empty = { 0, NULL, false, false, false, false, 0 };
+	table.assign( nSlots, empty );
+	for( int i = 0; i < nSlots; i++ ) {
+		table[i].packet = new PacketPlaceOrder();
+	}
+}
+
+OrderGateway::~OrderGateway()
+{
+	for( int i = 0; i < nSlots; i++ ) {
+		delete table[i].packet;
+	}
+	delete &cancels;
+	delete &queue;
+	delete &table;
+}
+
+int OrderGateway::slots() const
+{
+	return nSlots;
+}
+
+int OrderGateway::active() const
+{
+	return nActive;
+}
+
+int OrderGateway::slot( long orderId ) const
+{
+	return orderId % nSlots;
+}
+
+bool OrderGateway::canOpen( long orderId ) const
+{
+	return orderId > 0 && !table[slot(orderId)].active;
+}
+
+PacketPlaceOrder* OrderGateway::open( long orderId, const PlaceOrder &pO )
+{
+	if( !canOpen(orderId) ) {
+		return NULL;
+	}
+	Slot &s = table[slot(orderId)];
+	assert( !s.queued );
+	s.packet->recycle();
+	s.packet->record( orderId, pO );
+	s.orderId = orderId;
+	s.active = true;
+	nActive++;
+	cntOrders++;
+	return s.packet;
+}
+
+PacketPlaceOrder* OrderGateway::find( long orderId ) const
+{
+	if( orderId <= 0 ) {
+		return NULL;
+	}
+	const Slot &s = table[slot(orderId)];
+	if( s.orderId != orderId ) {
+		return NULL;
+	}
+	return s.packet;
+}
+
+bool OrderGateway::modify( long orderId, const PlaceOrder &pO )
+{
+	if( !isActive(orderId) ) {
+		return false;
+	}
+	Slot &s = table[slot(orderId)];
+	if( s.queued && s.cancel ) {
+		cntDropped++;
+		return false;
+	}
+	s.packet->modify( pO );
+	cntModified++;
+	return true;
+}
+
+bool OrderGateway::isActive( long orderId ) const
+{
+	if( orderId <= 0 ) {
+		return false;
+	}
+	const Slot &s = table[slot(orderId)];
+	return s.orderId == orderId && s.active;
+}
+
+void OrderGateway::enqueue( std::vector<int> &ring, int *head, int *size,
+	int i )
+{
+	assert( *size < nSlots );
+	ring[(*head + *size) % nSlots] = i;
+	(*size)++;
+	maxQueued = std::max( maxQueued, qSize + cSize );
+}
+
+/* remove slot i from the ring, the ones behind it move up */
+void OrderGateway::unqueue( std::vector<int> &ring, int head, int *size,
+	int i )
+{
+	int k = 0;
+	while( k < *size && ring[(head + k) % nSlots] != i ) {
+		k++;
+	}
+	assert( k < *size );
+	for( ; k + 1 < *size; k++ ) {
+		ring[(head + k) % nSlots] = ring[(head + k + 1) % nSlots];
+	}
+	(*size)--;
+}
+
+void OrderGateway::push( long orderId, bool cancel, int64_t trigger )
+{
+	assert( isActive(orderId) );
+	const int i = slot( orderId );
+	Slot &s = table[i];
+	if( cancel ) {
+		cntCancels++;
+	}
+	/* a queued order is sent once, as modified or cancelled by now */
+	if( s.queued ) {
+		if( cancel && !s.cancel ) {
+			/* the cancel jumps the queue, the modify is obsolete */
+			unqueue( queue, qHead, &qSize, i );
+			enqueue( cancels, &cHead, &cSize, i );
+			s.cancel = true;
+			cntDropped++;
+		} else if( !cancel && s.cancel ) {
+			cntDropped++;
+		} else {
+			cntCoalesced++;
+		}
+		return;
+	}
+	s.queued = true;
+	s.waited = false;
+	s.cancel = cancel;
+	s.trigger = trigger;
+	if( cancel ) {
+		enqueue( cancels, &cHead, &cSize, i );
+	} else {
+		enqueue( queue, &qHead, &qSize, i );
+	}
+}
+
+bool OrderGateway::pending() const
+{
+	return qSize > 0 || cSize > 0;
+}
+
+void OrderGateway::wait()
+{
+	for( int i = 0; i < cSize; i++ ) {
+		table[cancels[(cHead + i) % nSlots]].waited = true;
+	}
+	for( int i = 0; i < qSize; i++ ) {
+		table[queue[(qHead + i) % nSlots]].waited = true;
+	}
+}
+
+long OrderGateway::pop( bool *cancel )
+{
+	assert( pending() );
+	int i;
+	if( cSize > 0 ) {
+		i = cancels[cHead];
+		cHead = (cHead + 1) % nSlots;
+		cSize--;
+	} else {
+		i = queue[qHead];
+		qHead = (qHead + 1) % nSlots;
+		qSize--;
+	}
+	Slot &s = table[i];
+	s.queued = false;
+	*cancel = s.cancel;
+	return s.orderId;
+}
+
+void OrderGateway::sent( long orderId, int64_t now )
+{
+	const Slot &s = table[slot(orderId)];
+	assert( s.orderId == orderId );
+	const int64_t lat = now - s.trigger;
+	if( s.waited ) {
+		cntDeferred++;
+	}
+	cntLatency++;
+	sumLatency += lat;
+	maxLatency = std::max( maxLatency, lat );
+}
+
+int OrderGateway::collect( int64_t nowMsecs )
+{
+	int cnt = 0;
+	for( int i = 0; i < nSlots && nActive > 0; i++ ) {
+		Slot &s = table[i];
+		if( !s.active || s.queued ) {
+			continue;
+		}
+		PacketPlaceOrder *p = s.packet;
+		const PlaceOrder &r = p->getRequest();
+		if( !p->finished() ) {
+			/* close non transmit orders where we haven't received errors */
+			if( !r.order.transmit && (nowMsecs - r.time_sent) > 5000 ) {
+				p->closeError( REQ_ERR_NONE );
+			} else {
+				continue;
+			}
+		}
+		p->dumpXml();
+		INFO_PRINTF( "fin order, %ld %s, %ld", s.orderId,
+			r.contract.symbol.c_str(), r.contract.conId );
+		s.active = false;
+		nActive--;
+		cntFinished++;
+		cnt++;
+	}
+	return cnt;
+}
+
+void OrderGateway::closeAll( int err )
+{
+	for( int i = 0; i < nSlots; i++ ) {
+		Slot &s = table[i];
+		if( s.active && !s.packet->finished() ) {
+			s.packet->closeError( (req_err)err );
+		}
+		s.queued = false;
+	}
+	qHead = 0;
+	qSize = 0;
+	cHead = 0;
+	cSize = 0;
+}
+
+void OrderGateway::dumpStats() const
+{
+	INFO_PRINTF( "order gateway: %ld orders, %ld modified, %ld cancels, "
+		"%ld finished, %d active, %ld waited for rate limit, "
+		"%d queued (max %d), %ld coalesced, %ld dropped, "
+		"event to order latency avg %.1fus, max %ldus", cntOrders,
+		cntModified, cntCancels, cntFinished, nActive, cntDeferred,
+		qSize + cSize, maxQueued, cntCoalesced, cntDropped,
+		cntLatency > 0 ? (double)sumLatency / cntLatency : 0.0,
+		(long)maxLatency );
+}
@@ -0,0 +1,107 @@
+/*** tws_gateway.h -- priority order gateway
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_GATEWAY_H
+#define TWS_GATEWAY_H
+
+#include <stdint.h>
+#include <vector>
+
+class PacketPlaceOrder;
+class PlaceOrder;
+
+
+/**
+ * Track orders which are sent right away instead of waiting in the
+ * PlaceOrderTodo job queue. There is a fixed number of slots, each with a
+ * preallocated PacketPlaceOrder, an order uses slot orderId % slots. Finished
+ * orders stay in their slot until it's reused, so late callbacks still find
+ * them. Orders which could not be sent because of the rate limit wait in a
+ * FIFO of slots, cancels in a separate one which is sent first. A queued
+ * slot is sent once with its newest request, a cancel drops it.
+ */
+class OrderGateway
+{
+	public:
+		OrderGateway( int slots );
+		~OrderGateway();
+
+		int slots() const;
+		int active() const;
+
+		/* whether a new order may use orderId */
+		bool canOpen( long orderId ) const;
+		PacketPlaceOrder* open( long orderId, const PlaceOrder& );
+		/* false if it's not active or about to be cancelled */
+		bool modify( long orderId, const PlaceOrder& );
+		/* the active or finished order or NULL */
+		PacketPlaceOrder* find( long orderId ) const;
+		bool isActive( long orderId ) const;
+
+		/* send orderId as soon as possible, trigger is the receive time of
+		   the event which caused it in usecs */
+		void push( long orderId, bool cancel, int64_t trigger );
+		bool pending() const;
+		/* all pending orders wait for the rate limit */
+		void wait();
+		/* the next order to send, return its orderId */
+		long pop( bool *cancel );
+		void sent( long orderId, int64_t now );
+
+		/* dump finished orders, return how many */
+		int collect( int64_t nowMsecs );
+		/* close all active orders, e.g. when the connection is lost */
+		void closeAll( int err );
+
+		void dumpStats() const;
+
+	private:
+		OrderGateway( const OrderGateway& );
+		OrderGateway& operator=( const OrderGateway& );
+
+		struct Slot
+		{
+			long orderId;
+			PacketPlaceOrder *packet;
+			bool active;
+			bool queued;
+			bool waited;
+			bool cancel;
+			int64_t trigger;
+		};
+
+		int slot( long orderId ) const;
+		void enqueue( std::vector<int> &ring, int *head, int *size, int i );
+		void unqueue( std::vector<int> &ring, int head, int *size, int i );
+
+		const int nSlots;
+		int nActive;
+		std::vector<Slot> &table;
+		/* rings of queued slots */
+		std::vector<int> &queue;
+		int qHead;
+		int qSize;
+		std::vector<int> &cancels;
+		int cHead;
+		int cSize;
+
+		/* statistics */
+		long cntOrders;
+		long cntModified;
+		long cntCancels;
+		long cntCoalesced;
+		long cntDropped;
+		int maxQueued;
+		long cntDeferred;
+		long cntFinished;
+		long cntLatency;
+		int64_t sumLatency;
+		int64_t maxLatency;
+};
+
+#endif
@@ -0,0 +1,433 @@
+/*** tws_greeks.cpp -- option computations and chain snapshots
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_greeks.h"
+#include "tws_query.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <twsapi/twsapi_config.h>
+#include <twsapi/EWrapper.h> //TickType
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#if TWSAPI_IB_VERSION_NUMBER < 97200
+# define lastTradeDateOrContractMonth expiry
+#endif
+
+#define GREEKS_MAGIC "TWSGRKS"
+#define GREEKS_SNAP_MAGIC "TWSSNAP"
+#define GREEKS_BYTE_ORDER 0x01020304u
+#define GREEKS_VERSION 1
+
+#define GREEKS_COLS_ALL (GREEK_CALCS * GREEK_COLS)
+
+/* the file format must not depend on the compiler */
+static_assert( sizeof(GreeksFileHeader) == 32, "bad GreeksFileHeader size" );
+static_assert( sizeof(GreeksOption) == 48, "bad GreeksOption size" );
+static_assert( sizeof(GreeksSnapshot) == 24, "bad GreeksSnapshot size" );
+
+
+int tick_greek_calc( int tickType )
+{
+	switch( tickType ) {
+	case BID_OPTION_COMPUTATION:
+	case DELAYED_BID_OPTION_COMPUTATION:
+		return GREEK_CALC_BID;
+	case ASK_OPTION_COMPUTATION:
+	case DELAYED_ASK_OPTION_COMPUTATION:
+		return GREEK_CALC_ASK;
+	case LAST_OPTION_COMPUTATION:
+	case DELAYED_LAST_OPTION_COMPUTATION:
+		return GREEK_CALC_LAST;
+	case MODEL_OPTION:
+	case DELAYED_MODEL_OPTION_COMPUTATION:
+		return GREEK_CALC_MODEL;
+	}
+	return -1;
+}
+
+const char* greek_calc_str( int calc )
+{
+	switch( (greek_calc)calc ) {
+	case GREEK_CALC_BID:   return "bid";
+	case GREEK_CALC_ASK:   return "ask";
+	case GREEK_CALC_LAST:  return "last";
+	case GREEK_CALC_MODEL: return "model";
+	case GREEK_CALCS:      break;
+	}
+	return "unknown";
+}
+
+const char* greek_col_str( int col )
+{
+	switch( (greek_col)col ) {
+	case GREEK_IV:          return "impliedVol";
+	case GREEK_DELTA:       return "delta";
+	case GREEK_OPT_PRICE:   return "optPrice";
+	case GREEK_PV_DIVIDEND: return "pvDividend";
+	case GREEK_GAMMA:       return "gamma";
+	case GREEK_VEGA:        return "vega";
+	case GREEK_THETA:       return "theta";
+	case GREEK_UND_PRICE:   return "undPrice";
+	case GREEK_COLS:        break;
+	}
+	return "unknown";
+}
+
+static bool chain_less( const GreeksOption &a, const GreeksOption &b )
+{
+	int c = strcmp( a.symbol, b.symbol );
+	if( c == 0 ) {
+		c = strcmp( a.expiry, b.expiry );
+	}
+	if( c != 0 ) {
+		return c < 0;
+	} else if( a.strike != b.strike ) {
+		return a.strike < b.strike;
+	}
+	c = strcmp( a.right, b.right );
+	return c != 0 ? c < 0 : a.tickerId < b.tickerId;
+}
+
+static void copy_str( char *dst, size_t n, const std::string &src )
+{
+	strncpy( dst, src.c_str(), n - 1 );
+	dst[n - 1] = '\0';
+}
+
+
+
+
+OptionGreeks::OptionGreeks() :
+	nRows(0),
+	options(*(new std::vector<GreeksOption>())),
+	rowOfTicker(*(new std::vector<int>())),
+	vals(*(new std::vector<double>())),
+	stamps_(*(new std::vector<int64_t>())),
+	file(NULL),
+	cntSet(0),
+	cntDropped(0),
+	cntSnapshots(0),
+	writeUsecs(0)
+{
+}
+
+OptionGreeks::~OptionGreeks()
+{
+	if( file != NULL ) {
+		fclose( file );
+	}
+	delete &stamps_;
+	delete &vals;
+	delete &rowOfTicker;
+	delete &options;
+}
+
+/* one row per option or future option, tickerIds start with 1 */
+void OptionGreeks::init( const std::vector<MktDataRequest> &v )
+{
+	options.clear();
+	for( size_t i = 0; i < v.size(); i++ ) {
+		const Contract &c = v[i].ibContract;
+		if( c.secType != "OPT" && c.secType != "FOP" ) {
+			continue;
+		}
+		GreeksOption o;
+		memset( &o, 0, sizeof(o) );
+		o.tickerId = i + 1;
+		o.conId = c.conId;
+		o.strike = c.strike;
+		copy_str( o.symbol, sizeof(o.symbol), c.symbol );
+		copy_str( o.expiry, sizeof(o.expiry), c.lastTradeDateOrContractMonth );
+		copy_str( o.right, sizeof(o.right), c.right );
+		options.push_back( o );
+	}
+	std::sort( options.begin(), options.end(), chain_less );
+
+	nRows = options.size();
+	rowOfTicker.assign( v.size() + 1, -1 );
+	for( int r = 0; r < nRows; r++ ) {
+		rowOfTicker[options[r].tickerId] = r;
+	}
+	vals.assign( (size_t)GREEKS_COLS_ALL * nRows, 0.0 );
+	stamps_.assign( (size_t)GREEK_CALCS * nRows, 0 );
+}
+
+int OptionGreeks::size() const
+{
+	return nRows;
+}
+
+int OptionGreeks::row( int tickerId ) const
+{
+	if( tickerId < 0 || tickerId >= (int)rowOfTicker.size() ) {
+		return -1;
+	}
+	return rowOfTicker[tickerId];
+}
+
+const GreeksOption& OptionGreeks::option( int r ) const
+{
+	assert( r >= 0 && r < nRows );
+	return options[r];
+}
+
+bool OptionGreeks::set( int tickerId, int tickType, const double *v,
+	int64_t stamp )
+{
+	const int r = row( tickerId );
+	const int calc = tick_greek_calc( tickType );
+	if( r < 0 || calc < 0 ) {
+		cntDropped++;
+		return false;
+	}
+	double *col = &vals[(size_t)calc * GREEK_COLS * nRows + r];
+	for( int g = 0; g < GREEK_COLS; g++ ) {
+		col[(size_t)g * nRows] = v[g];
+	}
+	stamps_[(size_t)calc * nRows + r] = stamp;
+	cntSet++;
+	return true;
+}
+
+const double* OptionGreeks::column( int calc, int col ) const
+{
+	assert( calc >= 0 && calc < GREEK_CALCS && col >= 0 && col < GREEK_COLS );
+	return vals.data() + ((size_t)calc * GREEK_COLS + col) * nRows;
+}
+
+const int64_t* OptionGreeks::stamps( int calc ) const
+{
+	assert( calc >= 0 && calc < GREEK_CALCS );
+	return stamps_.data() + (size_t)calc * nRows;
+}
+
+/* append to path, the option table is written right now */
+bool OptionGreeks::openFile( const char *path )
+{
+	file = fopen( path, "ab" );
+	if( file == NULL ) {
+		ERROR_PRINTF( "opening greeks file failed: %s: '%s'",
+			strerror(errno), path );
+		return false;
+	}
+
+	GreeksFileHeader h;
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, GREEKS_MAGIC, sizeof(GREEKS_MAGIC) );
+	h.byteOrder = GREEKS_BYTE_ORDER;
+	h.version = GREEKS_VERSION;
+	h.optionSize = sizeof(GreeksOption);
+	h.created = nowInUsecs();
+	h.nOptions = nRows;
+	if( fwrite(&h, sizeof(h), 1, file) != 1
+	    || fwrite(options.data(), sizeof(GreeksOption), nRows, file)
+	       != (size_t)nRows || fflush(file) != 0 ) {
+		ERROR_PRINTF( "writing greeks file failed: %s: '%s'",
+			strerror(errno), path );
+		fclose( file );
+		file = NULL;
+		return false;
+	}
+	INFO_PRINTF( "writing snapshots of %d options to '%s'", nRows, path );
+	return true;
+}
+
+/* write all columns as they are */
+bool OptionGreeks::snapshot( int64_t now )
+{
+	if( file == NULL ) {
+		return false;
+	}
+	int64_t t = nowInUsecs();
+	GreeksSnapshot s;
+	memset( &s, 0, sizeof(s) );
+	memcpy( s.magic, GREEKS_SNAP_MAGIC, sizeof(GREEKS_SNAP_MAGIC) );
+	s.stamp = now;
+	s.nOptions = nRows;
+	s.nCols = GREEKS_COLS_ALL;
+	if( fwrite(&s, sizeof(s), 1, file) != 1
+	    || fwrite(vals.data(), sizeof(double), vals.size(), file)
+	       != vals.size()
+	    || fwrite(stamps_.data(), sizeof(int64_t), stamps_.size(), file)
+	       != stamps_.size()
+	    || fflush(file) != 0 ) {
+		ERROR_PRINTF( "writing greeks snapshot failed: %s",
+			strerror(errno) );
+		fclose( file );
+		file = NULL;
+		return false;
+	}
+	cntSnapshots++;
+	writeUsecs += nowInUsecs() - t;
+	return true;
+}
+
+void OptionGreeks::dumpStats() const
+{
+	INFO_PRINTF( "option greeks: %d options, %ld computations, %ld dropped, "
+		"%ld snapshots %.3fms", nRows, cntSet, cntDropped, cntSnapshots,
+		writeUsecs / 1000.0 );
+}
+
+
+
+
+GreeksReader::GreeksReader() :
+	file(NULL),
+	name(NULL),
+	swap(false),
+	snapStamp(0)
+{
+}
+
+GreeksReader::~GreeksReader()
+{
+	if( file != NULL && file != stdin ) {
+		fclose( file );
+	}
+}
+
+/* open and check the first header, read stdin if filename is NULL */
+bool GreeksReader::openFile( const char *filename )
+{
+	name = filename != NULL ? filename : "(stdin)";
+	if( filename == NULL ) {
+		file = stdin;
+	} else if( (file = fopen(filename, "rb")) == NULL ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), name );
+		return false;
+	}
+
+	char magic[8];
+	if( fread(magic, sizeof(magic), 1, file) != 1
+	    || memcmp(magic, GREEKS_MAGIC, sizeof(GREEKS_MAGIC)) != 0 ) {
+		fprintf( stderr, "error, not a greeks file: '%s'\n", name );
+		return false;
+	}
+	return readHeader( magic );
+}
+
+/* the rest of a file header and its option table */
+bool GreeksReader::readHeader( const char *magic )
+{
+	GreeksFileHeader h;
+	memcpy( h.magic, magic, sizeof(h.magic) );
+	if( fread((char*)&h + sizeof(h.magic), sizeof(h) - sizeof(h.magic), 1,
+	    file) != 1 ) {
+		fprintf( stderr, "error, truncated greeks file: '%s'\n", name );
+		return false;
+	}
+	swap = h.byteOrder != GREEKS_BYTE_ORDER;
+	if( swap ) {
+		SWAP_FIELD( h.byteOrder );
+		SWAP_FIELD( h.version );
+		SWAP_FIELD( h.optionSize );
+		SWAP_FIELD( h.nOptions );
+	}
+	if( h.byteOrder != GREEKS_BYTE_ORDER || h.version != GREEKS_VERSION
+	    || h.optionSize != sizeof(GreeksOption) || h.nOptions < 0 ) {
+		fprintf( stderr, "error, unsupported greeks file version %d: '%s'\n",
+			h.version, name );
+		return false;
+	}
+
+	options.resize( h.nOptions );
+	if( fread(options.data(), sizeof(GreeksOption), h.nOptions, file)
+	    != (size_t)h.nOptions ) {
+		fprintf( stderr, "error, truncated greeks file: '%s'\n", name );
+		return false;
+	}
+	for( size_t i = 0; swap && i < options.size(); i++ ) {
+		SWAP_FIELD( options[i].tickerId );
+		SWAP_FIELD( options[i].conId );
+		SWAP_FIELD( options[i].strike );
+	}
+	vals.resize( (size_t)GREEKS_COLS_ALL * options.size() );
+	stamps_.resize( (size_t)GREEK_CALCS * options.size() );
+	return true;
+}
+
+bool GreeksReader::next()
+{
+	GreeksSnapshot s;
+	do {
+		if( fread(s.magic, sizeof(s.magic), 1, file) != 1 ) {
+			if( ferror(file) ) {
+				fprintf( stderr, "error, reading '%s'\n", name );
+			}
+			return false;
+		}
+		/* appended by another run */
+		if( memcmp(s.magic, GREEKS_MAGIC, sizeof(GREEKS_MAGIC)) == 0 ) {
+			if( !readHeader(s.magic) ) {
+				return false;
+			}
+			continue;
+		}
+		break;
+	} while( true );
+
+	if( memcmp(s.magic, GREEKS_SNAP_MAGIC, sizeof(GREEKS_SNAP_MAGIC)) != 0
+	    || fread((char*)&s + sizeof(s.magic), sizeof(s) - sizeof(s.magic), 1,
+	       file) != 1 ) {
+		fprintf( stderr, "error, bad snapshot in '%s'\n", name );
+		return false;
+	}
+	if( swap ) {
+		SWAP_FIELD( s.stamp );
+		SWAP_FIELD( s.nOptions );
+		SWAP_FIELD( s.nCols );
+	}
+	if( s.nOptions != (int)options.size() || s.nCols != GREEKS_COLS_ALL ) {
+		fprintf( stderr, "error, bad snapshot in '%s'\n", name );
+		return false;
+	}
+	if( fread(vals.data(), sizeof(double), vals.size(), file) != vals.size()
+	    || fread(stamps_.data(), sizeof(int64_t), stamps_.size(), file)
+	       != stamps_.size() ) {
+		fprintf( stderr, "error, truncated greeks file: '%s'\n", name );
+		return false;
+	}
+	for( size_t i = 0; swap && i < vals.size(); i++ ) {
+		SWAP_FIELD( vals[i] );
+	}
+	for( size_t i = 0; swap && i < stamps_.size(); i++ ) {
+		SWAP_FIELD( stamps_[i] );
+	}
+	snapStamp = s.stamp;
+	return true;
+}
+
+int GreeksReader::size() const
+{
+	return options.size();
+}
+
+const GreeksOption& GreeksReader::option( int row ) const
+{
+	return options[row];
+}
+
+int64_t GreeksReader::stamp() const
+{
+	return snapStamp;
+}
+
+const double* GreeksReader::column( int calc, int col ) const
+{
+	return vals.data() + ((size_t)calc * GREEK_COLS + col) * options.size();
+}
+
+const int64_t* GreeksReader::stamps( int calc ) const
+{
+	return stamps_.data() + (size_t)calc * options.size();
+}
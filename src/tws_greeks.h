@@ -0,0 +1,166 @@
+/*** tws_greeks.h -- option computations and chain snapshots
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_GREEKS_H
+#define TWS_GREEKS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class MktDataRequest;
+
+
+/* the values of tickOptionComputation in IB's order */
+enum greek_col {
+	GREEK_IV,
+	GREEK_DELTA,
+	GREEK_OPT_PRICE,
+	GREEK_PV_DIVIDEND,
+	GREEK_GAMMA,
+	GREEK_VEGA,
+	GREEK_THETA,
+	GREEK_UND_PRICE,
+	GREEK_COLS
+};
+
+/* which price a computation is based on, delayed ones included */
+enum greek_calc {
+	GREEK_CALC_BID,
+	GREEK_CALC_ASK,
+	GREEK_CALC_LAST,
+	GREEK_CALC_MODEL,
+	GREEK_CALCS
+};
+
+/* return -1 if tickType is no option computation */
+int tick_greek_calc( int tickType );
+const char* greek_calc_str( int calc );
+const char* greek_col_str( int col );
+
+/* every snapshot file starts with this header */
+struct GreeksFileHeader
+{
+	char magic[8];
+	/* GREEKS_BYTE_ORDER in the writer's byte order */
+	uint32_t byteOrder;
+	uint16_t version;
+	uint16_t optionSize;
+	/* usecs since epoch */
+	int64_t created;
+	int32_t nOptions;
+	int32_t reserved;
+};
+
+/* followed by nOptions of these in chain order, see OptionGreeks */
+struct GreeksOption
+{
+	int32_t tickerId;
+	int32_t conId;
+	double strike;
+	/* NUL terminated, maybe truncated */
+	char symbol[16];
+	char expiry[12];
+	char right[4];
+};
+
+/* followed by any number of snapshots, each one is this header, then
+   GREEK_CALCS * GREEK_COLS columns of nOptions doubles and GREEK_CALCS
+   columns of nOptions int64_t receive times in usecs, 0 if never set */
+struct GreeksSnapshot
+{
+	char magic[8];
+	/* usecs since epoch */
+	int64_t stamp;
+	int32_t nOptions;
+	int32_t nCols;
+};
+
+
+/**
+ * Latest option computations of all option market data requests as
+ * structure of arrays. Rows are in chain order, sorted by symbol, expiry,
+ * strike and right. There is a column per computation type and value, so
+ * chain wide views like all deltas of the model are contiguous and a
+ * snapshot is written without any conversion.
+ */
+class OptionGreeks
+{
+	public:
+		OptionGreeks();
+		~OptionGreeks();
+
+		void init( const std::vector<MktDataRequest>& );
+		int size() const;
+		/* row of a tickerId or -1 if it's no option */
+		int row( int tickerId ) const;
+		const GreeksOption& option( int row ) const;
+
+		/* vals are the GREEK_COLS values of a tickOptionComputation */
+		bool set( int tickerId, int tickType, const double *vals,
+			int64_t stamp );
+		/* size() values of one computation type and value */
+		const double* column( int calc, int col ) const;
+		const int64_t* stamps( int calc ) const;
+
+		bool openFile( const char *path );
+		bool snapshot( int64_t now );
+
+		void dumpStats() const;
+
+	private:
+		OptionGreeks( const OptionGreeks& );
+		OptionGreeks& operator=( const OptionGreeks& );
+
+		int nRows;
+		std::vector<GreeksOption> &options;
+		std::vector<int> &rowOfTicker;
+		std::vector<double> &vals;
+		std::vector<int64_t> &stamps_;
+
+		FILE *file;
+
+		/* statistics */
+		long cntSet;
+		long cntDropped;
+		long cntSnapshots;
+		int64_t writeUsecs;
+};
+
+
+/* read snapshot files written by OptionGreeks, on any byte order */
+class GreeksReader
+{
+	public:
+		GreeksReader();
+		~GreeksReader();
+
+		bool openFile( const char *filename );
+		/* read the next snapshot */
+		bool next();
+
+		int size() const;
+		const GreeksOption& option( int row ) const;
+		int64_t stamp() const;
+		const double* column( int calc, int col ) const;
+		const int64_t* stamps( int calc ) const;
+
+	private:
+		bool readHeader( const char *magic );
+
+		FILE *file;
+		const char *name;
+		bool swap;
+		int64_t snapStamp;
+		std::vector<GreeksOption> options;
+		std::vector<double> vals;
+		std::vector<int64_t> stamps_;
+};
+
+#endif
@@ -0,0 +1,264 @@
+/*** tws_lines.cpp -- market data line scheduler
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_lines.h"
+#include "tws_query.h"
+#include "debug.h"
+
+#include <algorithm>
+
+/* TWS normally ends snapshots after 11 seconds */
+#define SNAPSHOT_TIMEOUT 15000
+
+/* give up a request after that many errors in a row */
+#define MAX_LINE_ERRORS 3
+
+
+MktDataLines::MktDataLines() :
+	lines(*(new std::vector<Line>())),
+	idle(*(new std::set< std::pair<double, int> >())),
+	deadlines(*(new std::set< std::pair<int64_t, int> >())),
+	maxLines(0),
+	sliceMsecs(0),
+	rotate(false),
+	active(0),
+	cntStreams(0),
+	cntSnapshots(0),
+	cntErrors(0),
+	sumRevisit(0),
+	cntRevisit(0),
+	maxRevisit(0)
+{
+}
+
+MktDataLines::~MktDataLines()
+{
+	delete &deadlines;
+	delete &idle;
+	delete &lines;
+}
+
+void MktDataLines::init( const std::vector<MktDataRequest> &reqs,
+	int maxL, int slice )
+{
+	assert( maxL > 0 && slice >= 0 );
+	maxLines = maxL;
+	sliceMsecs = slice;
+	rotate = (int)reqs.size() > maxLines;
+
+	lines.clear();
+	idle.clear();
+	deadlines.clear();
+	active = 0;
+	for( size_t i = 0; i < reqs.size(); i++ ) {
+		const int p = reqs[i].priority;
+		Line l;
+		l.state = IDLE;
+		l.oneShot = reqs[i].snapshot;
+		l.stride = p >= 0 ? 1.0 / (1 + p) : 1 - p;
+		/* high priorities come first in the first round too */
+		l.pass = l.stride;
+		l.until = 0;
+		l.lastServed = 0;
+		l.errors = 0;
+		lines.push_back( l );
+		idle.insert( std::make_pair(l.pass, (int)i) );
+	}
+	if( rotate ) {
+		INFO_PRINTF( "rotating %zu market data requests through %d lines "
+			"by %s", reqs.size(), maxLines,
+			sliceMsecs > 0 ? "time slices" : "snapshots" );
+	}
+}
+
+int MktDataLines::size() const
+{
+	return lines.size();
+}
+
+bool MktDataLines::rotating() const
+{
+	return rotate;
+}
+
+/* true if nothing is left to request, never while streaming */
+bool MktDataLines::finished() const
+{
+	return idle.empty() && active == 0;
+}
+
+/* time of the next expired() request, 0 if none */
+int64_t MktDataLines::nextWakeup() const
+{
+	if( deadlines.empty() ) {
+		return 0;
+	}
+	return deadlines.begin()->first;
+}
+
+int MktDataLines::expired( int64_t now ) const
+{
+	if( deadlines.empty() || deadlines.begin()->first > now ) {
+		return 0;
+	}
+	return deadlines.begin()->second + 1;
+}
+
+void MktDataLines::cancelled( int tickerId, int64_t now )
+{
+	lines[tickerId - 1].errors = 0;
+	release( tickerId - 1, now );
+}
+
+bool MktDataLines::canRequest() const
+{
+	return active < maxLines && !idle.empty();
+}
+
+int MktDataLines::request( int64_t now, bool *snapshot )
+{
+	assert( canRequest() );
+	const int i = idle.begin()->second;
+	idle.erase( idle.begin() );
+	Line &l = lines[i];
+	assert( l.state == IDLE );
+
+	if( l.oneShot || (rotate && sliceMsecs == 0) ) {
+		l.state = SNAPSHOT;
+		l.until = now + SNAPSHOT_TIMEOUT;
+		*snapshot = true;
+		cntSnapshots++;
+	} else {
+		l.state = STREAMING;
+		l.until = rotate ? now + sliceMsecs : 0;
+		*snapshot = false;
+		cntStreams++;
+	}
+	if( l.until != 0 ) {
+		deadlines.insert( std::make_pair(l.until, i) );
+	}
+	if( l.lastServed != 0 ) {
+		int64_t d = now - l.lastServed;
+		sumRevisit += d;
+		cntRevisit++;
+		maxRevisit = std::max( maxRevisit, d );
+	}
+	l.lastServed = now;
+	l.pass += l.stride;
+	active++;
+	return i + 1;
+}
+
+/* free the line of an active request */
+void MktDataLines::release( int i, int64_t now )
+{
+	assert( i >= 0 && i < (int)lines.size() );
+	Line &l = lines[i];
+	if( l.state != STREAMING && l.state != SNAPSHOT ) {
+		return;
+	}
+	if( l.until != 0 ) {
+		deadlines.erase( std::make_pair(l.until, i) );
+		l.until = 0;
+	}
+	active--;
+
+	if( l.oneShot && l.state == SNAPSHOT && l.errors == 0 ) {
+		l.state = DONE;
+		return;
+	}
+	if( l.errors >= MAX_LINE_ERRORS ) {
+		WARN_PRINTF( "Warning, giving up market data request %d after %d "
+			"errors.", i + 1, l.errors );
+		l.state = DONE;
+		return;
+	}
+	l.state = IDLE;
+	idle.insert( std::make_pair(l.pass, i) );
+}
+
+void MktDataLines::snapshotEnd( int tickerId, int64_t now )
+{
+	int i = tickerId - 1;
+	if( i < 0 || i >= (int)lines.size() || lines[i].state != SNAPSHOT ) {
+		return;
+	}
+	lines[i].errors = 0;
+	release( i, now );
+}
+
+/**
+ * Handle a TWS message for an active tickerId, return false if it's not
+ * ours. Only messages which end the subscription free the line.
+ */
+bool MktDataLines::error( int tickerId, int code, int64_t now )
+{
+	int i = tickerId - 1;
+	if( i < 0 || i >= (int)lines.size() ) {
+		return false;
+	}
+	Line &l = lines[i];
+	if( l.state != STREAMING && l.state != SNAPSHOT ) {
+		return false;
+	}
+
+	switch( code ) {
+	case 101:   /* max number of tickers has been reached */
+		l.errors++;
+		cntErrors++;
+		release( i, now );
+		if( active < maxLines ) {
+			WARN_PRINTF( "Warning, TWS allows only %d market data lines.",
+				std::max(active, 1) );
+			maxLines = std::max( active, 1 );
+		}
+		break;
+	case 200:   /* no security definition */
+	case 300:   /* can't find EId */
+	case 321:   /* error validating request */
+	case 322:   /* error processing request */
+	case 354:   /* not subscribed */
+	case 10089: /* requires additional subscription */
+	case 10090:
+	case 10091:
+	case 10186:
+	case 10197: /* competing live session */
+		l.errors++;
+		cntErrors++;
+		release( i, now );
+		break;
+	default:
+		/* informational like 10167 delayed data, still streaming */
+		break;
+	}
+	return true;
+}
+
+/* TWS connection lost, all subscriptions are gone */
+void MktDataLines::reset()
+{
+	for( size_t i = 0; i < lines.size(); i++ ) {
+		Line &l = lines[i];
+		if( l.state == STREAMING || l.state == SNAPSHOT ) {
+			l.state = IDLE;
+			l.until = 0;
+			idle.insert( std::make_pair(l.pass, (int)i) );
+		}
+	}
+	deadlines.clear();
+	active = 0;
+}
+
+void MktDataLines::dumpStats() const
+{
+	INFO_PRINTF( "market data lines: %zu requests, %d lines, %ld streams, "
+		"%ld snapshots, %ld errors, revisit avg %.3fs, max %.3fs",
+		lines.size(), maxLines, cntStreams, cntSnapshots, cntErrors,
+		cntRevisit > 0 ? sumRevisit / 1000.0 / cntRevisit : 0.0,
+		maxRevisit / 1000.0 );
+}
@@ -0,0 +1,90 @@
+/*** tws_lines.h -- market data line scheduler
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_LINES_H
+#define TWS_LINES_H
+
+#include <stdint.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+class MktDataRequest;
+
+
+/**
+ * Share at most maxLines concurrent market data lines between any number of
+ * market data requests, tickerId i+1 is request i. If all requests fit they
+ * are streamed all the time. Otherwise they are rotated, either by snapshots
+ * or by streaming each one for sliceMsecs. Requests are picked by stride
+ * scheduling, a request with priority p is served p+1 times as often as one
+ * with priority 0. Requests with snapshot set are served once.
+ */
+class MktDataLines
+{
+	public:
+		MktDataLines();
+		~MktDataLines();
+
+		void init( const std::vector<MktDataRequest>&, int maxLines,
+			int sliceMsecs );
+		int size() const;
+		bool rotating() const;
+		bool finished() const;
+		int64_t nextWakeup() const;
+
+		/* tickerId to cancel, 0 if none, then call cancelled() */
+		int expired( int64_t now ) const;
+		void cancelled( int tickerId, int64_t now );
+		/* tickerId to request now, 0 if none */
+		bool canRequest() const;
+		int request( int64_t now, bool *snapshot );
+
+		void snapshotEnd( int tickerId, int64_t now );
+		bool error( int tickerId, int code, int64_t now );
+		void reset();
+
+		void dumpStats() const;
+
+	private:
+		enum line_state { IDLE, STREAMING, SNAPSHOT, DONE };
+
+		struct Line
+		{
+			line_state state;
+			bool oneShot;
+			double stride;
+			double pass;
+			/* cancel or time out at, 0 means never */
+			int64_t until;
+			int64_t lastServed;
+			int errors;
+		};
+
+		void release( int i, int64_t now );
+
+		std::vector<Line> &lines;
+		/* idle requests by pass, smallest is next */
+		std::set< std::pair<double, int> > &idle;
+		/* active requests by until */
+		std::set< std::pair<int64_t, int> > &deadlines;
+		int maxLines;
+		int sliceMsecs;
+		bool rotate;
+		int active;
+
+		/* statistics */
+		long cntStreams;
+		long cntSnapshots;
+		long cntErrors;
+		int64_t sumRevisit;
+		long cntRevisit;
+		int64_t maxRevisit;
+};
+
+#endif
@@ -0,0 +1,434 @@
+/*** tws_log.cpp -- leveled asynchronous logging
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_log.h"
+#include "tws_util.h"
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* max time the log thread sleeps without being notified */
+#define LOG_IDLE_MSECS 100
+
+/* output buffer of the log thread, flushed when empty or nearly full */
+#define LOG_OUT_SIZE (64 * 1024)
+#define LOG_LINE_MAX 4096
+
+
+int tws_log_level = TWS_LOG_INFO;
+
+static const char *level_names[] = { "error", "warn", "info", "debug" };
+
+/* accept a level name or number, return -1 if invalid */
+int tws_log_parse_level( const char *s )
+{
+	for( int i = 0; i <= TWS_LOG_DEBUG; i++ ) {
+		if( strcasecmp(s, level_names[i]) == 0 ) {
+			return i;
+		}
+	}
+	char *end;
+	long l = strtol( s, &end, 10 );
+	if( *s == '\0' || *end != '\0' || l < 0 || l > TWS_LOG_DEBUG ) {
+		return -1;
+	}
+	return l;
+}
+
+
+/**
+ * Render "yyyy-mm-dd hh:mm:ss.zzz" into buf (23 chars, not terminated).
+ * localtime and strftime only run once per second and thread.
+ */
+static size_t render_stamp( int64_t msecs, char *buf )
+{
+	static thread_local int64_t cached_sec = -1;
+	static thread_local char cached[20];
+
+	const int64_t s = msecs / 1000;
+	const unsigned int ms = msecs % 1000;
+	if( s != cached_sec ) {
+		const time_t t = s;
+		struct tm *tmp_tm;
+#ifdef HAVE_LOCALTIME_R
+		struct tm tm;
+		tmp_tm = localtime_r( &t, &tm );
+#else
+		tmp_tm = localtime( &t );
+#endif
+		assert( tmp_tm != NULL );
+		size_t tmp_sz = strftime( cached, sizeof(cached), "%F %T", tmp_tm );
+		assert( tmp_sz == 19 );
+		(void) tmp_sz;
+		cached_sec = s;
+	}
+	memcpy( buf, cached, 19 );
+	buf[19] = '.';
+	buf[20] = '0' + ms / 100;
+	buf[21] = '0' + ms / 10 % 10;
+	buf[22] = '0' + ms % 10;
+	return 23;
+}
+
+/**
+ * Format a captured message like printf would have done it. Each conversion
+ * is passed to snprintf alone with the length modifier matching how the
+ * argument was captured.
+ */
+static size_t format_msg( const TwsLogMsg &m, char *buf, size_t size )
+{
+	assert( size > 32 );
+	/* keep room for the newline */
+	size--;
+	size_t len = render_stamp( m.msecs, buf );
+	buf[len++] = ' ';
+
+	const char *f = m.fmt;
+	int argi = 0;
+	while( *f != '\0' && len < size ) {
+		if( *f != '%' ) {
+			buf[len++] = *f++;
+			continue;
+		}
+		if( f[1] == '%' ) {
+			buf[len++] = '%';
+			f += 2;
+			continue;
+		}
+
+		char spec[32];
+		size_t sl = 0;
+		spec[sl++] = *f++;
+		while( *f != '\0' && strchr("-+ #0", *f) != NULL && sl < 8 ) {
+			spec[sl++] = *f++;
+		}
+		for( int prec = 0; prec < 2; prec++ ) {
+			if( prec ) {
+				if( *f != '.' ) {
+					break;
+				}
+				spec[sl++] = *f++;
+			}
+			if( *f == '*' ) {
+				f++;
+				int w = 0;
+				if( argi < m.nargs && m.args[argi].kind == 'i' ) {
+					w = m.args[argi].i;
+				}
+				argi++;
+				sl += snprintf( spec + sl, 12, "%d", w );
+			} else {
+				while( *f >= '0' && *f <= '9' && sl < 20 ) {
+					spec[sl++] = *f++;
+				}
+			}
+		}
+		while( *f != '\0' && strchr("hlLqjzt", *f) != NULL ) {
+			f++;
+		}
+		const char conv = *f;
+		if( conv == '\0' ) {
+			break;
+		}
+		f++;
+		if( argi >= m.nargs ) {
+			break;
+		}
+		const TwsLogArg &a = m.args[argi++];
+
+		int n = 0;
+		char *out = buf + len;
+		size_t room = size - len;
+		switch( conv ) {
+		case 'd':
+		case 'i':
+			if( a.kind == 'i' ) {
+				memcpy( spec + sl, "lld", 4 );
+				n = snprintf( out, room, spec, a.i );
+			}
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			if( a.kind == 'i' ) {
+				unsigned long long u = a.i;
+				if( a.size < (int)sizeof(u) ) {
+					u &= (1ULL << (8 * a.size)) - 1;
+				}
+				spec[sl++] = 'l';
+				spec[sl++] = 'l';
+				spec[sl++] = conv;
+				spec[sl] = '\0';
+				n = snprintf( out, room, spec, u );
+			}
+			break;
+		case 'c':
+			if( a.kind == 'i' ) {
+				memcpy( spec + sl, "c", 2 );
+				n = snprintf( out, room, spec, (int)a.i );
+			}
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if( a.kind == 'd' ) {
+				spec[sl++] = conv;
+				spec[sl] = '\0';
+				n = snprintf( out, room, spec, a.d );
+			}
+			break;
+		case 's':
+			if( a.kind == 's' ) {
+				memcpy( spec + sl, "s", 2 );
+				n = snprintf( out, room, spec, m.str + a.s );
+			}
+			break;
+		case 'p':
+			if( a.kind == 'p' ) {
+				memcpy( spec + sl, "p", 2 );
+				n = snprintf( out, room, spec, a.p );
+			}
+			break;
+		}
+		if( n > 0 ) {
+			len += std::min( (size_t)n, room - 1 );
+		}
+	}
+	buf[len++] = '\n';
+	return len;
+}
+
+
+struct LogCell
+{
+	std::atomic<uint64_t> seq;
+	TwsLogMsg msg;
+};
+
+/* bounded multi producer ring, the log thread is the only consumer */
+static LogCell *ring = NULL;
+static size_t ringMask = 0;
+static std::atomic<uint64_t> enqPos( 0 );
+static uint64_t deqPos = 0;
+/* everything before this position is on stderr */
+static std::atomic<uint64_t> written( 0 );
+
+static std::atomic<bool> running( false );
+static std::atomic<bool> stopping( false );
+static std::atomic<bool> sleeping( false );
+static std::thread *logThread = NULL;
+static std::mutex mutex;
+static std::condition_variable cond;
+
+static std::atomic<long> cntDropped( 0 );
+
+/* used while the log thread is not running */
+static thread_local TwsLogMsg scratch;
+
+static void log_main()
+{
+	char *out = (char*) malloc( LOG_OUT_SIZE );
+	size_t outLen = 0;
+
+	while( true ) {
+		int n = 0;
+		while( true ) {
+			LogCell &c = ring[deqPos & ringMask];
+			if( c.seq.load(std::memory_order_acquire) != deqPos + 1 ) {
+				break;
+			}
+			if( outLen + LOG_LINE_MAX > LOG_OUT_SIZE ) {
+				fwrite( out, 1, outLen, stderr );
+				outLen = 0;
+				written.store( deqPos, std::memory_order_release );
+			}
+			outLen += format_msg( c.msg, out + outLen, LOG_LINE_MAX );
+			c.seq.store( deqPos + ringMask + 1, std::memory_order_release );
+			deqPos++;
+			n++;
+		}
+		if( outLen > 0 ) {
+			fwrite( out, 1, outLen, stderr );
+			outLen = 0;
+			written.store( deqPos, std::memory_order_release );
+		}
+		if( n > 0 ) {
+			continue;
+		}
+		if( stopping.load() ) {
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock( mutex );
+		sleeping.store( true );
+		if( ring[deqPos & ringMask].seq.load() != deqPos + 1
+		    && !stopping.load() ) {
+			cond.wait_for( lock, std::chrono::milliseconds(LOG_IDLE_MSECS) );
+		}
+		sleeping.store( false );
+	}
+	free( out );
+}
+
+/**
+ * Start the log thread with a ring of at least that many messages. Must be
+ * called before any other thread logs.
+ */
+bool tws_log_start( size_t slots )
+{
+	if( running.load() ) {
+		return true;
+	}
+	size_t n = 1;
+	while( n < slots ) {
+		n <<= 1;
+	}
+	ring = new LogCell[n];
+	ringMask = n - 1;
+	for( size_t i = 0; i < n; i++ ) {
+		ring[i].seq.store( i, std::memory_order_relaxed );
+	}
+	enqPos.store( 0 );
+	deqPos = 0;
+	written.store( 0 );
+	stopping.store( false );
+	logThread = new std::thread( log_main );
+	running.store( true, std::memory_order_release );
+	atexit( tws_log_stop );
+	return true;
+}
+
+/**
+ * Write all pending messages and stop the log thread. Must not be called
+ * while other threads log.
+ */
+void tws_log_stop()
+{
+	if( !running.load() ) {
+		return;
+	}
+	running.store( false );
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopping.store( true );
+		cond.notify_one();
+	}
+	logThread->join();
+	delete logThread;
+	logThread = NULL;
+	delete[] ring;
+	ring = NULL;
+
+	if( cntDropped.load() > 0 ) {
+		fprintf( stderr, "Warning, dropped %ld log messages because the "
+			"log thread was too slow.\n", cntDropped.load() );
+	}
+}
+
+/* return the message to capture arguments into or NULL if dropped */
+TwsLogMsg* tws_log_begin( int level, const char *fmt )
+{
+	TwsLogMsg *m = &scratch;
+	if( running.load(std::memory_order_acquire) ) {
+		uint64_t pos = enqPos.load( std::memory_order_relaxed );
+		while( true ) {
+			LogCell &c = ring[pos & ringMask];
+			uint64_t seq = c.seq.load( std::memory_order_acquire );
+			int64_t dif = (int64_t)seq - (int64_t)pos;
+			if( dif == 0 ) {
+				if( enqPos.compare_exchange_weak(pos, pos + 1,
+				    std::memory_order_relaxed) ) {
+					m = &c.msg;
+					break;
+				}
+			} else if( dif < 0 ) {
+				/* full, never lose errors */
+				if( level > TWS_LOG_ERROR ) {
+					cntDropped++;
+					return NULL;
+				}
+				std::this_thread::yield();
+				pos = enqPos.load( std::memory_order_relaxed );
+			} else {
+				pos = enqPos.load( std::memory_order_relaxed );
+			}
+		}
+		m->pos = pos;
+	}
+	m->msecs = nowInMsecs();
+	m->fmt = fmt;
+	m->level = level;
+	m->nargs = 0;
+	m->strLen = 0;
+	return m;
+}
+
+void tws_log_commit( TwsLogMsg *m )
+{
+	if( m == &scratch ) {
+		char buf[LOG_LINE_MAX];
+		size_t len = format_msg( *m, buf, sizeof(buf) );
+		fwrite( buf, 1, len, stderr );
+		return;
+	}
+
+	LogCell &c = ring[m->pos & ringMask];
+	c.seq.store( m->pos + 1, std::memory_order_release );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( sleeping.load() || m->level == TWS_LOG_ERROR ) {
+		std::lock_guard<std::mutex> lock( mutex );
+		cond.notify_one();
+	}
+	if( m->level == TWS_LOG_ERROR ) {
+		/* errors are often followed by abort() */
+		const uint64_t pos = m->pos;
+		while( written.load(std::memory_order_acquire) <= pos ) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+/* copy a string argument, truncate it if the message is full */
+void tws_log_str( TwsLogMsg *m, const char *s )
+{
+	TwsLogArg &a = m->args[m->nargs++];
+	a.kind = 's';
+	a.size = 0;
+	if( s == NULL ) {
+		s = "(null)";
+	}
+	if( m->strLen >= TWS_LOG_STRBUF - 1 ) {
+		a.s = TWS_LOG_STRBUF - 1;
+		m->str[a.s] = '\0';
+		return;
+	}
+	a.s = m->strLen;
+	size_t room = TWS_LOG_STRBUF - 1 - m->strLen;
+	size_t n = strnlen( s, room );
+	memcpy( m->str + a.s, s, n );
+	m->str[a.s + n] = '\0';
+	m->strLen += n + 1;
+}
@@ -0,0 +1,152 @@
+/*** tws_log.h -- leveled asynchronous logging
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_LOG_H
+#define TWS_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <type_traits>
+
+
+enum tws_log_level {
+	TWS_LOG_ERROR,
+	TWS_LOG_WARN,
+	TWS_LOG_INFO,
+	TWS_LOG_DEBUG
+};
+
+/* messages above this level are compiled out, e.g. -DTWS_LOG_MAX_LEVEL=2 */
+#ifndef TWS_LOG_MAX_LEVEL
+# define TWS_LOG_MAX_LEVEL TWS_LOG_DEBUG
+#endif
+
+/* messages above this level are skipped before evaluating their arguments */
+extern int tws_log_level;
+
+int tws_log_parse_level( const char *s );
+bool tws_log_start( size_t slots );
+void tws_log_stop();
+
+
+/**
+ * Log a printf like message. The arguments are only evaluated if the level
+ * is enabled. Numbers and pointers are captured as they are, strings are
+ * copied. Formatting and writing happens in the log thread if started by
+ * tws_log_start(), otherwise immediately. Errors are written before
+ * returning in any case.
+ */
+#define TWS_LOG( _level_, _format_, _args_... ) \
+	do { \
+		if( (_level_) <= TWS_LOG_MAX_LEVEL && (_level_) <= tws_log_level ) { \
+			/* never evaluated, just let the compiler check the format */ \
+			(void) sizeof( printf(_format_, ## _args_) ); \
+			tws_log( (_level_), _format_, ## _args_ ); \
+		} \
+	} while( 0 )
+
+
+#define TWS_LOG_ARGS 24
+#define TWS_LOG_STRBUF 600
+
+struct TwsLogArg
+{
+	union {
+		long long i;
+		double d;
+		const void *p;
+		/* offset into TwsLogMsg::str */
+		size_t s;
+	};
+	/* 'i'nteger, 'd'ouble, 'p'ointer or 's'tring */
+	char kind;
+	/* sizeof the original integer, to format negative numbers as unsigned */
+	int size;
+};
+
+struct TwsLogMsg
+{
+	uint64_t pos;
+	int64_t msecs;
+	const char *fmt;
+	int level;
+	int nargs;
+	size_t strLen;
+	TwsLogArg args[TWS_LOG_ARGS];
+	char str[TWS_LOG_STRBUF];
+};
+
+TwsLogMsg* tws_log_begin( int level, const char *fmt );
+void tws_log_commit( TwsLogMsg* );
+void tws_log_str( TwsLogMsg*, const char* );
+
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value
+	|| std::is_enum<T>::value>::type
+tws_log_arg( TwsLogMsg *m, T v )
+{
+	TwsLogArg &a = m->args[m->nargs++];
+	a.i = (long long)v;
+	a.kind = 'i';
+	a.size = sizeof(T);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_pointer<T>::value>::type
+tws_log_arg( TwsLogMsg *m, T v )
+{
+	TwsLogArg &a = m->args[m->nargs++];
+	a.p = (const void*)v;
+	a.kind = 'p';
+	a.size = sizeof(T);
+}
+
+inline void tws_log_arg( TwsLogMsg *m, double v )
+{
+	TwsLogArg &a = m->args[m->nargs++];
+	a.d = v;
+	a.kind = 'd';
+	a.size = sizeof(v);
+}
+
+inline void tws_log_arg( TwsLogMsg *m, const char *v )
+{
+	tws_log_str( m, v );
+}
+
+inline void tws_log_arg( TwsLogMsg *m, char *v )
+{
+	tws_log_str( m, v );
+}
+
+inline void tws_log_args( TwsLogMsg* )
+{
+}
+
+template<typename T, typename... R>
+inline void tws_log_args( TwsLogMsg *m, const T &v, const R&... r )
+{
+	tws_log_arg( m, v );
+	tws_log_args( m, r... );
+}
+
+template<typename... A>
+void tws_log( int level, const char *fmt, const A&... a )
+{
+	static_assert( sizeof...(A) <= TWS_LOG_ARGS, "too many log arguments" );
+	TwsLogMsg *m = tws_log_begin( level, fmt );
+	if( m == NULL ) {
+		return;
+	}
+	tws_log_args( m, a... );
+	tws_log_commit( m );
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "tws_xml.h"
 #include "tws_query.h"
 #include "tws_util.h"
+#include "tws_bars.h"
 #include "debug.h"
 
 #include <twsapi/twsapi_config.h>
@@ -20,6 +21,7 @@
 
 #include <limits.h>
 #include <string.h>
+#include <algorithm>
 
 #if TWSAPI_IB_VERSION_NUMBER < 97200
 # define lastTradeDateOrContractMonth expiry
@@ -51,6 +53,12 @@ int GenericRequest::age() const
 }
 
 
+int64_t GenericRequest::ctime() const
+{
+	return _ctime;
+}
+
+
 void GenericRequest::nextRequest( ReqType t )
 {
 	_reqType = t;
@@ -72,11 +80,39 @@ void GenericRequest::close()
 
 
 
+/* scheduling state of a hist request, see HistTodo::checkoutOpt() */
+struct HistSched
+{
+	int64_t queued;
+	time_t deadline; /* 0 if none */
+	bool missed;
+	/* predicted to miss the deadline, see predictDeadlines() */
+	bool late;
+};
+
+/* completion metrics of one priority class */
+struct HistPrioStats
+{
+	int done;
+	int failed;
+	int missed;
+	int late;
+	int64_t sumMsecs;
+	int64_t maxMsecs;
+};
+
+
 HistTodo::HistTodo() :
 	doneRequests(*(new std::list<HistRequest*>())),
 	leftRequests(*(new std::list<HistRequest*>())),
 	errorRequests(*(new std::list<HistRequest*>())),
-	checkedOutRequest(NULL)
+	checkedOutRequest(NULL),
+	sched(*(new std::map<const HistRequest*, HistSched>())),
+	prioStats(*(new std::map<int, HistPrioStats>())),
+	lastFin(0),
+	svcMsecs(0),
+	shardIdx(0),
+	shardCnt(1)
 {
 }
 
@@ -99,6 +135,8 @@ HistTodo::~HistTodo()
 	if( checkedOutRequest != NULL ) {
 		delete checkedOutRequest;
 	}
+	delete &sched;
+	delete &prioStats;
 }
 
 
@@ -114,6 +152,17 @@ void HistTodo::dumpLeft() const
 }
 
 
+void HistTodo::dumpLeftXml() const
+{
+	std::list<HistRequest*>::const_iterator it;
+	for( it = leftRequests.begin(); it != leftRequests.end(); it++ ) {
+		PacketHistData phd;
+		phd.record( 0, **it );
+		phd.dumpXml();
+	}
+}
+
+
 int HistTodo::countDone() const
 {
 	return doneRequests.size();
@@ -134,40 +183,132 @@ void HistTodo::checkout()
 }
 
 
+/* scheduling state of hR, no deadline if it was never scheduled */
+const HistSched& HistTodo::schedOf( const HistRequest *hR ) const
+{
+	static const HistSched none = { 0, 0, false, false };
+	std::map<const HistRequest*, HistSched>::const_iterator it =
+		sched.find( hR );
+	return it != sched.end() ? it->second : none;
+}
+
+/* true if a should be requested before b */
+bool HistTodo::sched_less( const HistRequest *a, const HistRequest *b ) const
+{
+	if( a->priority != b->priority ) {
+		return a->priority > b->priority;
+	}
+	time_t da = schedOf(a).deadline;
+	time_t db = schedOf(b).deadline;
+	if( da != db ) {
+		return db == 0 || (da != 0 && da < db);
+	}
+	return false;
+}
+
+static void miss_deadline( const HistRequest *hR, HistSched *s )
+{
+	s->missed = true;
+	fprintf( stderr, "Warning, deadline %s missed: %s\n",
+		hR->deadline.c_str(), hR->toString().c_str() );
+}
+
+/**
+ * Warn once for each deadline which can't be met anymore if the remaining
+ * queue drains in schedule order at the rate we finished requests so far.
+ */
+void HistTodo::predictDeadlines( int64_t now )
+{
+	if( svcMsecs <= 0 ) {
+		return;
+	}
+	std::vector<const HistRequest*> v;
+	bool any = false;
+	for( std::list<HistRequest*>::const_iterator it = leftRequests.begin();
+		it != leftRequests.end(); it++ ) {
+		const HistSched &s = schedOf( *it );
+		any = any || (s.deadline != 0 && !s.missed && !s.late);
+		v.push_back( *it );
+	}
+	if( !any ) {
+		return;
+	}
+	std::stable_sort( v.begin(), v.end(),
+		[this]( const HistRequest *a, const HistRequest *b ) {
+			return sched_less( a, b ); } );
+	for( size_t k = 0; k < v.size(); k++ ) {
+		std::map<const HistRequest*, HistSched>::iterator it =
+			sched.find( v[k] );
+		if( it == sched.end() ) {
+			continue;
+		}
+		HistSched &s = it->second;
+		if( s.deadline == 0 || s.missed || s.late ) {
+			continue;
+		}
+		int64_t eta = now + (int64_t)(k + 1) * svcMsecs;
+		if( eta > (int64_t)s.deadline * 1000 ) {
+			s.late = true;
+			fprintf( stderr, "Warning, deadline %s can't be met, "
+				"expected in %llds: %s\n", v[k]->deadline.c_str(),
+				(long long)((eta - now) / 1000), v[k]->toString().c_str() );
+		}
+	}
+}
+
 int HistTodo::checkoutOpt( PacingGod *pG, const DataFarmStates *dfs )
 {
 	assert( checkedOutRequest == NULL );
 
+	predictDeadlines( nowInMsecs() );
+	const time_t now = time(NULL);
+	HistRequest *best_hR = NULL;
 	std::map<std::string, HistRequest*> hashByFarm;
 	std::map<std::string, int> countByFarm;
 	for( std::list<HistRequest*>::const_iterator it = leftRequests.begin();
 		it != leftRequests.end(); it++ ) {
+		HistSched &s = sched[*it];
+		if( s.deadline != 0 && !s.missed && s.deadline <= now ) {
+			miss_deadline( *it, &s );
+		}
+		if( best_hR == NULL || sched_less(*it, best_hR) ) {
+			best_hR = *it;
+		}
+
 		std::string farm = dfs->getHmdsFarm((*it)->ibContract);
 		if( hashByFarm.find(farm) == hashByFarm.end() ) {
 			hashByFarm[farm] = *it;
 			countByFarm[farm] = 1;
 		} else {
+			if( sched_less(*it, hashByFarm[farm]) ) {
+				hashByFarm[farm] = *it;
+			}
 			countByFarm[farm]++;
 		}
 	}
 
-	HistRequest *todo_hR = leftRequests.front();
-	int countTodo = 0;
+	HistRequest *todo_hR = best_hR;
+	const std::string *todo_farm = NULL;
 	for( std::map<std::string, HistRequest*>::const_iterator
 		    it = hashByFarm.begin(); it != hashByFarm.end(); it++ ) {
 		const std::string &farm = it->first;
 		HistRequest *tmp_hR = it->second;
 		const Contract& c = tmp_hR->ibContract;
-		if( pG->countLeft( c ) > 0 ) {
-			if( farm.empty() ) {
-				// 1. the unknown ones to learn farm quickly
-				todo_hR = tmp_hR;
-				break;
-			} else if( countTodo < countByFarm[farm] ) {
-				// 2. get from them biggest list
-				todo_hR = tmp_hR;
-				countTodo = countByFarm[farm];
-			}
+		if( pG->countLeft( c ) <= 0 ) {
+			continue;
+		}
+		if( todo_farm == NULL || sched_less(tmp_hR, todo_hR) ) {
+			// 1. the most urgent one of all pacing-eligible farms
+			todo_hR = tmp_hR;
+			todo_farm = &farm;
+		} else if( sched_less(todo_hR, tmp_hR) || todo_farm->empty() ) {
+			continue;
+		} else if( farm.empty()
+		           || countByFarm[*todo_farm] < countByFarm[farm] ) {
+			// 2. the unknown ones to learn farm quickly
+			// 3. get from them biggest list
+			todo_hR = tmp_hR;
+			todo_farm = &farm;
 		}
 	}
 
@@ -189,6 +330,55 @@ int HistTodo::checkoutOpt( PacingGod *pG, const DataFarmStates *dfs )
 }
 
 
+/* account the checked out request to its priority class and forget its
+   scheduling state */
+void HistTodo::finSched( bool ok )
+{
+	const HistRequest *hR = checkedOutRequest;
+	HistSched &s = sched[hR];
+	HistPrioStats &st = prioStats[hR->priority];
+
+	int64_t now = nowInMsecs();
+	if( s.deadline != 0 && !s.missed && now > (int64_t)s.deadline * 1000 ) {
+		miss_deadline( hR, &s );
+	}
+	/* smoothed time between two finished requests, the first one counts
+	   since it was queued */
+	int64_t ival = now - (lastFin != 0 ? lastFin : s.queued);
+	svcMsecs = svcMsecs == 0 ? ival : (7 * svcMsecs + ival) / 8;
+	lastFin = now;
+
+	if( s.missed ) {
+		st.missed++;
+	}
+	if( s.late ) {
+		st.late++;
+	}
+	if( !ok ) {
+		st.failed++;
+	} else {
+		int64_t msecs = now - s.queued;
+		st.done++;
+		st.sumMsecs += msecs;
+		st.maxMsecs = std::max( st.maxMsecs, msecs );
+	}
+	sched.erase( hR );
+}
+
+
+void HistTodo::dumpStats() const
+{
+	std::map<int, HistPrioStats>::const_reverse_iterator it;
+	for( it = prioStats.rbegin(); it != prioStats.rend(); it++ ) {
+		const HistPrioStats &st = it->second;
+		INFO_PRINTF( "hist priority %d: done %d, failed %d, missed deadline %d "
+			"(predicted %d), completion avg %.3fs, max %.3fs", it->first,
+			st.done, st.failed, st.missed, st.late, st.done > 0 ? st.sumMsecs / 1000.0 / st.done : 0.0,
+			st.maxMsecs / 1000.0 );
+	}
+}
+
+
 void HistTodo::cancelForRepeat( int priority )
 {
 	assert( checkedOutRequest != NULL );
@@ -197,6 +387,7 @@ void HistTodo::cancelForRepeat( int priority )
 	} else if( priority <=1 ) {
 		leftRequests.push_back(checkedOutRequest);
 	} else {
+		finSched( false );
 		errorRequests.push_back(checkedOutRequest);
 	}
 	checkedOutRequest = NULL;
@@ -213,15 +404,45 @@ const HistRequest& HistTodo::current() const
 void HistTodo::tellDone()
 {
 	assert( checkedOutRequest != NULL );
+	finSched( true );
 	doneRequests.push_back(checkedOutRequest);
 	checkedOutRequest = NULL;
 }
 
 
+void HistTodo::forgetDone()
+{
+	std::list<HistRequest*>::const_iterator it;
+	for( it = doneRequests.begin(); it != doneRequests.end(); it++ ) {
+		delete *it;
+	}
+	doneRequests.clear();
+	for( it = errorRequests.begin(); it != errorRequests.end(); it++ ) {
+		delete *it;
+	}
+	errorRequests.clear();
+}
+
+
 void HistTodo::add( const HistRequest& hR )
 {
 	HistRequest *p = new HistRequest(hR);
 	leftRequests.push_back(p);
+	addSched(p);
+}
+
+void HistTodo::addSched( const HistRequest *hR )
+{
+	HistSched s = { nowInMsecs(), 0, false, false };
+	if( !hR->deadline.empty() ) {
+		s.deadline = ib_datetime2time_t( hR->deadline );
+		if( s.deadline == -1 ) {
+			fprintf( stderr, "Warning, invalid deadline '%s' ignored.\n",
+				hR->deadline.c_str() );
+			s.deadline = 0;
+		}
+	}
+	sched[hR] = s;
 }
 
 int HistTodo::skip_by_perm(const Contract& con)
@@ -240,6 +461,7 @@ int HistTodo::skip_by_perm(const Contract& con)
 				strcasecmp( ci.secType.c_str(), con.secType.c_str()) == 0 &&
 				strcasecmp( ci.exchange.c_str(), con.exchange.c_str()) == 0) {
 			cnt_skipped++;
+			sched.erase( hr );
 			errorRequests.push_back(hr);
 			it = leftRequests.erase(it);
 		} else {
@@ -248,7 +470,7 @@ int HistTodo::skip_by_perm(const Contract& con)
 	}
 
 return_skip_by_con:
-	DEBUG_PRINTF("skipped %d requests for contracts like %s,%s,%s",
+	INFO_PRINTF("skipped %d requests for contracts like %s,%s,%s",
 		cnt_skipped,
 		con.symbol.c_str(), con.secType.c_str(), con.exchange.c_str());
 	return cnt_skipped;
@@ -283,6 +505,7 @@ int HistTodo::skip_by_nodata(const HistRequest& hr)
 			   strcasecmp( hr.whatToShow.c_str(), hi->whatToShow.c_str()) == 0)
 			) {
 			cnt_skipped++;
+			sched.erase( hi );
 			errorRequests.push_back(hi);
 			it = leftRequests.erase(it);
 		} else {
@@ -291,13 +514,299 @@ int HistTodo::skip_by_nodata(const HistRequest& hr)
 	}
 
 return_skip_by_con:
-	DEBUG_PRINTF("skipped %d requests for contracts like %s,%s,%s",
+	INFO_PRINTF("skipped %d requests for contracts like %s,%s,%s",
 		cnt_skipped,
 		con.symbol.c_str(), con.secType.c_str(), con.exchange.c_str());
 	return cnt_skipped;
 }
 
 
+/* a window which may be merged with its neighbours, see coalesce() */
+struct HistSpan
+{
+	int pos;
+	time_t begin;
+	time_t end;
+	HistRequest *hR;
+};
+
+static bool span_less( const HistSpan &a, const HistSpan &b )
+{
+	if( a.begin != b.begin ) {
+		return a.begin < b.begin;
+	}
+	return a.end < b.end;
+}
+
+static bool pos_less( const HistSpan &a, const HistSpan &b )
+{
+	return a.pos < b.pos;
+}
+
+/* requests are mergeable if only the requested window differs */
+static std::string coalesce_key( const HistRequest &hR )
+{
+	const Contract &c = hR.ibContract;
+	char buf[64];
+
+	snprintf( buf, sizeof(buf), "%d,%d,%c,%d", hR.useRTH, hR.formatDate,
+		hR.durationStr[hR.durationStr.size() - 1], c.includeExpired );
+	return ibToString(c) + "," + c.primaryExchange + "," + c.tradingClass
+		+ "," + hR.whatToShow + "," + hR.barSizeSetting + "," + buf;
+}
+
+/* merge spans, which are sorted by begin, into one request */
+static HistRequest* merge_spans( const std::vector<HistSpan> &spans,
+	time_t begin, time_t end )
+{
+	if( spans.size() == 1 ) {
+		return spans[0].hR;
+	}
+
+	HistRequest *hR = new HistRequest( *spans[0].hR );
+	hR->parts.clear();
+	for( size_t i = 0; i < spans.size(); i++ ) {
+		const HistRequest *m = spans[i].hR;
+		if( spans[i].end == end ) {
+			hR->endDateTime = m->endDateTime;
+		}
+		/* the merged request is as urgent as its most urgent part */
+		hR->priority = std::max( hR->priority, m->priority );
+		if( !m->deadline.empty() && (hR->deadline.empty()
+		    || ib_datetime2time_t(m->deadline)
+		       < ib_datetime2time_t(hR->deadline)) ) {
+			hR->deadline = m->deadline;
+		}
+		if( m->parts.empty() ) {
+			HistWindow w = { m->endDateTime, m->durationStr };
+			hR->parts.push_back(w);
+		} else {
+			hR->parts.insert( hR->parts.end(), m->parts.begin(), m->parts.end() );
+		}
+		delete m;
+	}
+
+	char buf[32];
+	if( hR->durationStr[hR->durationStr.size() - 1] == 'S' ) {
+		snprintf( buf, sizeof(buf), "%ld S", (long)(end - begin) );
+	} else {
+		snprintf( buf, sizeof(buf), "%d D", ib_busy_days(begin, end) );
+	}
+	hR->durationStr = buf;
+	return hR;
+}
+
+/**
+ * Merge contiguous or overlapping requests for the same contract, whatToShow,
+ * barSizeSetting and useRTH into the fewest requests TWS still accepts. The
+ * original windows are kept as parts to split the response later. Only
+ * durations in seconds or days are merged.
+ * Return the number of saved requests.
+ */
+int HistTodo::coalesce()
+{
+	assert( checkedOutRequest == NULL );
+
+	std::map< std::string, std::vector<HistSpan> > groups;
+	std::vector<HistSpan> result;
+	int count_before = leftRequests.size();
+	int pos = 0;
+
+	for( std::list<HistRequest*>::const_iterator it = leftRequests.begin();
+		    it != leftRequests.end(); it++, pos++ ) {
+		HistSpan s = { pos, 0, 0, *it };
+		if( ib_max_duration( s.hR->barSizeSetting.c_str() ) == NULL
+		    || ib_window( s.hR->endDateTime, s.hR->durationStr,
+		                  &s.begin, &s.end ) != 0 ) {
+			result.push_back(s);
+			continue;
+		}
+		groups[coalesce_key(*s.hR)].push_back(s);
+	}
+
+	std::map< std::string, std::vector<HistSpan> >::iterator g;
+	for( g = groups.begin(); g != groups.end(); g++ ) {
+		std::vector<HistSpan> &v = g->second;
+		std::sort( v.begin(), v.end(), span_less );
+
+		const HistRequest &first = *v[0].hR;
+		const bool secs = first.durationStr[first.durationStr.size() - 1] == 'S';
+		int max_secs = ib_duration2secs(
+			ib_max_duration(first.barSizeSetting.c_str()) );
+		if( secs && max_secs > 86400 ) {
+			/* TWS rejects more seconds than one day */
+			max_secs = 86400;
+		}
+
+		std::vector<HistSpan> chunk;
+		time_t begin = 0;
+		time_t end = 0;
+		for( size_t i = 0; i <= v.size(); i++ ) {
+			if( i < v.size() && !chunk.empty() && v[i].begin <= end ) {
+				time_t e = std::max( end, v[i].end );
+				long span = secs ? (long)(e - begin)
+					: 86400L * ib_busy_days( begin, e );
+				if( span <= max_secs ) {
+					end = e;
+					chunk.push_back(v[i]);
+					continue;
+				}
+			}
+			if( !chunk.empty() ) {
+				HistSpan s = { chunk[0].pos, begin, end, NULL };
+				for( size_t j = 1; j < chunk.size(); j++ ) {
+					s.pos = std::min( s.pos, chunk[j].pos );
+				}
+				if( chunk.size() > 1 ) {
+					/* merged requests are gone, the result is as old as
+					   the oldest one */
+					int64_t queued = nowInMsecs();
+					for( size_t j = 0; j < chunk.size(); j++ ) {
+						queued = std::min( queued,
+							schedOf(chunk[j].hR).queued );
+						sched.erase( chunk[j].hR );
+					}
+					s.hR = merge_spans( chunk, begin, end );
+					addSched( s.hR );
+					sched[s.hR].queued = queued;
+				} else {
+					s.hR = chunk[0].hR;
+				}
+				result.push_back(s);
+				chunk.clear();
+			}
+			if( i < v.size() ) {
+				begin = v[i].begin;
+				end = v[i].end;
+				chunk.push_back(v[i]);
+			}
+		}
+	}
+
+	/* keep the order of the job file */
+	std::sort( result.begin(), result.end(), pos_less );
+	leftRequests.clear();
+	for( size_t i = 0; i < result.size(); i++ ) {
+		leftRequests.push_back( result[i].hR );
+	}
+
+	int saved = count_before - leftRequests.size();
+	INFO_PRINTF( "coalesced %d hist requests into %d, saved %d requests",
+		count_before, (int)leftRequests.size(), saved );
+	return saved;
+}
+
+
+/* all requests of one contract, sharding never splits them */
+struct HistShardUnit
+{
+	std::string farm;
+	uint32_t hash;
+	std::string key;
+	int count;
+	int shard;
+};
+
+static bool shard_unit_less( const HistShardUnit *a, const HistShardUnit *b )
+{
+	/* unknown farms last */
+	if( a->farm.empty() != b->farm.empty() ) {
+		return b->farm.empty();
+	}
+	if( a->farm != b->farm ) {
+		return a->farm < b->farm;
+	}
+	if( a->hash != b->hash ) {
+		return a->hash < b->hash;
+	}
+	return a->key < b->key;
+}
+
+/**
+ * Keep only the requests of shard idx out of cnt shards. Requests for the
+ * same contract always stay together. Without dfs a contract goes to shard
+ * hash % cnt which does not depend on the rest of the job. With dfs the
+ * contracts are ordered by hmds farm and cut into cnt ranges of about the
+ * same number of requests, so each shard gets as few farms as possible. This
+ * needs the same job file for all shards.
+ * Return the number of dropped requests.
+ */
+int HistTodo::shard( int idx, int cnt, const DataFarmStates *dfs )
+{
+	assert( checkedOutRequest == NULL );
+	assert( idx >= 0 && idx < cnt );
+
+	std::map<std::string, HistShardUnit> units;
+	for( std::list<HistRequest*>::const_iterator it = leftRequests.begin();
+		    it != leftRequests.end(); it++ ) {
+		const Contract &c = (*it)->ibContract;
+		std::string key = ibToString(c);
+		std::map<std::string, HistShardUnit>::iterator u = units.find(key);
+		if( u != units.end() ) {
+			u->second.count++;
+			continue;
+		}
+		HistShardUnit unit;
+		unit.farm = dfs != NULL ? dfs->getHmdsFarm(c) : "";
+		unit.hash = stable_hash(key);
+		unit.key = key;
+		unit.count = 1;
+		unit.shard = unit.hash % cnt;
+		units[key] = unit;
+	}
+
+	if( dfs != NULL ) {
+		std::vector<HistShardUnit*> v;
+		for( std::map<std::string, HistShardUnit>::iterator u = units.begin();
+			    u != units.end(); u++ ) {
+			v.push_back( &u->second );
+		}
+		std::sort( v.begin(), v.end(), shard_unit_less );
+		/* a contract belongs to the range where its middle request falls */
+		int64_t total = leftRequests.size();
+		int64_t pos = 0;
+		for( size_t i = 0; i < v.size(); i++ ) {
+			int64_t mid = 2 * pos + v[i]->count;
+			v[i]->shard = std::min( (int64_t)cnt - 1, mid * cnt / (2 * total) );
+			pos += v[i]->count;
+		}
+	}
+
+	int dropped = 0;
+	std::list<HistRequest*>::iterator it = leftRequests.begin();
+	while( it != leftRequests.end() ) {
+		if( units[ibToString((*it)->ibContract)].shard == idx ) {
+			it++;
+			continue;
+		}
+		sched.erase( *it );
+		delete *it;
+		it = leftRequests.erase( it );
+		dropped++;
+	}
+
+	shardIdx = idx;
+	shardCnt = cnt;
+	INFO_PRINTF( "shard %d/%d: keeping %d hist requests, dropped %d",
+		idx + 1, cnt, (int)leftRequests.size(), dropped );
+	return dropped;
+}
+
+
+void HistTodo::dumpProgress() const
+{
+	if( shardCnt > 1 ) {
+		INFO_PRINTF( "shard %d/%d: hist done %d, failed %d, left %d",
+			shardIdx + 1, shardCnt, (int)doneRequests.size(),
+			(int)errorRequests.size(), (int)leftRequests.size() );
+	} else {
+		INFO_PRINTF( "hist done %d, failed %d, left %d",
+			(int)doneRequests.size(), (int)errorRequests.size(),
+			(int)leftRequests.size() );
+	}
+}
+
+
 
 ContractDetailsTodo::ContractDetailsTodo() :
 	curIndex(-1),
@@ -338,12 +847,45 @@ void ContractDetailsTodo::add( const ContractDetailsRequest& cdr )
 	contractDetailsRequests.push_back(cdr);
 }
 
+/* drop finished requests, a long running process would grow forever */
+void ContractDetailsTodo::forgetDone()
+{
+	if( countLeft() <= 0 ) {
+		contractDetailsRequests.clear();
+		curIndex = -1;
+	}
+}
+
+/* like HistTodo::shard() without farms, contract details are not paced */
+int ContractDetailsTodo::shard( int idx, int cnt )
+{
+	assert( curIndex == -1 );
+
+	std::vector<ContractDetailsRequest> keep;
+	for( size_t i = 0; i < contractDetailsRequests.size(); i++ ) {
+		const ContractDetailsRequest &cdr = contractDetailsRequests[i];
+		if( (int)(stable_hash(ibToString(cdr.ibContract())) % cnt) == idx ) {
+			keep.push_back(cdr);
+		}
+	}
+	int dropped = contractDetailsRequests.size() - keep.size();
+	contractDetailsRequests.swap(keep);
+	INFO_PRINTF( "shard %d/%d: keeping %d contract details requests, "
+		"dropped %d", idx + 1, cnt, (int)contractDetailsRequests.size(),
+		dropped );
+	return dropped;
+}
+
 
 
 
 PlaceOrderTodo::PlaceOrderTodo() :
 	curIndex(-1),
-	placeOrders(*(new std::vector<PlaceOrder>()))
+	placeOrders(*(new std::vector<PlaceOrder>())),
+	nextValidId(0),
+	cntCoalesced(0),
+	cntDropped(0),
+	maxLeft(0)
 {
 }
 
@@ -361,6 +903,9 @@ void PlaceOrderTodo::checkout()
 {
 	assert( countLeft() > 0 );
 	curIndex++;
+	if( placeOrders[curIndex].orderId != 0 ) {
+		setNextValidId( placeOrders[curIndex].orderId + 1 );
+	}
 }
 
 const PlaceOrder& PlaceOrderTodo::current() const
@@ -371,7 +916,69 @@ const PlaceOrder& PlaceOrderTodo::current() const
 
 void PlaceOrderTodo::add( const PlaceOrder& po )
 {
-	placeOrders.push_back(po);
+	size_t i = curIndex + 1;
+	if( po.orderId != 0 ) {
+		/* at most one queued order per orderId */
+		while( i < placeOrders.size()
+		    && placeOrders[i].orderId != po.orderId ) {
+			i++;
+		}
+	} else {
+		i = placeOrders.size();
+	}
+	if( i < placeOrders.size() ) {
+		PlaceOrder &queued = placeOrders[i];
+		if( queued.isCancel() ) {
+			/* anything after a cancel is obsolete */
+			cntDropped++;
+			return;
+		} else if( !po.isCancel() ) {
+			/* only the newest modify is sent */
+			queued = po;
+			cntCoalesced++;
+			return;
+		}
+		/* the cancel replaces the queued order */
+		placeOrders.erase( placeOrders.begin() + i );
+		cntDropped++;
+		if( nextValidId > 0 && po.orderId >= nextValidId ) {
+			/* it was never sent, nothing to cancel */
+			cntDropped++;
+			return;
+		}
+	}
+
+	if( po.isCancel() ) {
+		/* cancels go first, in the order they came */
+		i = curIndex + 1;
+		while( i < placeOrders.size() && placeOrders[i].isCancel() ) {
+			i++;
+		}
+		placeOrders.insert( placeOrders.begin() + i, po );
+	} else {
+		placeOrders.push_back(po);
+	}
+	maxLeft = std::max( maxLeft, countLeft() );
+}
+
+void PlaceOrderTodo::forgetDone()
+{
+	if( countLeft() <= 0 ) {
+		placeOrders.clear();
+		curIndex = -1;
+	}
+}
+
+void PlaceOrderTodo::setNextValidId( long orderId )
+{
+	/* TWS wants increasing orderIds, so all below were sent before */
+	nextValidId = std::max( nextValidId, orderId );
+}
+
+void PlaceOrderTodo::dumpStats() const
+{
+	INFO_PRINTF( "order queue: %d left (max %d), %ld coalesced, "
+		"%ld dropped", countLeft(), maxLeft, cntCoalesced, cntDropped );
 }
 
 
@@ -393,6 +1000,38 @@ void MktDataTodo::add( const MktDataRequest& mkr )
 }
 
 
+MktDepthTodo::MktDepthTodo() :
+	mktDepthRequests(*(new std::vector<MktDepthRequest>()))
+{
+}
+
+MktDepthTodo::~MktDepthTodo()
+{
+	delete &mktDepthRequests;
+}
+
+void MktDepthTodo::add( const MktDepthRequest& mdr )
+{
+	mktDepthRequests.push_back(mdr);
+}
+
+
+RealTimeBarsTodo::RealTimeBarsTodo() :
+	realTimeBarsRequests(*(new std::vector<RealTimeBarsRequest>()))
+{
+}
+
+RealTimeBarsTodo::~RealTimeBarsTodo()
+{
+	delete &realTimeBarsRequests;
+}
+
+void RealTimeBarsTodo::add( const RealTimeBarsRequest& rbr )
+{
+	realTimeBarsRequests.push_back(rbr);
+}
+
+
 OptParamsTodo::OptParamsTodo() :
 	curIndex(-1),
 	optParamsRequests(*(new std::vector<OptParamsRequest>()))
@@ -432,15 +1071,26 @@ void OptParamsTodo::add( const OptParamsRequest& opr )
 	optParamsRequests.push_back(opr);
 }
 
+void OptParamsTodo::forgetDone()
+{
+	if( countLeft() <= 0 ) {
+		optParamsRequests.clear();
+		curIndex = -1;
+	}
+}
+
 
 WorkTodo::WorkTodo() :
 	acc_status_todo(false),
 	executions_todo(false),
 	orders_todo(false),
+	streaming_ok(true),
 	_contractDetailsTodo( new ContractDetailsTodo() ),
 	_histTodo( new HistTodo() ),
 	_place_order_todo( new PlaceOrderTodo() ),
 	_market_data_todo( new MktDataTodo() ),
+	_market_depth_todo( new MktDepthTodo() ),
+	_realtime_bars_todo( new RealTimeBarsTodo() ),
 	_opt_params_todo( new OptParamsTodo() )
 {
 }
@@ -451,6 +1101,12 @@ WorkTodo::~WorkTodo()
 	if( _opt_params_todo != NULL ) {
 		delete _opt_params_todo;
 	}
+	if( _realtime_bars_todo != NULL ) {
+		delete _realtime_bars_todo;
+	}
+	if( _market_depth_todo != NULL ) {
+		delete _market_depth_todo;
+	}
 	if( _market_data_todo != NULL ) {
 		delete _market_data_todo;
 	}
@@ -528,6 +1184,26 @@ const MktDataTodo& WorkTodo::getMktDataTodo() const
 	return *_market_data_todo;
 }
 
+MktDepthTodo* WorkTodo::mktDepthTodo() const
+{
+	return _market_depth_todo;
+}
+
+const MktDepthTodo& WorkTodo::getMktDepthTodo() const
+{
+	return *_market_depth_todo;
+}
+
+RealTimeBarsTodo* WorkTodo::realTimeBarsTodo() const
+{
+	return _realtime_bars_todo;
+}
+
+const RealTimeBarsTodo& WorkTodo::getRealTimeBarsTodo() const
+{
+	return *_realtime_bars_todo;
+}
+
 OptParamsTodo* WorkTodo::optParamsTodo() const
 {
 	return _opt_params_todo;
@@ -556,6 +1232,21 @@ void WorkTodo::addSimpleRequest( GenericRequest::ReqType reqType )
 }
 
 
+/* real-time bars can be aggregated to intraday multiples of 5 secs only */
+static bool check_rt_bar_sizes( const std::string &barSizeSetting )
+{
+	size_t b = 0;
+	do {
+		size_t e = barSizeSetting.find( ',', b );
+		int secs = ib_bar_size2secs( barSizeSetting.substr(b, e - b) );
+		if( secs <= 0 || secs % RT_BAR_SECS != 0 ) {
+			return false;
+		}
+		b = e == std::string::npos ? e : e + 1;
+	} while( b != std::string::npos );
+	return true;
+}
+
 int WorkTodo::read_req( const xmlNodePtr xn )
 {
 	int ret = 1;
@@ -564,6 +1255,12 @@ int WorkTodo::read_req( const xmlNodePtr xn )
 	if( tmp == NULL ) {
 		fprintf(stderr, "Warning, no request type specified.\n");
 		ret = 0;
+	} else if( !streaming_ok && (strcmp( tmp, "market_data") == 0
+	    || strcmp( tmp, "market_depth") == 0
+	    || strcmp( tmp, "realtime_bars") == 0) ) {
+		ERROR_PRINTF( "%s requests are only allowed at start, ignored",
+			tmp );
+		ret = 0;
 	} else if( strcmp( tmp, "contract_details") == 0 ) {
 		PacketContractDetails *pcd = PacketContractDetails::fromXml(xn);
 		_contractDetailsTodo->add(pcd->getRequest());
@@ -584,6 +1281,21 @@ int WorkTodo::read_req( const xmlNodePtr xn )
 		PacketContractDetails *pcd = PacketContractDetails::fromXml(xn);
 		_contractDetailsTodo->add(pcd->getRequest());
 		delete pcd;
+	} else if ( strcmp( tmp, "market_depth") == 0 ) {
+		PacketMktDepth *pmd = PacketMktDepth::fromXml(xn);
+		_market_depth_todo->add( pmd->getRequest() );
+		delete pmd;
+	} else if ( strcmp( tmp, "realtime_bars") == 0 ) {
+		PacketRealTimeBars *prb = PacketRealTimeBars::fromXml(xn);
+		if( check_rt_bar_sizes(prb->getRequest().barSizeSetting) ) {
+			_realtime_bars_todo->add( prb->getRequest() );
+		} else {
+			fprintf(stderr, "Warning, bad barSizeSetting '%s' of "
+				"realtime_bars ignored.\n",
+				prb->getRequest().barSizeSetting.c_str() );
+			ret = 0;
+		}
+		delete prb;
 	} else if ( strcmp( tmp, "opt_params") == 0 ) {
 		PacketOptParams *pop = PacketOptParams::fromXml(xn);
 		_opt_params_todo->add(pop->getRequest());
@@ -603,17 +1315,28 @@ int WorkTodo::read_req( const xmlNodePtr xn )
 	return ret;
 }
 
-int WorkTodo::read_file( const char *fileName )
+int WorkTodo::read_file( const char *fileName, bool coalesce )
 {
-	int retVal = -1;
-
 	TwsXml file;
 	if( ! file.openFile(fileName) ) {
-		return retVal;
+		return -1;
 	}
-	retVal = 0;
+	return read_xml( &file, coalesce );
+}
+
+/* like read_file() but for a job we have already in memory */
+int WorkTodo::read_mem( const std::string &job, bool coalesce )
+{
+	TwsXml file;
+	file.openMem( job.data(), job.size() );
+	return read_xml( &file, coalesce );
+}
+
+int WorkTodo::read_xml( TwsXml *file, bool coalesce )
+{
+	int retVal = 0;
 	xmlNodePtr xn;
-	while( (xn = file.nextXmlNode()) != NULL ) {
+	while( (xn = file->nextXmlNode()) != NULL ) {
 		assert( xn->type == XML_ELEMENT_NODE  );
 		if( strcmp((char*)xn->name, "request") == 0 ) {
 			retVal += read_req( xn );
@@ -623,9 +1346,35 @@ int WorkTodo::read_file( const char *fileName )
 		}
 	}
 
+	if( coalesce ) {
+		_histTodo->coalesce();
+	}
 	return retVal;
 }
 
+/* free everything finished, for long running processes */
+void WorkTodo::forgetDone()
+{
+	_contractDetailsTodo->forgetDone();
+	_histTodo->forgetDone();
+	_place_order_todo->forgetDone();
+	_opt_params_todo->forgetDone();
+}
+
+/* subscriptions are set up once for the first job, later jobs can't
+   change them */
+void WorkTodo::allowStreaming( bool ok )
+{
+	streaming_ok = ok;
+}
+
+/* keep only our part of the job, return the number of dropped requests */
+int WorkTodo::shard( int idx, int cnt, const DataFarmStates *dfs )
+{
+	return _contractDetailsTodo->shard( idx, cnt )
+		+ _histTodo->shard( idx, cnt, dfs );
+}
+
 
 
 
@@ -677,7 +1426,7 @@ req_err Packet::getError() const
 void Packet::closeError( req_err e )
 {
 	if( mode != RECORD ) {
-		DEBUG_PRINTF( "Warning, closeError closed packet.");
+		WARN_PRINTF( "Warning, closeError closed packet.");
 		assert( mode == CLOSED );
 		return;
 	}
@@ -827,6 +1576,16 @@ PacketHistData * PacketHistData::fromXml( xmlNodePtr root )
 			if( strcmp((char*)p->name, "query") == 0 ) {
 				phd->request = new HistRequest();
 				from_xml(phd->request, p);
+				char *tmp = (char*) xmlGetProp( root, (xmlChar*) "priority" );
+				if( tmp ) {
+					phd->request->priority = atoi( tmp );
+					free(tmp);
+				}
+				tmp = (char*) xmlGetProp( root, (xmlChar*) "deadline" );
+				if( tmp ) {
+					phd->request->deadline = tmp;
+					free(tmp);
+				}
 			}
 			if( strcmp((char*)p->name, "response") == 0 ) {
 				for( xmlNodePtr q = p->children; q!= NULL; q=q->next) {
@@ -855,11 +1614,25 @@ PacketHistData * PacketHistData::fromXml( xmlNodePtr root )
 
 void PacketHistData::dumpXml()
 {
+	if( mode == CLOSED && !request->parts.empty() ) {
+		dumpXmlParts();
+		return;
+	}
+
 	xmlNodePtr root = TwsXml::newDocRoot();
 	xmlNodePtr nphd = xmlNewChild( root, NULL,
 		(const xmlChar*)"request", NULL );
 	xmlNewProp( nphd, (const xmlChar*)"type",
 		(const xmlChar*)"historical_data" );
+	if( request->priority != 0 ) {
+		char tmp[16];
+		snprintf( tmp, sizeof(tmp), "%d", request->priority );
+		xmlNewProp( nphd, (const xmlChar*)"priority", (const xmlChar*)tmp );
+	}
+	if( !request->deadline.empty() ) {
+		xmlNewProp( nphd, (const xmlChar*)"deadline",
+			(const xmlChar*)request->deadline.c_str() );
+	}
 
 	to_xml(nphd, *request);
 
@@ -873,11 +1646,91 @@ void PacketHistData::dumpXml()
 	TwsXml::dumpAndFree( root );
 }
 
+/* bar time of a row, formatDate 1 is local time, 2 is epoch */
+static time_t row_time( const RowHist &row, int formatDate )
+{
+	if( formatDate == 2 ) {
+		char *end;
+		long t = strtol( row.date.c_str(), &end, 10 );
+		return (*end == '\0' && end != row.date.c_str()) ? t : -1;
+	}
+	return ib_datetime2time_t( row.date );
+}
+
+/**
+ * Split the response of a coalesced request back into the originally
+ * requested windows and dump each one like a separate request.
+ */
+void PacketHistData::dumpXmlParts()
+{
+	const size_t n = request->parts.size();
+	std::vector<time_t> begin( n, 0 );
+	std::vector<time_t> end( n, 0 );
+	for( size_t i = 0; i < n; i++ ) {
+		const HistWindow &w = request->parts[i];
+		if( ib_window(w.endDateTime, w.durationStr, &begin[i], &end[i]) != 0 ) {
+			/* matches no row */
+			begin[i] = end[i] = 0;
+		}
+	}
+
+	/* rows outside of all windows are not requested (-2), rows without
+	   date go with the previous row or, leading ones, with the next one */
+	std::vector<int> part( rows.size(), -1 );
+	int prev = -1;
+	for( size_t j = 0; j < rows.size(); j++ ) {
+		time_t t = row_time( rows[j], request->formatDate );
+		if( t == -1 ) {
+			part[j] = prev;
+			continue;
+		}
+		part[j] = -2;
+		for( size_t i = 0; i < n; i++ ) {
+			if( t >= begin[i] && t < end[i] ) {
+				part[j] = prev = i;
+				break;
+			}
+		}
+	}
+	int next = 0;
+	for( size_t j = rows.size(); j-- > 0; ) {
+		if( part[j] == -1 ) {
+			part[j] = next;
+		} else if( part[j] >= 0 ) {
+			next = part[j];
+		}
+	}
+
+	for( size_t i = 0; i < n; i++ ) {
+		const HistWindow &w = request->parts[i];
+		HistRequest hR( *request );
+		hR.endDateTime = w.endDateTime;
+		hR.durationStr = w.durationStr;
+		hR.parts.clear();
+
+		PacketHistData phd;
+		phd.record( reqId, hR );
+		for( size_t j = 0; j < rows.size(); j++ ) {
+			if( part[j] == (int)i ) {
+				phd.rows.push_back( rows[j] );
+			}
+		}
+		phd.finishRow = finishRow;
+		phd.mode = CLOSED;
+		phd.dumpXml();
+	}
+}
+
 const HistRequest& PacketHistData::getRequest() const
 {
 	return *request;
 }
 
+const std::vector<RowHist>& PacketHistData::getRows() const
+{
+	return rows;
+}
+
 
 void PacketHistData::clear()
 {
@@ -1037,11 +1890,23 @@ void PacketPlaceOrder::clear()
 	}
 }
 
+void PacketPlaceOrder::recycle()
+{
+	mode = CLEAN;
+	error = REQ_ERR_NONE;
+	del_tws_rows(list);
+	list->clear();
+}
+
 void PacketPlaceOrder::record( long orderId, const PlaceOrder& oP )
 {
-	assert( mode == CLEAN && error == REQ_ERR_NONE && request == NULL );
+	assert( mode == CLEAN && error == REQ_ERR_NONE );
 	mode = RECORD;
-	this->request = new PlaceOrder( oP );
+	if( this->request == NULL ) {
+		this->request = new PlaceOrder( oP );
+	} else {
+		*this->request = oP;
+	}
 	this->request->orderId = orderId;
 	this->request->time_sent = nowInMsecs();
 }
@@ -1067,7 +1932,8 @@ void PacketPlaceOrder::append( const RowOrderStatus& row )
 	TwsRow arow = { t_orderStatus, new RowOrderStatus(row) };
 	list->push_back( arow );
 
-	if( row.remaining == 0 ) {
+	if( row.remaining == 0 || row.status == "Cancelled"
+	    || row.status == "ApiCancelled" ) {
 		mode = CLOSED;
 	}
 }
@@ -1381,6 +2247,11 @@ PacketMktData * PacketMktData::fromXml( xmlNodePtr root )
 			if( strcmp((char*)p->name, "query") == 0 ) {
 				pmd->request = new MktDataRequest();
 				from_xml(pmd->request, p);
+				char *tmp = (char*) xmlGetProp( root, (xmlChar*) "priority" );
+				if( tmp ) {
+					pmd->request->priority = atoi( tmp );
+					free(tmp);
+				}
 			}
 			if( strcmp((char*)p->name, "response") == 0 ) {
 				for( xmlNodePtr q = p->children; q!= NULL; q=q->next) {
@@ -1452,6 +2323,106 @@ void PacketMktData::record( int reqId, const MktDataRequest& mR )
 // }
 
 
+PacketMktDepth::PacketMktDepth()
+{
+	request = NULL;
+}
+
+PacketMktDepth::~PacketMktDepth()
+{
+	if( request != NULL ) {
+		delete request;
+	}
+}
+
+PacketMktDepth * PacketMktDepth::fromXml( xmlNodePtr root )
+{
+	PacketMktDepth *pmd = new PacketMktDepth();
+
+	for( xmlNodePtr p = root->children; p!= NULL; p=p->next) {
+		if( p->type == XML_ELEMENT_NODE
+		    && strcmp((char*)p->name, "query") == 0 ) {
+			pmd->request = new MktDepthRequest();
+			from_xml(pmd->request, p);
+		}
+	}
+	if( pmd->request == NULL ) {
+		/* like an empty query */
+		pmd->request = new MktDepthRequest();
+	}
+	return pmd;
+}
+
+void PacketMktDepth::dumpXml()
+{
+}
+
+const MktDepthRequest& PacketMktDepth::getRequest() const
+{
+	return *request;
+}
+
+void PacketMktDepth::clear()
+{
+	mode = CLEAN;
+	error = REQ_ERR_NONE;
+	if( request != NULL ) {
+		delete request;
+		request = NULL;
+	}
+}
+
+
+PacketRealTimeBars::PacketRealTimeBars()
+{
+	request = NULL;
+}
+
+PacketRealTimeBars::~PacketRealTimeBars()
+{
+	if( request != NULL ) {
+		delete request;
+	}
+}
+
+PacketRealTimeBars * PacketRealTimeBars::fromXml( xmlNodePtr root )
+{
+	PacketRealTimeBars *prb = new PacketRealTimeBars();
+
+	for( xmlNodePtr p = root->children; p!= NULL; p=p->next) {
+		if( p->type == XML_ELEMENT_NODE
+		    && strcmp((char*)p->name, "query") == 0 ) {
+			prb->request = new RealTimeBarsRequest();
+			from_xml(prb->request, p);
+		}
+	}
+	if( prb->request == NULL ) {
+		/* like an empty query */
+		prb->request = new RealTimeBarsRequest();
+	}
+	return prb;
+}
+
+void PacketRealTimeBars::dumpXml()
+{
+}
+
+const RealTimeBarsRequest& PacketRealTimeBars::getRequest() const
+{
+	return *request;
+}
+
+void PacketRealTimeBars::clear()
+{
+	mode = CLEAN;
+	error = REQ_ERR_NONE;
+	if( request != NULL ) {
+		delete request;
+		request = NULL;
+	}
+}
+
+
 PacketOptParams::PacketOptParams() :
 	opList(new std::vector<RowOptParams>())
 {
@@ -1609,7 +2580,7 @@ void PacingControl::clear()
 		if( now - dateTimes.back() < 5000  ) {
 			// HACK race condition might cause assert in notifyViolation(),
 			// to avoid this we would need to ack each request
-			DEBUG_PRINTF( "Warning, keep last pacing date time "
+			WARN_PRINTF( "Warning, keep last pacing date time "
 				"because it looks too new." );
 			dateTimes.erase( dateTimes.begin(), --(dateTimes.end()) );
 			violations.erase( violations.begin(), --(violations.end()) );
@@ -1631,7 +2602,7 @@ void PacingControl::addRequest()
 void PacingControl::remove_last_request()
 {
 	if( dateTimes.size() <= 0 ) {
-		DEBUG_PRINTF( "Warning, assert remove_last_request");
+		WARN_PRINTF( "Warning, assert remove_last_request");
 		return;
 	}
 	dateTimes.pop_back();
@@ -1643,7 +2614,7 @@ void PacingControl::notifyViolation()
 	if( violations.empty() ) {
 		/* Either we have cleared violations for no good reason or TWS itself
 		   made requests where we don't know about */
-		DEBUG_PRINTF( "Warning, pacing violation occurred while HMDS farm "
+		WARN_PRINTF( "Warning, pacing violation occurred while HMDS farm "
 			"looks clear.");
 		addRequest();
 	}
@@ -1830,7 +2801,7 @@ void PacingGod::clear()
 {
 	if( dataFarms.getActives().empty() ) {
 		// clear all PacingControls
-		DEBUG_PRINTF( "clear all pacing controls" );
+		INFO_PRINTF( "clear all pacing controls" );
 		controlGlobal.clear();
 		std::map<const std::string, PacingControl*>::iterator it;
 
@@ -1846,7 +2817,7 @@ void PacingGod::clear()
 		for( std::vector<std::string>::const_iterator it = inactives.begin();
 			    it != inactives.end(); it++ ) {
 			if( controlHmds.find(*it) != controlHmds.end() ) {
-				DEBUG_PRINTF( "clear pacing control of inactive farm %s",
+				INFO_PRINTF( "clear pacing control of inactive farm %s",
 					it->c_str() );
 				controlHmds.find(*it)->second->clear();
 			}
@@ -2198,7 +3169,7 @@ void DataFarmStates::check_edemo_hack( const std::string &farm )
 	   after reconnect. To fix it we would need to handle the general case that
 	   we've learned a wrong farm somehow which should be handled anyway. */
 	if( farm == "ibdemo" || farm == "demohmds" ) {
-		DEBUG_PRINTF( "Dropping hardcoded data farms because edemo TWS." );
+		INFO_PRINTF( "Dropping hardcoded data farms because edemo TWS." );
 		hLearn.clear();
 	}
 	edemo_checked = true;
@@ -2336,20 +3307,20 @@ void DataFarmStates::learnHmds( const Contract& c )
 	if( ! known_farm.empty() ) {
 		/* Either this is a race (TWS told us a farm is broken before sending
 		   last data) or our known farm is wrong. Just ignore this for now. */
-		DEBUG_PRINTF( "Warning, known HMDS farm (%s->%s) is not active (%s).",
+		WARN_PRINTF( "Warning, known HMDS farm (%s->%s) is not active (%s).",
 			lazyC.c_str(), known_farm.c_str(), farms_ok_str.c_str() );
 		return;
 	}
 
 	if( sl.size() <= 0 ) {
-		DEBUG_PRINTF( "Warning, can't learn HMDS while no farm is active.");
+		WARN_PRINTF( "Warning, can't learn HMDS while no farm is active.");
 	} else if( sl.size() == 1 ) {
 		hLearn[lazyC] = sl.front();
-		DEBUG_PRINTF( "learn HMDS farm (unique): %s %s",
+		INFO_PRINTF( "learn HMDS farm (unique): %s %s",
 			lazyC.c_str(), sl.front().c_str() );
 	} else {
 		//but doing nothing
-		DEBUG_PRINTF( "learn HMDS farm (ambiguous): %s (%s)",
+		INFO_PRINTF( "learn HMDS farm (ambiguous): %s (%s)",
 			lazyC.c_str(),
 			farms_ok_str.c_str() );
 	}
@@ -2374,7 +3345,7 @@ void DataFarmStates::learnHmdsLastOk(int msgNumber, const Contract& c )
 			assert( hLearn.find(lazyC)->second == lastChanged );
 		} else {
 			hLearn[lazyC] = lastChanged;
-			DEBUG_PRINTF( "learn HMDS farm (last ok): %s %s",
+			INFO_PRINTF( "learn HMDS farm (last ok): %s %s",
 				lazyC.c_str(), lastChanged.c_str());
 		}
 	}
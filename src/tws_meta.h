@@ -66,6 +66,7 @@ class GenericRequest
 		ReqType reqType() const;
 		int reqId() const;
 		int age() const;
+		int64_t ctime() const;
 		void nextRequest( ReqType );
 		void close();
 
@@ -87,6 +88,8 @@ class HistRequest;
 class PacingGod;
 class DataFarmStates;
 class WorkTodo;
+struct HistSched;
+struct HistPrioStats;
 
 class HistTodo
 {
@@ -95,6 +98,7 @@ class HistTodo
 		~HistTodo();
 
 		void dumpLeft() const;
+		void dumpLeftXml() const;
 
 		int countDone() const;
 		int countLeft() const;
@@ -106,12 +110,33 @@ class HistTodo
 		void add( const HistRequest& );
 		int skip_by_perm(const Contract&);
 		int skip_by_nodata(const HistRequest&);
+		int coalesce();
+		int shard( int idx, int cnt, const DataFarmStates *dfs );
+		void dumpStats() const;
+		void dumpProgress() const;
+		void forgetDone();
 
 	private:
+		void addSched( const HistRequest* );
+		const HistSched& schedOf( const HistRequest* ) const;
+		bool sched_less( const HistRequest*, const HistRequest* ) const;
+		void finSched( bool ok );
+		void predictDeadlines( int64_t now );
+
 		std::list<HistRequest*> &doneRequests;
 		std::list<HistRequest*> &leftRequests;
 		std::list<HistRequest*> &errorRequests;
 		HistRequest *checkedOutRequest;
+
+		std::map<const HistRequest*, HistSched> &sched;
+		std::map<int, HistPrioStats> &prioStats;
+		/* when the last request finished and the smoothed time between
+		   two of them */
+		int64_t lastFin;
+		int64_t svcMsecs;
+
+		int shardIdx;
+		int shardCnt;
 };
 
 
@@ -133,6 +158,8 @@ class ContractDetailsTodo
 		void repeat();
 		const ContractDetailsRequest& current() const;
 		void add( const ContractDetailsRequest& );
+		int shard( int idx, int cnt );
+		void forgetDone();
 
 	private:
 		int curIndex;
@@ -153,11 +180,23 @@ class PlaceOrderTodo
 		int countLeft() const;
 		void checkout();
 		const PlaceOrder& current() const;
+		/* queued orders with the same orderId are coalesced, cancels go
+		   first */
 		void add( const PlaceOrder& );
+		void forgetDone();
+		/* orderIds below that were used already, TWS's nextValidId */
+		void setNextValidId( long orderId );
+
+		void dumpStats() const;
 
 	private:
 		int curIndex;
 		std::vector<PlaceOrder> &placeOrders;
+		long nextValidId;
+
+		long cntCoalesced;
+		long cntDropped;
+		int maxLeft;
 };
 
 
@@ -176,6 +215,32 @@ class MktDataTodo
 		std::vector<MktDataRequest> &mktDataRequests;
 };
 
+class MktDepthRequest;
+
+class MktDepthTodo
+{
+	public:
+		MktDepthTodo();
+		virtual ~MktDepthTodo();
+
+		void add( const MktDepthRequest& );
+
+		std::vector<MktDepthRequest> &mktDepthRequests;
+};
+
+class RealTimeBarsRequest;
+
+class RealTimeBarsTodo
+{
+	public:
+		RealTimeBarsTodo();
+		virtual ~RealTimeBarsTodo();
+
+		void add( const RealTimeBarsRequest& );
+
+		std::vector<RealTimeBarsRequest> &realTimeBarsRequests;
+};
+
 class OptParamsRequest;
 
 class OptParamsTodo
@@ -188,12 +253,15 @@ class OptParamsTodo
 		void repeat();
 		const OptParamsRequest& current() const;
 		void add( const OptParamsRequest& );
+		void forgetDone();
 
 // 	private:
 		int curIndex;
 		std::vector<OptParamsRequest> &optParamsRequests;
 };
 
+class TwsXml;
+
 class WorkTodo
 {
 	public:
@@ -209,21 +277,34 @@ class WorkTodo
 		const PlaceOrderTodo& getPlaceOrderTodo() const;
 		MktDataTodo *mktDataTodo() const;
 		const MktDataTodo& getMktDataTodo() const;
+		MktDepthTodo *mktDepthTodo() const;
+		const MktDepthTodo& getMktDepthTodo() const;
+		RealTimeBarsTodo *realTimeBarsTodo() const;
+		const RealTimeBarsTodo& getRealTimeBarsTodo() const;
 		OptParamsTodo *optParamsTodo() const;
 		const OptParamsTodo& getOptParamsTodo() const;
 		void addSimpleRequest( GenericRequest::ReqType reqType );
-		int read_file( const char *fileName);
+		int read_file( const char *fileName, bool coalesce = false );
+		int read_mem( const std::string &job, bool coalesce = false );
+		int shard( int idx, int cnt, const DataFarmStates *dfs );
+		void forgetDone();
+		/* whether market data, depth and real-time bars may be read */
+		void allowStreaming( bool );
 
 	private:
+		int read_xml( TwsXml *file, bool coalesce );
 		int read_req( const xmlNodePtr xn );
 
 		mutable bool acc_status_todo;
 		mutable bool executions_todo;
 		mutable bool orders_todo;
+		bool streaming_ok;
 		ContractDetailsTodo *_contractDetailsTodo;
 		HistTodo *_histTodo;
 		PlaceOrderTodo *_place_order_todo;
 		MktDataTodo *_market_data_todo;
+		MktDepthTodo *_market_depth_todo;
+		RealTimeBarsTodo *_realtime_bars_todo;
 		OptParamsTodo *_opt_params_todo;
 };
 
@@ -342,6 +423,7 @@ class PacketHistData
 		static PacketHistData * fromXml( xmlNodePtr );
 
 		const HistRequest& getRequest() const;
+		const std::vector<RowHist>& getRows() const;
 		void clear();
 		void record( int reqId, const HistRequest& );
 		void append( int reqId, const RowHist& );
@@ -350,6 +432,8 @@ class PacketHistData
 		void dumpXml();
 
 	private:
+		void dumpXmlParts();
+
 		int reqId;
 		HistRequest *request;
 		std::vector<RowHist> &rows;
@@ -372,6 +456,8 @@ class PacketPlaceOrder
 
 		const PlaceOrder& getRequest() const;
 		virtual void clear();
+		/* like clear() but keep the request for the next record() */
+		void recycle();
 		void record( long orderId, const PlaceOrder& );
 		void modify( const PlaceOrder& );
 		void append( const RowError& );
@@ -553,6 +639,42 @@ class PacketMktData
 // 		std::vector<RowHist> &rows;
 };
 
+class PacketMktDepth
+	: public  Packet
+{
+	public:
+		PacketMktDepth();
+		virtual ~PacketMktDepth();
+
+		static PacketMktDepth * fromXml( xmlNodePtr );
+
+		const MktDepthRequest& getRequest() const;
+		void clear();
+
+		void dumpXml();
+
+	private:
+		MktDepthRequest *request;
+};
+
+class PacketRealTimeBars
+	: public  Packet
+{
+	public:
+		PacketRealTimeBars();
+		virtual ~PacketRealTimeBars();
+
+		static PacketRealTimeBars * fromXml( xmlNodePtr );
+
+		const RealTimeBarsRequest& getRequest() const;
+		void clear();
+
+		void dumpXml();
+
+	private:
+		RealTimeBarsRequest *request;
+};
+
 struct RowOptParams
 {
 	std::string exchange;
@@ -0,0 +1,458 @@
+/*** tws_orders.cpp -- order lifecycle of job orders and order states
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_orders.h"
+#include "tws_meta.h"
+#include "tws_query.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <assert.h>
+#include <algorithm>
+
+
+/* entries per slab chunk */
+#define CHUNK_SIZE 256
+/* non transmit orders are closed when we haven't received errors */
+#define NON_TRANSMIT_MSECS 5000
+
+
+static bool final_status( const std::string &status )
+{
+	return status == "Filled" || status == "Cancelled"
+		|| status == "ApiCancelled" || status == "Inactive";
+}
+
+
+struct OrderManager::Entry
+{
+	long orderId;
+	long permId;
+	/* kept when the entry is reused */
+	PacketPlaceOrder *packet;
+	bool used;
+	bool job;
+	bool archived;
+	bool hasStatus;
+	/* changes whenever the entry gets archived again or reused */
+	uint32_t gen;
+	int64_t doneAt;
+	/* free list */
+	int next;
+	RowOrderStatus status;
+};
+
+
+/**
+ * Linear probing hash of positive keys to entry indices. Key 0 marks empty
+ * cells, deletion shifts back the following cells instead of leaving
+ * tombstones.
+ */
+class OrderManager::Index
+{
+	public:
+		Index() : n(0), bits(0)
+		{
+			resize( 6 );
+		}
+
+		int get( long key ) const
+		{
+			if( key <= 0 ) {
+				return -1;
+			}
+			const size_t mask = cells.size() - 1;
+			for( size_t i = home(key); ; i = (i + 1) & mask ) {
+				if( cells[i].key == key ) {
+					return cells[i].val;
+				} else if( cells[i].key == 0 ) {
+					return -1;
+				}
+			}
+		}
+
+		void put( long key, int val )
+		{
+			assert( key > 0 );
+			if( 2 * (n + 1) > (int)cells.size() ) {
+				resize( bits + 1 );
+			}
+			const size_t mask = cells.size() - 1;
+			size_t i = home( key );
+			while( cells[i].key != 0 && cells[i].key != key ) {
+				i = (i + 1) & mask;
+			}
+			if( cells[i].key == 0 ) {
+				n++;
+			}
+			cells[i].key = key;
+			cells[i].val = val;
+		}
+
+		void erase( long key )
+		{
+			if( key <= 0 ) {
+				return;
+			}
+			const size_t mask = cells.size() - 1;
+			size_t i = home( key );
+			while( cells[i].key != key ) {
+				if( cells[i].key == 0 ) {
+					return;
+				}
+				i = (i + 1) & mask;
+			}
+			for( size_t j = (i + 1) & mask; cells[j].key != 0;
+			    j = (j + 1) & mask ) {
+				/* move back cells whose home isn't within (i,j] */
+				const size_t k = home( cells[j].key );
+				if( i <= j ? (i < k && k <= j) : (i < k || k <= j) ) {
+					continue;
+				}
+				cells[i] = cells[j];
+				i = j;
+			}
+			cells[i].key = 0;
+			n--;
+		}
+
+		int size() const
+		{
+			return n;
+		}
+
+	private:
+		struct Cell
+		{
+			long key;
+			int val;
+		};
+
+		size_t home( long key ) const
+		{
+			return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ULL)
+				>> (64 - bits));
+		}
+
+		void resize( int newBits )
+		{
+			std::vector<Cell> old;
+			old.swap( cells );
+			Cell empty = { 0, -1 };
+			bits = newBits;
+			cells.assign( (size_t)1 << bits, empty );
+			n = 0;
+			for( size_t i = 0; i < old.size(); i++ ) {
+				if( old[i].key != 0 ) {
+					put( old[i].key, old[i].val );
+				}
+			}
+		}
+
+		std::vector<Cell> cells;
+		int n;
+		int bits;
+};
+
+
+
+
+OrderManager::OrderManager( int64_t retentionMsecs ) :
+	retention(retentionMsecs),
+	chunks(*(new std::vector<Entry*>())),
+	nEntries(0),
+	freeHead(-1),
+	nLive(0),
+	byOrderId(*(new Index())),
+	byPermId(*(new Index())),
+	jobs(*(new std::vector<int>())),
+	archived(*(new std::deque<std::pair<int, uint32_t> >())),
+	cntJobs(0),
+	cntStates(0),
+	cntArchived(0),
+	cntPurged(0),
+	cntLate(0),
+	maxLive(0)
+{
+	assert( retentionMsecs >= 0 );
+}
+
+OrderManager::~OrderManager()
+{
+	for( int i = 0; i < nEntries; i++ ) {
+		delete at(i).packet;
+	}
+	for( size_t c = 0; c < chunks.size(); c++ ) {
+		delete[] chunks[c];
+	}
+	delete &archived;
+	delete &jobs;
+	delete &byPermId;
+	delete &byOrderId;
+	delete &chunks;
+}
+
+OrderManager::Entry& OrderManager::at( int i ) const
+{
+	assert( i >= 0 && i < nEntries );
+	return chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+}
+
+int OrderManager::alloc()
+{
+	if( freeHead < 0 ) {
+		Entry *chunk = new Entry[CHUNK_SIZE];
+		chunks.push_back( chunk );
+		for( int k = CHUNK_SIZE - 1; k >= 0; k-- ) {
+			chunk[k].packet = NULL;
+			chunk[k].used = false;
+			chunk[k].gen = 0;
+			chunk[k].next = freeHead;
+			freeHead = nEntries + k;
+		}
+		nEntries += CHUNK_SIZE;
+	}
+	const int i = freeHead;
+	Entry &e = at( i );
+	assert( !e.used );
+	freeHead = e.next;
+	e.used = true;
+	nLive++;
+	maxLive = std::max( maxLive, nLive );
+	return i;
+}
+
+void OrderManager::release( int i )
+{
+	Entry &e = at( i );
+	assert( e.used );
+	if( byOrderId.get(e.orderId) == i ) {
+		byOrderId.erase( e.orderId );
+	}
+	if( byPermId.get(e.permId) == i ) {
+		byPermId.erase( e.permId );
+	}
+	e.used = false;
+	e.gen++;
+	e.next = freeHead;
+	freeHead = i;
+	nLive--;
+}
+
+/* orders of other clients may reuse our orderIds, the permId decides */
+int OrderManager::lookup( long orderId, long permId ) const
+{
+	const int i = byOrderId.get( orderId );
+	if( i >= 0 ) {
+		const Entry &e = at( i );
+		if( permId <= 0 || e.permId <= 0 || e.permId == permId ) {
+			return i;
+		}
+	}
+	return byPermId.get( permId );
+}
+
+int OrderManager::create( long orderId, long permId )
+{
+	const int i = alloc();
+	Entry &e = at( i );
+	e.orderId = orderId;
+	e.permId = 0;
+	e.job = false;
+	e.archived = false;
+	e.hasStatus = false;
+	e.doneAt = 0;
+	if( orderId > 0 && byOrderId.get(orderId) < 0 ) {
+		byOrderId.put( orderId, i );
+	}
+	setPermId( i, permId );
+	return i;
+}
+
+void OrderManager::setPermId( int i, long permId )
+{
+	Entry &e = at( i );
+	if( permId <= 0 || e.permId == permId ) {
+		return;
+	}
+	if( byPermId.get(e.permId) == i ) {
+		byPermId.erase( e.permId );
+	}
+	e.permId = permId;
+	byPermId.put( permId, i );
+}
+
+void OrderManager::archive( int i, int64_t nowMsecs )
+{
+	Entry &e = at( i );
+	assert( !e.archived );
+	e.archived = true;
+	e.doneAt = nowMsecs;
+	archived.push_back( std::make_pair(i, e.gen) );
+	cntArchived++;
+}
+
+void OrderManager::purge( int64_t nowMsecs )
+{
+	while( !archived.empty() ) {
+		const int i = archived.front().first;
+		Entry &e = at( i );
+		if( e.used && e.archived && e.gen == archived.front().second ) {
+			if( nowMsecs - e.doneAt < retention ) {
+				break;
+			}
+			release( i );
+			cntPurged++;
+		}
+		/* else reopened or reused since then */
+		archived.pop_front();
+	}
+}
+
+
+PacketPlaceOrder* OrderManager::open( long orderId )
+{
+	assert( orderId > 0 );
+	int i = byOrderId.get( orderId );
+	if( i < 0 ) {
+		i = create( orderId, 0 );
+	}
+	Entry &e = at( i );
+	assert( !e.job || e.archived );
+	if( e.archived ) {
+		/* placed again, drop it from the archive */
+		e.archived = false;
+		e.gen++;
+	}
+	e.job = true;
+	if( e.packet == NULL ) {
+		e.packet = new PacketPlaceOrder();
+	} else {
+		e.packet->recycle();
+	}
+	jobs.push_back( i );
+	cntJobs++;
+	return e.packet;
+}
+
+PacketPlaceOrder* OrderManager::find( long orderId, bool *isArchived ) const
+{
+	const int i = byOrderId.get( orderId );
+	if( i < 0 || !at(i).job ) {
+		return NULL;
+	}
+	if( isArchived != NULL ) {
+		*isArchived = at(i).archived;
+	}
+	return at(i).packet;
+}
+
+int OrderManager::active() const
+{
+	return jobs.size();
+}
+
+void OrderManager::update( const RowOrderStatus &row )
+{
+	int i = lookup( row.id, row.permId );
+	if( i < 0 ) {
+		i = create( row.id, row.permId );
+	} else {
+		setPermId( i, row.permId );
+	}
+	Entry &e = at( i );
+	e.status = row;
+	e.hasStatus = true;
+	cntStates++;
+	if( e.archived ) {
+		cntLate++;
+	} else if( !e.job && final_status(row.status) ) {
+		archive( i, nowInMsecs() );
+	}
+}
+
+void OrderManager::update( const RowOpenOrder &row )
+{
+	int i = lookup( row.orderId, row.order.permId );
+	if( i < 0 ) {
+		i = create( row.orderId, row.order.permId );
+	} else {
+		setPermId( i, row.order.permId );
+	}
+	Entry &e = at( i );
+	if( e.archived ) {
+		cntLate++;
+	} else if( !e.job && final_status(row.orderState.status) ) {
+		archive( i, nowInMsecs() );
+	}
+}
+
+void OrderManager::openStatus( std::vector<const RowOrderStatus*> *out ) const
+{
+	for( int i = 0; i < nEntries; i++ ) {
+		const Entry &e = at( i );
+		if( e.used && e.hasStatus && !final_status(e.status.status) ) {
+			out->push_back( &e.status );
+		}
+	}
+}
+
+bool OrderManager::collect( int64_t nowMsecs )
+{
+	bool ok = true;
+	size_t keep = 0;
+	for( size_t k = 0; k < jobs.size(); k++ ) {
+		const int i = jobs[k];
+		Entry &e = at( i );
+		PacketPlaceOrder *p = e.packet;
+		const PlaceOrder &r = p->getRequest();
+		bool done = false;
+
+		assert( e.orderId == r.orderId );
+		if( !p->finished() ) {
+			/* close non transmit orders where we haven't received errors */
+			if( !r.order.transmit
+			    && (nowMsecs - r.time_sent) > NON_TRANSMIT_MSECS ) {
+				p->closeError( REQ_ERR_NONE );
+			}
+		}
+
+		if( p->finished() ) {
+			switch( p->getError() ) {
+			case REQ_ERR_NONE:
+			case REQ_ERR_REQUEST:
+			case REQ_ERR_TIMEOUT:
+				p->dumpXml();
+				INFO_PRINTF("fin order, %ld %s, %ld", e.orderId,
+					r.contract.symbol.c_str(), r.contract.conId);
+				archive( i, nowMsecs );
+				done = true;
+			case REQ_ERR_NODATA:
+			case REQ_ERR_NAV:
+				break;
+			case REQ_ERR_TWSCON:
+				ok = false;
+			}
+		}
+		if( !done ) {
+			jobs[keep++] = i;
+		}
+	}
+	jobs.resize( keep );
+
+	purge( nowMsecs );
+	return ok;
+}
+
+void OrderManager::dumpStats() const
+{
+	INFO_PRINTF( "order manager: %ld job orders, %ld order states, "
+		"%ld archived, %ld forgotten, %ld late callbacks, "
+		"%d orders kept (max %d, %d entries)", cntJobs, cntStates,
+		cntArchived, cntPurged, cntLate, nLive, maxLive, nEntries );
+}
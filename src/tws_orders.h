@@ -0,0 +1,99 @@
+/*** tws_orders.h -- order lifecycle of job orders and order states
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_ORDERS_H
+#define TWS_ORDERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+class PacketPlaceOrder;
+struct RowOrderStatus;
+struct RowOpenOrder;
+
+
+/**
+ * All orders we hear of, those of the job file with their PacketPlaceOrder
+ * and the latest orderStatus of any order. Entries live in a slab of fixed
+ * size chunks and are found by an open addressing hash on orderId, or on
+ * permId for orders of other clients.
+ *
+ * Finished job orders are dumped by collect(), finished states are archived
+ * as soon as their status is final. Archived orders still get late
+ * callbacks until they are forgotten after the retention window. Their
+ * entries and packets are reused then, memory is bounded by the number of
+ * orders per retention window.
+ */
+class OrderManager
+{
+	public:
+		OrderManager( int64_t retentionMsecs );
+		~OrderManager();
+
+		/* a clean packet for a new job order to record() */
+		PacketPlaceOrder* open( long orderId );
+		/* the job order or NULL, archived if it's finished already */
+		PacketPlaceOrder* find( long orderId, bool *archived = NULL ) const;
+		/* job orders not finished yet */
+		int active() const;
+
+		void update( const RowOrderStatus& );
+		void update( const RowOpenOrder& );
+		/* the latest status of all orders which are not final yet */
+		void openStatus( std::vector<const RowOrderStatus*> *out ) const;
+
+		/* dump finished job orders and forget archived orders older than
+		   the retention window, false if the connection broke */
+		bool collect( int64_t nowMsecs );
+
+		void dumpStats() const;
+
+	private:
+		OrderManager( const OrderManager& );
+		OrderManager& operator=( const OrderManager& );
+
+		struct Entry;
+		class Index;
+
+		Entry& at( int i ) const;
+		int alloc();
+		void release( int i );
+		int lookup( long orderId, long permId ) const;
+		int create( long orderId, long permId );
+		void setPermId( int i, long permId );
+		void archive( int i, int64_t nowMsecs );
+		void purge( int64_t nowMsecs );
+
+		const int64_t retention;
+
+		/* slab */
+		std::vector<Entry*> &chunks;
+		int nEntries;
+		int freeHead;
+		int nLive;
+
+		Index &byOrderId;
+		Index &byPermId;
+
+		/* active job orders */
+		std::vector<int> &jobs;
+		/* archived entries and their generation, oldest first */
+		std::deque<std::pair<int, uint32_t> > &archived;
+
+		/* statistics */
+		long cntJobs;
+		long cntStates;
+		long cntArchived;
+		long cntPurged;
+		long cntLate;
+		int maxLive;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*** tws_publish.cpp -- publish quotes in shared memory
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_publish.h"
+#include "tws_shm.h"
+#include "tws_quote.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined HAVE_SYS_MMAN_H
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+/* keep slots of different contracts in different cache lines */
+#define SHM_ALIGN 64
+
+/* readers must not depend on the compiler either */
+static_assert( sizeof(tws_shm_header) == 304, "bad tws_shm_header size" );
+static_assert( sizeof(tws_shm_dir) == 8, "bad tws_shm_dir size" );
+static_assert( sizeof(tws_shm_slot) == 16, "bad tws_shm_slot size" );
+
+
+static size_t shm_align( size_t n )
+{
+	return (n + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+static bool dir_less( const tws_shm_dir &a, const tws_shm_dir &b )
+{
+	return a.conId < b.conId || (a.conId == b.conId && a.slot < b.slot);
+}
+
+static tws_shm_slot* slot_ptr( tws_shm_header *h, int slot )
+{
+	return (tws_shm_slot*)((char*)h + h->slotsOffset
+		+ (size_t)slot * h->slotSize);
+}
+
+
+
+
+QuotePublisher::QuotePublisher( const std::string &n ) :
+	name(n),
+	board(NULL),
+	mem(NULL),
+	size(0),
+	cntSet(0),
+	cntDropped(0)
+{
+}
+
+QuotePublisher::~QuotePublisher()
+{
+	close();
+}
+
+#if defined HAVE_SYS_MMAN_H
+
+/**
+ * Create a new shared memory object. A stale one of the same name is
+ * unlinked first, readers which still have it mapped keep their copy and
+ * notice the new run by TWS_SHM_CLOSED or a changed created stamp.
+ */
+bool QuotePublisher::open( const QuoteBoard &b,
+	const std::vector<long> &conIds )
+{
+	assert( mem == NULL );
+	board = &b;
+	const uint32_t nSlots = conIds.size();
+	const uint32_t nCols = std::min( b.cols(), TWS_SHM_MAX_COLS );
+	if( b.cols() > TWS_SHM_MAX_COLS ) {
+		WARN_PRINTF( "Warning, publishing only %d of %d tick types.",
+			TWS_SHM_MAX_COLS, b.cols() );
+	}
+
+	const size_t dirOffset = shm_align( sizeof(tws_shm_header) );
+	const size_t slotsOffset = dirOffset
+		+ shm_align( nSlots * sizeof(tws_shm_dir) );
+	const size_t slotSize = shm_align( sizeof(tws_shm_slot)
+		+ nCols * (sizeof(double) + sizeof(int64_t)) );
+	size = slotsOffset + nSlots * slotSize;
+
+	shm_unlink( name.c_str() );
+	int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+	if( fd < 0 ) {
+		ERROR_PRINTF( "shm_open '%s' failed: %s", name.c_str(),
+			strerror(errno) );
+		return false;
+	}
+	if( ftruncate(fd, size) != 0 ) {
+		ERROR_PRINTF( "ftruncate '%s' failed: %s", name.c_str(),
+			strerror(errno) );
+		::close( fd );
+		shm_unlink( name.c_str() );
+		return false;
+	}
+	void *p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	::close( fd );
+	if( p == MAP_FAILED ) {
+		ERROR_PRINTF( "mmap '%s' failed: %s", name.c_str(), strerror(errno) );
+		shm_unlink( name.c_str() );
+		return false;
+	}
+	mem = (tws_shm_header*)p;
+
+	/* ftruncate gave us zeros, so all slots are even and never set */
+	mem->magic = TWS_SHM_MAGIC;
+	mem->version = TWS_SHM_VERSION;
+	mem->headerSize = sizeof(tws_shm_header);
+	mem->nCols = nCols;
+	mem->nSlots = nSlots;
+	mem->slotSize = slotSize;
+	mem->created = nowInUsecs();
+	mem->dirOffset = dirOffset;
+	mem->slotsOffset = slotsOffset;
+	for( int c = 0; c < TWS_SHM_MAX_COLS; c++ ) {
+		mem->tickTypes[c] = c < (int)nCols ? b.tickType( c ) : -1;
+	}
+
+	tws_shm_dir *dir = (tws_shm_dir*)((char*)mem + dirOffset);
+	for( uint32_t i = 0; i < nSlots; i++ ) {
+		tws_shm_slot *s = slot_ptr( mem, i );
+		s->tickerId = i + 1;
+		s->conId = conIds[i];
+		dir[i].conId = conIds[i];
+		dir[i].slot = i;
+	}
+	std::sort( dir, dir + nSlots, dir_less );
+
+	__atomic_store_n( &mem->state, TWS_SHM_READY, __ATOMIC_RELEASE );
+	INFO_PRINTF( "publishing %u quotes with %u tick types in shm '%s', "
+		"%zu bytes", nSlots, nCols, name.c_str(), size );
+	return true;
+}
+
+void QuotePublisher::close()
+{
+	if( mem == NULL ) {
+		return;
+	}
+	__atomic_store_n( &mem->state, TWS_SHM_CLOSED, __ATOMIC_RELEASE );
+	munmap( mem, size );
+	shm_unlink( name.c_str() );
+	mem = NULL;
+}
+
+#else
+
+bool QuotePublisher::open( const QuoteBoard&, const std::vector<long>& )
+{
+	ERROR_PRINTF( "no shared memory for '%s'", name.c_str() );
+	return false;
+}
+
+void QuotePublisher::close()
+{
+}
+
+#endif /* HAVE_SYS_MMAN_H */
+
+/* same sequence lock as QuoteBoard::set(), see tws_shm_read() */
+void QuotePublisher::set( int tickerId, int tickType, double val,
+	int64_t stamp )
+{
+	int c = board->col( tickType );
+	if( tickerId < 1 || tickerId > (int)mem->nSlots
+	    || c < 0 || c >= (int)mem->nCols ) {
+		cntDropped++;
+		return;
+	}
+	tws_shm_slot *s = slot_ptr( mem, tickerId - 1 );
+	double *v = (double*)(s + 1);
+	int64_t *st = (int64_t*)(v + mem->nCols);
+	uint32_t seq = __atomic_load_n( &s->seq, __ATOMIC_RELAXED );
+
+	/* odd while writing */
+	__atomic_store_n( &s->seq, seq + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	__atomic_store( &v[c], &val, __ATOMIC_RELAXED );
+	__atomic_store_n( &st[c], stamp, __ATOMIC_RELAXED );
+	__atomic_store_n( &s->seq, seq + 2, __ATOMIC_RELEASE );
+
+	cntSet++;
+}
+
+void QuotePublisher::dumpStats() const
+{
+	INFO_PRINTF( "quote publisher: shm '%s', %zu bytes, %ld ticks published, "
+		"%ld dropped", name.c_str(), size, cntSet, cntDropped );
+}
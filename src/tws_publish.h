@@ -0,0 +1,53 @@
+/*** tws_publish.h -- publish quotes in shared memory
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_PUBLISH_H
+#define TWS_PUBLISH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class QuoteBoard;
+struct tws_shm_header;
+
+
+/**
+ * Writer side of tws_shm.h. Mirrors the columns of a QuoteBoard into a POSIX
+ * shared memory object, slot i is tickerId i+1. There is exactly one writer,
+ * the thread calling set().
+ */
+class QuotePublisher
+{
+	public:
+		QuotePublisher( const std::string &name );
+		~QuotePublisher();
+
+		/* conIds of all tickerIds, starting with tickerId 1 */
+		bool open( const QuoteBoard&, const std::vector<long> &conIds );
+		void set( int tickerId, int tickType, double val, int64_t stamp );
+		void dumpStats() const;
+
+	private:
+		QuotePublisher( const QuotePublisher& );
+		QuotePublisher& operator=( const QuotePublisher& );
+
+		void close();
+
+		const std::string name;
+		const QuoteBoard *board;
+		tws_shm_header *mem;
+		size_t size;
+
+		/* statistics */
+		long cntSet;
+		long cntDropped;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include <twsapi/twsapi_config.h>
 
 #include <stdio.h>
+#include <strings.h>
 
 #if TWSAPI_IB_VERSION_NUMBER < 97200
 # define lastTradeDateOrContractMonth expiry
@@ -34,6 +35,7 @@ HistRequest::HistRequest()
 {
 	useRTH = 0;
 	formatDate = 0; // set invalid (IB allows 1 or 2)
+	priority = 0;
 }
 
 
@@ -94,11 +96,31 @@ PlaceOrder::PlaceOrder() :
 {
 }
 
+bool PlaceOrder::isCancel() const
+{
+	return order.totalQuantity == 0
+		&& strcasecmp(order.action.c_str(), "CANCEL") == 0;
+}
+
 
 
 
 MktDataRequest::MktDataRequest() :
-	snapshot(false)
+	snapshot(false),
+	priority(0)
+{
+}
+
+MktDepthRequest::MktDepthRequest() :
+	numRows(10)
+{
+}
+
+RealTimeBarsRequest::RealTimeBarsRequest() :
+	barSizeSetting("1 min"),
+	whatToShow("TRADES"),
+	useRTH(0),
+	formatDate(1)
 {
 }
 
@@ -14,6 +14,7 @@
 #include <twsapi/Execution.h>
 #include <twsapi/Order.h>
 #include <stdint.h>
+#include <vector>
 
 #ifndef TWSAPI_NO_NAMESPACE
 namespace IB {
@@ -35,6 +36,12 @@ class ContractDetailsRequest
 
 
 
+struct HistWindow
+{
+	std::string endDateTime;
+	std::string durationStr;
+};
+
 class HistRequest
 {
 	public:
@@ -52,6 +59,13 @@ class HistRequest
 		std::string whatToShow;
 		int useRTH;
 		int formatDate;
+
+		/* original windows if coalesced from several requests */
+		std::vector<HistWindow> parts;
+
+		/* scheduling hints, never sent to TWS */
+		int priority;
+		std::string deadline;
 };
 
 
@@ -90,6 +104,9 @@ class PlaceOrder
 	public:
 		PlaceOrder();
 
+		/* action CANCEL without quantity cancels orderId */
+		bool isCancel() const;
+
 		long orderId;
 		int64_t time_sent;
 		Contract contract;
@@ -107,6 +124,30 @@ class MktDataRequest
 		Contract ibContract;
 		std::string genericTicks;
 		bool snapshot;
+		/* higher is served more often if lines are short */
+		int priority;
+};
+
+class MktDepthRequest
+{
+	public:
+		MktDepthRequest();
+
+		Contract ibContract;
+		int numRows;
+};
+
+class RealTimeBarsRequest
+{
+	public:
+		RealTimeBarsRequest();
+
+		Contract ibContract;
+		/* bar sizes to aggregate to, comma separated like "1 min,5 mins" */
+		std::string barSizeSetting;
+		std::string whatToShow;
+		int useRTH;
+		int formatDate;
 };
 
 class OptParamsRequest
@@ -7,9 +7,13 @@
  ***/
 
 #include "tws_quote.h"
+#include "debug.h"
 #include <twsapi/twsapi_config.h>
 #include <twsapi/EWrapper.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <new>
 
 #ifndef TWSAPI_NO_NAMESPACE
 namespace IB {
@@ -17,31 +21,270 @@ namespace IB {
 using namespace IB;
 #endif
 
-Quote::Quote() :
-	val(new double[NOT_SET]),
-	stamp(new int64_t[NOT_SET])
+#define CACHE_LINE 64
+
+
+/* what TWS sends without generic ticks */
+static const int default_ticks[] = {
+	BID_SIZE, BID, ASK, ASK_SIZE, LAST, LAST_SIZE, HIGH, LOW, VOLUME, CLOSE,
+	OPEN
+};
+
+static const int delayed_ticks[] = {
+	DELAYED_BID, DELAYED_ASK, DELAYED_LAST, DELAYED_BID_SIZE,
+	DELAYED_ASK_SIZE, DELAYED_LAST_SIZE, DELAYED_HIGH, DELAYED_LOW,
+	DELAYED_VOLUME, DELAYED_CLOSE, DELAYED_OPEN
+};
+
+/* numeric tick types we get for a generic tick, string ticks are not stored */
+static const struct {
+	int generic;
+	int tickType;
+} generic_ticks[] = {
+	{ 100, OPTION_CALL_VOLUME },
+	{ 100, OPTION_PUT_VOLUME },
+	{ 101, OPTION_CALL_OPEN_INTEREST },
+	{ 101, OPTION_PUT_OPEN_INTEREST },
+	{ 104, OPTION_HISTORICAL_VOL },
+	{ 105, AVG_OPT_VOLUME },
+	{ 106, OPTION_IMPLIED_VOL },
+	{ 162, INDEX_FUTURE_PREMIUM },
+	{ 165, AVG_VOLUME },
+	{ 221, MARK_PRICE },
+	{ 225, AUCTION_VOLUME },
+	{ 225, AUCTION_PRICE },
+	{ 225, AUCTION_IMBALANCE },
+	{ 236, SHORTABLE },
+	{ 293, TRADE_COUNT },
+	{ 294, TRADE_RATE },
+	{ 295, VOLUME_RATE },
+	{ 318, LAST_RTH_TRADE },
+	{ 411, RT_HISTORICAL_VOL },
+	{ 588, FUTURES_OPEN_INTEREST },
+};
+
+#define ARRAY_SIZE( _a_ ) (sizeof(_a_) / sizeof(_a_[0]))
+
+
+QuoteBoard::QuoteBoard() :
+	nRows(0),
+	nCols(0),
+	stride(0),
+	colTypes(*(new std::vector<int>())),
+	colOfType(*(new std::vector<int>(NOT_SET, -1))),
+	mem(NULL),
+	vals(NULL),
+	stamps(NULL),
+	seq(NULL),
+	cntSet(0),
+	cntDropped(0),
+	cntRetries(0)
+{
+}
+
+QuoteBoard::~QuoteBoard()
+{
+	clear();
+	delete &colOfType;
+	delete &colTypes;
+}
+
+void QuoteBoard::clear()
+{
+	free( mem );
+	mem = NULL;
+	vals = NULL;
+	stamps = NULL;
+	seq = NULL;
+	nRows = nCols = stride = 0;
+}
+
+/**
+ * Return the tick types worth a column for the given comma separated
+ * generic tick list of a market data request.
+ */
+std::vector<int> QuoteBoard::tickTypes( const std::string &genericTicks,
+	bool delayed )
+{
+	std::vector<int> v( default_ticks, default_ticks + ARRAY_SIZE(default_ticks) );
+	if( delayed ) {
+		v.insert( v.end(), delayed_ticks,
+			delayed_ticks + ARRAY_SIZE(delayed_ticks) );
+	}
+
+	const char *s = genericTicks.c_str();
+	while( *s != '\0' ) {
+		char *end;
+		long g = strtol( s, &end, 10 );
+		if( end == s ) {
+			s++;
+			continue;
+		}
+		for( size_t i = 0; i < ARRAY_SIZE(generic_ticks); i++ ) {
+			if( generic_ticks[i].generic == g ) {
+				v.push_back( generic_ticks[i].tickType );
+			}
+		}
+		s = end;
+	}
+
+	std::sort( v.begin(), v.end() );
+	v.erase( std::unique(v.begin(), v.end()), v.end() );
+	return v;
+}
+
+/**
+ * Allocate rows 0 to rows-1 with the given tick types as columns. Must not
+ * be called while other threads are reading.
+ */
+void QuoteBoard::init( int rows, const std::vector<int> &types )
 {
-	memset(val, 0, sizeof(val) * NOT_SET);
-	memset(stamp, 0, sizeof(stamp) * NOT_SET);
+	clear();
+	std::fill( colOfType.begin(), colOfType.end(), -1 );
+	colTypes.clear();
+	for( size_t i = 0; i < types.size(); i++ ) {
+		int t = types[i];
+		if( t >= 0 && t < NOT_SET && colOfType[t] < 0 ) {
+			colOfType[t] = colTypes.size();
+			colTypes.push_back( t );
+		}
+	}
+
+	const int per_line = CACHE_LINE / sizeof(double);
+	nRows = rows;
+	nCols = colTypes.size();
+	stride = (rows + per_line - 1) / per_line * per_line;
+
+	size_t n = (size_t)nCols * stride;
+	size_t size = n * sizeof(*vals) + n * sizeof(*stamps)
+		+ stride * sizeof(*seq);
+	mem = malloc( size + CACHE_LINE - 1 );
+	char *p = (char*)(((uintptr_t)mem + CACHE_LINE - 1)
+		& ~(uintptr_t)(CACHE_LINE - 1));
+
+	vals = (std::atomic<double>*)p;
+	stamps = (std::atomic<int64_t>*)(p + n * sizeof(*vals));
+	seq = (std::atomic<uint32_t>*)(p + n * sizeof(*vals)
+		+ n * sizeof(*stamps));
+	for( size_t i = 0; i < n; i++ ) {
+		new (&vals[i]) std::atomic<double>(0.0);
+		new (&stamps[i]) std::atomic<int64_t>(0);
+	}
+	for( int i = 0; i < stride; i++ ) {
+		new (&seq[i]) std::atomic<uint32_t>(0);
+	}
+}
+
+int QuoteBoard::rows() const
+{
+	return nRows;
+}
+
+int QuoteBoard::cols() const
+{
+	return nCols;
+}
+
+/* return the column of a tick type or -1 if it's not stored */
+int QuoteBoard::col( int tickType ) const
+{
+	if( tickType < 0 || tickType >= NOT_SET ) {
+		return -1;
+	}
+	return colOfType[tickType];
+}
+
+int QuoteBoard::tickType( int c ) const
+{
+	assert( c >= 0 && c < nCols );
+	return colTypes[c];
+}
+
+/* return false if row or column does not exist */
+bool QuoteBoard::set( int tickerId, int tickType, double val, int64_t stamp )
+{
+	int c = col( tickType );
+	if( tickerId < 0 || tickerId >= nRows || c < 0 ) {
+		cntDropped++;
+		return false;
+	}
+	size_t i = (size_t)c * stride + tickerId;
+	std::atomic<uint32_t> &s = seq[tickerId];
+	uint32_t v = s.load( std::memory_order_relaxed );
+
+	/* odd while writing */
+	s.store( v + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	vals[i].store( val, std::memory_order_relaxed );
+	stamps[i].store( stamp, std::memory_order_relaxed );
+	s.store( v + 2, std::memory_order_release );
+
+	cntSet++;
+	return true;
 }
 
-Quote::Quote( const Quote& other ) :
-	val(new double[NOT_SET]),
-	stamp(new int64_t[NOT_SET])
+/* copy a consistent row, return false if the row does not exist */
+bool QuoteBoard::snapshot( int tickerId, double *v, int64_t *st ) const
 {
-	memcpy(val, other.val, sizeof(val) * NOT_SET);
-	memcpy(stamp, other.stamp, sizeof(stamp) * NOT_SET);
+	if( tickerId < 0 || tickerId >= nRows ) {
+		return false;
+	}
+	const std::atomic<uint32_t> &s = seq[tickerId];
+	while( true ) {
+		uint32_t s1 = s.load( std::memory_order_acquire );
+		if( s1 & 1 ) {
+			cntRetries++;
+			continue;
+		}
+		for( int c = 0; c < nCols; c++ ) {
+			size_t i = (size_t)c * stride + tickerId;
+			v[c] = vals[i].load( std::memory_order_relaxed );
+			st[c] = stamps[i].load( std::memory_order_relaxed );
+		}
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( s.load(std::memory_order_relaxed) == s1 ) {
+			return true;
+		}
+		cntRetries++;
+	}
 }
 
-Quote& Quote::operator=( const Quote& other )
+/* read a single field, 0.0 if it does not exist or was never set */
+double QuoteBoard::get( int tickerId, int tickType, int64_t *stamp ) const
 {
-	memcpy(val, other.val, sizeof(val) * NOT_SET);
-	memcpy(stamp, other.stamp, sizeof(stamp) * NOT_SET);
-	return *this;
+	int c = col( tickType );
+	if( tickerId < 0 || tickerId >= nRows || c < 0 ) {
+		if( stamp != NULL ) {
+			*stamp = 0;
+		}
+		return 0.0;
+	}
+	size_t i = (size_t)c * stride + tickerId;
+	const std::atomic<uint32_t> &s = seq[tickerId];
+	while( true ) {
+		uint32_t s1 = s.load( std::memory_order_acquire );
+		if( s1 & 1 ) {
+			cntRetries++;
+			continue;
+		}
+		double v = vals[i].load( std::memory_order_relaxed );
+		int64_t st = stamps[i].load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( s.load(std::memory_order_relaxed) == s1 ) {
+			if( stamp != NULL ) {
+				*stamp = st;
+			}
+			return v;
+		}
+		cntRetries++;
+	}
 }
 
-Quote::~Quote()
+void QuoteBoard::dumpStats() const
 {
-	delete[] val;
-	delete[] stamp;
+	INFO_PRINTF( "quote board: %d rows, %d columns, %zu bytes, %ld ticks "
+		"stored, %ld dropped, %ld reader retries", nRows, nCols,
+		(size_t)nCols * stride * (sizeof(*vals) + sizeof(*stamps))
+			+ stride * sizeof(*seq),
+		cntSet, cntDropped, cntRetries.load() );
 }
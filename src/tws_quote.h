@@ -10,21 +10,64 @@
 #define TWS_QUOTE_H
 
 #include <stdint.h>
+#include <atomic>
+#include <string>
 #include <vector>
 
-class Quote
+
+/**
+ * Latest tick values of all market data subscriptions as structure of
+ * arrays. Rows are tickerIds, columns are the subscribed tick types only.
+ * Each column is a cache line aligned array of values and one of stamps.
+ * There is exactly one writer thread, any other thread may read consistent
+ * rows, each row is protected by a sequence lock.
+ */
+class QuoteBoard
 {
 	public:
-		Quote();
-		Quote( const Quote& );
-		~Quote();
+		QuoteBoard();
+		~QuoteBoard();
 
-		Quote& operator= (const Quote&);
+		static std::vector<int> tickTypes( const std::string &genericTicks,
+			bool delayed );
 
-		double * const val;
-		int64_t * const stamp;
-};
+		void init( int rows, const std::vector<int> &tickTypes );
+		int rows() const;
+		int cols() const;
+		int col( int tickType ) const;
+		int tickType( int col ) const;
+
+		/* writer only */
+		bool set( int tickerId, int tickType, double val, int64_t stamp );
+
+		/* any thread, arrays of size cols(), stamp 0 means never set */
+		bool snapshot( int tickerId, double *vals, int64_t *stamps ) const;
+		double get( int tickerId, int tickType, int64_t *stamp = NULL ) const;
+
+		void dumpStats() const;
 
-typedef std::vector<Quote> Quotes;
+	private:
+		QuoteBoard( const QuoteBoard& );
+		QuoteBoard& operator=( const QuoteBoard& );
+
+		void clear();
+
+		int nRows;
+		int nCols;
+		/* rows rounded up to whole cache lines */
+		int stride;
+		std::vector<int> &colTypes;
+		std::vector<int> &colOfType;
+
+		void *mem;
+		std::atomic<double> *vals;
+		std::atomic<int64_t> *stamps;
+		std::atomic<uint32_t> *seq;
+
+		/* statistics */
+		long cntSet;
+		long cntDropped;
+		mutable std::atomic<long> cntRetries;
+};
 
 #endif
@@ -0,0 +1,267 @@
+/*** tws_reader.cpp -- TWS socket reader thread
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_reader.h"
+#include "tws_client.h"
+#include "tws_meta.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <twsapi/twsapi_config.h>
+#include <twsapi/Contract.h>
+
+#include <algorithm>
+#include <string>
+
+
+void tws_event_clone( TwsEvent *ev )
+{
+	switch( ev->type ) {
+	case TwsEvent::t_tickString:
+	case TwsEvent::t_updateAccountTime:
+	case TwsEvent::t_accountDownloadEnd:
+	case TwsEvent::t_updateMktDepthL2:
+		ev->data = new std::string( *(const std::string*)ev->data );
+		break;
+	case TwsEvent::t_orderStatus:
+		ev->data = new RowOrderStatus( *(const RowOrderStatus*)ev->data );
+		break;
+	case TwsEvent::t_openOrder:
+		ev->data = new RowOpenOrder( *(const RowOpenOrder*)ev->data );
+		break;
+	case TwsEvent::t_updateAccountValue:
+		ev->data = new RowAccVal( *(const RowAccVal*)ev->data );
+		break;
+	case TwsEvent::t_updatePortfolio:
+		ev->data = new RowPrtfl( *(const RowPrtfl*)ev->data );
+		break;
+	case TwsEvent::t_contractDetails:
+	case TwsEvent::t_bondContractDetails:
+		ev->data = new ContractDetails( *(const ContractDetails*)ev->data );
+		break;
+	case TwsEvent::t_execDetails:
+		ev->data = new RowExecution( *(const RowExecution*)ev->data );
+		break;
+	case TwsEvent::t_error:
+		ev->data = new RowError( *(const RowError*)ev->data );
+		break;
+	case TwsEvent::t_historicalData:
+		ev->data = new RowHist( *(const RowHist*)ev->data );
+		break;
+	case TwsEvent::t_optParams:
+		ev->data = new RowOptParams( *(const RowOptParams*)ev->data );
+		break;
+	default:
+		assert( ev->data == NULL );
+		break;
+	}
+}
+
+void tws_event_free( TwsEvent *ev )
+{
+	switch( ev->type ) {
+	case TwsEvent::t_tickString:
+	case TwsEvent::t_updateAccountTime:
+	case TwsEvent::t_accountDownloadEnd:
+	case TwsEvent::t_updateMktDepthL2:
+		delete (const std::string*)ev->data;
+		break;
+	case TwsEvent::t_orderStatus:
+		delete (const RowOrderStatus*)ev->data;
+		break;
+	case TwsEvent::t_openOrder:
+		delete (const RowOpenOrder*)ev->data;
+		break;
+	case TwsEvent::t_updateAccountValue:
+		delete (const RowAccVal*)ev->data;
+		break;
+	case TwsEvent::t_updatePortfolio:
+		delete (const RowPrtfl*)ev->data;
+		break;
+	case TwsEvent::t_contractDetails:
+	case TwsEvent::t_bondContractDetails:
+		delete (const ContractDetails*)ev->data;
+		break;
+	case TwsEvent::t_execDetails:
+		delete (const RowExecution*)ev->data;
+		break;
+	case TwsEvent::t_error:
+		delete (const RowError*)ev->data;
+		break;
+	case TwsEvent::t_historicalData:
+		delete (const RowHist*)ev->data;
+		break;
+	case TwsEvent::t_optParams:
+		delete (const RowOptParams*)ev->data;
+		break;
+	default:
+		break;
+	}
+	ev->data = NULL;
+}
+
+
+
+
+TwsReader::TwsReader( TWSClient *c, size_t capacity ) :
+	twsClient(c),
+	ring(*(new SpscRing<TwsEvent>(capacity))),
+	overflow(*(new std::deque<TwsEvent>())),
+	thread(NULL),
+	readerId(),
+	running(false),
+	sleeping(false),
+	woken(false),
+	cntPushed(0),
+	cntOverflowed(0),
+	cntStalls(0),
+	stallUsecs(0),
+	maxFill(0)
+{
+	assert( capacity > 0 && (capacity & (capacity - 1)) == 0 );
+}
+
+TwsReader::~TwsReader()
+{
+	stop();
+
+	TwsEvent ev;
+	while( pop(&ev) ) {
+		tws_event_free( &ev );
+	}
+	while( !overflow.empty() ) {
+		tws_event_free( &overflow.front() );
+		overflow.pop_front();
+	}
+	delete &overflow;
+	delete &ring;
+}
+
+void TwsReader::start()
+{
+	assert( thread == NULL );
+	running = true;
+	thread = new std::thread( &TwsReader::run, this );
+}
+
+void TwsReader::stop()
+{
+	if( thread == NULL ) {
+		return;
+	}
+	running = false;
+	thread->join();
+	delete thread;
+	thread = NULL;
+	readerId = std::thread::id();
+}
+
+bool TwsReader::inReaderThread() const
+{
+	return readerId.load() == std::this_thread::get_id();
+}
+
+/* move overflowed events into the ring, return true if all fit */
+bool TwsReader::flushOverflow()
+{
+	bool moved = false;
+	while( !overflow.empty() && ring.push(overflow.front()) ) {
+		overflow.pop_front();
+		moved = true;
+	}
+	if( moved ) {
+		notify();
+	}
+	return overflow.empty();
+}
+
+void TwsReader::push( const TwsEvent &ev )
+{
+	/* never block here, we are called back while decoding and holding the
+	   client lock which the job thread might need to consume */
+	if( !overflow.empty() || !ring.push(ev) ) {
+		overflow.push_back(ev);
+		cntOverflowed++;
+	}
+	cntPushed++;
+
+	size_t fill = ring.size() + overflow.size();
+	if( fill > maxFill ) {
+		maxFill = fill;
+	}
+	notify();
+}
+
+/* wake up the consumer if it's waiting for events */
+void TwsReader::notify()
+{
+	/* pairs with the fence in wait() */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if( sleeping ) {
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakeCond.notify_one();
+	}
+}
+
+bool TwsReader::pop( TwsEvent *ev )
+{
+	return ring.pop( ev );
+}
+
+/* block until events are available or msecs passed */
+void TwsReader::wait( int msecs )
+{
+	if( ring.size() > 0 ) {
+		return;
+	}
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	sleeping = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	wakeCond.wait_for( lock, std::chrono::milliseconds(msecs),
+		[this]{ return ring.size() > 0 || woken; } );
+	sleeping = false;
+	woken = false;
+}
+
+/* let wait() return early, any thread */
+void TwsReader::wake()
+{
+	std::lock_guard<std::mutex> lock(wakeMutex);
+	woken = true;
+	wakeCond.notify_one();
+}
+
+void TwsReader::run()
+{
+	readerId = std::this_thread::get_id();
+	while( running ) {
+		if( !flushOverflow() ) {
+			/* job thread is too slow, stop reading the socket */
+			int64_t t = nowInUsecs();
+			std::this_thread::sleep_for( std::chrono::microseconds(200) );
+			cntStalls++;
+			stallUsecs += nowInUsecs() - t;
+			continue;
+		}
+		if( !twsClient->isConnected() ) {
+			std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+			continue;
+		}
+		if( twsClient->waitReadable(50) ) {
+			twsClient->selectStuff(0);
+		}
+	}
+}
+
+void TwsReader::dumpStats() const
+{
+	INFO_PRINTF( "reader thread: %ld events, ring %zu, max fill %zu, "
+		"overflowed %ld, stalled %ld times %.3fms",
+		cntPushed.load(), ring.capacity(), maxFill.load(),
+		cntOverflowed.load(), cntStalls.load(), stallUsecs / 1000.0 );
+}
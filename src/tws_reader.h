@@ -0,0 +1,199 @@
+/*** tws_reader.h -- TWS socket reader thread
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_READER_H
+#define TWS_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class TWSClient;
+
+
+/* a decoded TWS callback, see TwsDlWrapper */
+struct TwsEvent
+{
+	enum tws_event_type {
+		t_tickPrice,
+		t_tickSize,
+		t_tickOptionComputation,
+		t_tickGeneric,
+		t_tickString,
+		t_orderStatus,
+		t_openOrder,
+		t_openOrderEnd,
+		t_connectionClosed,
+		t_updateAccountValue,
+		t_updatePortfolio,
+		t_updateAccountTime,
+		t_accountDownloadEnd,
+		t_nextValidId,
+		t_contractDetails,
+		t_bondContractDetails,
+		t_contractDetailsEnd,
+		t_execDetails,
+		t_execDetailsEnd,
+		t_error,
+		t_historicalData,
+		t_currentTime,
+		t_connectAck,
+		t_optParams,
+		t_optParamsEnd,
+		t_tickSnapshotEnd,
+		t_updateMktDepth,
+		t_updateMktDepthL2,
+		t_realtimeBar
+	};
+	tws_event_type type;
+	int id;         /* reqId or tickerId */
+	int field;      /* TickType */
+	long lval;      /* size, orderId, time, ... */
+	double dval[8];
+	/* RowHist, RowError, ... depending on type, owned if queued */
+	const void *data;
+	/* receive time in usecs, set by post() */
+	int64_t stamp;
+};
+
+/* deep copy the data of an event to queue it */
+void tws_event_clone( TwsEvent* );
+/* free the data of a cloned event */
+void tws_event_free( TwsEvent* );
+
+
+
+
+/**
+ * Lock-free bounded queue for exactly one producer and one consumer thread.
+ * Capacity must be a power of two.
+ */
+template<typename T>
+class SpscRing
+{
+	public:
+		SpscRing( size_t capacity ) :
+			mask(capacity - 1),
+			buf(new T[capacity]),
+			head(0),
+			tail(0)
+		{
+		}
+
+		~SpscRing()
+		{
+			delete[] buf;
+		}
+
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+
+		/* consumer or producer, may be outdated already */
+		size_t size() const
+		{
+			return tail.load(std::memory_order_acquire)
+				- head.load(std::memory_order_acquire);
+		}
+
+		/* producer only */
+		bool push( const T &v )
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if( t - head.load(std::memory_order_acquire) > mask ) {
+				return false;
+			}
+			buf[t & mask] = v;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* consumer only */
+		bool pop( T *v )
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if( h == tail.load(std::memory_order_acquire) ) {
+				return false;
+			}
+			*v = buf[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		SpscRing( const SpscRing& );
+		SpscRing& operator=( const SpscRing& );
+
+		const size_t mask;
+		T *buf;
+		/* keep consumer and producer index on different cache lines */
+		char pad0[64];
+		std::atomic<size_t> head;
+		char pad1[64];
+		std::atomic<size_t> tail;
+};
+
+
+
+
+/**
+ * Thread reading and decoding the TWS socket. The TwsDlWrapper callbacks
+ * run in this thread and push events which the job thread pops.
+ * If the job thread is too slow the reader stops reading the socket rather
+ * than blocking within a callback, so TWS sees the backpressure.
+ */
+class TwsReader
+{
+	public:
+		TwsReader( TWSClient*, size_t capacity );
+		~TwsReader();
+
+		void start();
+		void stop();
+		bool inReaderThread() const;
+
+		/* reader thread */
+		void push( const TwsEvent& );
+
+		/* job thread */
+		bool pop( TwsEvent* );
+		void wait( int msecs );
+		void wake();
+		void dumpStats() const;
+
+	private:
+		void run();
+		bool flushOverflow();
+		void notify();
+
+		TWSClient *twsClient;
+		SpscRing<TwsEvent> &ring;
+		std::deque<TwsEvent> &overflow;
+		std::thread *thread;
+		std::atomic<std::thread::id> readerId;
+		std::atomic<bool> running;
+
+		std::mutex wakeMutex;
+		std::condition_variable wakeCond;
+		std::atomic<bool> sleeping;
+		bool woken;
+
+		/* backpressure statistics */
+		std::atomic<long> cntPushed;
+		std::atomic<long> cntOverflowed;
+		std::atomic<long> cntStalls;
+		std::atomic<int64_t> stallUsecs;
+		std::atomic<size_t> maxFill;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*** tws_shm.h -- live quotes in shared memory
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+/*
+ * twsdo --shm NAME publishes the latest value of each subscribed tick type
+ * in the POSIX shared memory object NAME. This header is all a consumer
+ * needs, it's plain C and depends on nothing else from twstools.
+ *
+ * The segment is a header, a directory of (conId, slot) sorted by conId and
+ * one slot per market data request (tickerId - 1). A slot has a sequence
+ * number, which is odd while twsdo is writing, and one value and receive
+ * time per column. Readers never block the writer, they retry if the
+ * sequence changed while copying, see tws_shm_read().
+ */
+
+#ifndef TWS_SHM_H
+#define TWS_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TWS_SHM_MAGIC 0x4d485354u /* "TSHM" */
+#define TWS_SHM_VERSION 1
+#define TWS_SHM_MAX_COLS 64
+
+/* tws_shm_header.state */
+#define TWS_SHM_INIT 0
+#define TWS_SHM_READY 1
+/* twsdo has exited, reopen to get the next run's segment */
+#define TWS_SHM_CLOSED 2
+
+struct tws_shm_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t state;
+	uint32_t nCols;
+	uint32_t nSlots;
+	uint32_t slotSize;
+	/* usecs since epoch, differs for each twsdo run */
+	int64_t created;
+	uint64_t dirOffset;
+	uint64_t slotsOffset;
+	/* IB's TickType of each column, unused ones are -1 */
+	int32_t tickTypes[TWS_SHM_MAX_COLS];
+};
+
+struct tws_shm_dir
+{
+	int32_t conId;
+	int32_t slot;
+};
+
+/* followed by double vals[nCols] and int64_t stamps[nCols] */
+struct tws_shm_slot
+{
+	uint32_t seq;
+	int32_t tickerId;
+	int32_t conId;
+	int32_t reserved;
+};
+
+
+static inline const struct tws_shm_dir* tws_shm_dir_ptr(
+	const struct tws_shm_header *h )
+{
+	return (const struct tws_shm_dir*)((const char*)h + h->dirOffset);
+}
+
+static inline const struct tws_shm_slot* tws_shm_slot_ptr(
+	const struct tws_shm_header *h, int slot )
+{
+	return (const struct tws_shm_slot*)((const char*)h + h->slotsOffset
+		+ (size_t)slot * h->slotSize);
+}
+
+static inline int tws_shm_ready( const struct tws_shm_header *h )
+{
+	return h->magic == TWS_SHM_MAGIC && h->version == TWS_SHM_VERSION
+		&& __atomic_load_n( &h->state, __ATOMIC_ACQUIRE ) == TWS_SHM_READY;
+}
+
+/* column of a tick type or -1 if it's not published */
+static inline int tws_shm_col( const struct tws_shm_header *h, int tickType )
+{
+	uint32_t c;
+	for( c = 0; c < h->nCols; c++ ) {
+		if( h->tickTypes[c] == tickType ) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+/* first slot of a conId or -1 if it's not published */
+static inline int tws_shm_find( const struct tws_shm_header *h, int conId )
+{
+	const struct tws_shm_dir *d = tws_shm_dir_ptr( h );
+	uint32_t lo = 0;
+	uint32_t hi = h->nSlots;
+	while( lo < hi ) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if( d[mid].conId < conId ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if( lo < h->nSlots && d[lo].conId == conId ) {
+		return d[lo].slot;
+	}
+	return -1;
+}
+
+/**
+ * Copy a consistent slot into arrays of nCols elements, stamp 0 means never
+ * set. Return the number of retries or -1 if the slot does not exist.
+ */
+static inline int tws_shm_read( const struct tws_shm_header *h, int slot,
+	double *vals, int64_t *stamps )
+{
+	const struct tws_shm_slot *s;
+	const double *v;
+	const int64_t *st;
+	uint32_t s1, c;
+	int retries = 0;
+
+	if( slot < 0 || (uint32_t)slot >= h->nSlots ) {
+		return -1;
+	}
+	s = tws_shm_slot_ptr( h, slot );
+	v = (const double*)(s + 1);
+	st = (const int64_t*)(v + h->nCols);
+	while( 1 ) {
+		s1 = __atomic_load_n( &s->seq, __ATOMIC_ACQUIRE );
+		if( (s1 & 1) == 0 ) {
+			for( c = 0; c < h->nCols; c++ ) {
+				__atomic_load( &v[c], &vals[c], __ATOMIC_RELAXED );
+				__atomic_load( &st[c], &stamps[c], __ATOMIC_RELAXED );
+			}
+			__atomic_thread_fence( __ATOMIC_ACQUIRE );
+			if( __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == s1 ) {
+				return retries;
+			}
+		}
+		retries++;
+	}
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*** tws_strat.h -- event driven strategy modules
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+/*
+ * twsdo --strat MODULE loads a strategy module. A module exporting
+ * TWS_STRAT_ENTRY gets its callbacks invoked by twsdo's event loop right
+ * when an event has been decoded, without waiting for an idle pass. This
+ * header is all a module needs, it's plain C and depends on nothing else
+ * from twstools.
+ *
+ * Callbacks run in twsdo's event loop thread, or in the module's own
+ * thread if it was loaded as MODULE@CPU. Structs passed to callbacks and the
+ * strings they point to are views, they are valid during the callback only.
+ * Modules must neither block nor keep these pointers.
+ *
+ * A module is reloaded on SIGHUP or a reload command on the --daemon
+ * socket. Its fini() is called, the file is closed and opened again. The
+ * new module gets the current positions, open orders and latest quotes of
+ * its subscriptions as on_position(), on_order_status() and on_tick() with
+ * their original stamps, followed by on_connection() with the current state,
+ * before any new event. Timers and subscriptions of the old module are gone.
+ *
+ * twsbt --strat MODULE runs the same module on recorded ticks and historical
+ * bars instead. Its clock is virtual, now() and all stamps are those of the
+ * replayed data, and orders are filled by a simulator, see tws_backtest.h.
+ *
+ * The ABI is versioned by TWS_STRAT_ABI. Structs which may grow have a size
+ * field, set by the one who allocated them. Both sides must only access
+ * fields within that size.
+ *
+ * The old interface, init(), fini(), work() and quotes() taking the TwsDL
+ * instance, is still supported for modules without TWS_STRAT_ENTRY.
+ */
+
+#ifndef TWS_STRAT_H
+#define TWS_STRAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TWS_STRAT_ABI 1
+
+/* int tws_strat_open( uint32_t abi, const struct tws_strat_services*,
+   struct tws_strat_callbacks* ), return < 0 on error */
+#define TWS_STRAT_ENTRY "tws_strat_open"
+
+/* tws_strat_tick.kind, same as twsdo's tick recorder */
+#define TWS_STRAT_TICK_PRICE 0
+#define TWS_STRAT_TICK_SIZE 1
+#define TWS_STRAT_TICK_GENERIC 2
+/* value is the numeric prefix of str */
+#define TWS_STRAT_TICK_STRING 3
+/* value is the implied volatility, opt has all 8 values */
+#define TWS_STRAT_TICK_OPTION 4
+
+/* on_connection() states */
+#define TWS_STRAT_DISCONNECTED 0
+/* connected and handshake done, orders may be placed */
+#define TWS_STRAT_CONNECTED 1
+/* TWS lost its connection to IB, data will be lost */
+#define TWS_STRAT_IB_LOST 2
+#define TWS_STRAT_IB_RESTORED 3
+
+/* tws_strat_order.flags */
+#define TWS_STRAT_NO_TRANSMIT 0x1
+#define TWS_STRAT_OUTSIDE_RTH 0x2
+
+
+/* tickerIds are those of twsdo's job, see tws_strat_services.instrument() */
+struct tws_strat_tick
+{
+	/* receive time in usecs since epoch */
+	int64_t stamp;
+	int32_t tickerId;
+	int32_t conId;
+	/* IB's TickType */
+	int32_t tickType;
+	int32_t kind;
+	double value;
+	/* IV, delta, price, pv dividend, gamma, vega, theta and underlying
+	   price of TWS_STRAT_TICK_OPTION, otherwise NULL */
+	const double *opt;
+	/* TWS_STRAT_TICK_STRING only, otherwise NULL */
+	const char *str;
+};
+
+/* a finished bar of a real-time bars request, one per bar size */
+struct tws_strat_bar
+{
+	int64_t stamp;
+	int32_t tickerId;
+	int32_t conId;
+	/* secs since epoch */
+	int64_t start;
+	int64_t end;
+	double open;
+	double high;
+	double low;
+	double close;
+	double wap;
+	/* -1 if not available */
+	int64_t volume;
+	int32_t count;
+	/* some 5 secs bars are missing */
+	int32_t hasGaps;
+	/* IB's barSizeSetting, e.g. "1 min" */
+	const char *barSize;
+};
+
+struct tws_strat_order_status
+{
+	int64_t stamp;
+	int64_t orderId;
+	int32_t permId;
+	int32_t parentId;
+	int32_t clientId;
+	int32_t reserved;
+	double filled;
+	double remaining;
+	double avgFillPrice;
+	double lastFillPrice;
+	const char *status;
+	const char *whyHeld;
+};
+
+struct tws_strat_execution
+{
+	int64_t stamp;
+	int64_t orderId;
+	int32_t conId;
+	int32_t clientId;
+	int32_t permId;
+	int32_t reserved;
+	double shares;
+	double price;
+	double cumQty;
+	double avgPrice;
+	const char *execId;
+	const char *time;
+	const char *account;
+	const char *exchange;
+	/* BOT or SLD */
+	const char *side;
+	const char *symbol;
+};
+
+/* a position as of IB's latest portfolio update and our fills since then,
+   sent on both, P&L in the contract's currency */
+struct tws_strat_position
+{
+	int64_t stamp;
+	int32_t conId;
+	int32_t reserved;
+	double position;
+	double marketPrice;
+	double averageCost;
+	double unrealizedPNL;
+	double realizedPNL;
+	const char *account;
+	const char *symbol;
+};
+
+/* filled by instrument(), strings are valid until twsdo forgets the job */
+struct tws_strat_instrument
+{
+	int32_t tickerId;
+	int32_t conId;
+	const char *symbol;
+	const char *secType;
+	const char *expiry;
+	double strike;
+	const char *right;
+	const char *exchange;
+	const char *currency;
+};
+
+/* an order for the contract of a tickerId */
+struct tws_strat_order
+{
+	uint32_t size;
+	int32_t tickerId;
+	/* 0 for a new order, otherwise the order to modify */
+	int64_t orderId;
+	/* BUY or SELL */
+	const char *action;
+	double quantity;
+	/* LMT, MKT, STP, ... */
+	const char *orderType;
+	double lmtPrice;
+	double auxPrice;
+	/* NULL for the defaults */
+	const char *tif;
+	const char *account;
+	const char *orderRef;
+	uint32_t flags;
+};
+
+
+/* provided by twsdo, pass host as first argument */
+struct tws_strat_services
+{
+	uint32_t abi;
+	uint32_t size;
+	void *host;
+
+	/* usecs since epoch */
+	int64_t (*now)( void *host );
+	/* call on_timer( cookie ) at msecs since epoch */
+	int (*timer)( void *host, int64_t msecs, void *cookie );
+
+	/* return the orderId or -1, sent right away unless rate limited,
+	   cancels first, modifying an order about to be cancelled fails */
+	int64_t (*place_order)( void *host, const struct tws_strat_order* );
+	/* placed orders only, return -1 for unknown or finished ones */
+	int (*cancel_order)( void *host, int64_t orderId );
+
+	/* get on_tick() and on_bar() for tickerId, 0 means all of them,
+	   nothing is subscribed initially, tickerIds may be subscribed before
+	   twsdo knows their job */
+	int (*subscribe)( void *host, int tickerId );
+	int (*unsubscribe)( void *host, int tickerId );
+	int (*instrument)( void *host, int tickerId,
+		struct tws_strat_instrument* );
+
+	/* the quote board, the latest value of each subscribed tick type,
+	   stamps are msecs since epoch and 0 if never set */
+	int (*quote_cols)( void *host );
+	int (*quote_col_type)( void *host, int col );
+	double (*quote)( void *host, int tickerId, int tickType,
+		int64_t *stamp );
+	/* a consistent row of quote_cols() values and stamps */
+	int (*quote_row)( void *host, int tickerId, double *vals,
+		int64_t *stamps );
+
+	/* the position of conId in account, NULL for any account, marked to
+	   market by the quote board, -1 if there is none */
+	int (*position)( void *host, int32_t conId, const char *account,
+		struct tws_strat_position* );
+};
+
+/* filled by the module, unused callbacks stay NULL */
+struct tws_strat_callbacks
+{
+	uint32_t abi;
+	uint32_t size;
+	/* passed as first argument */
+	void *ctx;
+
+	void (*fini)( void *ctx );
+	void (*on_tick)( void *ctx, const struct tws_strat_tick* );
+	void (*on_bar)( void *ctx, const struct tws_strat_bar* );
+	void (*on_order_status)( void *ctx,
+		const struct tws_strat_order_status* );
+	void (*on_execution)( void *ctx, const struct tws_strat_execution* );
+	/* now in usecs since epoch */
+	void (*on_timer)( void *ctx, int64_t now, void *cookie );
+	void (*on_connection)( void *ctx, int state );
+	void (*on_position)( void *ctx, const struct tws_strat_position* );
+};
+
+typedef int (*tws_strat_open_f)( uint32_t abi,
+	const struct tws_strat_services*, struct tws_strat_callbacks* );
+
+#endif
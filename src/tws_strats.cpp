@@ -0,0 +1,747 @@
+/*** tws_strats.cpp -- strategy modules and their threads
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_strats.h"
+#include "twsdo.h"
+#include "tws_quote.h"
+#include "tws_reader.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <twsapi/twsapi_config.h>
+#include <twsapi/Contract.h>
+
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif  /* HAVE_CONFIG_H */
+#include "dso_magic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#if TWSAPI_IB_VERSION_NUMBER < 97200
+# define lastTradeDateOrContractMonth expiry
+#endif
+
+/* events a threaded module may lag behind before we drop ticks and bars */
+#define STRAT_QUEUE_SIZE 4096
+
+
+static const char* keep( std::string &s, const char *p )
+{
+	if( p == NULL ) {
+		return NULL;
+	}
+	s = p;
+	return s.c_str();
+}
+
+StratEvent* StratEvent::make( int type, const void *view, int64_t stamp )
+{
+	StratEvent *ev = new StratEvent();
+	ev->refs = 1;
+	ev->type = type;
+	ev->stamp = stamp;
+	ev->queued = nowInUsecs();
+	switch( type ) {
+	case TICK:
+		{
+			tws_strat_tick &t = ev->u.tick;
+			t = *(const tws_strat_tick*)view;
+			if( t.opt != NULL ) {
+				memcpy( ev->opt, t.opt, sizeof(ev->opt) );
+				t.opt = ev->opt;
+			}
+			t.str = keep( ev->str[0], t.str );
+		}
+		break;
+	case BAR:
+		ev->u.bar = *(const tws_strat_bar*)view;
+		ev->u.bar.barSize = keep( ev->str[0], ev->u.bar.barSize );
+		break;
+	case ORDER_STATUS:
+		ev->u.os = *(const tws_strat_order_status*)view;
+		ev->u.os.status = keep( ev->str[0], ev->u.os.status );
+		ev->u.os.whyHeld = keep( ev->str[1], ev->u.os.whyHeld );
+		break;
+	case EXECUTION:
+		{
+			tws_strat_execution &x = ev->u.exec;
+			x = *(const tws_strat_execution*)view;
+			x.execId = keep( ev->str[0], x.execId );
+			x.time = keep( ev->str[1], x.time );
+			x.account = keep( ev->str[2], x.account );
+			x.exchange = keep( ev->str[3], x.exchange );
+			x.side = keep( ev->str[4], x.side );
+			x.symbol = keep( ev->str[5], x.symbol );
+		}
+		break;
+	case TIMER:
+		ev->u.cookie = (void*)view;
+		break;
+	case CONNECTION:
+		ev->u.state = *(const int*)view;
+		break;
+	case POSITION:
+		ev->u.pos = *(const tws_strat_position*)view;
+		ev->u.pos.account = keep( ev->str[0], ev->u.pos.account );
+		ev->u.pos.symbol = keep( ev->str[1], ev->u.pos.symbol );
+		break;
+	default:
+		assert( false );
+		break;
+	}
+	return ev;
+}
+
+void StratEvent::release( StratEvent *ev )
+{
+	if( ev->refs.fetch_sub(1) == 1 ) {
+		delete ev;
+	}
+}
+
+const void* StratEvent::view() const
+{
+	switch( type ) {
+	case TIMER:
+		return u.cookie;
+	case CONNECTION:
+		return &u.state;
+	default:
+		return &u;
+	}
+}
+
+
+/* a service call, executed in the event loop thread, see exec() */
+struct StratModule::Cmd
+{
+	enum Type {
+		TIMER,
+		PLACE_ORDER,
+		CANCEL_ORDER,
+		SUBSCRIBE,
+		UNSUBSCRIBE,
+		INSTRUMENT,
+		POSITION
+	};
+
+	int type;
+	int64_t arg;
+	const tws_strat_order *order;
+	void *ptr;
+	int64_t result;
+	bool done;
+	const char *str;
+};
+
+static int64_t strat_now( void* )
+{
+	return nowInUsecs();
+}
+
+static int strat_timer( void *host, int64_t msecs, void *cookie )
+{
+	StratModule::Cmd c = { StratModule::Cmd::TIMER, msecs, NULL, cookie,
+		0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int64_t strat_place_order( void *host, const tws_strat_order *o )
+{
+	StratModule::Cmd c = { StratModule::Cmd::PLACE_ORDER, 0, o, NULL,
+		0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int strat_cancel_order( void *host, int64_t orderId )
+{
+	StratModule::Cmd c = { StratModule::Cmd::CANCEL_ORDER, orderId, NULL,
+		NULL, 0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int strat_subscribe( void *host, int tickerId )
+{
+	StratModule::Cmd c = { StratModule::Cmd::SUBSCRIBE, tickerId, NULL,
+		NULL, 0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int strat_unsubscribe( void *host, int tickerId )
+{
+	StratModule::Cmd c = { StratModule::Cmd::UNSUBSCRIBE, tickerId, NULL,
+		NULL, 0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int strat_instrument( void *host, int tickerId,
+	tws_strat_instrument *out )
+{
+	StratModule::Cmd c = { StratModule::Cmd::INSTRUMENT, tickerId, NULL,
+		out, 0, false, NULL };
+	return ((StratModule*)host)->exec( c );
+}
+
+static int strat_position( void *host, int32_t conId, const char *account,
+	tws_strat_position *out )
+{
+	StratModule::Cmd c = { StratModule::Cmd::POSITION, conId, NULL,
+		out, 0, false, account };
+	return ((StratModule*)host)->exec( c );
+}
+
+/* the quote board may be read by any thread */
+static int strat_quote_cols( void *host )
+{
+	return ((StratModule*)host)->host()->quotes->cols();
+}
+
+static int strat_quote_col_type( void *host, int col )
+{
+	const QuoteBoard *q = ((StratModule*)host)->host()->quotes;
+	if( col < 0 || col >= q->cols() ) {
+		return -1;
+	}
+	return q->tickType( col );
+}
+
+static double strat_quote( void *host, int tickerId, int tickType,
+	int64_t *stamp )
+{
+	const QuoteBoard *q = ((StratModule*)host)->host()->quotes;
+	return q->get( tickerId, tickType, stamp );
+}
+
+static int strat_quote_row( void *host, int tickerId, double *vals,
+	int64_t *stamps )
+{
+	const QuoteBoard *q = ((StratModule*)host)->host()->quotes;
+	return q->snapshot( tickerId, vals, stamps ) ? 0 : -1;
+}
+
+
+StratModule::StratModule( TwsDL *dl, const char *spec ) :
+	dl(dl),
+	file(spec),
+	_threaded(false),
+	cpu(-1),
+	dso(NULL),
+	subAll(false),
+	keep(false),
+	trigger(0),
+	queue(NULL),
+	spilled(false),
+	thread(NULL),
+	threadId(),
+	running(false),
+	finished(true),
+	sleeping(false),
+	cmd(NULL),
+	wakeLoop(NULL),
+	wakeClo(NULL),
+	cntEvents(0),
+	sumLatency(0),
+	maxLatency(0),
+	sumLag(0),
+	maxLag(0),
+	busyUsecs(0),
+	cpuUsecs(0),
+	cntDropped(0),
+	cntDeferred(0),
+	cntCmds(0),
+	cntReloads(0)
+{
+	memset( &srv, 0, sizeof(srv) );
+}
+
+StratModule::~StratModule()
+{
+	stop();
+	for( size_t i = 0; i < overflow.size(); i++ ) {
+		StratEvent::release( overflow[i] );
+	}
+	if( queue != NULL ) {
+		StratEvent *ev;
+		while( queue->pop(&ev) ) {
+			StratEvent::release( ev );
+		}
+		delete queue;
+	}
+	if( dso != NULL ) {
+		close_dso( dso, dl );
+	}
+}
+
+/* parse FILE[@CPU] and load the module */
+bool StratModule::open()
+{
+	size_t at = file.rfind( '@' );
+	if( at != std::string::npos ) {
+		const std::string c = file.substr( at + 1 );
+		char *end;
+		_threaded = true;
+		cpu = c.empty() ? -1 : strtol( c.c_str(), &end, 10 );
+		if( !c.empty() && (*end != '\0' || cpu < -1) ) {
+			fprintf( stderr, "error, invalid strat cpu '%s'\n", c.c_str() );
+			return false;
+		}
+		file.erase( at );
+	}
+	size_t slash = file.rfind( '/' );
+	_name = slash == std::string::npos ? file : file.substr( slash + 1 );
+	return load();
+}
+
+bool StratModule::load()
+{
+	srv.abi = TWS_STRAT_ABI;
+	srv.size = sizeof(srv);
+	srv.host = this;
+	srv.now = strat_now;
+	srv.timer = strat_timer;
+	srv.place_order = strat_place_order;
+	srv.cancel_order = strat_cancel_order;
+	srv.subscribe = strat_subscribe;
+	srv.unsubscribe = strat_unsubscribe;
+	srv.instrument = strat_instrument;
+	srv.quote_cols = strat_quote_cols;
+	srv.quote_col_type = strat_quote_col_type;
+	srv.quote = strat_quote;
+	srv.quote_row = strat_quote_row;
+	srv.position = strat_position;
+
+	// for the moment we assume that the lt's load path is
+	// set up correctly or that the user has given an
+	// absolute file, if not just do fuckall
+	if( (dso = open_dso( file.c_str(), dl, &srv )) == NULL ) {
+		return false;
+	}
+	if( _threaded && !dso->typed ) {
+		fprintf( stderr, "error, module `%s' without %s() can't run in "
+			"its own thread\n", file.c_str(), TWS_STRAT_ENTRY );
+		close_dso( dso, dl );
+		dso = NULL;
+		return false;
+	}
+	if( _threaded && queue == NULL ) {
+		queue = new SpscRing<StratEvent*>( STRAT_QUEUE_SIZE );
+	}
+	return true;
+}
+
+/* the thread has to be stopped first, it drains the queue to the old
+   module, the new one sets up its own timers and subscriptions */
+bool StratModule::reload()
+{
+	stop();
+	if( dso != NULL ) {
+		close_dso( dso, dl );
+		dso = NULL;
+	}
+	subs.clear();
+	subAll = false;
+	timers.clear();
+	cntReloads++;
+	return load();
+}
+
+TwsDL* StratModule::host() const
+{
+	return dl;
+}
+
+const std::string& StratModule::name() const
+{
+	return _name;
+}
+
+bool StratModule::typed() const
+{
+	return dso != NULL && dso->typed;
+}
+
+bool StratModule::threaded() const
+{
+	return _threaded;
+}
+
+void StratModule::setWake( void (*wake)(void*), void *clo )
+{
+	wakeLoop = wake;
+	wakeClo = clo;
+}
+
+void StratModule::start()
+{
+	if( !_threaded || dso == NULL ) {
+		return;
+	}
+	assert( thread == NULL && wakeLoop != NULL );
+	running = true;
+	finished = false;
+	thread = new std::thread( &StratModule::loop, this );
+}
+
+void StratModule::stop()
+{
+	if( thread == NULL ) {
+		return;
+	}
+	/* hand over the overflow, the thread may wait for service calls */
+	while( !overflow.empty() ) {
+		serve();
+		std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+	}
+	running = false;
+	while( !finished ) {
+		{
+			std::lock_guard<std::mutex> lock( wakeMutex );
+			wakeCond.notify_one();
+		}
+		/* refuse service calls, the event loop is gone */
+		if( cmd.load() != NULL ) {
+			std::lock_guard<std::mutex> lock( cmdMutex );
+			Cmd *c = cmd.load();
+			c->result = -1;
+			c->done = true;
+			cmd = NULL;
+			cmdCond.notify_one();
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+	}
+	thread->join();
+	delete thread;
+	thread = NULL;
+}
+
+/* modules which failed to reload are gone until the next reload */
+void StratModule::work()
+{
+	if( dso != NULL ) {
+		work_dso( dso, dl );
+	}
+}
+
+bool StratModule::hasQuotes() const
+{
+	return dso != NULL && dso->quotesf != NULL;
+}
+
+void StratModule::quotes( const TwsQuoteUpdate *upd, size_t n )
+{
+	if( dso != NULL ) {
+		quotes_dso( dso, dl, upd, n );
+	}
+}
+
+bool StratModule::wants( int type, int tickerId ) const
+{
+	if( dso == NULL || !dso->typed ) {
+		return false;
+	}
+	const tws_strat_callbacks &cb = dso->cb;
+	switch( type ) {
+	case StratEvent::TICK:
+		if( cb.on_tick == NULL ) {
+			return false;
+		}
+		break;
+	case StratEvent::BAR:
+		if( cb.on_bar == NULL ) {
+			return false;
+		}
+		break;
+	case StratEvent::ORDER_STATUS:
+		return cb.on_order_status != NULL;
+	case StratEvent::EXECUTION:
+		return cb.on_execution != NULL;
+	case StratEvent::CONNECTION:
+		return cb.on_connection != NULL;
+	case StratEvent::POSITION:
+		return cb.on_position != NULL;
+	default:
+		return true;
+	}
+	return subAll || (tickerId >= 0 && tickerId < (int)subs.size()
+		&& subs[tickerId]);
+}
+
+void StratModule::post( int type, const void *view, int64_t stamp,
+	StratEvent **shared )
+{
+	if( !_threaded ) {
+		dispatch( type, view, stamp );
+		return;
+	}
+	if( *shared == NULL ) {
+		*shared = StratEvent::make( type, view, stamp );
+	}
+	(*shared)->refs++;
+	push( *shared );
+}
+
+void StratModule::keepAll( bool on )
+{
+	keep = on;
+}
+
+void StratModule::push( StratEvent *ev )
+{
+	drain();
+	if( !overflow.empty() || !queue->push(ev) ) {
+		if( !keep && (ev->type == StratEvent::TICK
+		    || ev->type == StratEvent::BAR) ) {
+			cntDropped++;
+			StratEvent::release( ev );
+			return;
+		}
+		/* orders, executions, positions and timers must not get lost */
+		overflow.push_back( ev );
+		cntDeferred++;
+		spilled = true;
+		return;
+	}
+	wake();
+}
+
+/* move the overflow into the queue as far as it fits */
+void StratModule::drain()
+{
+	if( overflow.empty() ) {
+		return;
+	}
+	while( !overflow.empty() && queue->push(overflow.front()) ) {
+		overflow.pop_front();
+	}
+	spilled = !overflow.empty();
+	wake();
+}
+
+void StratModule::wake()
+{
+	/* pairs with the fence in loop() */
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( sleeping ) {
+		std::lock_guard<std::mutex> lock( wakeMutex );
+		wakeCond.notify_one();
+	}
+}
+
+/* call on_timer() for all expired timers, now in usecs */
+void StratModule::expire( int64_t now )
+{
+	while( !timers.empty() && timers.begin()->first <= now / 1000 ) {
+		/* on_timer() may schedule new timers */
+		void *cookie = timers.begin()->second;
+		timers.erase( timers.begin() );
+		if( _threaded ) {
+			push( StratEvent::make(StratEvent::TIMER, cookie, now) );
+		} else {
+			dispatch( StratEvent::TIMER, cookie, now );
+		}
+	}
+}
+
+bool StratModule::hasTimers() const
+{
+	return !timers.empty();
+}
+
+/* event loop thread, run a pending service call of our thread */
+void StratModule::serve()
+{
+	drain();
+	if( cmd.load(std::memory_order_relaxed) == NULL ) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock( cmdMutex );
+	Cmd *c = cmd.load();
+	c->result = run( *c );
+	c->done = true;
+	cmd = NULL;
+	cntCmds++;
+	cmdCond.notify_one();
+}
+
+int64_t StratModule::exec( Cmd &c )
+{
+	if( !_threaded || threadId.load() != std::this_thread::get_id() ) {
+		return run( c );
+	}
+	/* we are in our thread, let the event loop do it and wait */
+	std::unique_lock<std::mutex> lock( cmdMutex );
+	cmd = &c;
+	wakeLoop( wakeClo );
+	cmdCond.wait( lock, [&c]{ return c.done; } );
+	return c.result;
+}
+
+int64_t StratModule::run( Cmd &c )
+{
+	const int64_t trig = trigger != 0 ? trigger : nowInUsecs();
+	switch( c.type ) {
+	case Cmd::TIMER:
+		timers.insert( std::make_pair(c.arg, c.ptr) );
+		dl->wakeAt( c.arg );
+		return 0;
+	case Cmd::PLACE_ORDER:
+		return dl->stratPlaceOrder( *c.order, trig );
+	case Cmd::CANCEL_ORDER:
+		return dl->stratCancelOrder( c.arg, trig );
+	case Cmd::SUBSCRIBE:
+	case Cmd::UNSUBSCRIBE:
+		{
+			const bool on = c.type == Cmd::SUBSCRIBE;
+			const int tickerId = c.arg;
+			/* not checked, jobs may come later */
+			if( tickerId < 0 ) {
+				return -1;
+			} else if( tickerId == 0 ) {
+				subAll = on;
+				subs.clear();
+				return 0;
+			}
+			if( (int)subs.size() <= tickerId ) {
+				subs.resize( tickerId + 1, 0 );
+			}
+			subs[tickerId] = on;
+		}
+		return 0;
+	case Cmd::INSTRUMENT:
+		{
+			const Contract *ct = dl->tickerContract( c.arg );
+			tws_strat_instrument *out = (tws_strat_instrument*)c.ptr;
+			if( ct == NULL ) {
+				return -1;
+			}
+			out->tickerId = c.arg;
+			out->conId = ct->conId;
+			out->symbol = ct->symbol.c_str();
+			out->secType = ct->secType.c_str();
+			out->expiry = ct->lastTradeDateOrContractMonth.c_str();
+			out->strike = ct->strike;
+			out->right = ct->right.c_str();
+			out->exchange = ct->exchange.c_str();
+			out->currency = ct->currency.c_str();
+		}
+		return 0;
+	case Cmd::POSITION:
+		return dl->stratGetPosition( c.arg, c.str,
+			(tws_strat_position*)c.ptr );
+	}
+	assert( false );
+	return -1;
+}
+
+void StratModule::dispatch( int type, const void *view, int64_t stamp )
+{
+	const int64_t t0 = nowInUsecs();
+	const int64_t lat = t0 - stamp;
+	cntEvents++;
+	sumLatency += lat;
+	maxLatency = std::max( maxLatency, lat );
+
+	trigger = stamp;
+	switch( type ) {
+	case StratEvent::TICK:
+		tick_dso( dso, (const tws_strat_tick*)view );
+		break;
+	case StratEvent::BAR:
+		bar_dso( dso, (const tws_strat_bar*)view );
+		break;
+	case StratEvent::ORDER_STATUS:
+		order_status_dso( dso, (const tws_strat_order_status*)view );
+		break;
+	case StratEvent::EXECUTION:
+		execution_dso( dso, (const tws_strat_execution*)view );
+		break;
+	case StratEvent::TIMER:
+		timer_dso( dso, stamp, (void*)view );
+		break;
+	case StratEvent::CONNECTION:
+		connection_dso( dso, *(const int*)view );
+		break;
+	case StratEvent::POSITION:
+		position_dso( dso, (const tws_strat_position*)view );
+		break;
+	}
+	trigger = 0;
+	busyUsecs += nowInUsecs() - t0;
+}
+
+/* the module's own thread */
+void StratModule::loop()
+{
+	threadId = std::this_thread::get_id();
+#if defined __linux__
+	if( cpu >= 0 ) {
+		cpu_set_t set;
+		CPU_ZERO( &set );
+		CPU_SET( cpu, &set );
+		int err = pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+		if( err != 0 ) {
+			WARN_PRINTF( "Warning, pinning strategy %s to cpu %d failed: %s",
+				_name.c_str(), cpu, strerror(err) );
+		}
+	}
+#endif
+	StratEvent *ev;
+	while( true ) {
+		if( queue->pop(&ev) ) {
+			const int64_t lag = nowInUsecs() - ev->queued;
+			sumLag += lag;
+			maxLag = std::max( maxLag, lag );
+			dispatch( ev->type, ev->view(), ev->stamp );
+			StratEvent::release( ev );
+			/* let the event loop refill the queue from its overflow */
+			if( spilled && queue->size() <= STRAT_QUEUE_SIZE / 2
+			    && spilled.exchange(false) ) {
+				wakeLoop( wakeClo );
+			}
+			continue;
+		}
+		if( !running ) {
+			break;
+		}
+		std::unique_lock<std::mutex> lock( wakeMutex );
+		sleeping = true;
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		wakeCond.wait_for( lock, std::chrono::milliseconds(100),
+			[this]{ return queue->size() > 0 || !running; } );
+		sleeping = false;
+	}
+	struct timespec ts;
+	if( clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0 ) {
+		cpuUsecs += (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+	threadId = std::thread::id();
+	finished = true;
+}
+
+/* cpu time of inline modules is the time spent in their callbacks */
+void StratModule::dumpStats() const
+{
+	INFO_PRINTF( "strategy %s: %ld events, %ld dropped, %ld deferred, "
+		"receive to callback latency avg %.1fus, max %ldus, "
+		"queue lag avg %.1fus, max %ldus, "
+		"cpu %.3fms, %ld service calls waited for, %zu timers pending, "
+		"%d reloads",
+		_name.c_str(), cntEvents, cntDropped.load(), cntDeferred,
+		cntEvents > 0 ? (double)sumLatency / cntEvents : 0.0,
+		(long)maxLatency,
+		cntEvents > 0 ? (double)sumLag / cntEvents : 0.0, (long)maxLag,
+		(_threaded ? cpuUsecs : busyUsecs) / 1000.0, cntCmds,
+		timers.size(), cntReloads );
+}
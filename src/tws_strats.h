@@ -0,0 +1,182 @@
+/*** tws_strats.h -- strategy modules and their threads
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_STRATS_H
+#define TWS_STRATS_H
+
+#include "tws_strat.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TwsDL;
+struct TwsQuoteUpdate;
+template<typename T> class SpscRing;
+typedef struct tws_dso_s *tws_dso_t;
+
+
+/**
+ * One event for any number of threaded modules. The views point into the
+ * event's own copies, it's freed by the last module done with it.
+ */
+struct StratEvent
+{
+	enum Type {
+		TICK,
+		BAR,
+		ORDER_STATUS,
+		EXECUTION,
+		TIMER,
+		CONNECTION,
+		POSITION
+	};
+
+	static StratEvent* make( int type, const void *view, int64_t stamp );
+	static void release( StratEvent* );
+	const void* view() const;
+
+	std::atomic<int> refs;
+	int type;
+	/* receive time of what caused it in usecs */
+	int64_t stamp;
+	/* when it was queued in usecs */
+	int64_t queued;
+	union {
+		tws_strat_tick tick;
+		tws_strat_bar bar;
+		tws_strat_order_status os;
+		tws_strat_execution exec;
+		tws_strat_position pos;
+		void *cookie;
+		int state;
+	} u;
+	double opt[8];
+	std::string str[6];
+};
+
+
+/**
+ * A strategy module loaded by --strat FILE[@CPU]. Modules run in the event
+ * loop thread unless @CPU is given. Then the module gets its own thread and
+ * event queue, pinned to CPU unless it's empty or -1. The services of
+ * threaded modules which touch twsdo's state are executed by the event
+ * loop while the module's thread waits. When the queue is full ticks and
+ * bars are dropped, all other events wait in an overflow list.
+ */
+class StratModule
+{
+	public:
+		StratModule( TwsDL*, const char *spec );
+		~StratModule();
+
+		bool open();
+		/* close and load the file again, start() it afterwards */
+		bool reload();
+		TwsDL* host() const;
+		const std::string& name() const;
+		bool typed() const;
+		bool threaded() const;
+		/* let the event loop serve commands of our thread */
+		void setWake( void (*wake)(void*), void *clo );
+
+		void start();
+		void stop();
+
+		/* legacy work() and quotes() */
+		void work();
+		bool hasQuotes() const;
+		void quotes( const TwsQuoteUpdate*, size_t n );
+
+		/* event loop thread */
+		bool wants( int type, int tickerId ) const;
+		/* call back right away or queue the shared event, see release() */
+		void post( int type, const void *view, int64_t stamp,
+			StratEvent **shared );
+		/* queue ticks and bars instead of dropping them, for replays */
+		void keepAll( bool on );
+		void expire( int64_t now );
+		bool hasTimers() const;
+		void serve();
+
+		void dumpStats() const;
+
+		/* services, see tws_strat.h */
+		struct Cmd;
+		int64_t exec( Cmd& );
+
+	private:
+		StratModule( const StratModule& );
+		StratModule& operator=( const StratModule& );
+
+		bool load();
+		int64_t run( Cmd& );
+		void dispatch( int type, const void *view, int64_t stamp );
+		void loop();
+		void push( StratEvent* );
+		void drain();
+		void wake();
+
+		TwsDL *dl;
+		std::string file;
+		std::string _name;
+		bool _threaded;
+		int cpu;
+		tws_dso_t dso;
+		tws_strat_services srv;
+
+		/* event loop thread only */
+		std::vector<char> subs;
+		bool subAll;
+		bool keep;
+		std::multimap<int64_t, void*> timers;
+
+		/* receive time of the event the module is handling */
+		int64_t trigger;
+
+		SpscRing<StratEvent*> *queue;
+		/* events which didn't fit into the queue, event loop thread only */
+		std::deque<StratEvent*> overflow;
+		/* overflow is not empty, the thread wakes the event loop */
+		std::atomic<bool> spilled;
+		std::thread *thread;
+		std::atomic<std::thread::id> threadId;
+		std::atomic<bool> running;
+		std::atomic<bool> finished;
+		std::mutex wakeMutex;
+		std::condition_variable wakeCond;
+		std::atomic<bool> sleeping;
+
+		/* a service call of our thread, see exec() */
+		std::mutex cmdMutex;
+		std::condition_variable cmdCond;
+		std::atomic<Cmd*> cmd;
+		void (*wakeLoop)(void*);
+		void *wakeClo;
+
+		/* statistics, written by the thread calling back */
+		long cntEvents;
+		int64_t sumLatency;
+		int64_t maxLatency;
+		int64_t sumLag;
+		int64_t maxLag;
+		int64_t busyUsecs;
+		int64_t cpuUsecs;
+		std::atomic<long> cntDropped;
+		long cntDeferred;
+		long cntCmds;
+		int cntReloads;
+};
+
+#endif
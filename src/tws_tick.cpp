@@ -0,0 +1,292 @@
+/*** tws_tick.cpp -- binary tick recorder
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_tick.h"
+#include "tws_util.h"
+#include "debug.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+#define TICK_MAGIC "TWSTICK"
+#define TICK_BYTE_ORDER 0x01020304u
+#define TICK_VERSION 1
+
+/* records per batched write */
+#define TICK_BATCH 4096
+
+/* the file format must not depend on the compiler */
+static_assert( sizeof(TickFileHeader) == 32, "bad TickFileHeader size" );
+static_assert( sizeof(TickRecord) == 32, "bad TickRecord size" );
+
+
+const char* tick_kind_str( int kind )
+{
+	switch( (tick_kind)kind ) {
+	case TICK_PRICE:            return "price";
+	case TICK_SIZE:             return "size";
+	case TICK_GENERIC:          return "generic";
+	case TICK_STRING:           return "string";
+	case TICK_OPT_IV:           return "impliedVol";
+	case TICK_OPT_DELTA:        return "delta";
+	case TICK_OPT_PRICE:        return "optPrice";
+	case TICK_OPT_PV_DIVIDEND:  return "pvDividend";
+	case TICK_OPT_GAMMA:        return "gamma";
+	case TICK_OPT_VEGA:         return "vega";
+	case TICK_OPT_THETA:        return "theta";
+	case TICK_OPT_UND_PRICE:    return "undPrice";
+	case TICK_DEPTH_ASK_INSERT: return "askInsert";
+	case TICK_DEPTH_ASK_UPDATE: return "askUpdate";
+	case TICK_DEPTH_ASK_DELETE: return "askDelete";
+	case TICK_DEPTH_BID_INSERT: return "bidInsert";
+	case TICK_DEPTH_BID_UPDATE: return "bidUpdate";
+	case TICK_DEPTH_BID_DELETE: return "bidDelete";
+	}
+	return "unknown";
+}
+
+
+
+
+TickRecorder::TickRecorder( const std::string &p, size_t s ) :
+	prefix(p),
+	segmentSize(s),
+	segment(0),
+	file(NULL),
+	fileSize(0),
+	batch(new TickRecord[TICK_BATCH]),
+	batchLen(0),
+	failed(false),
+	cntRecords(0),
+	cntWrites(0),
+	writeUsecs(0)
+{
+	assert( segmentSize >= sizeof(TickFileHeader) + sizeof(TickRecord) );
+}
+
+TickRecorder::~TickRecorder()
+{
+	flush();
+	if( file != NULL ) {
+		fclose( file );
+	}
+	delete[] batch;
+}
+
+bool TickRecorder::open()
+{
+	/* "yyyy-mm-dd HH:MM:SS" -> "yyyymmdd-HHMMSS" */
+	std::string t = time_t_local( time(NULL) );
+	for( size_t i = 0; i < t.size(); i++ ) {
+		if( t[i] == ' ' ) {
+			startTime += '-';
+		} else if( t[i] != '-' && t[i] != ':' ) {
+			startTime += t[i];
+		}
+	}
+	return rotate();
+}
+
+/* close the current segment and start the next one */
+bool TickRecorder::rotate()
+{
+	if( file != NULL ) {
+		fclose( file );
+		file = NULL;
+	}
+
+	char name[4096];
+	FILE *f;
+	do {
+		segment++;
+		snprintf( name, sizeof(name), "%s.%s.%04d.tick", prefix.c_str(),
+			startTime.c_str(), segment );
+		/* never overwrite segments of another run */
+		if( (f = fopen(name, "rb")) != NULL ) {
+			fclose( f );
+			continue;
+		}
+		break;
+	} while( true );
+
+	file = fopen( name, "wb" );
+	if( file == NULL ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), name );
+		failed = true;
+		return false;
+	}
+	/* we write whole batches anyway */
+	setvbuf( file, NULL, _IONBF, 0 );
+
+	TickFileHeader h;
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, TICK_MAGIC, sizeof(TICK_MAGIC) );
+	h.byteOrder = TICK_BYTE_ORDER;
+	h.version = TICK_VERSION;
+	h.recordSize = sizeof(TickRecord);
+	h.created = nowInUsecs();
+	if( fwrite(&h, sizeof(h), 1, file) != 1 ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), name );
+		failed = true;
+		return false;
+	}
+	fileSize = sizeof(h);
+	INFO_PRINTF( "recording ticks to '%s'", name );
+	return true;
+}
+
+void TickRecorder::record( int64_t stamp, int tickerId, long conId,
+	int tickType, int kind, double value, int size )
+{
+	if( batchLen >= TICK_BATCH ) {
+		flush();
+	}
+	TickRecord &r = batch[batchLen++];
+	memset( &r, 0, sizeof(r) );
+	r.stamp = stamp;
+	r.tickerId = tickerId;
+	r.conId = conId;
+	r.tickType = tickType;
+	r.kind = kind;
+	r.size = size;
+	r.value = value;
+	cntRecords++;
+}
+
+/* write the batch, split it if the segment gets full */
+bool TickRecorder::flush()
+{
+	if( batchLen == 0 ) {
+		return true;
+	}
+	if( failed ) {
+		/* don't buffer forever, we have already complained */
+		batchLen = 0;
+		return false;
+	}
+
+	int64_t t = nowInUsecs();
+	size_t done = 0;
+	while( done < batchLen ) {
+		size_t room = (segmentSize - fileSize) / sizeof(TickRecord);
+		if( room == 0 ) {
+			if( !rotate() ) {
+				break;
+			}
+			continue;
+		}
+		size_t n = std::min( room, batchLen - done );
+		if( fwrite(batch + done, sizeof(TickRecord), n, file) != n ) {
+			fprintf( stderr, "error, writing ticks: %s\n", strerror(errno) );
+			failed = true;
+			break;
+		}
+		fileSize += n * sizeof(TickRecord);
+		done += n;
+		cntWrites++;
+	}
+	batchLen = 0;
+	writeUsecs += nowInUsecs() - t;
+	return !failed;
+}
+
+size_t TickRecorder::pending() const
+{
+	return batchLen;
+}
+
+/* stamp of the oldest unwritten record, 0 if none */
+int64_t TickRecorder::oldestPending() const
+{
+	return batchLen > 0 ? batch[0].stamp : 0;
+}
+
+void TickRecorder::dumpStats() const
+{
+	INFO_PRINTF( "tick recorder: %ld records, %d segments, %ld writes "
+		"%.3fms", cntRecords, segment, cntWrites, writeUsecs / 1000.0 );
+}
+
+
+
+
+TickReader::TickReader() :
+	file(NULL),
+	name(NULL),
+	swap(false),
+	batch(new TickRecord[TICK_BATCH]),
+	batchLen(0),
+	batchPos(0)
+{
+}
+
+TickReader::~TickReader()
+{
+	if( file != NULL && file != stdin ) {
+		fclose( file );
+	}
+	delete[] batch;
+}
+
+/* open and check the header, read stdin if filename is NULL */
+bool TickReader::openFile( const char *filename )
+{
+	name = filename != NULL ? filename : "(stdin)";
+	if( filename == NULL ) {
+		file = stdin;
+	} else if( (file = fopen(filename, "rb")) == NULL ) {
+		fprintf( stderr, "error, %s: '%s'\n", strerror(errno), name );
+		return false;
+	}
+
+	TickFileHeader h;
+	if( fread(&h, sizeof(h), 1, file) != 1
+	    || memcmp(h.magic, TICK_MAGIC, sizeof(TICK_MAGIC)) != 0 ) {
+		fprintf( stderr, "error, not a tick file: '%s'\n", name );
+		return false;
+	}
+	swap = h.byteOrder != TICK_BYTE_ORDER;
+	if( swap ) {
+		SWAP_FIELD( h.byteOrder );
+		SWAP_FIELD( h.version );
+		SWAP_FIELD( h.recordSize );
+	}
+	if( h.byteOrder != TICK_BYTE_ORDER || h.version != TICK_VERSION
+	    || h.recordSize != sizeof(TickRecord) ) {
+		fprintf( stderr, "error, unsupported tick file version %d: '%s'\n",
+			h.version, name );
+		return false;
+	}
+	return true;
+}
+
+bool TickReader::next( TickRecord *r )
+{
+	if( batchPos >= batchLen ) {
+		batchLen = fread( batch, sizeof(TickRecord), TICK_BATCH, file );
+		batchPos = 0;
+		if( batchLen == 0 ) {
+			if( ferror(file) ) {
+				fprintf( stderr, "error, reading '%s'\n", name );
+			}
+			return false;
+		}
+	}
+	*r = batch[batchPos++];
+	if( swap ) {
+		SWAP_FIELD( r->stamp );
+		SWAP_FIELD( r->tickerId );
+		SWAP_FIELD( r->conId );
+		SWAP_FIELD( r->tickType );
+		SWAP_FIELD( r->size );
+		SWAP_FIELD( r->value );
+	}
+	return true;
+}
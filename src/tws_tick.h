@@ -0,0 +1,133 @@
+/*** tws_tick.h -- binary tick recorder
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_TICK_H
+#define TWS_TICK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+
+
+enum tick_kind {
+	TICK_PRICE,
+	TICK_SIZE,
+	TICK_GENERIC,
+	/* numeric prefix of a string tick */
+	TICK_STRING,
+	/* the 8 values of an option computation tick */
+	TICK_OPT_IV,
+	TICK_OPT_DELTA,
+	TICK_OPT_PRICE,
+	TICK_OPT_PV_DIVIDEND,
+	TICK_OPT_GAMMA,
+	TICK_OPT_VEGA,
+	TICK_OPT_THETA,
+	TICK_OPT_UND_PRICE,
+	/* market depth operations, tickType is the book position */
+	TICK_DEPTH_ASK_INSERT,
+	TICK_DEPTH_ASK_UPDATE,
+	TICK_DEPTH_ASK_DELETE,
+	TICK_DEPTH_BID_INSERT,
+	TICK_DEPTH_BID_UPDATE,
+	TICK_DEPTH_BID_DELETE
+};
+
+const char* tick_kind_str( int kind );
+
+/* every segment file starts with this header */
+struct TickFileHeader
+{
+	char magic[8];
+	/* TICK_BYTE_ORDER in the writer's byte order */
+	uint32_t byteOrder;
+	uint16_t version;
+	uint16_t recordSize;
+	/* usecs since epoch */
+	int64_t created;
+	int64_t reserved;
+};
+
+/* followed by any number of these, in the header's byte order */
+struct TickRecord
+{
+	/* receive time in usecs since epoch */
+	int64_t stamp;
+	int32_t tickerId;
+	int32_t conId;
+	int16_t tickType;
+	uint8_t kind;
+	uint8_t reserved;
+	/* size of depth records, 0 otherwise */
+	int32_t size;
+	double value;
+};
+
+
+/**
+ * Append ticks to segment files PREFIX.YYYYMMDD-HHMMSS.NNNN.tick. Records
+ * are collected in a preallocated batch which is written when full or by
+ * flush(). A new segment is started when the current one would exceed the
+ * segment size.
+ */
+class TickRecorder
+{
+	public:
+		TickRecorder( const std::string &prefix, size_t segmentSize );
+		~TickRecorder();
+
+		bool open();
+		void record( int64_t stamp, int tickerId, long conId, int tickType,
+			int kind, double value, int size = 0 );
+		bool flush();
+		size_t pending() const;
+		int64_t oldestPending() const;
+		void dumpStats() const;
+
+	private:
+		bool rotate();
+
+		const std::string prefix;
+		const size_t segmentSize;
+		std::string startTime;
+		int segment;
+
+		FILE *file;
+		size_t fileSize;
+		TickRecord *batch;
+		size_t batchLen;
+		bool failed;
+
+		/* statistics */
+		long cntRecords;
+		long cntWrites;
+		int64_t writeUsecs;
+};
+
+
+/* read segment files written by TickRecorder, on any byte order */
+class TickReader
+{
+	public:
+		TickReader();
+		~TickReader();
+
+		bool openFile( const char *filename );
+		bool next( TickRecord* );
+
+	private:
+		FILE *file;
+		const char *name;
+		bool swap;
+		TickRecord *batch;
+		size_t batchLen;
+		size_t batchPos;
+};
+
+#endif
@@ -47,6 +47,15 @@ int64_t nowInMsecs()
 	return now_ms;
 }
 
+int64_t nowInUsecs()
+{
+	timeval tv;
+	int err = gettimeofday( &tv, NULL );
+	assert( err == 0 );
+
+	return (int64_t)tv.tv_sec * 1000000 + (int64_t)tv.tv_usec;
+}
+
 std::string msecs_to_string( int64_t msecs )
 {
 	const time_t s = msecs / 1000;
@@ -146,6 +155,29 @@ std::string time_t_local( time_t t )
 }
 
 
+/**
+ * Convert time_t to IB's local date time string "yyyymmdd  HH:MM:SS".
+ */
+std::string time_t_ib( time_t t )
+{
+	struct tm *tmp;
+	char buf[sizeof("yyyymmdd  HH:MM:SS")];
+
+#ifdef HAVE_LOCALTIME_R
+	struct tm tm;
+	tmp = localtime_r( &t, &tm );
+#else
+	tmp = localtime( &t );
+#endif
+	assert( tmp != NULL );
+
+	if( strftime(buf, sizeof(buf), "%Y%m%d  %T", tmp) == 0) {
+		assert( false );
+	}
+	return buf;
+}
+
+
 /**
  * Convert IB's duration string to seconds.
  * Return -1 on parse error.
@@ -193,6 +225,234 @@ int ib_duration2secs( const std::string &dur )
 }
 
 
+/**
+ * Convert an intraday bar size like "5 secs", "1 min" or "4 hours" to
+ * seconds. Return -1 on parse error or for daily and longer bars.
+ */
+int ib_bar_size2secs( const std::string &barSizeSetting )
+{
+	const char *s = barSizeSetting.c_str();
+	char *unit;
+	long val = strtol( s, &unit, 10 );
+	if( unit == s || *unit != ' ' || val <= 0 || val > 86400 ) {
+		return -1;
+	}
+	unit++;
+
+	int secs;
+	if( strcasecmp(unit, "sec") == 0 || strcasecmp(unit, "secs") == 0 ) {
+		secs = 1;
+	} else if( strcasecmp(unit, "min") == 0
+	    || strcasecmp(unit, "mins") == 0 ) {
+		secs = 60;
+	} else if( strcasecmp(unit, "hour") == 0
+	    || strcasecmp(unit, "hours") == 0 ) {
+		secs = 3600;
+	} else {
+		return -1;
+	}
+	if( val * secs > 86400 ) {
+		return -1;
+	}
+	return val * secs;
+}
+
+
+/**
+ * Return the maximum durationStr TWS accepts for the given bar size or NULL
+ * if the bar size is unknown.
+ */
+const char* ib_max_duration( const char* barSizeSetting )
+{
+/* valid bars: (1|5|15|30) secs, 1 min, (2|3|5|15|30) mins, 1 hour, 4 hours
+   seems to be not supported anymore: 1 day, 1 week, 1 month, 3 months, 1 year
+   valid durations: integer{SPACE}unit (S|D|W|M|Y) */
+	// TODO
+
+	if( strcmp( barSizeSetting, "1 secs")==0 ) {
+		return "2000 S";
+	} else if( strcasecmp( barSizeSetting, "5 secs")==0 ) {
+		return "10000 S";
+	} else if( strcasecmp( barSizeSetting, "15 secs")==0 ) {
+		return "30000 S";
+	} else if( strcasecmp( barSizeSetting, "30 secs")==0 ) {
+		return "86400 S"; // seems to get more that "1 D"
+	} else if( strcasecmp( barSizeSetting, "1 min")==0 ) {
+		return "6 D";
+	} else if( strcasecmp( barSizeSetting, "2 mins")==0 ) {
+		return "6 D";
+	} else if( strcasecmp( barSizeSetting, "3 mins")==0 ) {
+		return "6 D";
+	} else if( strcasecmp( barSizeSetting, "5 mins")==0 ) {
+		return "6 D";
+	} else if( strcasecmp( barSizeSetting, "15 mins")==0 ) {
+		return "20 D";
+	} else if( strcasecmp( barSizeSetting, "30 mins")==0 ) {
+		return "34 D";
+	} else if( strcasecmp( barSizeSetting, "1 hour")==0 ) {
+		return "34 D";
+	} else if( strcasecmp( barSizeSetting, "4 hours")==0 ) {
+		return "34 D";
+	} else if( strcasecmp( barSizeSetting, "1 day")==0 ) {
+		/* Is "1 Y" always better than "52 W" or "12 M"? Note that longer
+		   requests will be rejected from local TWS itself! */
+		return "1 Y";
+	}
+	return NULL;
+}
+
+
+/**
+ * Convert IB style date or date time string (local time) to time_t.
+ * Return -1 on parse error.
+ */
+time_t ib_datetime2time_t( const std::string &ib_datetime )
+{
+	struct tm tm;
+
+	if( ib_strptime( &tm, ib_datetime ) == -1 ) {
+		return -1;
+	}
+	tm.tm_isdst = -1; // set "auto dst", strptime() does not set it
+	return mktime( &tm );
+}
+
+
+/* step back to the previous business day, keeping the time of day */
+static void prev_busy_day( struct tm *tm )
+{
+	do {
+		tm->tm_mday--;
+		tm->tm_isdst = -1;
+		mktime( tm ); // normalize, updates tm_wday
+	} while( tm->tm_wday == 0 || tm->tm_wday == 6 );
+}
+
+
+/**
+ * Get the time span [begin, end) covered by a historical data request.
+ * An empty endDateTime means now. Durations in days are counted as business
+ * days. Other units than seconds and days are not supported.
+ * Return 0 on success or -1 on error.
+ */
+int ib_window( const std::string &endDateTime, const std::string &durationStr,
+	time_t *begin, time_t *end )
+{
+	int secs = ib_duration2secs( durationStr );
+	if( secs < 0 ) {
+		return -1;
+	}
+
+	if( endDateTime.empty() ) {
+		*end = time(NULL);
+	} else if( (*end = ib_datetime2time_t(endDateTime)) == -1 ) {
+		return -1;
+	}
+
+	switch( durationStr[durationStr.size() - 1] ) {
+	case 'S':
+		*begin = *end - secs;
+		return 0;
+	case 'D':
+		break;
+	default:
+		return -1;
+	}
+
+	struct tm tm;
+#ifdef HAVE_LOCALTIME_R
+	if( localtime_r( end, &tm ) == NULL ) {
+		return -1;
+	}
+#else
+	struct tm *tmp_tm = localtime( end );
+	if( tmp_tm == NULL ) {
+		return -1;
+	}
+	tm = *tmp_tm;
+#endif
+	for( int days = secs / 86400; days > 0; days-- ) {
+		prev_busy_day( &tm );
+	}
+	*begin = mktime( &tm );
+	return 0;
+}
+
+
+/**
+ * Return the number of business days needed to reach back from end to begin.
+ */
+int ib_busy_days( time_t begin, time_t end )
+{
+	struct tm tm;
+	int days = 0;
+
+#ifdef HAVE_LOCALTIME_R
+	localtime_r( &end, &tm );
+#else
+	tm = *localtime( &end );
+#endif
+	while( end > begin ) {
+		prev_busy_day( &tm );
+		end = mktime( &tm );
+		days++;
+	}
+	return days;
+}
+
+
+/**
+ * Parse a shard spec "I/N" with 1 <= I <= N. Set idx zero based.
+ * Return -1 on error.
+ */
+int parse_shard( const char *str, int *idx, int *cnt )
+{
+	char *end;
+	long i, n;
+
+	i = strtol( str, &end, 10 );
+	if( end == str || *end != '/' ) {
+		return -1;
+	}
+	str = end + 1;
+	n = strtol( str, &end, 10 );
+	if( end == str || *end != '\0' ) {
+		return -1;
+	}
+	if( n < 1 || n > INT_MAX || i < 1 || i > n ) {
+		return -1;
+	}
+	*idx = i - 1;
+	*cnt = n;
+	return 0;
+}
+
+
+/**
+ * 32 bit FNV-1a, it must never change to keep shards stable across versions
+ * and hosts.
+ */
+uint32_t stable_hash( const std::string &s )
+{
+	uint32_t h = 2166136261u;
+	for( size_t i = 0; i < s.size(); i++ ) {
+		h ^= (unsigned char) s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void swap_bytes( void *p, size_t n )
+{
+	unsigned char *c = (unsigned char*) p;
+	for( size_t i = 0; i < n / 2; i++ ) {
+		unsigned char tmp = c[i];
+		c[i] = c[n - 1 - i];
+		c[n - 1 - i] = tmp;
+	}
+}
+
+
 std::string ibToString( int tickType) {
 	 /* cast to get compiler warnings when enums are missing in switch */
 	TickType xtickType = (TickType)(tickType);
@@ -26,13 +26,29 @@ using namespace IB;
 
 
 int64_t nowInMsecs();
+int64_t nowInUsecs();
 std::string msecs_to_string( int64_t msecs );
 
 int ib_strptime( struct tm *tm, const std::string &ib_datetime );
 std::string ib_date2iso( const std::string &ibDate );
 std::string time_t_local( time_t t );
+std::string time_t_ib( time_t t );
 
 int ib_duration2secs( const std::string &dur );
+int ib_bar_size2secs( const std::string &barSizeSetting );
+const char* ib_max_duration( const char* barSizeSetting );
+time_t ib_datetime2time_t( const std::string &ib_datetime );
+int ib_window( const std::string &endDateTime, const std::string &durationStr,
+	time_t *begin, time_t *end );
+int ib_busy_days( time_t begin, time_t end );
+
+int parse_shard( const char *str, int *idx, int *cnt );
+uint32_t stable_hash( const std::string& );
+
+/* reverse the bytes of a field read from a file of the other byte order */
+#define SWAP_FIELD( _f_ ) \
+	swap_bytes( &(_f_), sizeof(_f_) )
+void swap_bytes( void *p, size_t n );
 
 std::string ibToString( int ibTickType);
 std::string ibToString( const Execution& );
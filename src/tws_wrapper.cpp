@@ -9,6 +9,7 @@
 #include "tws_wrapper.h"
 #include "twsdo.h"
 #include "tws_meta.h"
+#include "tws_reader.h"
 #include "tws_util.h"
 #include "debug.h"
 #include "config.h"
@@ -20,7 +21,8 @@
 #include <twsapi/CommissionReport.h>
 
 TwsDlWrapper::TwsDlWrapper( TwsDL* parent ) :
-	parentTwsDL(parent)
+	parentTwsDL(parent),
+	reader(NULL)
 {
 }
 
@@ -28,6 +30,23 @@ TwsDlWrapper::~TwsDlWrapper()
 {
 }
 
+void TwsDlWrapper::setReader( TwsReader *r )
+{
+	reader = r;
+}
+
+/* queue events if called back by the reader thread, otherwise handle now */
+void TwsDlWrapper::post( TwsEvent *ev )
+{
+	ev->stamp = nowInUsecs();
+	if( reader != NULL && reader->inReaderThread() ) {
+		tws_event_clone( ev );
+		reader->push( *ev );
+	} else {
+		parentTwsDL->twsEvent( *ev );
+	}
+}
+
 void TwsDlWrapper::tickPrice( TickerId tickerId, TickType field,
 	double price, const TickAttrib& ta)
 {
@@ -35,7 +54,9 @@ void TwsDlWrapper::tickPrice( TickerId tickerId, TickType field,
 	DEBUG_PRINTF( "TICK_PRICE: %ld %s %g %d",
 		tickerId, ibToString(field).c_str(), price, ta.canAutoExecute);
 #endif
-	parentTwsDL->twsTickPrice( tickerId, field, price, ta.canAutoExecute );
+	TwsEvent ev = { TwsEvent::t_tickPrice, (int)tickerId, field,
+		ta.canAutoExecute, {price}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::tickSize( TickerId tickerId, TickType field,
@@ -45,7 +66,9 @@ void TwsDlWrapper::tickSize( TickerId tickerId, TickType field,
 	DEBUG_PRINTF( "TICK_SIZE: %ld %s %d",
 		tickerId, ibToString(field).c_str(), size );
 #endif
-	parentTwsDL->twsTickSize( tickerId, field, size );
+	TwsEvent ev = { TwsEvent::t_tickSize, (int)tickerId, field, size, {},
+		NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::tickOptionComputation ( TickerId tickerId,
@@ -58,8 +81,10 @@ void TwsDlWrapper::tickOptionComputation ( TickerId tickerId,
 		tickerId, ibToString(tickType).c_str(), impliedVol, delta,
 		optPrice, pvDividend, gamma, vega, theta, undPrice );
 #endif
-	parentTwsDL->twsTickOptionComputation(tickerId, tickType, impliedVol,
-		delta, optPrice, pvDividend, gamma, vega, theta, undPrice);
+	TwsEvent ev = { TwsEvent::t_tickOptionComputation, (int)tickerId,
+		tickType, 0, {impliedVol, delta, optPrice, pvDividend, gamma, vega,
+		theta, undPrice}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::tickGeneric( TickerId tickerId, TickType tickType,
@@ -69,7 +94,9 @@ void TwsDlWrapper::tickGeneric( TickerId tickerId, TickType tickType,
 	DEBUG_PRINTF( "TICK_GENERIC: %ld %s %g",
 		tickerId, ibToString(tickType).c_str(), value );
 #endif
-	parentTwsDL->twsTickGeneric(tickerId, tickType, value);
+	TwsEvent ev = { TwsEvent::t_tickGeneric, (int)tickerId, tickType, 0,
+		{value}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::tickString( TickerId tickerId, TickType tickType,
@@ -82,7 +109,9 @@ void TwsDlWrapper::tickString( TickerId tickerId, TickType tickType,
 	DEBUG_PRINTF( "TICK_STRING: %ld %s %s",
 		tickerId, ibToString(tickType).c_str(), value.c_str() );
 #endif
-	parentTwsDL->twsTickString( tickerId, tickType, value);
+	TwsEvent ev = { TwsEvent::t_tickString, (int)tickerId, tickType, 0, {},
+		&value, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::tickEFP( TickerId tickerId, TickType tickType,
@@ -107,7 +136,8 @@ void TwsDlWrapper::orderStatus ( OrderId orderId,
 #endif
 	RowOrderStatus row = { orderId, status, filled, remaining,
 		avgFillPrice, permId, parentId, lastFillPrice, clientId, whyHeld };
-	parentTwsDL->twsOrderStatus(row);
+	TwsEvent ev = { TwsEvent::t_orderStatus, 0, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::openOrder( OrderId orderId,
@@ -138,7 +168,8 @@ void TwsDlWrapper::openOrder( OrderId orderId,
 		orderState.equityWithLoanAfter.c_str() );
 #endif
 	RowOpenOrder row = { orderId, contract, order, orderState };
-	parentTwsDL->twsOpenOrder(row);
+	TwsEvent ev = { TwsEvent::t_openOrder, 0, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::openOrderEnd()
@@ -146,7 +177,8 @@ void TwsDlWrapper::openOrderEnd()
 #if 1
 	DEBUG_PRINTF( "OPEN_ORDER_END" );
 #endif
-	parentTwsDL->twsOpenOrderEnd();
+	TwsEvent ev = { TwsEvent::t_openOrderEnd, 0, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::winError( const IBString &str, int lastError )
@@ -160,7 +192,8 @@ void TwsDlWrapper::connectionClosed()
 #if 0
 	DEBUG_PRINTF( "CONNECTION_CLOSED" );
 #endif
-	parentTwsDL->twsConnectionClosed();
+	TwsEvent ev = { TwsEvent::t_connectionClosed, 0, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updateAccountValue( const IBString& key,
@@ -172,7 +205,8 @@ void TwsDlWrapper::updateAccountValue( const IBString& key,
 		key.c_str(), val.c_str(), currency.c_str(), accountName.c_str() );
 #endif
 	RowAccVal row = { key, val, currency, accountName };
-	parentTwsDL->twsUpdateAccountValue( row );
+	TwsEvent ev = { TwsEvent::t_updateAccountValue, 0, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updatePortfolio( const Contract& contract,
@@ -187,7 +221,8 @@ void TwsDlWrapper::updatePortfolio( const Contract& contract,
 #endif
 	RowPrtfl row = { contract, position, marketPrice, marketValue,
 		averageCost, unrealizedPNL, realizedPNL, accountName};
-	parentTwsDL->twsUpdatePortfolio( row );
+	TwsEvent ev = { TwsEvent::t_updatePortfolio, 0, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updateAccountTime( const IBString& timeStamp )
@@ -195,7 +230,9 @@ void TwsDlWrapper::updateAccountTime( const IBString& timeStamp )
 #if 0
 	DEBUG_PRINTF( "ACCT_UPDATE_TIME: %s", timeStamp.c_str() );
 #endif
-	parentTwsDL->twsUpdateAccountTime( timeStamp );
+	TwsEvent ev = { TwsEvent::t_updateAccountTime, 0, 0, 0, {},
+		&timeStamp, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::accountDownloadEnd( const IBString& accountName )
@@ -203,7 +240,9 @@ void TwsDlWrapper::accountDownloadEnd( const IBString& accountName )
 #if 1
 	DEBUG_PRINTF( "ACCT_DOWNLOAD_END: %s", accountName.c_str() );
 #endif
-	parentTwsDL->twsAccountDownloadEnd( accountName );
+	TwsEvent ev = { TwsEvent::t_accountDownloadEnd, 0, 0, 0, {},
+		&accountName, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::nextValidId( OrderId orderId )
@@ -211,7 +250,8 @@ void TwsDlWrapper::nextValidId( OrderId orderId )
 #if 1
 	DEBUG_PRINTF( "NEXT_VALID_ID: %ld", orderId );
 #endif
-	parentTwsDL->nextValidId( orderId );
+	TwsEvent ev = { TwsEvent::t_nextValidId, 0, 0, orderId, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::contractDetails( int reqId,
@@ -232,7 +272,9 @@ void TwsDlWrapper::contractDetails( int reqId,
 		contractDetails.summary.tradingClass.c_str()
 		);
 #endif
-	parentTwsDL->twsContractDetails( reqId, contractDetails );
+	TwsEvent ev = { TwsEvent::t_contractDetails, reqId, 0, 0, {},
+		&contractDetails, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::bondContractDetails( int reqId,
@@ -254,8 +296,9 @@ void TwsDlWrapper::bondContractDetails( int reqId,
 		contractDetails.summary.tradingClass.c_str()
 		);
 #endif
-	parentTwsDL->twsBondContractDetails(
-		reqId, contractDetails );
+	TwsEvent ev = { TwsEvent::t_bondContractDetails, reqId, 0, 0, {},
+		&contractDetails, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::contractDetailsEnd( int reqId )
@@ -263,7 +306,8 @@ void TwsDlWrapper::contractDetailsEnd( int reqId )
 #if 0
 	DEBUG_PRINTF( "CONTRACT_DATA_END: %d", reqId );
 #endif
-	parentTwsDL->twsContractDetailsEnd(reqId);
+	TwsEvent ev = { TwsEvent::t_contractDetailsEnd, reqId, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::execDetails ( int reqId, const Contract& contract,
@@ -275,7 +319,8 @@ void TwsDlWrapper::execDetails ( int reqId, const Contract& contract,
 		ibToString(execution).c_str());
 #endif
 	RowExecution row = { contract, execution };
-	parentTwsDL->twsExecDetails(  reqId, row );
+	TwsEvent ev = { TwsEvent::t_execDetails, reqId, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::execDetailsEnd( int reqId )
@@ -283,7 +328,8 @@ void TwsDlWrapper::execDetailsEnd( int reqId )
 #if 1
 	DEBUG_PRINTF( "EXECUTION_DATA_END: %d", reqId );
 #endif
-	parentTwsDL->twsExecDetailsEnd( reqId );
+	TwsEvent ev = { TwsEvent::t_execDetailsEnd, reqId, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::error(int id, int errorCode, const IBString& errorString)
@@ -292,21 +338,32 @@ void TwsDlWrapper::error(int id, int errorCode, const IBString& errorString)
 	DEBUG_PRINTF( "ERR_MSG: %d %d %s", id, errorCode, errorString.c_str() );
 #endif
 	RowError row = { id, errorCode, errorString };
-	parentTwsDL->twsError( row );
+	TwsEvent ev = { TwsEvent::t_error, id, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updateMktDepth( TickerId id, int position,
 	int operation, int side, double price, int size )
 {
-	// TODO
-	DEBUG_PRINTF( "MARKET_DEPTH: %ld", id );
+#if 0
+	DEBUG_PRINTF( "MARKET_DEPTH: %ld %d %d %d %g %d", id, position,
+		operation, side, price, size );
+#endif
+	TwsEvent ev = { TwsEvent::t_updateMktDepth, (int)id, position, size,
+		{price, (double)operation, (double)side}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updateMktDepthL2( TickerId id, int position,
 	const IBString& mktMaker, int operation, int side, double price, int size)
 {
-	// TODO
-	DEBUG_PRINTF( "MARKET_DEPTH_L2: %ld", id );
+#if 0
+	DEBUG_PRINTF( "MARKET_DEPTH_L2: %ld %d %s %d %d %g %d", id, position,
+		mktMaker.c_str(), operation, side, price, size );
+#endif
+	TwsEvent ev = { TwsEvent::t_updateMktDepthL2, (int)id, position, size,
+		{price, (double)operation, (double)side}, &mktMaker, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::updateNewsBulletin( int msgId, int msgType,
@@ -336,7 +393,8 @@ void TwsDlWrapper::historicalData( TickerId reqId, const Bar& bar)
 #endif
 	/* TODO remove RowHist and use Bar directly */
 	RowHist row = { bar.time, bar.open, bar.high, bar.low, bar.close, bar.volume, bar.count, bar.wap, false };
-	parentTwsDL->twsHistoricalData( reqId, row );
+	TwsEvent ev = { TwsEvent::t_historicalData, (int)reqId, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::historicalDataEnd(int reqId,
@@ -347,7 +405,8 @@ void TwsDlWrapper::historicalDataEnd(int reqId,
 #endif
 	RowHist row = dflt_RowHist;
 	row.date = IBString("finished-") + startDateStr + "-" + endDateStr;
-	parentTwsDL->twsHistoricalData( reqId, row );
+	TwsEvent ev = { TwsEvent::t_historicalData, reqId, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::scannerParameters( const IBString &xml )
@@ -373,8 +432,14 @@ void TwsDlWrapper::scannerDataEnd(int reqId)
 void TwsDlWrapper::realtimeBar( TickerId reqId, long time, double open,
 	double high, double low, double close, long volume, double wap, int count )
 {
-	// TODO
-	DEBUG_PRINTF( "REAL_TIME_BAR: %ld %ld", reqId, time );
+#if 0
+	DEBUG_PRINTF( "REAL_TIME_BAR: %ld %ld %g %g %g %g %ld %g %d", reqId, time,
+		open, high, low, close, volume, wap, count );
+#endif
+	TwsEvent ev = { TwsEvent::t_realtimeBar, (int)reqId, 0, time,
+		{open, high, low, close, (double)volume, wap, (double)count},
+		NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::currentTime( long time )
@@ -382,7 +447,8 @@ void TwsDlWrapper::currentTime( long time )
 #if 1
 	DEBUG_PRINTF( "CURRENT_TIME: %ld", time );
 #endif
-	parentTwsDL->twsCurrentTime( time );
+	TwsEvent ev = { TwsEvent::t_currentTime, 0, 0, time, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::fundamentalData( TickerId reqId,
@@ -400,7 +466,8 @@ void TwsDlWrapper::deltaNeutralValidation( int reqId,
 
 void TwsDlWrapper::tickSnapshotEnd( int reqId )
 {
-	DEBUG_PRINTF( "TICK_SNAPSHOT_END: %d", reqId );
+	TwsEvent ev = { TwsEvent::t_tickSnapshotEnd, reqId, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::marketDataType( TickerId reqId, int marketDataType )
@@ -479,7 +546,8 @@ void TwsDlWrapper::connectAck()
 #if 1
 	DEBUG_PRINTF( "CONNECT_ACK");
 #endif
-	parentTwsDL->twsConnectAck();
+	TwsEvent ev = { TwsEvent::t_connectAck, 0, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::positionMulti( int reqId, const std::string& account,
@@ -519,7 +587,8 @@ void TwsDlWrapper::securityDefinitionOptionalParameter(int reqId,
 	RowOptParams row = {
 		exchange, underlyingConId, tradingClass,
 		multiplier, expirations, strikes };
-	parentTwsDL->twsOptParams(reqId, row);
+	TwsEvent ev = { TwsEvent::t_optParams, reqId, 0, 0, {}, &row, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::securityDefinitionOptionalParameterEnd(int reqId)
@@ -527,7 +596,8 @@ void TwsDlWrapper::securityDefinitionOptionalParameterEnd(int reqId)
 #if 0
 	DEBUG_PRINTF("OPT_PARAMS_END: %d", reqId);
 #endif
-	parentTwsDL->twsOptParamsEnd(reqId);
+	TwsEvent ev = { TwsEvent::t_optParamsEnd, reqId, 0, 0, {}, NULL, 0 };
+	post( &ev );
 }
 
 void TwsDlWrapper::softDollarTiers(int reqId,
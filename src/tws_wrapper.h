@@ -19,6 +19,8 @@ using namespace IB;
 #endif
 
 class TwsDL;
+class TwsReader;
+struct TwsEvent;
 
 class TwsDlWrapper : public EWrapper
 {
@@ -28,8 +30,13 @@ public:
 
 	#include <twsapi/EWrapper_prototypes.h>
 
+	void setReader( TwsReader* );
+
 private:
+	void post( TwsEvent* );
+
 	TwsDL* parentTwsDL;
+	TwsReader *reader;
 };
 
 #endif
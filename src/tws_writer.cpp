@@ -0,0 +1,107 @@
+/*** tws_writer.cpp -- asynchronous xml output
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_writer.h"
+#include "tws_xml.h"
+#include "tws_util.h"
+#include "debug.h"
+
+
+TwsWriter::TwsWriter( size_t c ) :
+	capacity(c),
+	queue(*(new std::deque<xmlDocPtr>())),
+	thread(NULL),
+	running(false),
+	cntDocs(0),
+	maxDepth(0),
+	cntBlocked(0),
+	blockedUsecs(0),
+	writeUsecs(0)
+{
+	assert( capacity > 0 );
+}
+
+TwsWriter::~TwsWriter()
+{
+	stop();
+	assert( queue.empty() );
+	delete &queue;
+}
+
+void TwsWriter::start()
+{
+	assert( thread == NULL );
+	running = true;
+	thread = new std::thread( &TwsWriter::run, this );
+}
+
+/* write everything queued so far and join the thread */
+void TwsWriter::stop()
+{
+	if( thread == NULL ) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	notEmpty.notify_one();
+	thread->join();
+	delete thread;
+	thread = NULL;
+}
+
+/* take over the document, block only if the queue is full */
+void TwsWriter::push( xmlDocPtr doc )
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if( queue.size() >= capacity ) {
+		int64_t t = nowInUsecs();
+		notFull.wait( lock, [this]{ return queue.size() < capacity; } );
+		cntBlocked++;
+		blockedUsecs += nowInUsecs() - t;
+	}
+	queue.push_back( doc );
+	cntDocs++;
+	if( queue.size() > maxDepth ) {
+		maxDepth = queue.size();
+	}
+	lock.unlock();
+	notEmpty.notify_one();
+}
+
+void TwsWriter::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;) {
+		notEmpty.wait( lock, [this]{ return !queue.empty() || !running; } );
+		if( queue.empty() ) {
+			break;
+		}
+		xmlDocPtr doc = queue.front();
+		queue.pop_front();
+		lock.unlock();
+		notFull.notify_one();
+
+		int64_t t = nowInUsecs();
+		TwsXml::dumpDoc( doc );
+		t = nowInUsecs() - t;
+
+		lock.lock();
+		writeUsecs += t;
+	}
+	fflush( stdout );
+}
+
+void TwsWriter::dumpStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	INFO_PRINTF( "output writer: %ld docs, queue %zu, max depth %zu, "
+		"writing %.3fms, blocked %ld times %.3fms", cntDocs, capacity,
+		maxDepth, writeUsecs / 1000.0, cntBlocked, blockedUsecs / 1000.0 );
+}
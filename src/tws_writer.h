@@ -0,0 +1,58 @@
+/*** tws_writer.h -- asynchronous xml output
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#ifndef TWS_WRITER_H
+#define TWS_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <libxml/tree.h>
+
+
+/**
+ * Thread formatting and writing finished xml documents in the order they
+ * were pushed. The job thread only blocks if the queue is full.
+ */
+class TwsWriter
+{
+	public:
+		TwsWriter( size_t capacity );
+		~TwsWriter();
+
+		void start();
+		void stop();
+
+		void push( xmlDocPtr );
+		void dumpStats() const;
+
+	private:
+		void run();
+
+		const size_t capacity;
+		std::deque<xmlDocPtr> &queue;
+		std::thread *thread;
+		bool running;
+
+		mutable std::mutex mutex;
+		std::condition_variable notEmpty;
+		std::condition_variable notFull;
+
+		/* statistics, protected by mutex */
+		long cntDocs;
+		size_t maxDepth;
+		long cntBlocked;
+		int64_t blockedUsecs;
+		int64_t writeUsecs;
+};
+
+#endif
@@ -902,6 +902,12 @@ void to_xml( xmlNodePtr parent, const HistRequest& hr)
 	ADD_ATTR_STRING( hr, whatToShow );
 	ADD_ATTR_INT( hr, useRTH );
 	ADD_ATTR_INT( hr, formatDate );
+
+	for( size_t i = 0; i < hr.parts.size(); i++ ) {
+		xmlNodePtr np = xmlNewChild( ne, NULL, (xmlChar*)"part", NULL);
+		A_ADD_ATTR_STRING( np, hr.parts[i], endDateTime );
+		A_ADD_ATTR_STRING( np, hr.parts[i], durationStr );
+	}
 }
 
 void to_xml( xmlNodePtr parent, const AccStatusRequest &aR )
@@ -966,9 +972,24 @@ void from_xml( HistRequest *hR, const xmlNodePtr node )
 	char* tmp;
 
 	for( xmlNodePtr p = node->children; p!= NULL; p=p->next) {
-		if( p->type == XML_ELEMENT_NODE
-			&& strcmp((char*)p->name, "reqContract") == 0 )  {
+		if( p->type != XML_ELEMENT_NODE ) {
+			continue;
+		}
+		if( strcmp((char*)p->name, "reqContract") == 0 )  {
 			conv_xml2ib( &hR->ibContract, p);
+		} else if( strcmp((char*)p->name, "part") == 0 )  {
+			HistWindow w;
+			tmp = (char*) xmlGetProp( p, (xmlChar*) "endDateTime" );
+			if( tmp ) {
+				w.endDateTime = std::string(tmp);
+				free(tmp);
+			}
+			tmp = (char*) xmlGetProp( p, (xmlChar*) "durationStr" );
+			if( tmp ) {
+				w.durationStr = std::string(tmp);
+				free(tmp);
+			}
+			hR->parts.push_back(w);
 		}
 	}
 
@@ -1035,6 +1056,37 @@ void from_xml( MktDataRequest* mdr, const xmlNodePtr node )
 	GET_ATTR_BOOL( mdr, snapshot );
 }
 
+void from_xml( MktDepthRequest* mdr, const xmlNodePtr node )
+{
+	char* tmp;
+
+	for( xmlNodePtr p = node->children; p!= NULL; p=p->next) {
+		if( p->type == XML_ELEMENT_NODE
+			&& strcmp((char*)p->name, "reqContract") == 0 )  {
+			conv_xml2ib( &mdr->ibContract, p);
+		}
+	}
+
+	GET_ATTR_INT( mdr, numRows );
+}
+
+void from_xml( RealTimeBarsRequest* rbr, const xmlNodePtr node )
+{
+	char* tmp;
+
+	for( xmlNodePtr p = node->children; p!= NULL; p=p->next) {
+		if( p->type == XML_ELEMENT_NODE
+			&& strcmp((char*)p->name, "reqContract") == 0 )  {
+			conv_xml2ib( &rbr->ibContract, p);
+		}
+	}
+
+	GET_ATTR_STRING( rbr, barSizeSetting );
+	GET_ATTR_STRING( rbr, whatToShow );
+	GET_ATTR_INT( rbr, useRTH );
+	GET_ATTR_INT( rbr, formatDate );
+}
+
 void from_xml( OptParamsRequest* opr, const xmlNodePtr node )
 {
 	for( xmlNodePtr p = node->children; p!= NULL; p=p->next) {
@@ -1306,10 +1358,21 @@ bool TwsXml::openFile( const char *filename )
 	return true;
 }
 
+/* parse docs from a copy of data instead of a file */
+void TwsXml::openMem( const char *data, size_t len )
+{
+	assert( file == NULL && buf_len == 0 );
+	while( (long)len >= buf_size ) {
+		resize_buf();
+	}
+	memcpy( buf, data, len );
+	buf_len = len;
+}
+
 xmlDocPtr TwsXml::nextXmlDoc()
 {
 	xmlDocPtr doc = NULL;
-	if( file == NULL ) {
+	if( file == NULL && buf_len == 0 ) {
 		return doc;
 	}
 
@@ -1326,6 +1389,11 @@ xmlDocPtr TwsXml::nextXmlDoc()
 			break;
 		}
 		cp += tmp_len;
+		if( file == NULL ) {
+			/* openMem(), no more data */
+			jump_ff = 0;
+			break;
+		}
 
 		if( (buf_len + CHUNK_SIZE) >= buf_size ) {
 			resize_buf();
@@ -1423,11 +1491,21 @@ xmlNodePtr TwsXml::nextXmlNode()
 bool TwsXml::_skip_defaults = false;
 const bool& TwsXml::skip_defaults = _skip_defaults;
 
+void (*TwsXml::dump_handler)(xmlDocPtr, void*) = NULL;
+void *TwsXml::dump_clo = NULL;
+
 void TwsXml::setSkipDefaults( bool b )
 {
 	_skip_defaults = b;
 }
 
+/* let somebody else dump and free our docs, e.g. a writer thread */
+void TwsXml::setDumpHandler( void (*f)(xmlDocPtr, void*), void *clo )
+{
+	dump_handler = f;
+	dump_clo = clo;
+}
+
 xmlNodePtr TwsXml::newDocRoot()
 {
 	xmlDocPtr doc = xmlNewDoc( (const xmlChar*) "1.0");
@@ -1441,10 +1519,19 @@ xmlNodePtr TwsXml::newDocRoot()
 
 void TwsXml::dumpAndFree( xmlNodePtr root )
 {
-	xmlDocFormatDump(stdout, root->doc, 1);
+	if( dump_handler != NULL ) {
+		dump_handler( root->doc, dump_clo );
+		return;
+	}
+	dumpDoc( root->doc );
+}
+
+void TwsXml::dumpDoc( xmlDocPtr doc )
+{
+	xmlDocFormatDump(stdout, doc, 1);
 	//HACK print form feed as xml file separator
 	printf("\f");
 
-	xmlFreeDoc(root->doc);
+	xmlFreeDoc(doc);
 }
 
@@ -12,6 +12,7 @@
 /* it's a pain to get macro PRIdMAX on C++ */
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <stddef.h>
 
 #include <twsapi/twsapi_config.h>
 
@@ -70,6 +71,8 @@ class ExecutionsRequest;
 class OrdersRequest;
 class PlaceOrder;
 class MktDataRequest;
+class MktDepthRequest;
+class RealTimeBarsRequest;
 class OptParamsRequest;
 
 void to_xml( xmlNodePtr parent, const ContractDetailsRequest& );
@@ -88,6 +91,8 @@ void from_xml( ExecutionsRequest*, const xmlNodePtr node );
 void from_xml( OrdersRequest*, const xmlNodePtr node );
 void from_xml( PlaceOrder*, const xmlNodePtr node );
 void from_xml( MktDataRequest*, const xmlNodePtr node );
+void from_xml( MktDepthRequest*, const xmlNodePtr node );
+void from_xml( RealTimeBarsRequest*, const xmlNodePtr node );
 void from_xml( OptParamsRequest* const, xmlNodePtr node );
 
 
@@ -118,8 +123,11 @@ class TwsXml
 		static void setSkipDefaults( bool );
 		static xmlNodePtr newDocRoot();
 		static void dumpAndFree( xmlNodePtr root );
+		static void dumpDoc( xmlDocPtr doc );
+		static void setDumpHandler( void (*f)(xmlDocPtr, void*), void *clo );
 
 		bool openFile( const char *filename );
+		void openMem( const char *data, size_t len );
 		xmlDocPtr nextXmlDoc();
 		xmlNodePtr nextXmlRoot();
 		xmlNodePtr nextXmlNode();
@@ -130,6 +138,8 @@ class TwsXml
 		void resize_buf();
 
 		static bool _skip_defaults;
+		static void (*dump_handler)(xmlDocPtr, void*);
+		static void *dump_clo;
 
 		void *file; // FILE*
 		long buf_size;
@@ -0,0 +1,130 @@
+/*** twsbt.cpp -- backtest strategy modules on recorded market data
+ *
+ * Copyright (C) 2011-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+
+#include "tws_backtest.h"
+#include "tws_xml.h"
+#include "debug.h"
+#include "version.h"
+#include "config.h"
+
+#include <twsapi/twsapi_config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "twsbt_ggo.h"
+
+
+static gengetopt_args_info args_info;
+
+static int skipdefp = 0;
+static const char *accountp = "BT";
+static double commissionp = 0.0;
+
+
+#define VERSION_MSG \
+CMDLINE_PARSER_PACKAGE_NAME " (" PACKAGE_NAME ") %s [\
+built with twsapi " TWSAPI_VERSION "]\n\
+Copyright (C) 2010-2018 Ruediger Meier\n\
+License BSD 3-Clause\n\
+\n\
+Written by Ruediger Meier <sweet_f_a@gmx.de>\n"
+
+
+static void check_display_args()
+{
+	if( args_info.help_given ) {
+		gengetopt_args_info_usage =
+			"Usage: " CMDLINE_PARSER_PACKAGE_NAME " [OPTION]... [FILE]...";
+		cmdline_parser_print_help();
+	} else if( args_info.usage_given ) {
+		printf( "%s\n", gengetopt_args_info_usage );
+	} else if( args_info.version_given ) {
+		printf( VERSION_MSG, twstools_version_string );
+ 	} else {
+		return;
+	}
+
+	exit(0);
+}
+
+static void gengetopt_check_opts()
+{
+	if( !args_info.strat_given ) {
+		fprintf( stderr, "error, nothing to do, use --strat.\n" );
+		exit(2);
+	}
+	skipdefp = args_info.verbose_xml_given;
+	if( args_info.account_given ) {
+		accountp = args_info.account_arg;
+	}
+	if( args_info.commission_given ) {
+		commissionp = args_info.commission_arg;
+	}
+}
+
+static void gengetopt_free()
+{
+	cmdline_parser_free( &args_info );
+}
+
+
+/**
+ * Replay FILEs, historical data as twsxml or tick files as written by
+ * twsdo --ticks, through all --strat modules. Without FILE it's read from
+ * stdin.
+ */
+static bool backtest()
+{
+	Backtest bt;
+	bt.setAccount( accountp );
+	bt.setCommission( commissionp );
+
+	if( args_info.inputs_num == 0 ) {
+		if( !bt.loadFile(NULL) ) {
+			return false;
+		}
+	}
+	for( unsigned i = 0; i < args_info.inputs_num; i++ ) {
+		if( !bt.loadFile(args_info.inputs[i]) ) {
+			return false;
+		}
+	}
+	bt.prepare();
+	for( unsigned i = 0; i < args_info.strat_given; i++ ) {
+		if( !bt.addModule(args_info.strat_arg[i]) ) {
+			return false;
+		}
+	}
+
+	bt.run();
+	bt.dumpXml();
+	bt.dumpStats();
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	atexit( gengetopt_free );
+
+	if( cmdline_parser(argc, argv, &args_info) != 0 ) {
+		return 2; // exit
+	}
+
+	check_display_args();
+	gengetopt_check_opts();
+
+	TwsXml::setSkipDefaults( !skipdefp );
+
+	if( !backtest() ) {
+		return 1;
+	}
+	return 0;
+}
@@ -12,6 +12,20 @@
 #include "tws_util.h"
 #include "tws_client.h"
 #include "tws_wrapper.h"
+#include "tws_reader.h"
+#include "tws_writer.h"
+#include "tws_daemon.h"
+#include "tws_tick.h"
+#include "tws_lines.h"
+#include "tws_publish.h"
+#include "tws_conflate.h"
+#include "tws_book.h"
+#include "tws_bars.h"
+#include "tws_greeks.h"
+#include "tws_gateway.h"
+#include "tws_orders.h"
+#include "tws_strats.h"
+#include "tws_xml.h"
 #include "tws_account.h"
 #include "debug.h"
 
@@ -26,10 +40,14 @@
 #if defined HAVE_CONFIG_H
 # include "config.h"
 #endif  /* HAVE_CONFIG_H */
-#include "dso_magic.h"
 
+#include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
 
 #if defined _WIN32
 # include <winsock2.h>
@@ -49,9 +67,29 @@ ConfigTwsdo::ConfigTwsdo()
 	tws_port = 7474;
 	tws_client_id = 123;
 	ai_family = AF_UNSPEC;
+	coalesce = 0;
+	shard_idx = 0;
+	shard_cnt = 1;
+	shard_by_farm = 1;
+	threaded = 0;
+	async_output = 0;
+	daemon_path = NULL;
+	max_lines = 100;
+	line_slice = 0;
+	tick_prefix = NULL;
+	tick_segment = 64;
+	shm_name = NULL;
+	conflate_sink = NULL;
+	conflate_interval = 100;
+	conflate_latency = 0;
+	greeks_file = NULL;
+	greeks_interval = 60;
+	order_retention = 600;
+	pnl_interval = 0;
 
 	get_account = 0;
 	tws_account_name = "";
+	account_stream = 0;
 	get_exec = 0;
 	get_order = 0;
 
@@ -63,7 +101,8 @@ ConfigTwsdo::ConfigTwsdo()
 	tws_minPacingTime = 1000;
 	tws_violationPause = 60000;
 
-	strat_file = NULL;
+	strat_files = NULL;
+	strat_cnt = 0;
 }
 
 void ConfigTwsdo::init_ai_family( int ipv4, int ipv6 )
@@ -111,29 +150,137 @@ void ConfigTwsdo::init_mkt_data_type(const char *str)
 	}
 }
 
+void ConfigTwsdo::init_shard( const char *shard, const char *shard_by )
+{
+	if( shard != NULL && parse_shard(shard, &shard_idx, &shard_cnt) != 0 ) {
+		fprintf( stderr, "error, invalid shard '%s', expected I/N\n", shard );
+		exit(2);
+	}
+	if( shard_by == NULL || strcmp(shard_by, "farm") == 0 ) {
+		shard_by_farm = 1;
+	} else if( strcmp(shard_by, "contract") == 0 ) {
+		shard_by_farm = 0;
+	} else {
+		fprintf( stderr, "error, invalid shard-by '%s'\n", shard_by );
+		exit(2);
+	}
+}
+
+/* token bucket for all messages to TWS, IB allows 50 per second */
 struct RateLimit
 {
 	bool can_send(int n = 1)
 	{
-		uint64_t now = nowInMsecs() / m_interval;
-		if (m_time < now) {
-			m_time = now;
-			m_count = n;
-			return true;
-		} else if ( m_count + n > m_rate ) {
+		int64_t now = nowInMsecs();
+		m_tokens = std::min( (double)m_burst,
+			m_tokens + (now - m_time) * m_rate / 1000.0 );
+		m_time = now;
+		if( m_tokens < n ) {
 			return false;
-		} else {
-			m_count += n;;
-			return true;
+		}
+		m_tokens -= n;
+		return true;
+	};
+
+	/* when can_send(n) will succeed again */
+	int64_t next_time(int n = 1) const
+	{
+		return m_time + (int64_t)ceil( (n - m_tokens) * 1000 / m_rate );
+	};
+
+	const int m_rate = 50;
+	const int m_burst = 25;
+	double m_tokens = 25;
+	int64_t m_time = 0;
+};
+
+/* wake-up times of the event loop, earliest first */
+struct TimerHeap
+{
+	void schedule( int64_t when )
+	{
+		heap.insert(when);
+	};
+
+	void expire( int64_t now )
+	{
+		while( !heap.empty() && *heap.begin() <= now ) {
+			heap.erase(heap.begin());
 		}
 	};
 
-	const int m_interval = 500;
-	const int m_rate = 25;
-	int m_count = 0;
-	uint64_t m_time = 0;
+	/* msecs to wait for the next timer, at most max */
+	int timeout( int64_t now, int max ) const
+	{
+		if( heap.empty() || *heap.begin() - now >= max ) {
+			return max;
+		}
+		return std::max( (int64_t)0, *heap.begin() - now );
+	};
+
+	/* a set because equal wake-up times are scheduled over and over */
+	std::set<int64_t> heap;
 };
 
+/* event loop latency, see dumpLoopStats() */
+struct LoopStats
+{
+	long wakeups = 0;
+	int64_t woken = 0;
+	int64_t finished = 0;
+	int count = 0;
+	int64_t sumUsecs = 0;
+	int64_t maxUsecs = 0;
+};
+
+/* upper bound for blocking in select, nothing should rely on it */
+#define MAX_IDLE_TIME 1000
+
+/* events the reader thread may queue before it stops reading */
+#define READER_QUEUE_SIZE 16384
+
+/* finished docs the writer thread may queue before we block */
+#define WRITER_QUEUE_SIZE 256
+
+/* max age of recorded ticks before we write them */
+#define TICK_FLUSH_MSECS 1000
+
+/* concurrent orders of the order gateway */
+#define GATEWAY_SLOTS 256
+
+/* report hist progress after that many finished requests */
+#define HIST_PROGRESS_EVERY 100
+
+/* TWS tickerIds of market data, depth and real-time bars, see
+   depthTickerId(), kept away from the reqIds of GenericRequest and from
+   our orderIds which share the same number space in error messages */
+#define STREAM_ID_BASE 0x40000000
+
+static void push_writer( xmlDocPtr doc, void *clo )
+{
+	((TwsWriter*)clo)->push( doc );
+}
+
+static void push_daemon( xmlDocPtr doc, void *clo )
+{
+	((TwsDaemon*)clo)->push( doc );
+}
+
+static void wake_reader( void *clo )
+{
+	((TwsReader*)clo)->wake();
+}
+
+/* set by SIGHUP, the event loop reloads all strategy modules */
+static volatile sig_atomic_t reload_strats = 0;
+
+#if defined SIGHUP
+static void on_sighup( int )
+{
+	reload_strats = 1;
+}
+#endif
+
 struct TwsHeartBeat
 {
 	TwsHeartBeat();
@@ -173,19 +320,41 @@ TwsDL::TwsDL() :
 	tws_hb(new TwsHeartBeat()),
 	tws_valid_orderId(0),
 	connectivity_IB_TWS(false),
-	curIdleTime(0),
+	timers(new TimerHeap()),
+	loop_stats(new LoopStats()),
 	twsWrapper( new TwsDlWrapper(this) ),
 	twsClient( new TWSClient(twsWrapper) ),
+	reader(NULL),
+	writer(NULL),
+	daemon(NULL),
+	ticks(NULL),
+	eventStamp(0),
 	rate_limit(new RateLimit()),
 	msgCounter(0),
 	currentRequest(  *(new GenericRequest()) ),
 	workTodo( new WorkTodo() ),
+	histReported(0),
 	account( new Account ),
-	quotes( new Quotes ),
+	quotes( new QuoteBoard() ),
+	lines( new MktDataLines() ),
+	publisher(NULL),
+	conflator(NULL),
+	greeks( new OptionGreeks() ),
+	greeksDue(0),
+	pnlDue(0),
+	accDelta(NULL),
+	accDue(0),
+	accSubscribed(false),
+	depth( new DepthBooks() ),
+	depthNext(0),
+	rtBars( new BarAggregator() ),
+	rtBarsNext(0),
 	packet( NULL ),
+	orderMgr( NULL ),
+	gateway( new OrderGateway(GATEWAY_SLOTS) ),
 	dataFarms( *(new DataFarmStates()) ),
 	pacingControl( *(new PacingGod(dataFarms)) ),
-	strat(NULL)
+	strats( *(new std::vector<StratModule*>()) )
 {
 }
 
@@ -195,7 +364,23 @@ TwsDL::~TwsDL()
 	delete &currentRequest;
 	delete tws_hb;
 	delete rate_limit;
+	delete timers;
+	delete loop_stats;
 
+	if( daemon != NULL ) {
+		TwsXml::setDumpHandler( NULL, NULL );
+		delete daemon;
+	}
+	if( ticks != NULL ) {
+		delete ticks;
+	}
+	if( reader != NULL ) {
+		delete reader;
+	}
+	if( writer != NULL ) {
+		TwsXml::setDumpHandler( NULL, NULL );
+		delete writer;
+	}
 	if( twsClient != NULL ) {
 		delete twsClient;
 	}
@@ -208,16 +393,44 @@ TwsDL::~TwsDL()
 	if( account != NULL ) {
 		delete account;
 	}
+	if( accDelta != NULL ) {
+		delete accDelta;
+	}
 	if( quotes != NULL ) {
 		delete quotes;
 	}
+	if( lines != NULL ) {
+		delete lines;
+	}
+	if( publisher != NULL ) {
+		delete publisher;
+	}
+	if( conflator != NULL ) {
+		delete conflator;
+	}
+	if( greeks != NULL ) {
+		delete greeks;
+	}
+	if( rtBars != NULL ) {
+		delete rtBars;
+	}
+	if( depth != NULL ) {
+		delete depth;
+	}
 	if( packet != NULL ) {
 		delete packet;
 	}
+	if( orderMgr != NULL ) {
+		delete orderMgr;
+	}
+	if( gateway != NULL ) {
+		delete gateway;
+	}
 
-	if( strat != NULL ) {
-		close_dso( strat, this );
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		delete strats[i];
 	}
+	delete &strats;
 
 	delete &pacingControl;
 	delete &dataFarms;
@@ -231,20 +444,111 @@ int TwsDL::setup( const ConfigTwsdo &c )
 	pacingControl.setPacingTime( cfg.tws_maxRequests,
 		cfg.tws_pacingInterval, cfg.tws_minPacingTime );
 	pacingControl.setViolationPause( cfg.tws_violationPause );
+	orderMgr = new OrderManager( cfg.order_retention * 1000LL );
+	if( cfg.account_stream > 0 ) {
+		accDelta = new AccountDelta();
+	}
 
 	// try loading DSOs before anything else
-	if( cfg.strat_file ) {
-		// for the moment we assume that the lt's load path is
-		// set up correctly or that the user has given an
-		// absolute file, if not just do fuckall
-		if( (strat = open_dso( cfg.strat_file, this )) == NULL ) {
+	for( int i = 0; i < cfg.strat_cnt; i++ ) {
+		StratModule *m = new StratModule( this, cfg.strat_files[i] );
+		strats.push_back( m );
+		if( !m->open() ) {
 			return -1;
 		}
+		if( m->threaded() ) {
+			/* module threads wake us up via the reader */
+			cfg.threaded = 1;
+		}
 	}
 
 	if( initWork() < 0 ) {
 		return -1;
 	}
+
+	if( cfg.daemon_path != NULL ) {
+		/* the daemon thread wakes us up via the reader */
+		cfg.threaded = 1;
+		if( cfg.async_output ) {
+			fprintf( stderr, "Warning, the daemon writes results in its "
+				"own thread, ignoring --async-output.\n" );
+			cfg.async_output = 0;
+		}
+	}
+	if( cfg.threaded ) {
+#if ! defined TWS_ORIG_CLIENT
+		reader = new TwsReader( twsClient, READER_QUEUE_SIZE );
+		twsWrapper->setReader( reader );
+#else
+		fprintf( stderr, "Warning, the original twsapi client has its "
+			"own reader thread, ignoring --threaded.\n" );
+#endif
+	}
+	if( cfg.async_output ) {
+		writer = new TwsWriter( WRITER_QUEUE_SIZE );
+		TwsXml::setDumpHandler( push_writer, writer );
+	}
+	if( cfg.tick_prefix != NULL ) {
+		if( cfg.tick_segment <= 0 ) {
+			fprintf( stderr, "error, invalid ticks-segment %d\n",
+				cfg.tick_segment );
+			return -1;
+		}
+		ticks = new TickRecorder( cfg.tick_prefix,
+			(size_t)cfg.tick_segment << 20 );
+		if( !ticks->open() ) {
+			return -1;
+		}
+	}
+	if( cfg.conflate_sink != NULL ) {
+		const char *sink = cfg.conflate_sink;
+		conflator = new Conflator( cfg.conflate_interval,
+			cfg.conflate_latency );
+		if( strcmp(sink, "strat") == 0 ) {
+			bool found = false;
+			for( size_t i = 0; i < strats.size(); i++ ) {
+				found = found || strats[i]->hasQuotes();
+			}
+			if( !found ) {
+				fprintf( stderr, "error, conflate sink 'strat' needs a "
+					"strategy module with quotes()\n" );
+				return -1;
+			}
+			conflator->setCallback( stratQuotes, this );
+		} else if( strncmp(sink, "unix:", 5) == 0 ) {
+			if( !conflator->openUnix(sink + 5) ) {
+				return -1;
+			}
+		} else if( !conflator->openFile(sink) ) {
+			return -1;
+		}
+	}
+	if( cfg.daemon_path != NULL ) {
+		if( reader == NULL ) {
+			fprintf( stderr, "error, daemon mode needs --threaded.\n" );
+			return -1;
+		}
+		daemon = new TwsDaemon( wake_reader, reader );
+		if( !daemon->listen(cfg.daemon_path) ) {
+			return -1;
+		}
+		TwsXml::setDumpHandler( push_daemon, daemon );
+	}
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		if( !strats[i]->threaded() ) {
+			continue;
+		}
+		if( reader == NULL ) {
+			fprintf( stderr, "error, strategy threads need --threaded.\n" );
+			return -1;
+		}
+		strats[i]->setWake( wake_reader, reader );
+	}
+#if defined SIGHUP
+	if( !strats.empty() ) {
+		signal( SIGHUP, on_sighup );
+	}
+#endif
 	return 0;
 }
 
@@ -253,21 +557,132 @@ int TwsDL::start()
 	assert( state == IDLE );
 
 	quit = false;
-	curIdleTime = 0;
+	if( reader != NULL ) {
+		reader->start();
+	}
+	if( writer != NULL ) {
+		writer->start();
+	}
+	if( daemon != NULL ) {
+		daemon->start();
+	}
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		strats[i]->start();
+	}
+	if( cfg.pnl_interval > 0 ) {
+		const int64_t ival = cfg.pnl_interval * 1000;
+		pnlDue = (nowInMsecs() / ival + 1) * ival;
+		wakeAt( pnlDue );
+	}
 	eventLoop();
+	/* final docs while the writer and the daemon still take them */
+	if( accDue != 0 ) {
+		flushAccStatus();
+	}
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		strats[i]->stop();
+	}
+	if( daemon != NULL ) {
+		daemon->stop();
+	}
+	if( reader != NULL ) {
+		reader->stop();
+	}
+	if( writer != NULL ) {
+		writer->stop();
+	}
+	workTodo->getHistTodo().dumpStats();
+	if( lines->size() > 0 ) {
+		lines->dumpStats();
+	}
+	if( depth->size() > 0 ) {
+		depth->dumpStats();
+	}
+	if( rtBars->size() > 0 ) {
+		rtBars->dumpStats();
+	}
+	if( quotes->rows() > 0 ) {
+		quotes->dumpStats();
+	}
+	if( publisher != NULL ) {
+		publisher->dumpStats();
+	}
+	if( conflator != NULL ) {
+		conflator->flush( nowInMsecs() );
+		conflator->dumpStats();
+	}
+	if( greeksDue != 0 ) {
+		greeks->snapshot( nowInUsecs() );
+	}
+	if( greeks->size() > 0 ) {
+		greeks->dumpStats();
+	}
+	if( ticks != NULL ) {
+		ticks->flush();
+		ticks->dumpStats();
+	}
+	bool typed = false;
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		if( strats[i]->typed() ) {
+			strats[i]->dumpStats();
+			typed = true;
+		}
+	}
+	if( typed ) {
+		gateway->dumpStats();
+	}
+	dumpOrderStats();
+	if( pnlDue != 0 ) {
+		account->dumpPnl();
+		account->dumpStats();
+	}
+	if( accDelta != NULL ) {
+		accDelta->dumpStats();
+	}
+	dumpLoopStats();
 	return error;
 }
 
 
+/**
+ * Sleep in select until the socket is ready or the earliest timer expires.
+ * Everybody waiting for something else than socket data has to schedule
+ * a wake-up using wakeAt() or wakeIn().
+ */
 void TwsDL::eventLoop()
 {
+	int idleTime = 0;
 	while( !quit ) {
-		if( curIdleTime > 0 ) {
-			twsClient->selectStuff( curIdleTime );
+		if( reader != NULL ) {
+			reader->wait( idleTime );
+			TwsEvent ev;
+			while( !quit && reader->pop(&ev) ) {
+				twsEvent( ev );
+				tws_event_free( &ev );
+			}
+		} else {
+			twsClient->selectStuff( idleTime );
+		}
+		loop_stats->wakeups++;
+		loop_stats->woken = nowInUsecs();
+		timers->expire( loop_stats->woken / 1000 );
+		if( reload_strats ) {
+			reload_strats = 0;
+			reloadStrats( NULL );
+		}
+		if( daemon != NULL ) {
+			std::string cmd;
+			while( daemon->popControl(&cmd) ) {
+				control( cmd );
+			}
+		}
+		for( size_t i = 0; i < strats.size(); i++ ) {
+			strats[i]->serve();
+			if( strats[i]->hasTimers() ) {
+				strats[i]->expire( loop_stats->woken );
+			}
 		}
-		/* We want to set the default select timeout if nobody will change it
-		   later. TODO do better */
-		curIdleTime = -1;
+
 		switch( state ) {
 			case WAIT_TWS_CON:
 				waitTwsCon();
@@ -276,9 +691,115 @@ void TwsDL::eventLoop()
 				idle();
 				break;
 		}
-		if( curIdleTime == -1 ) {
-			curIdleTime = 50;
+		if( ticks != NULL && ticks->pending() > 0 && loop_stats->woken
+		    - ticks->oldestPending() >= TICK_FLUSH_MSECS * 1000 ) {
+			ticks->flush();
+		}
+		if( conflator != NULL && conflator->pending()
+		    && loop_stats->woken / 1000 >= conflator->deadline() ) {
+			conflator->flush( loop_stats->woken / 1000 );
+			if( conflator->pending() ) {
+				wakeAt( conflator->deadline() );
+			}
+		}
+		if( greeksDue != 0 && loop_stats->woken / 1000 >= greeksDue ) {
+			greeks->snapshot( loop_stats->woken );
+			greeksDue += cfg.greeks_interval * 1000;
+			wakeAt( greeksDue );
+		}
+		if( pnlDue != 0 && loop_stats->woken / 1000 >= pnlDue ) {
+			account->dumpPnl();
+			pnlDue += cfg.pnl_interval * 1000;
+			wakeAt( pnlDue );
+		}
+		if( accDue != 0 && loop_stats->woken / 1000 >= accDue ) {
+			flushAccStatus();
+			accDue += cfg.account_stream * 1000;
+			wakeAt( accDue );
+		}
+		idleTime = timers->timeout( nowInMsecs(), MAX_IDLE_TIME );
+	}
+}
+
+
+/* a control command of a daemon client */
+void TwsDL::control( const std::string &cmd )
+{
+	char verb[16];
+	char arg[256];
+	int n = sscanf( cmd.c_str(), "%15s %255s", verb, arg );
+	if( n >= 1 && strcmp(verb, "reload") == 0 ) {
+		reloadStrats( n == 2 ? arg : NULL );
+		return;
+	} else if( n == 1 && strcmp(verb, "stats") == 0 ) {
+		if( !strats.empty() ) {
+			gateway->dumpStats();
 		}
+		dumpOrderStats();
+		return;
+	}
+	WARN_PRINTF( "Warning, unknown control command '%s'.", cmd.c_str() );
+}
+
+void TwsDL::dumpOrderStats() const
+{
+	workTodo->getPlaceOrderTodo().dumpStats();
+	orderMgr->dumpStats();
+}
+
+/* reload the strategy modules with the given name or file, NULL for all,
+   without touching connection, subscriptions or jobs */
+void TwsDL::reloadStrats( const char *name )
+{
+	int cnt = 0;
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		StratModule *m = strats[i];
+		if( name != NULL && m->name() != name ) {
+			continue;
+		}
+		cnt++;
+		INFO_PRINTF( "reloading strategy %s", m->name().c_str() );
+		if( !m->reload() ) {
+			ERROR_PRINTF( "cannot reload strategy %s, it stays unloaded",
+				m->name().c_str() );
+			continue;
+		}
+		stratReplay( m );
+		m->start();
+	}
+	if( cnt == 0 ) {
+		WARN_PRINTF( "Warning, no strategy '%s' to reload.",
+			name != NULL ? name : "" );
+	}
+}
+
+void TwsDL::wakeAt( int64_t msecs )
+{
+	timers->schedule( msecs );
+}
+
+
+void TwsDL::wakeIn( int msecs )
+{
+	timers->schedule( nowInMsecs() + msecs );
+}
+
+
+void TwsDL::dumpLoopStats() const
+{
+	const LoopStats &st = *loop_stats;
+	INFO_PRINTF( "event loop: %ld wakeups, callback to next request latency "
+		"avg %.3fms, max %.3fms (%d requests)", st.wakeups,
+		st.count > 0 ? st.sumUsecs / 1000.0 / st.count : 0.0,
+		st.maxUsecs / 1000.0, st.count );
+	if( reader != NULL ) {
+		reader->dumpStats();
+	}
+	if( writer != NULL ) {
+		writer->dumpStats();
+	}
+	if( daemon != NULL ) {
+		daemon->dumpStats();
 	}
 }
 
@@ -289,9 +810,9 @@ void TwsDL::connectTws()
 
 	int64_t w = nowInMsecs() - lastConnectionTime;
 	if( w < cfg.tws_conTimeout ) {
-		DEBUG_PRINTF( "Waiting %ldms before connecting again.",
+		INFO_PRINTF( "Waiting %ldms before connecting again.",
 			(long)(cfg.tws_conTimeout - w) );
-		curIdleTime = cfg.tws_conTimeout - w;
+		wakeAt( lastConnectionTime + cfg.tws_conTimeout );
 		return;
 	}
 
@@ -305,14 +826,14 @@ void TwsDL::connectTws()
 	assert( con == twsClient->isConnected() );
 
 	if( !con ) {
-		DEBUG_PRINTF("TWS connection failed.");
+		INFO_PRINTF("TWS connection failed.");
 		changeState(IDLE);
 #if TWSAPI_IB_VERSION_NUMBER >= 97200
-	} else if (!twsClient->ePosixClient->asyncEConnect()) {
+	} else if (!twsClient->asyncEConnect()) {
 #else
 	} else {
 #endif
-		DEBUG_PRINTF("TWS connection established: %d, %s",
+		INFO_PRINTF("TWS connection established: %d, %s",
 			twsClient->serverVersion(), twsClient->TwsConnectionTime().c_str());
 		/* this must be set before any possible "Connectivity" callback msg */
 		connectivity_IB_TWS = true;
@@ -322,13 +843,13 @@ void TwsDL::connectTws()
 void TwsDL::twsConnectAck()
 {
 #if TWSAPI_IB_VERSION_NUMBER >= 97200
-	if (twsClient->ePosixClient->asyncEConnect()) {
-		DEBUG_PRINTF("TWS connection established (async): %d, %s",
+	if (twsClient->asyncEConnect()) {
+		INFO_PRINTF("TWS connection established (async): %d, %s",
 			twsClient->serverVersion(), twsClient->TwsConnectionTime().c_str());
 		/* this must be set before any possible "Connectivity" callback msg */
 		connectivity_IB_TWS = true;
 		rate_limit->can_send(2);
-		twsClient->ePosixClient->startApi();
+		twsClient->startApi();
 	}
 #endif
 }
@@ -348,18 +869,19 @@ void TwsDL::waitTwsCon()
 				twsClient->reqMarketDataType(cfg.mkt_data_type);
 			twsClient->reqCurrentTime();
 		} if( tws_hb->tws_time != 0 && tws_valid_orderId != 0 ) {
-			DEBUG_PRINTF( "Connection process finished." );
+			INFO_PRINTF( "Connection process finished." );
 			changeState( IDLE );
+			stratConnection( TWS_STRAT_CONNECTED );
 		} else if( w > 0 ) {
 			DEBUG_PRINTF( "Still waiting for connection finish." );
-			curIdleTime = w;
+			wakeAt( lastConnectionTime + cfg.tws_conTimeout );
 		} else {
-			DEBUG_PRINTF( "Timeout connecting TWS." );
+			INFO_PRINTF( "Timeout connecting TWS." );
 			twsClient->disconnectTWS();
 		}
 	} else {
 		// TODO print a specific error
-		DEBUG_PRINTF( "Connecting TWS failed." );
+		INFO_PRINTF( "Connecting TWS failed." );
 		changeState( IDLE );
 	}
 }
@@ -368,6 +890,11 @@ void TwsDL::waitTwsCon()
 void TwsDL::idle()
 {
 	waitData();
+	/* orders don't wait for other requests */
+	if( !quit && twsClient->isConnected() ) {
+		sendOrders();
+		placeAllOrders();
+	}
 	if( quit || currentRequest.reqType() != GenericRequest::NONE ) {
 		return;
 	}
@@ -377,10 +904,25 @@ void TwsDL::idle()
 		return;
 	}
 
-	// HACK
-	static int fuckme = 0;
-	if( fuckme <= 0 ) {
-		fuckme = reqMktData();
+	if( quotes->rows() == 0
+	    && !workTodo->getMktDataTodo().mktDataRequests.empty() ) {
+		initLines();
+	}
+	serveLines();
+	if( depth->size() == 0
+	    && !workTodo->getMktDepthTodo().mktDepthRequests.empty() ) {
+		initDepth();
+	}
+	serveDepth();
+	if( rtBars->size() == 0 && !workTodo->getRealTimeBarsTodo()
+	    .realTimeBarsRequests.empty() ) {
+		initRtBars();
+	}
+	serveRtBars();
+	if( accDue != 0 && !accSubscribed && canSend() ) {
+		/* unchanged values of the new download are dropped */
+		twsClient->reqAccountUpdates( true, cfg.tws_account_name );
+		accSubscribed = true;
 	}
 
 	GenericRequest::ReqType reqType = workTodo->nextReqType();
@@ -404,25 +946,70 @@ void TwsDL::idle()
 		reqOptParams();
 		break;
 	case GenericRequest::NONE:
-		/* TODO for now we place all orders when nothing else todo */
-		if( strat != NULL ) {
-			work_dso( strat, this );
+		if( !strats.empty() ) {
+			for( size_t i = 0; i < strats.size(); i++ ) {
+				strats[i]->work();
+			}
+			placeAllOrders();
 		}
-		placeAllOrders();
 		break;
 	}
 
-	if( reqType == GenericRequest::NONE && fuckme <= 1
-		&& workTodo->placeOrderTodo()->countLeft() <= 0 && p_orders.empty() ) {
+	if( currentRequest.reqType() != GenericRequest::NONE
+	    && loop_stats->finished != 0 ) {
+		int64_t lat = nowInUsecs() - loop_stats->finished;
+		loop_stats->finished = 0;
+		loop_stats->count++;
+		loop_stats->sumUsecs += lat;
+		loop_stats->maxUsecs = std::max( loop_stats->maxUsecs, lat );
+	}
+
+	if( reqType != GenericRequest::NONE
+	    || workTodo->placeOrderTodo()->countLeft() > 0
+	    || orderMgr->active() != 0 || gateway->active() != 0 ) {
+		return;
+	}
+	if( daemon != NULL ) {
+		/* subscriptions of the first job stream on while we serve jobs */
+		nextJob();
+		return;
+	}
+	if( lines->finished() && depth->size() == 0 && rtBars->size() == 0 ) {
+		if( accDue != 0 ) {
+			/* streaming the account until we get killed */
+			return;
+		}
 		_lastError = "No more work to do.";
 		quit = true;
 	}
 }
 
 
+/* daemon mode, the current job is done, start the next one if any */
+void TwsDL::nextJob()
+{
+	daemon->finish();
+	workTodo->forgetDone();
+	histReported = 0;
+
+	TwsJob job;
+	if( !daemon->popJob(&job) ) {
+		return;
+	}
+	daemon->activate( job );
+	workTodo->allowStreaming( false );
+	int cnt = workTodo->read_mem( job.xml, cfg.coalesce );
+	INFO_PRINTF( "got %d jobs from client %d", cnt, job.client );
+	wakeIn( 0 );
+}
+
+
 void TwsDL::waitData()
 {
-	finPlaceOrder();
+	orderMgr->collect( nowInMsecs() );
+	if( gateway->active() > 0 ) {
+		gateway->collect( nowInMsecs() );
+	}
 	if( packet == NULL || currentRequest.reqType() == GenericRequest::NONE ) {
 		return;
 	}
@@ -435,9 +1022,10 @@ void TwsDL::waitData()
 				last = now;
 				DEBUG_PRINTF( "Still waiting for data." );
 			}
+			wakeAt( currentRequest.ctime() + cfg.tws_reqTimeout + 1 );
 			return;
 		} else {
-			DEBUG_PRINTF( "Timeout waiting for data." );
+			INFO_PRINTF( "Timeout waiting for data." );
 			packet->closeError( REQ_ERR_TIMEOUT );
 		}
 	}
@@ -471,6 +1059,7 @@ void TwsDL::waitData()
 	delete packet;
 	packet = NULL;
 	currentRequest.close();
+	loop_stats->finished = loop_stats->woken;
 }
 
 
@@ -479,7 +1068,7 @@ bool TwsDL::finContracts()
 	PacketContractDetails* p = (PacketContractDetails*)packet;
 	switch( packet->getError() ) {
 	case REQ_ERR_NONE:
-		DEBUG_PRINTF("Contracts received: %zu", p->constList().size());
+		INFO_PRINTF("Contracts received: %zu", p->constList().size());
 		packet->dumpXml();
 	case REQ_ERR_NODATA:
 	case REQ_ERR_NAV:
@@ -492,7 +1081,7 @@ bool TwsDL::finContracts()
 		return true;
 	}
 
-	if( strat != NULL ) {
+	if( !strats.empty() ) {
 		// HACK we want exactly one ContractDetails for each mkt data contract
 		assert( p->constList().size() == 1 );
 		const ContractDetails &cd = p->constList().at(0);
@@ -514,7 +1103,7 @@ bool TwsDL::finOptParams()
 	PacketOptParams* p = (PacketOptParams*)packet;
 	switch( packet->getError() ) {
 	case REQ_ERR_NONE:
-		DEBUG_PRINTF("OptParams received: %zu", p->constList().size());
+		INFO_PRINTF("OptParams received: %zu", p->constList().size());
 		packet->dumpXml();
 	case REQ_ERR_NODATA:
 	case REQ_ERR_NAV:
@@ -550,56 +1139,126 @@ bool TwsDL::finHist()
 		histTodo->cancelForRepeat(2);
 		break;
 	}
+	const int done = histTodo->countDone();
+	if( histTodo->countLeft() == 0 || (done != histReported
+	    && done % HIST_PROGRESS_EVERY == 0) ) {
+		histTodo->dumpProgress();
+		histReported = done;
+	}
 	return true;
 }
 
 
-bool TwsDL::finPlaceOrder()
-{
-	bool ok = true;
-	std::map<long, PacketPlaceOrder*>::iterator it = p_orders.begin();
-	while( it != p_orders.end() ) {
-		/* increment it already here and use it_tmp because erase would
-		   invalidate it */
-		std::map<long, PacketPlaceOrder*>::iterator it_tmp = it++;
-		long orderId = it_tmp->first;
-		PacketPlaceOrder* p = it_tmp->second;
-		const PlaceOrder &r = p->getRequest();
-
-		assert( orderId == r.orderId );
-		if( ! p->finished() ) {
-			/* close non transmit orders where we haven't received errors */
-			if( !r.order.transmit && (nowInMsecs() - r.time_sent) > 5000 ) {
-				p->closeError( REQ_ERR_NONE );
-			} else {
-				continue;
-			}
-		}
+#define ERR_MATCH( _strg_  ) \
+	( err.msg.find(_strg_) != std::string::npos )
 
-		switch( p->getError() ) {
-		case REQ_ERR_NONE:
-		case REQ_ERR_REQUEST:
-		case REQ_ERR_TIMEOUT:
-			p->dumpXml();
-			DEBUG_PRINTF("fin order, %ld %s, %ld", orderId,
-				r.contract.symbol.c_str(), r.contract.conId);
-			assert( p_orders_old.find(orderId) == p_orders_old.end() );
-			p_orders_old[orderId] = p;
-			p_orders.erase( it_tmp );
-		case REQ_ERR_NODATA:
-		case REQ_ERR_NAV:
-			break;
-		case REQ_ERR_TWSCON:
-			ok = false;
+void TwsDL::twsEvent( const TwsEvent &ev )
+{
+	eventStamp = ev.stamp;
+	switch( ev.type ) {
+	case TwsEvent::t_tickPrice:
+		twsTickPrice( ev.id - STREAM_ID_BASE, (TickType)ev.field,
+			ev.dval[0], ev.lval );
+		break;
+	case TwsEvent::t_tickSize:
+		twsTickSize( ev.id - STREAM_ID_BASE, (TickType)ev.field, ev.lval );
+		break;
+	case TwsEvent::t_tickOptionComputation:
+		twsTickOptionComputation( ev.id - STREAM_ID_BASE, (TickType)ev.field,
+			ev.dval[0], ev.dval[1], ev.dval[2], ev.dval[3], ev.dval[4],
+			ev.dval[5], ev.dval[6], ev.dval[7] );
+		break;
+	case TwsEvent::t_tickGeneric:
+		twsTickGeneric( ev.id - STREAM_ID_BASE, (TickType)ev.field,
+			ev.dval[0] );
+		break;
+	case TwsEvent::t_tickString:
+		twsTickString( ev.id - STREAM_ID_BASE, (TickType)ev.field,
+			*(const std::string*)ev.data );
+		break;
+	case TwsEvent::t_orderStatus:
+		twsOrderStatus( *(const RowOrderStatus*)ev.data );
+		break;
+	case TwsEvent::t_openOrder:
+		twsOpenOrder( *(const RowOpenOrder*)ev.data );
+		break;
+	case TwsEvent::t_openOrderEnd:
+		twsOpenOrderEnd();
+		break;
+	case TwsEvent::t_connectionClosed:
+		twsConnectionClosed();
+		break;
+	case TwsEvent::t_updateAccountValue:
+		twsUpdateAccountValue( *(const RowAccVal*)ev.data );
+		break;
+	case TwsEvent::t_updatePortfolio:
+		twsUpdatePortfolio( *(const RowPrtfl*)ev.data );
+		break;
+	case TwsEvent::t_updateAccountTime:
+		twsUpdateAccountTime( *(const std::string*)ev.data );
+		break;
+	case TwsEvent::t_accountDownloadEnd:
+		twsAccountDownloadEnd( *(const std::string*)ev.data );
+		break;
+	case TwsEvent::t_nextValidId:
+		nextValidId( ev.lval );
+		break;
+	case TwsEvent::t_contractDetails:
+		twsContractDetails( ev.id, *(const ContractDetails*)ev.data );
+		break;
+	case TwsEvent::t_bondContractDetails:
+		twsBondContractDetails( ev.id, *(const ContractDetails*)ev.data );
+		break;
+	case TwsEvent::t_contractDetailsEnd:
+		twsContractDetailsEnd( ev.id );
+		break;
+	case TwsEvent::t_execDetails:
+		twsExecDetails( ev.id, *(const RowExecution*)ev.data );
+		break;
+	case TwsEvent::t_execDetailsEnd:
+		twsExecDetailsEnd( ev.id );
+		break;
+	case TwsEvent::t_error:
+		twsError( *(const RowError*)ev.data );
+		break;
+	case TwsEvent::t_historicalData:
+		twsHistoricalData( ev.id, *(const RowHist*)ev.data );
+		break;
+	case TwsEvent::t_currentTime:
+		twsCurrentTime( ev.lval );
+		break;
+	case TwsEvent::t_connectAck:
+		twsConnectAck();
+		break;
+	case TwsEvent::t_optParams:
+		twsOptParams( ev.id, *(const RowOptParams*)ev.data );
+		break;
+	case TwsEvent::t_optParamsEnd:
+		twsOptParamsEnd( ev.id );
+		break;
+	case TwsEvent::t_tickSnapshotEnd:
+		twsTickSnapshotEnd( ev.id - STREAM_ID_BASE );
+		break;
+	case TwsEvent::t_updateMktDepth:
+		twsUpdateMktDepth( ev.id - STREAM_ID_BASE, ev.field, "",
+			(int)ev.dval[1], (int)ev.dval[2], ev.dval[0], ev.lval );
+		break;
+	case TwsEvent::t_updateMktDepthL2:
+		twsUpdateMktDepth( ev.id - STREAM_ID_BASE, ev.field,
+			*(const std::string*)ev.data, (int)ev.dval[1], (int)ev.dval[2],
+			ev.dval[0], ev.lval );
+		break;
+	case TwsEvent::t_realtimeBar:
+		{
+			RtBar bar = { ev.lval, ev.dval[0], ev.dval[1], ev.dval[2],
+				ev.dval[3], (long long)ev.dval[4], ev.dval[5],
+				(int)ev.dval[6] };
+			twsRealtimeBar( ev.id - STREAM_ID_BASE, bar );
 		}
+		break;
 	}
-	return ok;
 }
 
-
-#define ERR_MATCH( _strg_  ) \
-	( err.msg.find(_strg_) != std::string::npos )
-
 void TwsDL::twsError( const RowError& err )
 {
 	msgCounter++;
@@ -608,21 +1267,44 @@ void TwsDL::twsError( const RowError& err )
 		switch( err.code ) {
 		default:
 		case 504: /* NOT_CONNECTED */
-			DEBUG_PRINTF( "fatal: %d %d %s", err.id, err.code, err.msg.c_str());
+			ERROR_PRINTF( "fatal: %d %d %s", err.id, err.code, err.msg.c_str());
 			assert(false);
 			break;
 		case 503: /* UPDATE_TWS */
-			DEBUG_PRINTF( "error: %s", err.msg.c_str() );
+			ERROR_PRINTF( "error: %s", err.msg.c_str() );
 			break;
 		case 502: /* CONNECT_FAIL */
-			DEBUG_PRINTF( "connection failed: %s", err.msg.c_str());
+			ERROR_PRINTF( "connection failed: %s", err.msg.c_str());
 			break;
 		}
 		return;
 	}
 
-	if( err.id == currentRequest.reqId() ) {
-		DEBUG_PRINTF( "TWS message for request %d: %d '%s'",
+	if( err.id >= STREAM_ID_BASE ) {
+		const int id = err.id - STREAM_ID_BASE;
+		if( lines->error(id, err.code, nowInMsecs()) ) {
+			INFO_PRINTF( "TWS message for market data request %d: %d '%s'",
+				id, err.code, err.msg.c_str() );
+		} else if( depth->size() > 0 && id >= depthTickerId(0)
+			    && id < depthTickerId(depth->size()) ) {
+			INFO_PRINTF( "TWS message for market depth request %d: %d '%s'",
+				id, err.code, err.msg.c_str() );
+			if( err.code == 317 ) {
+				/* market depth data has been reset */
+				depth->clear( id - depthTickerId(0) );
+			}
+		} else if( rtBars->size() > 0 && id >= rtBarsTickerId(0)
+			    && id < rtBarsTickerId(workTodo->getRealTimeBarsTodo()
+			    .realTimeBarsRequests.size()) ) {
+			INFO_PRINTF( "TWS message for real-time bars request %d: %d '%s'",
+				id, err.code, err.msg.c_str() );
+		} else {
+			INFO_PRINTF( "TWS message for unexpected ticker %d: %d '%s'",
+				id, err.code, err.msg.c_str() );
+		}
+		return;
+	} else if( err.id == currentRequest.reqId() ) {
+		INFO_PRINTF( "TWS message for request %d: %d '%s'",
 			err.id, err.code, err.msg.c_str() );
 		switch( currentRequest.reqType() ) {
 			case GenericRequest::CONTRACT_DETAILS_REQUEST:
@@ -638,7 +1320,7 @@ void TwsDL::twsError( const RowError& err )
 				assert( false );
 				break;
 			case GenericRequest::NONE:
-				DEBUG_PRINTF( "Warning, got message for closed request %d.",
+				WARN_PRINTF( "Warning, got message for closed request %d.",
 					err.id );
 				break;
 		}
@@ -648,12 +1330,12 @@ void TwsDL::twsError( const RowError& err )
 	}
 
 	if( err.id != -1 ) {
-		DEBUG_PRINTF( "TWS message for unexpected request %d: %d '%s'",
+		INFO_PRINTF( "TWS message for unexpected request %d: %d '%s'",
 			err.id, err.code, err.msg.c_str() );
 		return;
 	}
 
-	DEBUG_PRINTF( "TWS message generic: %d %s", err.code, err.msg.c_str() );
+	INFO_PRINTF( "TWS message generic: %d %s", err.code, err.msg.c_str() );
 
 	// TODO do better
 	switch( err.code ) {
@@ -661,7 +1343,7 @@ void TwsDL::twsError( const RowError& err )
 			assert(ERR_MATCH("Connectivity between IB and T"));
 			assert(ERR_MATCH(" has been lost."));
 			connectivity_IB_TWS = false;
-			curIdleTime = cfg.tws_reqTimeout;
+			stratConnection( TWS_STRAT_IB_LOST );
 			break;
 		case 1101:
 			assert(ERR_MATCH("Connectivity between IB and T"));
@@ -670,6 +1352,7 @@ void TwsDL::twsError( const RowError& err )
 			if( currentRequest.reqType() == GenericRequest::HIST_REQUEST ) {
 				packet->closeError( REQ_ERR_TWSCON );
 			}
+			stratConnection( TWS_STRAT_IB_RESTORED );
 			break;
 		case 1102:
 			assert(ERR_MATCH("Connectivity between IB and T"));
@@ -678,6 +1361,7 @@ void TwsDL::twsError( const RowError& err )
 			if( currentRequest.reqType() == GenericRequest::HIST_REQUEST ) {
 				packet->closeError( REQ_ERR_TWSCON );
 			}
+			stratConnection( TWS_STRAT_IB_RESTORED );
 			break;
 		case 1300:
 			assert(ERR_MATCH("TWS socket port has been reset and this connection is being dropped."));
@@ -696,6 +1380,7 @@ void TwsDL::twsError( const RowError& err )
 			assert(ERR_MATCH("Connectivity between T"));
 			assert(ERR_MATCH(" and server is broken. It will be restored automatically."));
 			connectivity_IB_TWS = false;
+			stratConnection( TWS_STRAT_IB_LOST );
 			break;
 	}
 }
@@ -720,7 +1405,7 @@ void TwsDL::errorContracts( const RowError& err )
 		packet->closeError( REQ_ERR_REQUEST );
 		break;
 	default:
-		DEBUG_PRINTF( "Warning, unhandled error code." );
+		WARN_PRINTF( "Warning, unhandled error code." );
 		break;
 	}
 }
@@ -738,12 +1423,12 @@ void TwsDL::errorHistData( const RowError& err )
 			p_histData.closeError( REQ_ERR_TWSCON );
 			pacingControl.notifyViolation( curContract );
 		} else if( ERR_MATCH("HMDS query returned no data:") ) {
-			DEBUG_PRINTF( "READY - NO DATA %p %d", cur_hR, err.id );
+			INFO_PRINTF( "READY - NO DATA %p %d", cur_hR, err.id );
 			dataFarms.learnHmds( curContract );
 			p_histData.closeError( REQ_ERR_NODATA );
 		} else if( ERR_MATCH("No historical market data for") ) {
 			// NOTE we should skip all similar work intelligently
-			DEBUG_PRINTF( "WARNING - DATA IS NOT AVAILABLE on HMDS server. "
+			WARN_PRINTF( "WARNING - DATA IS NOT AVAILABLE on HMDS server. "
 				"%p %d", cur_hR, err.id );
 			dataFarms.learnHmds( curContract );
 			p_histData.closeError( REQ_ERR_NAV );
@@ -751,7 +1436,7 @@ void TwsDL::errorHistData( const RowError& err )
 			ERR_MATCH("No data of type DayChart is available") ||
 			ERR_MATCH("BEST queries are not supported for this contract")) {
 			// NOTE we should skip all similar work intelligently
-			DEBUG_PRINTF( "WARNING - DATA IS NOT AVAILABLE (no HMDS route). "
+			WARN_PRINTF( "WARNING - DATA IS NOT AVAILABLE (no HMDS route). "
 				"%p %d", cur_hR, err.id );
 			p_histData.closeError( REQ_ERR_NAV );
 			workTodo->histTodo()->skip_by_nodata(*cur_hR);
@@ -767,7 +1452,7 @@ void TwsDL::errorHistData( const RowError& err )
 			dataFarms.learnHmds( curContract );
 			p_histData.closeError( REQ_ERR_REQUEST );
 		} else {
-			DEBUG_PRINTF( "Warning, unhandled error message." );
+			WARN_PRINTF( "Warning, unhandled error message." );
 			// seen: "TWS exited during processing of HMDS query"
 		}
 		break;
@@ -775,11 +1460,11 @@ void TwsDL::errorHistData( const RowError& err )
 	case 165:
 		if( ERR_MATCH("HMDS server disconnect occurred.  Attempting reconnection") ||
 		    ERR_MATCH("HMDS connection attempt failed.  Connection will be re-attempted") ) {
-			curIdleTime = cfg.tws_reqTimeout;
+			/* nothing to do, TWS reconnects itself */
 		} else if( ERR_MATCH("HMDS server connection was successful") ) {
 			dataFarms.learnHmdsLastOk( msgCounter, curContract );
 		} else {
-			DEBUG_PRINTF( "Warning, unhandled error message." );
+			WARN_PRINTF( "Warning, unhandled error message." );
 		}
 		break;
 	// No security definition has been found for the request"
@@ -797,13 +1482,13 @@ void TwsDL::errorHistData( const RowError& err )
 	case 201:
 	// Order cancelled - Reason:
 	case 202:
-		DEBUG_PRINTF( "Warning, unexpected error code." );
+		WARN_PRINTF( "Warning, unexpected error code." );
 		/* TODO "Order cancelled", this is expected here and we'll wait for some
 		   more orderStatus callbacks */
 		break;
 	// The security <security> is not available or allowed for this account
 	case 203:
-		DEBUG_PRINTF( "Warning, unhandled error code." );
+		WARN_PRINTF( "Warning, unhandled error code." );
 		break;
 	// Server error when validating an API client request
 	case 321:
@@ -812,7 +1497,7 @@ void TwsDL::errorHistData( const RowError& err )
 		p_histData.closeError( REQ_ERR_REQUEST );
 		break;
 	default:
-		DEBUG_PRINTF( "Warning, unhandled error code." );
+		WARN_PRINTF( "Warning, unhandled error code." );
 		break;
 	}
 }
@@ -820,29 +1505,35 @@ void TwsDL::errorHistData( const RowError& err )
 
 void TwsDL::errorPlaceOrder( const RowError& err )
 {
-	if( p_orders.find(err.id) != p_orders.end() ) {
-		assert( p_orders_old.find(err.id) == p_orders_old.end() );
-		PacketPlaceOrder *p_pO = p_orders[err.id];
-		if( p_pO->finished() ) {
-			DEBUG_PRINTF("Warning, got openOrder callback for closed order.");
-		}
-		p_pO->append(err);
-
-		switch( err.code ) {
-		// Unable to modify this order as its still being processed.
-		case 2102:
-			break;
-		default:
-			p_pO->closeError( REQ_ERR_REQUEST );
+	PacketPlaceOrder *gp = gateway->find( err.id );
+	if( gp != NULL ) {
+		gp->append( err );
+		if( err.code != 2102 && !gp->finished() ) {
+			gp->closeError( REQ_ERR_REQUEST );
 		}
 		return;
-	} else if( p_orders_old.find(err.id) != p_orders_old.end() ) {
-		assert( p_orders.find(err.id) == p_orders.end() );
-		DEBUG_PRINTF("Warning, got openOrder callback for finished order.");
-		PacketPlaceOrder *p_pO = p_orders_old[err.id];
+	}
+	bool archived;
+	PacketPlaceOrder *p_pO = orderMgr->find( err.id, &archived );
+	if( p_pO == NULL ) {
+		return;
+	} else if( archived ) {
+		WARN_PRINTF("Warning, got openOrder callback for finished order.");
 		p_pO->append(err);
 		return;
 	}
+	if( p_pO->finished() ) {
+		WARN_PRINTF("Warning, got openOrder callback for closed order.");
+	}
+	p_pO->append(err);
+
+	switch( err.code ) {
+	// Unable to modify this order as its still being processed.
+	case 2102:
+		break;
+	default:
+		p_pO->closeError( REQ_ERR_REQUEST );
+	}
 }
 
 
@@ -851,7 +1542,7 @@ void TwsDL::errorPlaceOrder( const RowError& err )
 
 void TwsDL::twsConnectionClosed()
 {
-	DEBUG_PRINTF( "disconnected in state %d", state );
+	INFO_PRINTF( "disconnected in state %d", state );
 
 	if( currentRequest.reqType() != GenericRequest::NONE ) {
 		if( !packet->finished() ) {
@@ -872,20 +1563,32 @@ void TwsDL::twsConnectionClosed()
 			}
 		}
 	}
-	assert( p_orders.empty() ); // TODO repeat
+	assert( orderMgr->active() == 0 ); // TODO repeat
+	/* the strategy decides whether to place them again */
+	gateway->closeAll( REQ_ERR_TWSCON );
+	accSubscribed = false;
 
 	connectivity_IB_TWS = false;
 	dataFarms.setAllBroken();
 	pacingControl.clear();
+	lines->reset();
+	/* subscribe all depth again */
+	for( int i = 0; i < depth->size(); i++ ) {
+		depth->clear( i );
+	}
+	depthNext = 0;
+	/* missed bars are marked as gaps */
+	rtBarsNext = 0;
 	/* avoid re-connect right now */
 	lastConnectionTime = nowInMsecs();
+	stratConnection( TWS_STRAT_DISCONNECTED );
 }
 
 
 void TwsDL::twsContractDetails( int reqId, const ContractDetails &ibContractDetails )
 {
 	if( currentRequest.reqType() != GenericRequest::CONTRACT_DETAILS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 
@@ -902,7 +1605,7 @@ void TwsDL::twsContractDetails( int reqId, const ContractDetails &ibContractDeta
 void TwsDL::twsBondContractDetails( int reqId, const ContractDetails &ibContractDetails )
 {
 	if( currentRequest.reqType() != GenericRequest::CONTRACT_DETAILS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 	if( currentRequest.reqId() != reqId ) {
@@ -918,7 +1621,7 @@ void TwsDL::twsBondContractDetails( int reqId, const ContractDetails &ibContract
 void TwsDL::twsContractDetailsEnd( int reqId )
 {
 	if( currentRequest.reqType() != GenericRequest::CONTRACT_DETAILS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 	if( currentRequest.reqId() != reqId ) {
@@ -934,7 +1637,7 @@ void TwsDL::twsContractDetailsEnd( int reqId )
 void TwsDL::twsHistoricalData( int reqId, const RowHist &row )
 {
 	if( currentRequest.reqType() != GenericRequest::HIST_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 	if( currentRequest.reqId() != reqId ) {
@@ -950,15 +1653,21 @@ void TwsDL::twsHistoricalData( int reqId, const RowHist &row )
 	((PacketHistData*)packet)->append( reqId, row );
 
 	if( packet->finished() ) {
-		DEBUG_PRINTF( "READY %p %d",
+		INFO_PRINTF( "READY %p %d",
 			&workTodo->getHistTodo().current(), reqId );
 	}
 }
 
 void TwsDL::twsUpdateAccountValue( const RowAccVal& row )
 {
+	if( accDelta != NULL ) {
+		accDelta->update( row );
+	}
 	if( currentRequest.reqType() != GenericRequest::ACC_STATUS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (updateAccountValue).");
+		if( accDue != 0 ) {
+			return;
+		}
+		WARN_PRINTF( "Warning, unexpected tws callback (updateAccountValue).");
 		return;
 	}
 	((PacketAccStatus*)packet)->append( row );
@@ -966,10 +1675,22 @@ void TwsDL::twsUpdateAccountValue( const RowAccVal& row )
 
 void TwsDL::twsUpdatePortfolio( const RowPrtfl& row )
 {
-	account->updatePortfolio(row);
+	const PositionPnl *pos = account->updatePortfolio( row, eventStamp );
+
+	if( stratWants(StratEvent::POSITION, -1) ) {
+		tws_strat_position p;
+		stratPosition( *pos, eventStamp, &p );
+		stratPost( StratEvent::POSITION, &p, -1 );
+	}
+	if( accDelta != NULL ) {
+		accDelta->update( row );
+	}
 
 	if( currentRequest.reqType() != GenericRequest::ACC_STATUS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (updatePortfolio).");
+		if( accDue != 0 ) {
+			return;
+		}
+		WARN_PRINTF( "Warning, unexpected tws callback (updatePortfolio).");
 		return;
 	}
 	((PacketAccStatus*)packet)->append( row );
@@ -977,8 +1698,14 @@ void TwsDL::twsUpdatePortfolio( const RowPrtfl& row )
 
 void TwsDL::twsUpdateAccountTime( const std::string& timeStamp )
 {
+	if( accDelta != NULL ) {
+		accDelta->updateTime( timeStamp );
+	}
 	if( currentRequest.reqType() != GenericRequest::ACC_STATUS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (updateAccountTime).");
+		if( accDue != 0 ) {
+			return;
+		}
+		WARN_PRINTF( "Warning, unexpected tws callback (updateAccountTime).");
 		return;
 	}
 	((PacketAccStatus*)packet)->appendUpdateAccountTime( timeStamp );
@@ -987,16 +1714,66 @@ void TwsDL::twsUpdateAccountTime( const std::string& timeStamp )
 void TwsDL::twsAccountDownloadEnd( const std::string& accountName )
 {
 	if( currentRequest.reqType() != GenericRequest::ACC_STATUS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (accountDownloadEnd).");
+		if( accDue != 0 ) {
+			INFO_PRINTF( "account updates subscribed again" );
+			return;
+		}
+		WARN_PRINTF( "Warning, unexpected tws callback (accountDownloadEnd).");
 		return;
 	}
 	((PacketAccStatus*)packet)->appendAccountDownloadEnd( accountName );
+
+	if( accDelta != NULL ) {
+		/* the complete download is dumped, keep the subscription open and
+		   dump changes only from now on */
+		accDelta->clean();
+		const int64_t ival = cfg.account_stream * 1000;
+		accDue = (nowInMsecs() / ival + 1) * ival;
+		wakeAt( accDue );
+	}
 }
 
 void TwsDL::twsExecDetails( int reqId, const RowExecution &row )
 {
+	if( stratWants(StratEvent::EXECUTION, -1) ) {
+		const Execution &e = row.execution;
+		tws_strat_execution x;
+		x.stamp = eventStamp;
+		x.orderId = e.orderId;
+		x.conId = row.contract.conId;
+		x.clientId = e.clientId;
+		x.permId = e.permId;
+		x.reserved = 0;
+		x.shares = e.shares;
+		x.price = e.price;
+		x.cumQty = e.cumQty;
+		x.avgPrice = e.avgPrice;
+		x.execId = e.execId.c_str();
+		x.time = e.time.c_str();
+		x.account = e.acctNumber.c_str();
+		x.exchange = e.exchange.c_str();
+		x.side = e.side.c_str();
+		x.symbol = row.contract.symbol.c_str();
+		stratPost( StratEvent::EXECUTION, &x, -1 );
+	}
+
+	/* fills of our own orders come without request, those of
+	   reqExecutions() are in the portfolio already */
+	const PositionPnl *pos = reqId == -1
+		? account->execution( row, eventStamp ) : NULL;
+	if( pos != NULL && stratWants(StratEvent::POSITION, -1) ) {
+		tws_strat_position p;
+		stratPosition( *pos, eventStamp, &p );
+		stratPost( StratEvent::POSITION, &p, -1 );
+	}
+
+	/* executions of our own orders come without request */
+	if( reqId == -1 && currentRequest.reqType()
+	    != GenericRequest::EXECUTIONS_REQUEST ) {
+		return;
+	}
 	if( currentRequest.reqType() != GenericRequest::EXECUTIONS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (execDetails).");
+		WARN_PRINTF( "Warning, unexpected tws callback (execDetails).");
 		return;
 	}
 	((PacketExecutions*)packet)->append( reqId, row );
@@ -1005,7 +1782,7 @@ void TwsDL::twsExecDetails( int reqId, const RowExecution &row )
 void TwsDL::twsExecDetailsEnd( int reqId )
 {
 	if( currentRequest.reqType() != GenericRequest::EXECUTIONS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (execDetailsEnd).");
+		WARN_PRINTF( "Warning, unexpected tws callback (execDetailsEnd).");
 		return;
 	}
 	((PacketExecutions*)packet)->appendExecutionsEnd( reqId );
@@ -1013,54 +1790,62 @@ void TwsDL::twsExecDetailsEnd( int reqId )
 
 void TwsDL::twsOrderStatus( const RowOrderStatus& row )
 {
-	account->update_os(row);
+	orderMgr->update( row );
+
+	if( stratWants(StratEvent::ORDER_STATUS, -1) ) {
+		tws_strat_order_status os;
+		stratOrderStatus( row, eventStamp, &os );
+		stratPost( StratEvent::ORDER_STATUS, &os, -1 );
+	}
 
 	if( currentRequest.reqType() == GenericRequest::ORDERS_REQUEST ) {
 		((PacketOrders*)packet)->append(row);
 		return;
 	}
-	if( p_orders.find(row.id) != p_orders.end() ) {
-		assert( p_orders_old.find(row.id) == p_orders_old.end() );
-		PacketPlaceOrder *p_pO = p_orders[row.id];
-		if( p_pO->finished() ) {
-			DEBUG_PRINTF("Warning, got orderStatus callback for closed order.");
-		}
-		p_pO->append(row);
+	PacketPlaceOrder *gp = gateway->find( row.id );
+	if( gp != NULL ) {
+		gp->append( row );
 		return;
-	} else if( p_orders_old.find(row.id) != p_orders_old.end() ) {
-		assert( p_orders.find(row.id) == p_orders.end() );
-		DEBUG_PRINTF("Warning, got orderStatus callback for finished order.");
-		PacketPlaceOrder *p_pO = p_orders_old[row.id];
+	}
+	bool archived;
+	PacketPlaceOrder *p_pO = orderMgr->find( row.id, &archived );
+	if( p_pO != NULL ) {
+		if( archived ) {
+			WARN_PRINTF("Warning, got orderStatus callback for finished order.");
+		} else if( p_pO->finished() ) {
+			WARN_PRINTF("Warning, got orderStatus callback for closed order.");
+		}
 		p_pO->append(row);
 		return;
 	}
-	DEBUG_PRINTF( "Warning, unexpected tws callback (orderStatus).");
+	WARN_PRINTF( "Warning, unexpected tws callback (orderStatus).");
 }
 
 void TwsDL::twsOpenOrder( const RowOpenOrder& row )
 {
-	account->update_oo(row);
+	orderMgr->update( row );
 
 	if( currentRequest.reqType() == GenericRequest::ORDERS_REQUEST ) {
 		((PacketOrders*)packet)->append(row);
 		return;
 	}
-	if( p_orders.find(row.orderId) != p_orders.end() ) {
-		assert( p_orders_old.find(row.orderId) == p_orders_old.end() );
-		PacketPlaceOrder *p_pO = p_orders[row.orderId];
-		if( p_pO->finished() ) {
-			DEBUG_PRINTF("Warning, got openOrder callback for closed order.");
-		}
-		p_pO->append(row);
+	PacketPlaceOrder *gp = gateway->find( row.orderId );
+	if( gp != NULL ) {
+		gp->append( row );
 		return;
-	} else if( p_orders_old.find(row.orderId) != p_orders_old.end() ) {
-		assert( p_orders.find(row.orderId) == p_orders.end() );
-		DEBUG_PRINTF("Warning, got openOrder callback for finished order.");
-		PacketPlaceOrder *p_pO = p_orders_old[row.orderId];
+	}
+	bool archived;
+	PacketPlaceOrder *p_pO = orderMgr->find( row.orderId, &archived );
+	if( p_pO != NULL ) {
+		if( archived ) {
+			WARN_PRINTF("Warning, got openOrder callback for finished order.");
+		} else if( p_pO->finished() ) {
+			WARN_PRINTF("Warning, got openOrder callback for closed order.");
+		}
 		p_pO->append(row);
 		return;
 	}
-	DEBUG_PRINTF( "Warning, unexpected tws callback (openOrder).");
+	WARN_PRINTF( "Warning, unexpected tws callback (openOrder).");
 }
 
 void TwsDL::twsOpenOrderEnd()
@@ -1068,7 +1853,7 @@ void TwsDL::twsOpenOrderEnd()
 	/* this messages usually comes unexpected right after connecting */
 
 	if( currentRequest.reqType() != GenericRequest::ORDERS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback (openOrderEnd).");
+		WARN_PRINTF( "Warning, unexpected tws callback (openOrderEnd).");
 		return;
 	}
 
@@ -1087,14 +1872,16 @@ void TwsDL::nextValidId( long orderId )
 	if( state == WAIT_TWS_CON ) {
 		tws_valid_orderId = orderId;
 	}
+	workTodo->placeOrderTodo()->setNextValidId( orderId );
 }
 
 void TwsDL::twsTickPrice( int reqId, TickType field, double price,
 	int canAutoExecute )
 {
-	Quote &q = quotes->at(reqId-1);
-	q.val[field] = price;
-	q.stamp[field] = nowInMsecs();
+	setQuote( reqId, field, price );
+	markPosition( reqId, field, price );
+	stratTick( reqId, field, TICK_PRICE, price );
+	recordTick( reqId, field, TICK_PRICE, price );
 
 	const std::vector<MktDataRequest> &mdlist
 		= workTodo->getMktDataTodo().mktDataRequests;
@@ -1108,9 +1895,9 @@ void TwsDL::twsTickPrice( int reqId, TickType field, double price,
 
 void TwsDL::twsTickSize( int reqId, TickType field, int size )
 {
-	Quote &q = quotes->at(reqId-1);
-	q.val[field] = size;
-	q.stamp[field] = nowInMsecs();
+	setQuote( reqId, field, size );
+	stratTick( reqId, field, TICK_SIZE, size );
+	recordTick( reqId, field, TICK_SIZE, size );
 
 	const std::vector<MktDataRequest> &mdlist
 		= workTodo->getMktDataTodo().mktDataRequests;
@@ -1132,29 +1919,439 @@ void TwsDL::twsTickOptionComputation( TickerId reqId,
 	DEBUG_PRINTF("TICK_OPTION_COMPUTATION: %ld %s %ld %s %g %g %g %g %g %g %g %g",
 		reqId, c.symbol.c_str(), c.conId, ibToString(tickType).c_str(),
 		impliedVol, delta, optPrice, pvDividend, gamma, vega, theta, undPrice );
+
+	const double v[GREEK_COLS] = { impliedVol, delta, optPrice, pvDividend,
+		gamma, vega, theta, undPrice };
+	greeks->set( reqId, tickType, v, eventStamp );
+	stratTick( reqId, tickType, TICK_OPT_IV, impliedVol, v );
+
+	if( ticks != NULL ) {
+		recordTick( reqId, tickType, TICK_OPT_IV, impliedVol );
+		recordTick( reqId, tickType, TICK_OPT_DELTA, delta );
+		recordTick( reqId, tickType, TICK_OPT_PRICE, optPrice );
+		recordTick( reqId, tickType, TICK_OPT_PV_DIVIDEND, pvDividend );
+		recordTick( reqId, tickType, TICK_OPT_GAMMA, gamma );
+		recordTick( reqId, tickType, TICK_OPT_VEGA, vega );
+		recordTick( reqId, tickType, TICK_OPT_THETA, theta );
+		recordTick( reqId, tickType, TICK_OPT_UND_PRICE, undPrice );
+	}
 }
 
 void TwsDL::twsTickGeneric( TickerId reqId, TickType tickType, double value )
 {
+	setQuote( reqId, tickType, value );
+	stratTick( reqId, tickType, TICK_GENERIC, value );
+	recordTick( reqId, tickType, TICK_GENERIC, value );
+
 	const Contract &c
 		= workTodo->getMktDataTodo().mktDataRequests[reqId - 1].ibContract;
 	DEBUG_PRINTF("TICK_GENERIC: %ld %s %ld %s %g", reqId,
 		c.symbol.c_str(), c.conId, ibToString(tickType).c_str(), value );
 }
 
+/* store a tick in the quote board and publish it if enabled */
+void TwsDL::setQuote( int reqId, int tickType, double value )
+{
+	quotes->set( reqId, tickType, value, eventStamp / 1000 );
+	if( publisher != NULL ) {
+		publisher->set( reqId, tickType, value, eventStamp );
+	}
+	if( conflator != NULL
+	    && conflator->update(reqId, tickType, value, eventStamp) ) {
+		wakeAt( conflator->deadline() );
+	}
+}
+
+/* pass a conflated batch to the strategy modules */
+void TwsDL::stratQuotes( void *clo, const TwsQuoteUpdate *upd, size_t n )
+{
+	TwsDL *dl = (TwsDL*)clo;
+	for( size_t i = 0; i < dl->strats.size(); i++ ) {
+		dl->strats[i]->quotes( upd, n );
+	}
+}
+
+/* whether any strategy module wants this event */
+bool TwsDL::stratWants( int type, int tickerId ) const
+{
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		if( strats[i]->wants(type, tickerId) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* fan out the current event, threaded modules share one copy */
+void TwsDL::stratPost( int type, const void *view, int tickerId )
+{
+	StratEvent *shared = NULL;
+	for( size_t i = 0; i < strats.size(); i++ ) {
+		if( strats[i]->wants(type, tickerId) ) {
+			strats[i]->post( type, view, eventStamp, &shared );
+		}
+	}
+	if( shared != NULL ) {
+		StratEvent::release( shared );
+	}
+}
+
+/* pass a tick to the strategy modules right away, opt are the GREEK_COLS
+   values of option computations */
+void TwsDL::stratTick( int reqId, int tickType, int kind, double value,
+	const double *opt, const char *str )
+{
+	if( !stratWants(StratEvent::TICK, reqId) ) {
+		return;
+	}
+	const std::vector<MktDataRequest> &mdlist
+		= workTodo->getMktDataTodo().mktDataRequests;
+	assert( reqId > 0 && reqId <= (int)mdlist.size() );
+
+	tws_strat_tick t;
+	t.stamp = eventStamp;
+	t.tickerId = reqId;
+	t.conId = mdlist[reqId - 1].ibContract.conId;
+	t.tickType = tickType;
+	t.kind = kind == TICK_OPT_IV ? TWS_STRAT_TICK_OPTION : kind;
+	t.value = value;
+	t.opt = opt;
+	t.str = str;
+	stratPost( StratEvent::TICK, &t, reqId );
+}
+
+void TwsDL::stratConnection( int state )
+{
+	stratPost( StratEvent::CONNECTION, &state, -1 );
+}
+
+void TwsDL::stratOrderStatus( const RowOrderStatus &row, int64_t stamp,
+	tws_strat_order_status *os ) const
+{
+	os->stamp = stamp;
+	os->orderId = row.id;
+	os->permId = row.permId;
+	os->parentId = row.parentId;
+	os->clientId = row.clientId;
+	os->reserved = 0;
+	os->filled = row.filled;
+	os->remaining = row.remaining;
+	os->avgFillPrice = row.avgFillPrice;
+	os->lastFillPrice = row.lastFillPrice;
+	os->status = row.status.c_str();
+	os->whyHeld = row.whyHeld.c_str();
+}
+
+void TwsDL::stratPosition( const PositionPnl &pos, int64_t stamp,
+	tws_strat_position *p ) const
+{
+	p->stamp = stamp;
+	p->conId = pos.conId;
+	p->reserved = 0;
+	p->position = pos.position;
+	p->marketPrice = pos.mark;
+	p->averageCost = pos.avgPrice * pos.multiplier;
+	p->unrealizedPNL = pos.unrealizedPNL;
+	p->realizedPNL = pos.realizedPNL;
+	p->account = account->accounts()[pos.acct].name.c_str();
+	p->symbol = account->symbol( pos.conId ).c_str();
+}
+
+int TwsDL::stratGetPosition( long conId, const char *acct,
+	tws_strat_position *p ) const
+{
+	const PositionPnl *pos = account->position( conId,
+		acct != NULL ? acct : "" );
+	if( pos == NULL ) {
+		return -1;
+	}
+	stratPosition( *pos, pos->stamp, p );
+	return 0;
+}
+
+/* mark positions with the last price, or mid while there is none */
+void TwsDL::markPosition( int reqId, int tickType, double price )
+{
+	const Contract *c = tickerContract( reqId );
+	if( c == NULL ) {
+		return;
+	}
+	const bool delayed = tickType >= DELAYED_BID;
+	const int last = delayed ? DELAYED_LAST : LAST;
+	int64_t stamp;
+	switch( tickType ) {
+	case LAST:
+	case DELAYED_LAST:
+		account->mark( c->conId, price );
+		break;
+	case BID:
+	case ASK:
+	case DELAYED_BID:
+	case DELAYED_ASK:
+		quotes->get( reqId, last, &stamp );
+		if( stamp == 0 ) {
+			const double bid = quotes->get( reqId,
+				delayed ? DELAYED_BID : BID );
+			const double ask = quotes->get( reqId,
+				delayed ? DELAYED_ASK : ASK );
+			if( bid > 0.0 && ask > 0.0 ) {
+				account->mark( c->conId, (bid + ask) / 2.0 );
+			}
+		}
+		break;
+	}
+}
+
+/* how the tick recorder would call a quote board column */
+static int quote_kind( int tickType )
+{
+	switch( tickType ) {
+	case BID_SIZE:
+	case ASK_SIZE:
+	case LAST_SIZE:
+	case VOLUME:
+	case DELAYED_BID_SIZE:
+	case DELAYED_ASK_SIZE:
+	case DELAYED_LAST_SIZE:
+	case DELAYED_VOLUME:
+		return TWS_STRAT_TICK_SIZE;
+	case BID:
+	case ASK:
+	case LAST:
+	case HIGH:
+	case LOW:
+	case CLOSE:
+	case OPEN:
+	case DELAYED_BID:
+	case DELAYED_ASK:
+	case DELAYED_LAST:
+	case DELAYED_HIGH:
+	case DELAYED_LOW:
+	case DELAYED_CLOSE:
+	case DELAYED_OPEN:
+		return TWS_STRAT_TICK_PRICE;
+	default:
+		return TWS_STRAT_TICK_GENERIC;
+	}
+}
+
+static void post_one( StratModule *m, int type, const void *view,
+	int tickerId, int64_t stamp )
+{
+	if( !m->wants(type, tickerId) ) {
+		return;
+	}
+	StratEvent *shared = NULL;
+	m->post( type, view, stamp, &shared );
+	if( shared != NULL ) {
+		StratEvent::release( shared );
+	}
+}
+
+/* bring a reloaded module up to date, views keep their original stamps */
+void TwsDL::stratReplay( StratModule *m )
+{
+	const int64_t now = nowInUsecs();
+	int cnt = 0;
+	/* the thread is not running yet, don't drop what exceeds its queue */
+	m->keepAll( true );
+
+	const std::vector<PositionPnl> &positions = account->positions();
+	for( size_t i = 0; i < positions.size(); i++ ) {
+		tws_strat_position p;
+		stratPosition( positions[i], positions[i].stamp, &p );
+		post_one( m, StratEvent::POSITION, &p, -1, now );
+		cnt++;
+	}
+
+	std::vector<const RowOrderStatus*> states;
+	orderMgr->openStatus( &states );
+	for( size_t i = 0; i < states.size(); i++ ) {
+		tws_strat_order_status os;
+		stratOrderStatus( *states[i], now, &os );
+		post_one( m, StratEvent::ORDER_STATUS, &os, -1, now );
+		cnt++;
+	}
+
+	const std::vector<MktDataRequest> &mdlist
+		= workTodo->getMktDataTodo().mktDataRequests;
+	const int nCols = quotes->cols();
+	std::vector<double> vals( nCols );
+	std::vector<int64_t> stamps( nCols );
+	for( int reqId = 1; reqId < quotes->rows()
+	    && reqId <= (int)mdlist.size(); reqId++ ) {
+		if( !m->wants(StratEvent::TICK, reqId)
+		    || !quotes->snapshot(reqId, vals.data(), stamps.data()) ) {
+			continue;
+		}
+		for( int c = 0; c < nCols; c++ ) {
+			if( stamps[c] == 0 ) {
+				continue;
+			}
+			tws_strat_tick t;
+			t.stamp = stamps[c] * 1000;
+			t.tickerId = reqId;
+			t.conId = mdlist[reqId - 1].ibContract.conId;
+			t.tickType = quotes->tickType( c );
+			t.kind = quote_kind( t.tickType );
+			t.value = vals[c];
+			t.opt = NULL;
+			t.str = NULL;
+			post_one( m, StratEvent::TICK, &t, reqId, now );
+			cnt++;
+		}
+	}
+
+	int conn = TWS_STRAT_DISCONNECTED;
+	if( twsClient->isConnected() && state == IDLE ) {
+		conn = connectivity_IB_TWS ? TWS_STRAT_CONNECTED : TWS_STRAT_IB_LOST;
+	}
+	post_one( m, StratEvent::CONNECTION, &conn, -1, now );
+	m->keepAll( false );
+	INFO_PRINTF( "replayed %d events to strategy %s", cnt,
+		m->name().c_str() );
+}
+
+/* contract of any market data, depth or real-time bars tickerId */
+const Contract* TwsDL::tickerContract( int tickerId ) const
+{
+	const std::vector<MktDataRequest> &md =
+		workTodo->getMktDataTodo().mktDataRequests;
+	const std::vector<MktDepthRequest> &dd =
+		workTodo->getMktDepthTodo().mktDepthRequests;
+	const std::vector<RealTimeBarsRequest> &rb =
+		workTodo->getRealTimeBarsTodo().realTimeBarsRequests;
+	if( tickerId > 0 && tickerId <= (int)md.size() ) {
+		return &md[tickerId - 1].ibContract;
+	}
+	int i = tickerId - depthTickerId( 0 );
+	if( i >= 0 && i < (int)dd.size() ) {
+		return &dd[i].ibContract;
+	}
+	i = tickerId - rtBarsTickerId( 0 );
+	if( i >= 0 && i < (int)rb.size() ) {
+		return &rb[i].ibContract;
+	}
+	return NULL;
+}
+
+/* send an order of the strategy module right away if the rate limit
+   allows, otherwise as soon as possible */
+long TwsDL::stratPlaceOrder( const tws_strat_order &o, int64_t trigger )
+{
+	const Contract *c = tickerContract( o.tickerId );
+	if( o.size < sizeof(o) || c == NULL || o.action == NULL
+	    || o.orderType == NULL || tws_valid_orderId == 0 ) {
+		return -1;
+	}
+	PlaceOrder pO;
+	pO.contract = *c;
+	pO.order.action = o.action;
+	pO.order.totalQuantity = o.quantity;
+	pO.order.orderType = o.orderType;
+	pO.order.lmtPrice = o.lmtPrice;
+	pO.order.auxPrice = o.auxPrice;
+	if( o.tif != NULL ) {
+		pO.order.tif = o.tif;
+	}
+	if( o.account != NULL ) {
+		pO.order.account = o.account;
+	}
+	if( o.orderRef != NULL ) {
+		pO.order.orderRef = o.orderRef;
+	}
+	pO.order.transmit = !(o.flags & TWS_STRAT_NO_TRANSMIT);
+	pO.order.outsideRth = (o.flags & TWS_STRAT_OUTSIDE_RTH) != 0;
+
+	if( o.orderId != 0 ) {
+		pO.orderId = o.orderId;
+		if( !gateway->modify(o.orderId, pO) ) {
+			return -1;
+		}
+	} else {
+		/* skip orderIds whose slot is still used by an open order */
+		for( int i = 0; i < gateway->slots()
+		    && !gateway->canOpen(tws_valid_orderId); i++ ) {
+			tws_valid_orderId++;
+		}
+		if( !gateway->canOpen(tws_valid_orderId) ) {
+			WARN_PRINTF( "Warning, order gateway is full." );
+			return -1;
+		}
+		pO.orderId = fetch_inc_order_id();
+		gateway->open( pO.orderId, pO );
+	}
+	gateway->push( pO.orderId, false, trigger );
+	sendOrders();
+	return pO.orderId;
+}
+
+int TwsDL::stratCancelOrder( long orderId, int64_t trigger )
+{
+	if( gateway->isActive(orderId) ) {
+		gateway->push( orderId, true, trigger );
+		sendOrders();
+		return 0;
+	}
+	/* orders of the job file */
+	bool archived;
+	const PacketPlaceOrder *p = orderMgr->find( orderId, &archived );
+	if( p == NULL || archived ) {
+		return -1;
+	}
+	PlaceOrder pO;
+	pO.orderId = orderId;
+	pO.contract = p->getRequest().contract;
+	pO.order.action = "CANCEL";
+	pO.order.totalQuantity = 0;
+	workTodo->placeOrderTodo()->add( pO );
+	wakeIn( 0 );
+	return 0;
+}
+
+/* append a tick to the recorder, written at least every TICK_FLUSH_MSECS */
+void TwsDL::recordTick( int reqId, int tickType, int kind, double value,
+	int size )
+{
+	if( ticks == NULL ) {
+		return;
+	}
+	const std::vector<MktDataRequest> &mdlist
+		= workTodo->getMktDataTodo().mktDataRequests;
+	const std::vector<MktDepthRequest> &dlist
+		= workTodo->getMktDepthTodo().mktDepthRequests;
+	const int book = reqId - depthTickerId( 0 );
+	long conId = 0;
+	if( reqId > 0 && reqId <= (int)mdlist.size() ) {
+		conId = mdlist[reqId - 1].ibContract.conId;
+	} else if( book >= 0 && book < (int)dlist.size() ) {
+		conId = dlist[book].ibContract.conId;
+	}
+	if( ticks->pending() == 0 ) {
+		wakeIn( TICK_FLUSH_MSECS );
+	}
+	ticks->record( eventStamp, reqId, conId, tickType, kind, value, size );
+}
+
 void TwsDL::twsTickString(TickerId reqId, TickType tickType,
 	const IBString& value )
 {
+	/* most string ticks are numbers like LAST_TIMESTAMP or start with one
+	   like RT_VOLUME's price */
+	const double num = atof( value.c_str() );
+	stratTick( reqId, tickType, TICK_STRING, num, NULL, value.c_str() );
+	recordTick( reqId, tickType, TICK_STRING, num );
+
 	const Contract &c
 		= workTodo->getMktDataTodo().mktDataRequests[reqId - 1].ibContract;
 	DEBUG_PRINTF("TICK_STRING: %ld %s %ld %s %s", reqId,
 		c.symbol.c_str(), c.conId, ibToString(tickType).c_str(), value.c_str() );
 }
 
-void TwsDL::twsOptParams(int reqId, RowOptParams& r)
+void TwsDL::twsOptParams(int reqId, const RowOptParams& r)
 {
 	if( currentRequest.reqType() != GenericRequest::OPT_PARAMS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 	if( currentRequest.reqId() != reqId ) {
@@ -1169,7 +2366,7 @@ void TwsDL::twsOptParams(int reqId, RowOptParams& r)
 void TwsDL::twsOptParamsEnd(int reqId)
 {
 	if( currentRequest.reqType() != GenericRequest::OPT_PARAMS_REQUEST ) {
-		DEBUG_PRINTF( "Warning, unexpected tws callback.");
+		WARN_PRINTF( "Warning, unexpected tws callback.");
 		return;
 	}
 	if( currentRequest.reqId() != reqId ) {
@@ -1181,6 +2378,89 @@ void TwsDL::twsOptParamsEnd(int reqId)
 	((PacketOptParams*)packet)->setFinished();
 }
 
+void TwsDL::twsTickSnapshotEnd( int reqId )
+{
+	lines->snapshotEnd( reqId, nowInMsecs() );
+}
+
+void TwsDL::twsUpdateMktDepth( int reqId, int position,
+	const std::string &mktMaker, int operation, int side, double price,
+	int size )
+{
+	const int book = reqId - depthTickerId( 0 );
+	if( book < 0 || book >= depth->size() ) {
+		WARN_PRINTF( "Warning, market depth for unknown request %d.", reqId );
+		return;
+	}
+	DEBUG_PRINTF( "MARKET_DEPTH: %d %d %s %d %d %g %d", reqId, position,
+		mktMaker.c_str(), operation, side, price, size );
+	if( !depth->apply(book, position, operation, side, price, size,
+	    mktMaker.c_str()) ) {
+		return;
+	}
+	recordTick( reqId, position, TICK_DEPTH_ASK_INSERT + 3 * side
+		+ operation, price, size );
+}
+
+void TwsDL::twsRealtimeBar( int reqId, const RtBar &bar )
+{
+	const std::vector<RealTimeBarsRequest> &v =
+		workTodo->getRealTimeBarsTodo().realTimeBarsRequests;
+	const int request = reqId - rtBarsTickerId( 0 );
+	if( request < 0 || request >= (int)v.size() ) {
+		WARN_PRINTF( "Warning, real-time bar for unknown request %d.", reqId );
+		return;
+	}
+	DEBUG_PRINTF( "REAL_TIME_BAR: %d %ld %g %g %g %g %lld %g %d", reqId,
+		(long)bar.time, bar.open, bar.high, bar.low, bar.close, bar.volume,
+		bar.wap, bar.count );
+
+	const RealTimeBarsRequest &r = v[request];
+	const int n = rtBars->update( request, bar );
+	for( int i = 0; i < n; i++ ) {
+		/* dump each finished bar like a historical data request for just
+		   this bar */
+		const RowHist &row = rtBars->finished( i );
+		const time_t end = rtBars->finishedEnd( i );
+		const std::string &bss =
+			rtBars->barSizeSetting( rtBars->finishedAgg(i) );
+		const int secs = ib_bar_size2secs( bss );
+		if( stratWants(StratEvent::BAR, reqId) ) {
+			tws_strat_bar b;
+			b.stamp = eventStamp;
+			b.tickerId = reqId;
+			b.conId = r.ibContract.conId;
+			b.start = end - secs;
+			b.end = end;
+			b.open = row.open;
+			b.high = row.high;
+			b.low = row.low;
+			b.close = row.close;
+			b.wap = row.WAP;
+			b.volume = row.volume;
+			b.count = row.count;
+			b.hasGaps = row.hasGaps;
+			b.barSize = bss.c_str();
+			stratPost( StratEvent::BAR, &b, reqId );
+		}
+		char dur[16];
+		snprintf( dur, sizeof(dur), "%d S", secs );
+
+		HistRequest hR;
+		hR.initialize( r.ibContract, time_t_ib(end), dur, bss,
+			r.whatToShow, r.useRTH, r.formatDate );
+		RowHist fin = dflt_RowHist;
+		fin.date = "finished-" + time_t_ib( end - secs )
+			+ "-" + time_t_ib( end );
+
+		PacketHistData phd;
+		phd.record( reqId, hR );
+		phd.append( reqId, row );
+		phd.append( reqId, fin );
+		phd.dumpXml();
+	}
+}
+
 int TwsDL::initWork()
 {
 	if( cfg.get_account ) {
@@ -1193,21 +2473,41 @@ int TwsDL::initWork()
 		workTodo->addSimpleRequest(GenericRequest::ORDERS_REQUEST);
 	}
 
-	int cnt = workTodo->read_file(cfg.workfile);
+	if( cfg.daemon_path != NULL && cfg.workfile == NULL ) {
+		/* jobs will come from the daemon socket, not stdin */
+		return 0;
+	}
+
+	int cnt = workTodo->read_file(cfg.workfile, cfg.coalesce);
 	if( cnt < 0 ) {
 		/* it's not an error if no workfile is given and nothing on stdin */
 		cnt = cfg.workfile == NULL ? 0 : -1;
 		goto end;
 	}
-	DEBUG_PRINTF( "got %d jobs from workFile %s", cnt, cfg.workfile );
+	INFO_PRINTF( "got %d jobs from workFile %s", cnt, cfg.workfile );
+	if( cfg.shard_cnt > 1 ) {
+		/* every shard would place the orders and stream the data */
+		const WorkTodo &w = *workTodo;
+		if( w.getPlaceOrderTodo().countLeft() > 0
+		    || !w.getMktDataTodo().mktDataRequests.empty()
+		    || !w.getMktDepthTodo().mktDepthRequests.empty()
+		    || !w.getRealTimeBarsTodo().realTimeBarsRequests.empty() ) {
+			fprintf( stderr, "error, cannot shard place_order, market_data, "
+				"market_depth or realtime_bars requests.\n" );
+			cnt = -1;
+			goto end;
+		}
+		cnt -= workTodo->shard( cfg.shard_idx, cfg.shard_cnt,
+			cfg.shard_by_farm ? &dataFarms : NULL );
+	}
 
 	if( workTodo->getContractDetailsTodo().countLeft() > 0 ) {
-		DEBUG_PRINTF( "getting contracts from TWS, %d",
+		INFO_PRINTF( "getting contracts from TWS, %d",
 			workTodo->getContractDetailsTodo().countLeft() );
 // 		state = IDLE;
 	}
 	if( workTodo->getHistTodo().countLeft() > 0 ) {
-		DEBUG_PRINTF( "getting hist data from TWS, %d",
+		INFO_PRINTF( "getting hist data from TWS, %d",
 			workTodo->getHistTodo().countLeft());
 		dumpWorkTodo();
 // 		state = IDLE;;
@@ -1242,6 +2542,18 @@ void TwsDL::changeState( State s )
 {
 	assert( state != s );
 	state = s;
+	/* let the new state run without waiting for the socket */
+	wakeIn( 0 );
+}
+
+
+bool TwsDL::canSend()
+{
+	if( rate_limit->can_send() ) {
+		return true;
+	}
+	wakeAt( rate_limit->next_time() );
+	return false;
 }
 
 
@@ -1255,7 +2567,7 @@ long TwsDL::fetch_inc_order_id()
 
 void TwsDL::reqContractDetails()
 {
-	if (! rate_limit->can_send())
+	if( !canSend() )
 		return;
 	workTodo->contractDetailsTodo()->checkout();
 	const ContractDetailsRequest &cdR
@@ -1276,7 +2588,7 @@ void TwsDL::reqHistoricalData()
 	int wait = workTodo->histTodo()->checkoutOpt( &pacingControl, &dataFarms );
 
 	if( wait > 0 ) {
-		curIdleTime = (wait < 1000) ? wait : 1000;
+		wakeIn( wait );
 		return;
 	}
 	if( wait < -1 ) {
@@ -1292,7 +2604,7 @@ void TwsDL::reqHistoricalData()
 	pacingControl.addRequest( hR.ibContract );
 
 	const Contract &c = hR.ibContract;
-	DEBUG_PRINTF( "REQ_HISTORICAL_DATA %p %d: %ld,%s,%s,%s,%s %s,%s,%s,%s",
+	INFO_PRINTF( "REQ_HISTORICAL_DATA %p %d: %ld,%s,%s,%s,%s %s,%s,%s,%s",
 		&workTodo->getHistTodo().current(),
 		currentRequest.reqId(), c.conId,
 		c.symbol.c_str(), c.secType.c_str(),c.exchange.c_str(),c.lastTradeDateOrContractMonth.c_str(),
@@ -1322,6 +2634,23 @@ void TwsDL::reqAccStatus()
 
 	accStatus->record( aR );
 	twsClient->reqAccountUpdates(aR.subscribe, aR.acctCode);
+	accSubscribed = true;
+}
+
+/* dump the account changes of --account-stream since the last delta */
+void TwsDL::flushAccStatus()
+{
+	if( !accDelta->pending() ) {
+		return;
+	}
+	AccStatusRequest aR;
+	aR.subscribe = true;
+	aR.acctCode = cfg.tws_account_name;
+
+	PacketAccStatus p;
+	p.record( aR );
+	accDelta->flush( &p );
+	p.dumpXml();
 }
 
 void TwsDL::reqExecutions()
@@ -1360,57 +2689,198 @@ void TwsDL::placeOrder()
 	} else {
 		orderId = pO.orderId;
 	}
-	PacketPlaceOrder *p_placeOrder;
-	if( p_orders.find(orderId) == p_orders.end() ) {
-		p_placeOrder = new PacketPlaceOrder();
-		p_orders[orderId] = p_placeOrder;
+	bool archived;
+	PacketPlaceOrder *p_placeOrder = orderMgr->find( orderId, &archived );
+	if( p_placeOrder == NULL || archived ) {
+		p_placeOrder = orderMgr->open( orderId );
 		p_placeOrder->record( orderId, pO );
 	} else {
 		// TODO order modify
-		p_placeOrder = p_orders[orderId];
 		p_placeOrder->modify( pO );
 	}
 
-	if( pO.order.totalQuantity != 0
-	    || strcasecmp(pO.order.action.c_str(), "CANCEL") != 0 ) {
+	if( !pO.isCancel() ) {
 		twsClient->placeOrder( orderId, pO.contract, pO.order );
 	} else {
 		twsClient->cancelOrder( orderId );
 	}
 }
 
+/* send the queued orders of the gateway */
+void TwsDL::sendOrders()
+{
+	while( gateway->pending() ) {
+		if( !twsClient->isConnected() || !canSend() ) {
+			gateway->wait();
+			return;
+		}
+		bool cancel;
+		const long orderId = gateway->pop( &cancel );
+		if( cancel ) {
+			twsClient->cancelOrder( orderId );
+		} else {
+			const PlaceOrder &pO = gateway->find( orderId )->getRequest();
+			twsClient->placeOrder( orderId, pO.contract, pO.order );
+		}
+		gateway->sent( orderId, nowInUsecs() );
+	}
+}
+
 void TwsDL::placeAllOrders()
 {
 	PlaceOrderTodo* todo = workTodo->placeOrderTodo();
-	while( todo->countLeft() > 0 && rate_limit->can_send()) {
+	while( todo->countLeft() > 0 && canSend() ) {
 		placeOrder();
 	}
 }
 
-int TwsDL::reqMktData()
+/* one row per tickerId, columns for all tick types we may get */
+void TwsDL::initLines()
 {
 	const std::vector<MktDataRequest> &v =
 		workTodo->getMktDataTodo().mktDataRequests;
 	std::vector<MktDataRequest>::const_iterator it;
-	int reqId = 1;
 
-	/* initialize quote snapshot */
-	assert(quotes->empty());
-	quotes->resize(v.size());
+	assert( quotes->rows() == 0 );
+	std::vector<int> types;
+	for( it = v.begin(); it < v.end(); it++ ) {
+		std::vector<int> t = QuoteBoard::tickTypes( it->genericTicks,
+			cfg.mkt_data_type == 0 || cfg.mkt_data_type >= 3 );
+		types.insert( types.end(), t.begin(), t.end() );
+	}
+	quotes->init( v.size() + 1, types );
+	lines->init( v, cfg.max_lines, cfg.line_slice );
+
+	std::vector<long> conIds;
+	for( it = v.begin(); it < v.end(); it++ ) {
+		conIds.push_back( it->ibContract.conId );
+	}
+	if( conflator != NULL ) {
+		conflator->init( *quotes, conIds );
+	}
+	greeks->init( v );
+	if( cfg.greeks_file != NULL && greeksDue == 0
+	    && greeks->openFile(cfg.greeks_file) ) {
+		/* snapshots at whole intervals */
+		const int64_t ival = cfg.greeks_interval * 1000;
+		greeksDue = (nowInMsecs() / ival + 1) * ival;
+		wakeAt( greeksDue );
+	}
+	if( cfg.shm_name != NULL && publisher == NULL ) {
+		/* quotes are still stored, just not published */
+		publisher = new QuotePublisher( cfg.shm_name );
+		if( !publisher->open(*quotes, conIds) ) {
+			delete publisher;
+			publisher = NULL;
+		}
+	}
+}
 
-	for( it = v.begin(); it < v.end(); it++, reqId++ ) {
-		twsClient->reqMktData( reqId, it->ibContract, it->genericTicks,
-			it->snapshot );
+/* depth requests use the tickerIds after those of market data, all relative
+   to STREAM_ID_BASE on the wire */
+int TwsDL::depthTickerId( int book ) const
+{
+	return workTodo->getMktDataTodo().mktDataRequests.size() + 1 + book;
+}
+
+/* one book per market depth request, as deep as the deepest one */
+void TwsDL::initDepth()
+{
+	const std::vector<MktDepthRequest> &v =
+		workTodo->getMktDepthTodo().mktDepthRequests;
+	int rows = 1;
+	for( size_t i = 0; i < v.size(); i++ ) {
+		rows = std::max( rows, v[i].numRows );
+	}
+	depth->init( v.size(), rows );
+	depthNext = 0;
+}
+
+/* subscribe all depth requests once per connection */
+void TwsDL::serveDepth()
+{
+	const std::vector<MktDepthRequest> &v =
+		workTodo->getMktDepthTodo().mktDepthRequests;
+	while( depthNext < depth->size() && canSend() ) {
+		const MktDepthRequest &r = v[depthNext];
+		twsClient->reqMktDepth( STREAM_ID_BASE + depthTickerId(depthNext),
+			r.ibContract, r.numRows );
+		depthNext++;
+	}
+}
+
+/* real-time bar requests use the tickerIds after those of depth */
+int TwsDL::rtBarsTickerId( int request ) const
+{
+	return depthTickerId( workTodo->getMktDepthTodo().mktDepthRequests.size() )
+		+ request;
+}
+
+/* aggregate each real-time bar request to all its bar sizes */
+void TwsDL::initRtBars()
+{
+	const std::vector<RealTimeBarsRequest> &v =
+		workTodo->getRealTimeBarsTodo().realTimeBarsRequests;
+	for( size_t i = 0; i < v.size(); i++ ) {
+		const std::string &bss = v[i].barSizeSetting;
+		size_t b = 0;
+		do {
+			size_t e = bss.find( ',', b );
+			if( rtBars->add(i, bss.substr(b, e - b), v[i].formatDate) < 0 ) {
+				/* already checked when reading the job */
+				assert( false );
+			}
+			b = e == std::string::npos ? e : e + 1;
+		} while( b != std::string::npos );
+	}
+	rtBarsNext = 0;
+}
+
+/* subscribe all real-time bar requests once per connection */
+void TwsDL::serveRtBars()
+{
+	const std::vector<RealTimeBarsRequest> &v =
+		workTodo->getRealTimeBarsTodo().realTimeBarsRequests;
+	if( rtBars->size() == 0 ) {
+		return;
+	}
+	while( rtBarsNext < (int)v.size() && canSend() ) {
+		const RealTimeBarsRequest &r = v[rtBarsNext];
+		twsClient->reqRealTimeBars(
+			STREAM_ID_BASE + rtBarsTickerId(rtBarsNext), r.ibContract,
+			r.whatToShow, r.useRTH );
+		rtBarsNext++;
+	}
+}
+
+/* (re)subscribe market data as far as lines and rate limit allow */
+void TwsDL::serveLines()
+{
+	const std::vector<MktDataRequest> &v =
+		workTodo->getMktDataTodo().mktDataRequests;
+	int64_t now = nowInMsecs();
+	int tickerId;
+
+	while( (tickerId = lines->expired(now)) > 0 && canSend() ) {
+		twsClient->cancelMktData( STREAM_ID_BASE + tickerId );
+		lines->cancelled( tickerId, now );
+	}
+	while( lines->canRequest() && canSend() ) {
+		bool snapshot;
+		tickerId = lines->request( now, &snapshot );
+		const MktDataRequest &mR = v[tickerId - 1];
+		/* TWS refuses generic ticks for snapshots */
+		twsClient->reqMktData( STREAM_ID_BASE + tickerId, mR.ibContract,
+			(snapshot && !mR.snapshot) ? "" : mR.genericTicks, snapshot );
 	}
-	if( reqId > 1 ) {
-// 		changeState( WAIT_DATA );
+	if( lines->nextWakeup() > 0 ) {
+		wakeAt( lines->nextWakeup() );
 	}
-	return reqId;
 }
 
 void TwsDL::reqOptParams()
 {
-	if (! rate_limit->can_send())
+	if( !canSend() )
 		return;
 	workTodo->optParamsTodo()->checkout();
 	const OptParamsRequest &opR
@@ -12,6 +12,7 @@
 #include <string>
 #include <stdint.h>
 #include <map>
+#include <vector>
 
 #include "tws_quote.h"
 
@@ -22,6 +23,27 @@
 
 class TWSClient;
 struct RateLimit;
+struct TimerHeap;
+struct LoopStats;
+struct TwsEvent;
+class TwsReader;
+class TwsWriter;
+class TwsDaemon;
+class TickRecorder;
+class MktDataLines;
+class QuotePublisher;
+class Conflator;
+class DepthBooks;
+class BarAggregator;
+class OptionGreeks;
+class OrderGateway;
+class OrderManager;
+struct RtBar;
+struct TwsQuoteUpdate;
+class StratModule;
+struct tws_strat_order;
+struct tws_strat_order_status;
+struct tws_strat_position;
 
 #ifndef TWSAPI_NO_NAMESPACE
 namespace IB {
@@ -40,6 +62,7 @@ struct ConfigTwsdo
 
 	void init_ai_family( int ipv4, int ipv6 );
 	void init_mkt_data_type(const char *str);
+	void init_shard( const char *shard, const char *shard_by );
 
 	const char *workfile;
 	int skipdef;
@@ -47,9 +70,29 @@ struct ConfigTwsdo
 	int tws_port;
 	int tws_client_id;
 	int ai_family;
+	int coalesce;
+	int shard_idx;
+	int shard_cnt;
+	int shard_by_farm;
+	int threaded;
+	int async_output;
+	const char *daemon_path;
+	int max_lines;
+	int line_slice;
+	const char *tick_prefix;
+	int tick_segment;
+	const char *shm_name;
+	const char *conflate_sink;
+	int conflate_interval;
+	int conflate_latency;
+	const char *greeks_file;
+	int greeks_interval;
+	int order_retention;
+	int pnl_interval;
 
 	int get_account;
 	const char* tws_account_name;
+	int account_stream;
 	int get_exec;
 	int get_order;
 
@@ -61,7 +104,9 @@ struct ConfigTwsdo
 	int tws_minPacingTime;
 	int tws_violationPause;
 
-	const char* strat_file;
+	/* --strat FILE[@CPU], see StratModule */
+	const char **strat_files;
+	int strat_cnt;
 };
 
 
@@ -79,6 +124,7 @@ class RowError;
 class RowHist;
 class RowAccVal;
 class RowPrtfl;
+struct PositionPnl;
 class RowExecution;
 class RowOrderStatus;
 class RowOpenOrder;
@@ -86,12 +132,11 @@ class RowOptParams;
 class PacingGod;
 class DataFarmStates;
 class Account;
+class AccountDelta;
 
 class TwsDlWrapper;
 class TwsHeartBeat;
 
-typedef struct tws_dso_s *tws_dso_t;
-
 
 
 class TwsDL
@@ -111,21 +156,28 @@ class TwsDL
 		State currentState() const;
 		std::string lastError() const;
 
+		/* make the event loop wake up in time, also for strategies */
+		void wakeAt( int64_t msecs );
+		void wakeIn( int msecs );
+
 // 	private:
 		void eventLoop();
 
 		void dumpWorkTodo() const;
+		void dumpLoopStats() const;
+		void dumpOrderStats() const;
 
 		void connectTws();
 		void waitTwsCon();
 		void idle();
+		void nextJob();
 		bool finContracts();
 		bool finOptParams();
 		bool finHist();
-		bool finPlaceOrder();
 		void waitData();
 
 		void changeState( State );
+		bool canSend();
 
 		int initWork();
 
@@ -134,11 +186,20 @@ class TwsDL
 		void reqContractDetails();
 		void reqHistoricalData();
 		void reqAccStatus();
+		void flushAccStatus();
 		void reqExecutions();
 		void reqOrders();
 		void placeOrder();
 		void placeAllOrders();
-		int reqMktData();
+		void sendOrders();
+		void initLines();
+		void serveLines();
+		int depthTickerId( int book ) const;
+		void initDepth();
+		void serveDepth();
+		int rtBarsTickerId( int request ) const;
+		void initRtBars();
+		void serveRtBars();
 		void reqOptParams();
 
 		void errorContracts( const RowError& );
@@ -146,6 +207,7 @@ class TwsDL
 		void errorPlaceOrder( const RowError& );
 
 		// callbacks from our twsWrapper
+		void twsEvent( const TwsEvent& );
 		void twsError( const RowError& );
 
 		void twsConnectionClosed();
@@ -177,9 +239,38 @@ class TwsDL
 			double value );
 		void twsTickString(TickerId tickerId, TickType tickType,
 			const IBString& value );
+		void setQuote( int reqId, int tickType, double value );
+		static void stratQuotes( void *clo, const TwsQuoteUpdate*,
+			size_t n );
+		bool stratWants( int type, int tickerId ) const;
+		void stratPost( int type, const void *view, int tickerId );
+		void stratTick( int reqId, int tickType, int kind, double value,
+			const double *opt = NULL, const char *str = NULL );
+		void stratConnection( int state );
+		void stratOrderStatus( const RowOrderStatus&, int64_t stamp,
+			tws_strat_order_status* ) const;
+		void stratPosition( const PositionPnl&, int64_t stamp,
+			tws_strat_position* ) const;
+		int stratGetPosition( long conId, const char *acct,
+			tws_strat_position* ) const;
+		void markPosition( int reqId, int tickType, double price );
+		void stratReplay( StratModule* );
+		void reloadStrats( const char *name );
+		void control( const std::string &cmd );
+		const Contract* tickerContract( int tickerId ) const;
+		/* trigger is the receive time of the event causing it in usecs */
+		long stratPlaceOrder( const tws_strat_order&, int64_t trigger );
+		int stratCancelOrder( long orderId, int64_t trigger );
+		void recordTick( int reqId, int tickType, int kind, double value,
+			int size = 0 );
 		void twsConnectAck();
-		void twsOptParams(int reqId, RowOptParams&);
+		void twsOptParams(int reqId, const RowOptParams&);
 		void twsOptParamsEnd(int reqId);
+		void twsTickSnapshotEnd( int reqId );
+		void twsUpdateMktDepth( int reqId, int position,
+			const std::string &mktMaker, int operation, int side,
+			double price, int size );
+		void twsRealtimeBar( int reqId, const RtBar& );
 
 		State state;
 		bool quit;
@@ -189,12 +280,19 @@ class TwsDL
 		TwsHeartBeat *tws_hb;
 		long tws_valid_orderId;
 		bool connectivity_IB_TWS;
-		int curIdleTime;
+		TimerHeap *timers;
+		LoopStats *loop_stats;
 
 		ConfigTwsdo cfg;
 
 		TwsDlWrapper *twsWrapper;
 		TWSClient  *twsClient;
+		TwsReader *reader;
+		TwsWriter *writer;
+		TwsDaemon *daemon;
+		TickRecorder *ticks;
+		/* receive time of the currently handled TwsEvent */
+		int64_t eventStamp;
 
 		RateLimit *rate_limit;
 
@@ -202,19 +300,45 @@ class TwsDL
 		GenericRequest &currentRequest;
 
 		WorkTodo *workTodo;
+		/* countDone() at the last hist progress report */
+		int histReported;
 		Account *account;
-		Quotes *quotes;
+		QuoteBoard *quotes;
+		MktDataLines *lines;
+		QuotePublisher *publisher;
+		Conflator *conflator;
+		/* option computations of market data, snapshots due at greeksDue */
+		OptionGreeks *greeks;
+		int64_t greeksDue;
+		/* next dump of positions and P&L if --pnl is given */
+		int64_t pnlDue;
+		/* last account state of --account-stream, next delta at accDue
+		   once the first download is done */
+		AccountDelta *accDelta;
+		int64_t accDue;
+		bool accSubscribed;
+		/* books in job order, see depthTickerId() */
+		DepthBooks *depth;
+		/* next book to subscribe */
+		int depthNext;
+		/* bar sizes of all real-time bar requests, see rtBarsTickerId() */
+		BarAggregator *rtBars;
+		/* next real-time bar request to subscribe */
+		int rtBarsNext;
 
 		Packet *packet;
-		std::map<long, PacketPlaceOrder*> p_orders;
-		std::map<long, PacketPlaceOrder*> p_orders_old;
+		/* orders of the job file and states of all orders */
+		OrderManager *orderMgr;
+		/* orders of strategies, sent without waiting for other jobs */
+		OrderGateway *gateway;
 
 		std::map<long, ContractDetails*> con_details;
 
 		DataFarmStates &dataFarms;
 		PacingGod &pacingControl;
 
-		tws_dso_t strat;
+		/* in --strat order */
+		std::vector<StratModule*> &strats;
 
 	friend class TwsDlWrapper;
 };
@@ -20,6 +20,8 @@
 static gengetopt_args_info args_info;
 static ConfigTwsdo cfg;
 
+/* log messages queued before the log thread has written them */
+#define LOG_RING_SIZE 2048
 
 
 
@@ -69,10 +71,105 @@ static void gengetopt_check_opts()
 		cfg.tws_client_id = args_info.id_arg;
 	}
 	cfg.init_ai_family( args_info.ipv4_given, args_info.ipv6_given );
+	cfg.coalesce = args_info.coalesce_given;
+	cfg.init_shard( args_info.shard_given ? args_info.shard_arg : NULL,
+		args_info.shard_by_given ? args_info.shard_by_arg : NULL );
+	if( args_info.log_level_given ) {
+		tws_log_level = tws_log_parse_level( args_info.log_level_arg );
+		if( tws_log_level < 0 ) {
+			fprintf( stderr, "error, invalid log-level '%s'\n",
+				args_info.log_level_arg );
+			exit(2);
+		}
+	}
+	cfg.threaded = args_info.threaded_given;
+	cfg.async_output = args_info.async_output_given;
+	if( args_info.lines_given ) {
+		if( args_info.lines_arg <= 0 ) {
+			fprintf( stderr, "error, invalid lines %d\n", args_info.lines_arg );
+			exit(2);
+		}
+		cfg.max_lines = args_info.lines_arg;
+	}
+	if( args_info.line_slice_given ) {
+		if( args_info.line_slice_arg < 0 ) {
+			fprintf( stderr, "error, invalid line-slice %d\n",
+				args_info.line_slice_arg );
+			exit(2);
+		}
+		cfg.line_slice = args_info.line_slice_arg;
+	}
+	if( args_info.ticks_given ) {
+		cfg.tick_prefix = args_info.ticks_arg;
+	}
+	if( args_info.ticks_segment_given ) {
+		cfg.tick_segment = args_info.ticks_segment_arg;
+	}
+	if( args_info.shm_given ) {
+		cfg.shm_name = args_info.shm_arg;
+	}
+	if( args_info.conflate_given ) {
+		cfg.conflate_sink = args_info.conflate_arg;
+	}
+	if( args_info.conflate_interval_given ) {
+		if( args_info.conflate_interval_arg <= 0 ) {
+			fprintf( stderr, "error, invalid conflate-interval %d\n",
+				args_info.conflate_interval_arg );
+			exit(2);
+		}
+		cfg.conflate_interval = args_info.conflate_interval_arg;
+	}
+	if( args_info.conflate_latency_given ) {
+		if( args_info.conflate_latency_arg < 0 ) {
+			fprintf( stderr, "error, invalid conflate-latency %d\n",
+				args_info.conflate_latency_arg );
+			exit(2);
+		}
+		cfg.conflate_latency = args_info.conflate_latency_arg;
+	}
+	if( args_info.greeks_given ) {
+		cfg.greeks_file = args_info.greeks_arg;
+	}
+	if( args_info.greeks_interval_given ) {
+		if( args_info.greeks_interval_arg <= 0 ) {
+			fprintf( stderr, "error, invalid greeks-interval %d\n",
+				args_info.greeks_interval_arg );
+			exit(2);
+		}
+		cfg.greeks_interval = args_info.greeks_interval_arg;
+	}
+	if( args_info.pnl_given ) {
+		if( args_info.pnl_arg <= 0 ) {
+			fprintf( stderr, "error, invalid pnl %d\n",
+				args_info.pnl_arg );
+			exit(2);
+		}
+		cfg.pnl_interval = args_info.pnl_arg;
+	}
+	if( args_info.order_retention_given ) {
+		if( args_info.order_retention_arg < 0 ) {
+			fprintf( stderr, "error, invalid order-retention %d\n",
+				args_info.order_retention_arg );
+			exit(2);
+		}
+		cfg.order_retention = args_info.order_retention_arg;
+	}
+	if( args_info.daemon_given ) {
+		cfg.daemon_path = args_info.daemon_arg;
+	}
 	cfg.get_account = args_info.get_account_given;
 	if( args_info.accountName_given ) {
 		cfg.tws_account_name = args_info.accountName_arg;
 	}
+	if( args_info.account_stream_given ) {
+		if( args_info.account_stream_arg <= 0 ) {
+			fprintf( stderr, "error, invalid account-stream %d\n",
+				args_info.account_stream_arg );
+			exit(2);
+		}
+		cfg.account_stream = args_info.account_stream_arg;
+		cfg.get_account = 1;
+	}
 	cfg.get_exec = args_info.get_exec_given;
 	cfg.get_order = args_info.get_order_given;
 
@@ -100,7 +197,8 @@ static void gengetopt_check_opts()
 
 	// DSO loading
 	if( args_info.strat_given ) {
-		cfg.strat_file = args_info.strat_arg;
+		cfg.strat_files = (const char**) args_info.strat_arg;
+		cfg.strat_cnt = args_info.strat_given;
 	}
 }
 
@@ -122,6 +220,9 @@ int main(int argc, char *argv[])
 	gengetopt_check_opts();
 
 	TwsXml::setSkipDefaults( !cfg.skipdef );
+	if( !args_info.sync_log_given ) {
+		tws_log_start( LOG_RING_SIZE );
+	}
 
 	TwsDL twsDL;
 	if( twsDL.setup(cfg) != 0 ) {
@@ -130,9 +231,9 @@ int main(int argc, char *argv[])
 	int ret = twsDL.start();
 
 	if( ret != 0 ) {
-		DEBUG_PRINTF( "error: %s", twsDL.lastError().c_str() );
+		ERROR_PRINTF( "error: %s", twsDL.lastError().c_str() );
 	} else {
-		DEBUG_PRINTF( "%s", twsDL.lastError().c_str() );
+		INFO_PRINTF( "%s", twsDL.lastError().c_str() );
 	}
 	return ret;
 }
@@ -9,6 +9,9 @@
 #include "tws_xml.h"
 #include "tws_meta.h"
 #include "tws_query.h"
+#include "tws_util.h"
+#include "tws_tick.h"
+#include "tws_greeks.h"
 #include "debug.h"
 #include "version.h"
 #include "config.h"
@@ -19,7 +22,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include <libxml/tree.h>
+#include <map>
+#include <vector>
 
 #include "twsgen_ggo.h"
 
@@ -32,6 +38,10 @@ static gengetopt_args_info args_info;
 static const char *filep = NULL;
 static int skipdefp = 0;
 static int histjobp = 0;
+static int coalescep = 0;
+static int shard_idxp = 0;
+static int shard_cntp = 1;
+static int shard_by_farmp = 1;
 static const char *endDateTimep = "";
 static const char *durationStrp = NULL;
 static const char *barSizeSettingp = "1 hour";
@@ -40,6 +50,9 @@ static int useRTHp = 0;
 static int utcp = 0;
 static const char *includeExpiredp = "auto";
 static int to_csvp = 0;
+static int ticks_to_csvp = 0;
+static int columnarp = 0;
+static int greeks_to_csvp = 0;
 static int no_convp = 0;
 static const char *max_expiryp = NULL;
 
@@ -72,7 +85,7 @@ static void check_display_args()
 {
 	if( args_info.help_given ) {
 		gengetopt_args_info_usage =
-			"Usage: " CMDLINE_PARSER_PACKAGE_NAME " [OPTION]... [FILE]";
+			"Usage: " CMDLINE_PARSER_PACKAGE_NAME " [OPTION]... [FILE]...";
 		cmdline_parser_print_help();
 	} else if( args_info.usage_given ) {
 		printf( "%s\n", gengetopt_args_info_usage );
@@ -87,15 +100,42 @@ static void check_display_args()
 
 static void gengetopt_check_opts()
 {
+	ticks_to_csvp = args_info.ticks_to_csv_given;
+	columnarp = args_info.columnar_given;
+	greeks_to_csvp = args_info.greeks_to_csv_given;
+	if( columnarp && (!ticks_to_csvp || args_info.inputs_num == 0) ) {
+		fprintf( stderr, "error, --columnar needs -T and FILEs\n" );
+		exit(2);
+	}
+
 	if( args_info.inputs_num == 1 ) {
 		filep = args_info.inputs[0];
-	} else if( args_info.inputs_num > 1 ) {
+	} else if( args_info.inputs_num > 1 && !ticks_to_csvp
+	    && !greeks_to_csvp ) {
 		fprintf( stderr, "error: bad usage\n" );
 		exit(2);
 	}
 
 	skipdefp = args_info.verbose_xml_given;
 	histjobp = args_info.histjob_given;
+	coalescep = args_info.coalesce_given;
+	if( args_info.shard_given && parse_shard(args_info.shard_arg,
+		    &shard_idxp, &shard_cntp) != 0 ) {
+		fprintf( stderr, "error, invalid shard '%s', expected I/N\n",
+			args_info.shard_arg );
+		exit(2);
+	}
+	if( args_info.shard_by_given ) {
+		if( strcmp(args_info.shard_by_arg, "farm") == 0 ) {
+			shard_by_farmp = 1;
+		} else if( strcmp(args_info.shard_by_arg, "contract") == 0 ) {
+			shard_by_farmp = 0;
+		} else {
+			fprintf( stderr, "error, invalid shard-by '%s'\n",
+				args_info.shard_by_arg );
+			exit(2);
+		}
+	}
 	if( args_info.endDateTime_given ) {
 		endDateTimep = args_info.endDateTime_arg;
 	}
@@ -128,45 +168,14 @@ static void gengetopt_free()
 
 const char* max_durationStr( const char* barSizeSetting )
 {
-/* valid bars: (1|5|15|30) secs, 1 min, (2|3|5|15|30) mins, 1 hour, 4 hours
-   seems to be not supported anymore: 1 day, 1 week, 1 month, 3 months, 1 year
-   valid durations: integer{SPACE}unit (S|D|W|M|Y) */
-	// TODO
-
-	if( strcmp( barSizeSetting, "1 secs")==0 ) {
-		return "2000 S";
-	} else if( strcasecmp( barSizeSetting, "5 secs")==0 ) {
-		return "10000 S";
-	} else if( strcasecmp( barSizeSetting, "15 secs")==0 ) {
-		return "30000 S";
-	} else if( strcasecmp( barSizeSetting, "30 secs")==0 ) {
-		return "86400 S"; // seems to get more that "1 D"
-	} else if( strcasecmp( barSizeSetting, "1 min")==0 ) {
-		return "6 D";
-	} else if( strcasecmp( barSizeSetting, "2 mins")==0 ) {
-		return "6 D";
-	} else if( strcasecmp( barSizeSetting, "3 mins")==0 ) {
-		return "6 D";
-	} else if( strcasecmp( barSizeSetting, "5 mins")==0 ) {
-		return "6 D";
-	} else if( strcasecmp( barSizeSetting, "15 mins")==0 ) {
-		return "20 D";
-	} else if( strcasecmp( barSizeSetting, "30 mins")==0 ) {
-		return "34 D";
-	} else if( strcasecmp( barSizeSetting, "1 hour")==0 ) {
-		return "34 D";
-	} else if( strcasecmp( barSizeSetting, "4 hours")==0 ) {
-		return "34 D";
-	} else if( strcasecmp( barSizeSetting, "1 day")==0 ) {
-		/* Is "1 Y" always better than "52 W" or "12 M"? Note that longer
-		   requests will be rejected from local TWS itself! */
-		return "1 Y";
-	} else {
+	const char *dur = ib_max_duration( barSizeSetting );
+	if( dur == NULL ) {
 		fprintf( stderr, "error, could not guess durationStr from unknown "
 			"--barSizeSetting '%s', use a known one or overide with "
 			"--durationStr\n", barSizeSettingp );
 			exit(2);
 	}
+	return dur;
 }
 
 void set_includeExpired()
@@ -304,6 +313,20 @@ bool skip_expiry( const std::string &expiry, time_t t_before )
 }
 
 
+/* coalesce and/or shard, in this order to balance the real requests */
+static void rework_hist_todo( HistTodo *histTodo )
+{
+	if( coalescep ) {
+		histTodo->coalesce();
+	}
+	if( shard_cntp > 1 ) {
+		DataFarmStates dfs;
+		histTodo->shard( shard_idxp, shard_cntp,
+			shard_by_farmp ? &dfs : NULL );
+	}
+	histTodo->dumpLeftXml();
+}
+
 bool gen_hist_job()
 {
 	TwsXml file;
@@ -312,13 +335,15 @@ bool gen_hist_job()
 	}
 
 	time_t t_begin = min_begin_date( endDateTimep, durationStrp );
-	DEBUG_PRINTF("skipping expiries before: '%s'",
+	INFO_PRINTF("skipping expiries before: '%s'",
 		time_t_local(t_begin).c_str() );
 
 	xmlNodePtr xn;
 	int count_docs = 0;
 	/* NOTE We are dumping single HistRequests but we should build and dump
-	   a HistTodo object */
+	   a HistTodo object, we do it at least when coalescing or sharding */
+	const bool todo = coalescep || shard_cntp > 1;
+	HistTodo histTodo;
 	while( (xn = file.nextXmlNode()) != NULL ) {
 		count_docs++;
 		PacketContractDetails *pcd = PacketContractDetails::fromXml( xn );
@@ -347,6 +372,10 @@ bool gen_hist_job()
 				hR.initialize( c, endDateTimep, durationStrp, barSizeSettingp,
 				               *wts, useRTHp, formatDate() );
 
+				if( todo ) {
+					histTodo.add( hR );
+					continue;
+				}
 				PacketHistData phd;
 				phd.record( 0, hR );
 				phd.dumpXml();
@@ -357,6 +386,34 @@ bool gen_hist_job()
 	fprintf( stderr, "notice, %d xml docs parsed from file '%s'\n",
 		count_docs, filep );
 
+	if( todo ) {
+		rework_hist_todo( &histTodo );
+	}
+	return true;
+}
+
+
+bool rework_job()
+{
+	TwsXml file;
+	if( ! file.openFile(filep) ) {
+		return false;
+	}
+
+	HistTodo histTodo;
+	xmlNodePtr xn;
+	int count_docs = 0;
+	while( (xn = file.nextXmlNode()) != NULL ) {
+		count_docs++;
+		PacketHistData *phd = PacketHistData::fromXml( xn );
+		histTodo.add( phd->getRequest() );
+		delete phd;
+	}
+	fprintf( stderr, "notice, %d xml docs parsed from file '%s'\n",
+		count_docs, filep );
+
+	rework_hist_todo( &histTodo );
+
 	return true;
 }
 
@@ -376,7 +433,7 @@ bool gen_csv()
 				"max-expiry must be IB's format YYYYMMDD.\n" );
 			return false;
 		}
-		DEBUG_PRINTF("skipping expiries newer than: '%s'", max_expiryp );
+		INFO_PRINTF("skipping expiries newer than: '%s'", max_expiryp );
 	}
 
 	xmlNodePtr xn;
@@ -407,6 +464,150 @@ cont:
 }
 
 
+/* column of a tick, option computations have one per value */
+static inline int tick_col_key( const TickRecord &r )
+{
+	return r.tickType * 32 + r.kind;
+}
+
+static std::string tick_col_name( int key )
+{
+	int kind = key % 32;
+	std::string s = ibToString( key / 32 );
+	if( kind >= TICK_OPT_IV ) {
+		s += ".";
+		s += tick_kind_str( kind );
+	}
+	return s;
+}
+
+static void print_tick_stamp( int64_t stamp )
+{
+	printf( "%lld.%06lld", (long long)(stamp / 1000000),
+		(long long)(stamp % 1000000) );
+}
+
+bool gen_ticks_csv()
+{
+	/* stdin if there are no files */
+	int nfiles = args_info.inputs_num > 0 ? args_info.inputs_num : 1;
+	const char *name = NULL;
+	long count = 0;
+
+	/* columnar needs all columns before the first line */
+	std::map<int, int> cols;
+	if( columnarp ) {
+		for( int i = 0; i < nfiles; i++ ) {
+			TickReader reader;
+			if( !reader.openFile(args_info.inputs[i]) ) {
+				return false;
+			}
+			TickRecord r;
+			while( reader.next(&r) ) {
+				if( r.kind < TICK_DEPTH_ASK_INSERT ) {
+					cols[tick_col_key(r)] = 0;
+				}
+			}
+		}
+		int n = 0;
+		printf( "time\ttickerId\tconId" );
+		for( std::map<int, int>::iterator it = cols.begin();
+		     it != cols.end(); it++ ) {
+			it->second = n++;
+			printf( "\t%s", tick_col_name(it->first).c_str() );
+		}
+		printf( "\n" );
+	}
+
+	/* last values per tickerId, NAN if not seen yet */
+	std::map<int, std::vector<double> > last;
+	for( int i = 0; i < nfiles; i++ ) {
+		name = args_info.inputs_num > 0 ? args_info.inputs[i] : NULL;
+		TickReader reader;
+		if( !reader.openFile(name) ) {
+			return false;
+		}
+		TickRecord r;
+		while( reader.next(&r) ) {
+			count++;
+			const bool depth = r.kind >= TICK_DEPTH_ASK_INSERT;
+			if( columnarp && depth ) {
+				/* no last values, only meaningful as book operations */
+				continue;
+			}
+			print_tick_stamp( r.stamp );
+			if( depth ) {
+				printf( "\t%d\t%d\t%s\t%d\t%.10g\t%d\n", r.tickerId,
+					r.conId, tick_kind_str(r.kind), r.tickType, r.value,
+					r.size );
+				continue;
+			} else if( !columnarp ) {
+				printf( "\t%d\t%d\t%s\t%s\t%.10g\n", r.tickerId, r.conId,
+					tick_kind_str(r.kind), ibToString(r.tickType).c_str(),
+					r.value );
+				continue;
+			}
+			std::vector<double> &v = last[r.tickerId];
+			if( v.empty() ) {
+				v.resize( cols.size(), NAN );
+			}
+			v[cols[tick_col_key(r)]] = r.value;
+			printf( "\t%d\t%d", r.tickerId, r.conId );
+			for( size_t c = 0; c < v.size(); c++ ) {
+				if( isnan(v[c]) ) {
+					printf( "\t" );
+				} else {
+					printf( "\t%.10g", v[c] );
+				}
+			}
+			printf( "\n" );
+		}
+	}
+	fprintf( stderr, "notice, %ld ticks read from %d file(s)\n",
+		count, nfiles );
+
+	return true;
+}
+
+bool gen_greeks_csv()
+{
+	/* stdin if there are no files */
+	int nfiles = args_info.inputs_num > 0 ? args_info.inputs_num : 1;
+	long count = 0;
+
+	for( int i = 0; i < nfiles; i++ ) {
+		const char *name = args_info.inputs_num > 0 ? args_info.inputs[i]
+			: NULL;
+		GreeksReader reader;
+		if( !reader.openFile(name) ) {
+			return false;
+		}
+		while( reader.next() ) {
+			count++;
+			for( int r = 0; r < reader.size(); r++ ) {
+				const GreeksOption &o = reader.option( r );
+				for( int c = 0; c < GREEK_CALCS; c++ ) {
+					if( reader.stamps(c)[r] == 0 ) {
+						continue;
+					}
+					print_tick_stamp( reader.stamp() );
+					printf( "\t%s\t%s\t%g\t%s\t%d\t%s", o.symbol, o.expiry,
+						o.strike, o.right, o.conId, greek_calc_str(c) );
+					for( int g = 0; g < GREEK_COLS; g++ ) {
+						printf( "\t%.10g", reader.column(c, g)[r] );
+					}
+					printf( "\n" );
+				}
+			}
+		}
+	}
+	fprintf( stderr, "notice, %ld snapshots read from %d file(s)\n",
+		count, nfiles );
+
+	return true;
+}
+
+
 int main(int argc, char *argv[])
 {
 	atexit( gengetopt_free );
@@ -425,7 +626,15 @@ int main(int argc, char *argv[])
 	split_whatToShow();
 	set_includeExpired();
 
-	if( histjobp ) {
+	if( ticks_to_csvp ) {
+		if( !gen_ticks_csv() ) {
+			return 1;
+		}
+	} else if( greeks_to_csvp ) {
+		if( !gen_greeks_csv() ) {
+			return 1;
+		}
+	} else if( histjobp ) {
 		if( !gen_hist_job() ) {
 			return 1;
 		}
@@ -433,8 +642,12 @@ int main(int argc, char *argv[])
 		if( !gen_csv() ) {
 			return 1;
 		}
+	} else if( coalescep || shard_cntp > 1 ) {
+		if( !rework_job() ) {
+			return 1;
+		}
 	} else {
-		fprintf( stderr, "error, nothing to do, use -H or -C.\n" );
+		fprintf( stderr, "error, nothing to do, use -H, -C, -T, -G, -M or --shard.\n" );
 		return 2;
 	}
 
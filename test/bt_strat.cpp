@@ -0,0 +1,162 @@
+/*** bt_strat.cpp -- strategy module for the twsbt tests
+ *
+ * Copyright (C) 2010-2018 Ruediger Meier
+ * Author:  Ruediger Meier <sweet_f_a@gmx.de>
+ * License: BSD 3-Clause, see LICENSE file
+ *
+ ***/
+#include "tws_strat.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+extern "C" {
+/* libtool needs C symbols */
+extern int tws_strat_open(uint32_t, const tws_strat_services*,
+	tws_strat_callbacks*);
+}
+
+#define MAX_TICKERS 64
+
+/*
+ * Bars: buy below the close after a rising bar, protect the position with a
+ * stop, sell at market after a falling bar.
+ * Ticks: buy at market on the first ask, place a sell limit on the first
+ * last and cancel it by timer one msec later.
+ */
+struct bts
+{
+	const tws_strat_services *srv;
+	double prev[MAX_TICKERS];
+	double pos[MAX_TICKERS];
+	int64_t pending[MAX_TICKERS];
+	int64_t sellLmt;
+	bool bought;
+};
+
+static bts the_bts;
+
+
+static int64_t order( bts *s, int tickerId, const char *action,
+	const char *type, double lmt, double aux, double qty )
+{
+	tws_strat_order o;
+	memset( &o, 0, sizeof(o) );
+	o.size = sizeof(o);
+	o.tickerId = tickerId;
+	o.action = action;
+	o.quantity = qty;
+	o.orderType = type;
+	o.lmtPrice = lmt;
+	o.auxPrice = aux;
+	return s->srv->place_order( s->srv->host, &o );
+}
+
+static void bts_on_connection( void *ctx, int state )
+{
+	bts *s = (bts*)ctx;
+	if( state == TWS_STRAT_CONNECTED ) {
+		s->srv->subscribe( s->srv->host, 0 );
+	}
+}
+
+static void bts_on_bar( void *ctx, const tws_strat_bar *b )
+{
+	bts *s = (bts*)ctx;
+	const int id = b->tickerId;
+	if( id >= MAX_TICKERS ) {
+		return;
+	}
+	const double prev = s->prev[id];
+	s->prev[id] = b->close;
+	if( prev == 0.0 ) {
+		return;
+	}
+
+	if( s->pos[id] == 0.0 && s->pending[id] == 0 && b->close > prev ) {
+		s->pending[id] = order( s, id, "BUY", "LMT",
+			b->close - 0.0004, 0.0, 1000 );
+	} else if( s->pos[id] > 0.0 && b->close < prev ) {
+		if( s->pending[id] != 0 ) {
+			s->srv->cancel_order( s->srv->host, s->pending[id] );
+		}
+		s->pending[id] = order( s, id, "SELL", "MKT", 0.0, 0.0,
+			s->pos[id] );
+	} else if( s->pos[id] > 0.0 && s->pending[id] == 0 ) {
+		s->pending[id] = order( s, id, "SELL", "STP", 0.0, b->low,
+			s->pos[id] );
+	}
+}
+
+static void bts_on_tick( void *ctx, const tws_strat_tick *t )
+{
+	bts *s = (bts*)ctx;
+	if( t->kind != TWS_STRAT_TICK_PRICE ) {
+		return;
+	}
+	if( t->tickType == 2 /* ASK */ && !s->bought ) {
+		s->bought = true;
+		order( s, t->tickerId, "BUY", "MKT", 0.0, 0.0, 100 );
+	} else if( t->tickType == 4 /* LAST */ && s->sellLmt == 0 ) {
+		s->sellLmt = order( s, t->tickerId, "SELL", "LMT",
+			t->value + 0.1, 0.0, 100 );
+		s->srv->timer( s->srv->host, s->srv->now(s->srv->host) / 1000 + 1,
+			&s->sellLmt );
+	}
+}
+
+static void bts_on_timer( void *ctx, int64_t now, void *cookie )
+{
+	bts *s = (bts*)ctx;
+	s->srv->cancel_order( s->srv->host, *(int64_t*)cookie );
+}
+
+static void bts_on_order_status( void *ctx, const tws_strat_order_status *os )
+{
+	bts *s = (bts*)ctx;
+	if( strcmp(os->status, "Filled") != 0
+	    && strcmp(os->status, "Cancelled") != 0 ) {
+		return;
+	}
+	for( int i = 0; i < MAX_TICKERS; i++ ) {
+		if( s->pending[i] == os->orderId ) {
+			s->pending[i] = 0;
+		}
+	}
+}
+
+static void bts_on_position( void *ctx, const tws_strat_position *p )
+{
+	bts *s = (bts*)ctx;
+	tws_strat_position q;
+	if( s->srv->position(s->srv->host, p->conId, NULL, &q) != 0
+	    || q.position != p->position ) {
+		abort();
+	}
+	tws_strat_instrument in;
+	for( int i = 1; i < MAX_TICKERS; i++ ) {
+		if( s->srv->instrument(s->srv->host, i, &in) == 0
+		    && in.conId == p->conId ) {
+			s->pos[i] = p->position;
+		}
+	}
+}
+
+int tws_strat_open( uint32_t abi, const tws_strat_services *srv,
+	tws_strat_callbacks *cb )
+{
+	if( abi < TWS_STRAT_ABI || srv->size < sizeof(*srv) ) {
+		return -1;
+	}
+	memset( &the_bts, 0, sizeof(the_bts) );
+	the_bts.srv = srv;
+	cb->ctx = &the_bts;
+	cb->on_connection = bts_on_connection;
+	cb->on_bar = bts_on_bar;
+	cb->on_tick = bts_on_tick;
+	cb->on_timer = bts_on_timer;
+	cb->on_order_status = bts_on_order_status;
+	cb->on_position = bts_on_position;
+	return 0;
+}